@@ -0,0 +1,67 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+	parameters:
+	x0 - address in - crc out
+	x1 - byte count
+	x2 - 1 KiB scratch area for the crc table
+
+	Same crc as image_calculate_checksum(): polynomial 0x04c11db7,
+	msb first, initial value 0xffffffff, no final xor.
+	The optional crc32 instructions are not used, they implement
+	the bit reflected variant only.
+*/
+
+	.text
+	.align	2
+
+_start:
+main:
+	mov	w9, #0x1db7
+	movk	w9, #0x04c1, lsl #16
+
+	/* build the table, one entry per byte value */
+	mov	w3, #0
+table_loop:
+	lsl	w4, w3, #24
+	mov	w5, #8
+bit_loop:
+	lsl	w6, w4, #1
+	eor	w7, w6, w9
+	tst	w4, #0x80000000
+	csel	w4, w7, w6, ne
+	subs	w5, w5, #1
+	b.ne	bit_loop
+	str	w4, [x2, x3, lsl #2]
+	add	w3, w3, #1
+	cmp	w3, #256
+	b.ne	table_loop
+
+	mov	w4, #0xffffffff
+	cbz	x1, done
+byte_loop:
+	ldrb	w5, [x0], #1
+	eor	w5, w5, w4, lsr #24
+	ldr	w6, [x2, x5, lsl #2]
+	eor	w4, w6, w4, lsl #8
+	subs	x1, x1, #1
+	b.ne	byte_loop
+
+done:
+	mov	w0, w4
+	hlt	#0
+
+	.end
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Spencer Oliver                                  *
+ *   spen@spen-soft.co.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+	.global main
+	.text
+	.set noreorder
+
+/* Same code as mips32.s, with 64 bit address arithmetic so that it
+ * also works on addresses which aren't sign extended 32 bit values.
+ * Register numbers are used as the $tN names differ between ABIs.
+ *
+ * params:
+ * $4 address in
+ * $5 byte count
+ * vars
+ * $4 crc
+ * $5 crc data byte
+ * temps:
+ * $2 $3 $6 $7 $8 $9 $10 $11 $12
+ */
+
+.ent main
+main:
+	daddiu	$12, $4, 0		/* address in */
+	daddiu	$10, $5, 0		/* count */
+
+	addiu	$4, $0, -1		/* $4 crc - result */
+
+	beq		$0, $0, ncomp
+	daddiu	$11, $0, 0		/* clear bytes read */
+
+nbyte:
+	lb		$5, ($12)		/* load byte from source address */
+	daddiu	$12, $12, 1		/* inc address */
+
+crc:
+	sll		$5, $5, 24
+	lui		$2, 0x04c1
+	xor		$4, $4, $5
+	ori		$7, $2, 0x1db7
+	addu	$6, $0, $0		/* clear bit count */
+loop:
+	sll		$8, $4, 1
+	addiu	$6, $6, 1		/* inc bit count */
+	slti	$4, $4, 0
+	xor		$9, $8, $7
+	movn	$8, $9, $4
+	slti	$3, $6, 8		/* 8bits processed */
+	bne		$3, $0, loop
+	addu	$4, $8, $0
+
+ncomp:
+	bne		$10, $11, nbyte	/* all bytes processed */
+	daddiu	$11, $11, 1
+
+wait:
+	sdbbp
+
+.end main
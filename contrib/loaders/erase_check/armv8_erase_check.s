@@ -0,0 +1,70 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+	parameters:
+	x0 - pointer to struct { uint64_t size_in_result_out, uint64_t addr }
+	     array, terminated by a zero size
+	x1 - value to check, replicated to all 8 bytes
+
+	Blocks whose address and size are multiples of 8 are read by
+	doublewords, all others by bytes.
+*/
+
+	.text
+	.align	2
+
+BLOCK_SIZE_RESULT	= 0
+SIZEOF_STRUCT_BLOCK	= 16
+
+start:
+block_loop:
+	ldp	x2, x3, [x0]		/* get size and address */
+	cbz	x2, done
+
+	orr	x4, x2, x3
+	tst	x4, #7
+	b.ne	byte_loop
+
+dword_loop:
+	ldr	x4, [x3], #8
+	cmp	x4, x1
+	b.ne	not_erased
+	subs	x2, x2, #8
+	b.ne	dword_loop
+	b	erased
+
+byte_loop:
+	ldrb	w4, [x3], #1
+	cmp	w4, w1, uxtb
+	b.ne	not_erased
+	subs	x2, x2, #1
+	b.ne	byte_loop
+
+erased:
+	mov	x4, #1		/* block is erased */
+save_result:
+	str	x4, [x0, #BLOCK_SIZE_RESULT]
+	add	x0, x0, #SIZEOF_STRUCT_BLOCK
+	b	block_loop
+
+not_erased:
+	mov	x4, #0
+	b	save_result
+
+done:
+	hlt	#0
+
+	.end
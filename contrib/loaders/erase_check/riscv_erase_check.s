@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+	Assembled twice, with XLEN defined to 32 and to 64.
+
+	parameters:
+	a0 - pointer to struct { xlen size_in_result_out, xlen addr }
+	     array, terminated by a zero size
+	a1 - value to check, replicated to all bytes of a register
+	a2..a5 - scratch
+
+	Only x0..x15 are used so the same source works for RV32E.
+	Blocks whose address and size are multiples of XLEN / 8 are
+	read by words, all others by bytes.
+*/
+
+	.text
+	.option norvc
+
+	.if XLEN == 64
+	.macro	LOADX rd, off, base
+	ld	\rd, \off(\base)
+	.endm
+	.macro	STOREX rs, off, base
+	sd	\rs, \off(\base)
+	.endm
+	.else
+	.macro	LOADX rd, off, base
+	lw	\rd, \off(\base)
+	.endm
+	.macro	STOREX rs, off, base
+	sw	\rs, \off(\base)
+	.endm
+	.endif
+
+XLENB			= XLEN / 8
+BLOCK_SIZE_RESULT	= 0
+BLOCK_ADDRESS		= XLENB
+SIZEOF_STRUCT_BLOCK	= 2 * XLENB
+
+start:
+block_loop:
+	LOADX	a2, BLOCK_SIZE_RESULT, a0
+	beqz	a2, done
+	LOADX	a3, BLOCK_ADDRESS, a0
+
+	or	a4, a2, a3
+	andi	a4, a4, XLENB - 1
+	bnez	a4, byte_loop
+
+word_loop:
+	LOADX	a4, 0, a3
+	bne	a4, a1, not_erased
+	addi	a3, a3, XLENB
+	addi	a2, a2, -XLENB
+	bnez	a2, word_loop
+	j	erased
+
+byte_loop:
+	andi	a5, a1, 0xff
+byte_loop_next:
+	lbu	a4, 0(a3)
+	bne	a4, a5, not_erased
+	addi	a3, a3, 1
+	addi	a2, a2, -1
+	bnez	a2, byte_loop_next
+
+erased:
+	li	a4, 1		/* block is erased */
+save_result:
+	STOREX	a4, BLOCK_SIZE_RESULT, a0
+	addi	a0, a0, SIZEOF_STRUCT_BLOCK
+	j	block_loop
+
+not_erased:
+	li	a4, 0
+	j	save_result
+
+done:
+	ebreak
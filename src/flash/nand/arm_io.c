@@ -297,3 +297,231 @@ int arm_nandread(struct arm_nand_data *nand, uint8_t *data, uint32_t size)
 
 	return retval;
 }
+
+/* Pages handled by one run of the multi page loops */
+#define ARM_NAND_PAGES_MAX	64
+
+static int arm_nand_run_pages(struct arm_nand_data *nand, struct nand_device *device,
+		bool write, uint32_t page, uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	struct target *target = nand->target;
+	struct arm_algorithm armv4_5_algo;
+	struct armv7m_algorithm armv7m_algo;
+	void *arm_algo;
+	struct arm *arm = target->arch_info;
+	struct working_area *area = NULL;
+	struct reg_param reg_params[8];
+	const uint32_t *code;
+	unsigned int code_size;
+	uint32_t exit_var = 0;
+	uint32_t pages, cycles;
+	int retval;
+
+	/* Inputs:
+	 *  r0	NAND data address (byte wide)
+	 *  r1	NAND command latch
+	 *  r2	NAND address latch
+	 *  r3	buffer address
+	 *  r4	first page
+	 *  r5	bytes per page, data followed by OOB
+	 *  r6	number of pages
+	 *  r7	column cycles | row cycles << 8 | large page << 16
+	 * Outputs:
+	 *  r0	zero, or the status of the page which failed to program
+	 *  r4	page where the loop stopped
+	 *
+	 * see contrib/loaders/flash/nand/nand_pages.S for src
+	 */
+	static const uint32_t code_armv4_5_write[] = {
+		0xe3a08080, 0xe5c18000, 0xe20790ff, 0xe3a08000,
+		0xe5c28000, 0xe2599001, 0x1afffffc, 0xe1a09427,
+		0xe20990ff, 0xe1a0a004, 0xe5c2a000, 0xe1a0a42a,
+		0xe2599001, 0x1afffffb, 0xe1a09005, 0xe4d38001,
+		0xe5c08000, 0xe2599001, 0x1afffffb, 0xe3a08010,
+		0xe5c18000, 0xe3a09040, 0xe2599001, 0x1afffffd,
+		0xe3a08070, 0xe5c18000, 0xe5d08000, 0xe3180040,
+		0x0afffffc, 0xe3180001, 0x1a000003, 0xe2844001,
+		0xe2566001, 0x1affffdd, 0xe3a08000, 0xe1a00008,
+		0xe1200070,
+	};
+	static const uint32_t code_armv4_5_read[] = {
+		0xe3a08000, 0xe5c18000, 0xe20790ff, 0xe3a08000,
+		0xe5c28000, 0xe2599001, 0x1afffffc, 0xe1a09427,
+		0xe20990ff, 0xe1a0a004, 0xe5c2a000, 0xe1a0a42a,
+		0xe2599001, 0x1afffffb, 0xe3170801, 0x0a000001,
+		0xe3a08030, 0xe5c18000, 0xe3a09040, 0xe2599001,
+		0x1afffffd, 0xe3a08070, 0xe5c18000, 0xe5d08000,
+		0xe3180040, 0x0afffffc, 0xe3a08000, 0xe5c18000,
+		0xe1a09005, 0xe5d08000, 0xe4c38001, 0xe2599001,
+		0x1afffffb, 0xe2844001, 0xe2566001, 0x1affffdb,
+		0xe3a00000, 0xe1200070,
+	};
+	static const uint32_t code_armv7m_write[] = {
+		0x0880f04f, 0x8000f881, 0x09fff007, 0x0800f04f,
+		0x8000f882, 0x0901f1b9, 0xea4fd1fa, 0xf0092917,
+		0x46a209ff, 0xa000f882, 0x2a1aea4f, 0x0901f1b9,
+		0x46a9d1f8, 0x8b01f813, 0x8000f880, 0x0901f1b9,
+		0xf04fd1f8, 0xf8810810, 0xf04f8000, 0xf1b90940,
+		0xd1fc0901, 0x0870f04f, 0x8000f881, 0x8000f890,
+		0x0f40f018, 0xf018d0fa, 0xd1050f01, 0x0401f104,
+		0xd1c51e76, 0x0800f04f, 0xbe004640,
+	};
+	static const uint32_t code_armv7m_read[] = {
+		0x0800f04f, 0x8000f881, 0x09fff007, 0x0800f04f,
+		0x8000f882, 0x0901f1b9, 0xea4fd1fa, 0xf0092917,
+		0x46a209ff, 0xa000f882, 0x2a1aea4f, 0x0901f1b9,
+		0xf417d1f8, 0xd0033f80, 0x0830f04f, 0x8000f881,
+		0x0940f04f, 0x0901f1b9, 0xf04fd1fc, 0xf8810870,
+		0xf8908000, 0xf0188000, 0xd0fa0f40, 0x0800f04f,
+		0x8000f881, 0xf89046a9, 0xf8038000, 0xf1b98b01,
+		0xd1f80901, 0x0401f104, 0xd1c11e76, 0x0000f04f,
+		0xbf00be00,
+	};
+
+	if (!nand->cmd || !nand->addr || device->bus_width != 8)
+		return ERROR_NAND_OPERATION_NOT_SUPPORTED;
+
+	/* set up algorithm */
+	if (is_armv7m(target_to_armv7m(target))) {  /* armv7m target */
+		armv7m_algo.common_magic = ARMV7M_COMMON_MAGIC;
+		armv7m_algo.core_mode = ARM_MODE_THREAD;
+		arm_algo = &armv7m_algo;
+		code = write ? code_armv7m_write : code_armv7m_read;
+		code_size = write ? sizeof(code_armv7m_write) : sizeof(code_armv7m_read);
+	} else {
+		armv4_5_algo.common_magic = ARM_COMMON_MAGIC;
+		armv4_5_algo.core_mode = ARM_MODE_SVC;
+		armv4_5_algo.core_state = ARM_STATE_ARM;
+		arm_algo = &armv4_5_algo;
+		code = write ? code_armv4_5_write : code_armv4_5_read;
+		code_size = write ? sizeof(code_armv4_5_write) : sizeof(code_armv4_5_read);
+	}
+
+	/* as many pages per run as the working area can hold */
+	pages = MIN(count, ARM_NAND_PAGES_MAX);
+	while (target_alloc_working_area_try(target, code_size + pages * page_bytes,
+			&area) != ERROR_OK) {
+		if (pages == 1) {
+			LOG_DEBUG("%s: no %u byte buffer", __func__, code_size + page_bytes);
+			return ERROR_NAND_NO_BUFFER;
+		}
+		pages /= 2;
+	}
+
+	retval = arm_code_to_working_area(target, code, code_size, 0, &area);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, area);
+		return retval;
+	}
+
+	/* armv4 must exit using a hardware breakpoint */
+	if (arm->arch == ARM_ARCH_V4)
+		exit_var = area->address + code_size - 4;
+
+	cycles = device->page_size <= 512 ? 1 : 2;
+	cycles |= (device->address_cycles - cycles) << 8;
+	if (device->page_size > 512)
+		cycles |= 1 << 16;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);
+	init_reg_param(&reg_params[6], "r6", 32, PARAM_OUT);
+	init_reg_param(&reg_params[7], "r7", 32, PARAM_OUT);
+
+	uint32_t target_buf = area->address + code_size;
+	while (count > 0) {
+		uint32_t n = MIN(count, pages);
+
+		if (write) {
+			retval = target_write_buffer(target, target_buf, n * page_bytes, buffer);
+			if (retval != ERROR_OK)
+				break;
+		}
+
+		buf_set_u32(reg_params[0].value, 0, 32, nand->data);
+		buf_set_u32(reg_params[1].value, 0, 32, nand->cmd);
+		buf_set_u32(reg_params[2].value, 0, 32, nand->addr);
+		buf_set_u32(reg_params[3].value, 0, 32, target_buf);
+		buf_set_u32(reg_params[4].value, 0, 32, page);
+		buf_set_u32(reg_params[5].value, 0, 32, page_bytes);
+		buf_set_u32(reg_params[6].value, 0, 32, n);
+		buf_set_u32(reg_params[7].value, 0, 32, cycles);
+
+		/* page program takes up to a few hundred us, reads much less */
+		retval = target_run_algorithm(target, 0, NULL, 8, reg_params,
+				area->address, exit_var, 1000 + 10 * n, arm_algo);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("error executing hosted NAND %s", write ? "write" : "read");
+			break;
+		}
+
+		uint32_t status = buf_get_u32(reg_params[0].value, 0, 32);
+		if (status) {
+			LOG_ERROR("write of page %" PRIu32 " didn't pass, status: 0x%2.2" PRIx32,
+				buf_get_u32(reg_params[4].value, 0, 32), status);
+			retval = ERROR_NAND_OPERATION_FAILED;
+			break;
+		}
+
+		if (!write) {
+			retval = target_read_buffer(target, target_buf, n * page_bytes, buffer);
+			if (retval != ERROR_OK)
+				break;
+		}
+
+		page += n;
+		count -= n;
+		buffer += n * page_bytes;
+	}
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	target_free_working_area(target, area);
+
+	return retval;
+}
+
+/**
+ * Programs @a count consecutive pages of an 8-bit wide NAND with a single
+ * on-chip loop per batch of pages, sending the commands, addresses and
+ * data and polling the status on the target. Needs the command and
+ * address latches in @a nand.
+ *
+ * @param nand Pointer to the arm_nand_data struct that defines the I/O
+ * @param device The NAND device, for its geometry
+ * @param page First page to program
+ * @param count Number of pages
+ * @param buffer Page data, each page followed by its OOB
+ * @param page_bytes Size of data plus OOB of each page
+ * @return Success or failure of the operation;
+ * ERROR_NAND_OPERATION_NOT_SUPPORTED or ERROR_NAND_NO_BUFFER if the
+ * caller has to program the pages one at a time.
+ */
+int arm_nand_write_pages(struct arm_nand_data *nand, struct nand_device *device,
+		uint32_t page, uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	return arm_nand_run_pages(nand, device, true, page, count, buffer, page_bytes);
+}
+
+/**
+ * Reads @a count consecutive pages of an 8-bit wide NAND, the counterpart
+ * of arm_nand_write_pages().
+ *
+ * @param nand Pointer to the arm_nand_data struct that defines the I/O
+ * @param device The NAND device, for its geometry
+ * @param page First page to read
+ * @param count Number of pages
+ * @param buffer Where to store the data, each page followed by its OOB
+ * @param page_bytes Size of data plus OOB of each page
+ * @return Success or failure of the operation
+ */
+int arm_nand_read_pages(struct arm_nand_data *nand, struct nand_device *device,
+		uint32_t page, uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	return arm_nand_run_pages(nand, device, false, page, count, buffer, page_bytes);
+}
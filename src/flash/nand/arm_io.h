@@ -17,6 +17,8 @@
 #ifndef OPENOCD_FLASH_NAND_ARM_IO_H
 #define OPENOCD_FLASH_NAND_ARM_IO_H
 
+struct nand_device;
+
 /**
  * Available operational states the arm_nand_data struct can be in.
  */
@@ -43,6 +45,11 @@ struct arm_nand_data {
 	/** Where data is read from or written to. */
 	uint32_t data;
 
+	/** Command and address latches, zero if the multi page loops of
+	 * arm_nand_write_pages() and arm_nand_read_pages() can't be used. */
+	uint32_t cmd;
+	uint32_t addr;
+
 	/** Last operation executed using this struct. */
 	enum arm_nand_op op;
 
@@ -52,4 +59,9 @@ struct arm_nand_data {
 int arm_nandwrite(struct arm_nand_data *nand, uint8_t *data, int size);
 int arm_nandread(struct arm_nand_data *nand, uint8_t *data, uint32_t size);
 
+int arm_nand_write_pages(struct arm_nand_data *nand, struct nand_device *device,
+		uint32_t page, uint32_t count, uint8_t *buffer, uint32_t page_bytes);
+int arm_nand_read_pages(struct arm_nand_data *nand, struct nand_device *device,
+		uint32_t page, uint32_t count, uint8_t *buffer, uint32_t page_bytes);
+
 #endif /* OPENOCD_FLASH_NAND_ARM_IO_H */
@@ -296,6 +296,76 @@ static int at91sam9_write_block_data(struct nand_device *nand, uint8_t *data, in
 	return status;
 }
 
+/**
+ * Write consecutive pages with a single hosted loop per batch. Only used when
+ * the pages come with their OOB or raw access is enabled, as the 1-bit ECC of
+ * at91sam9_write_page() needs the ECC controller after each page.
+ *
+ * @param nand NAND device to write to.
+ * @param page First page to write.
+ * @param count Number of pages.
+ * @param buffer Page data, each page followed by its OOB.
+ * @param page_bytes Size of data plus OOB of each page.
+ * @return Success or failure of the hosted write.
+ */
+static int at91sam9_write_pages(struct nand_device *nand, uint32_t page,
+	uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	struct at91sam9_nand *info = nand->controller_priv;
+	struct arm_nand_data *io = &info->io;
+	int retval;
+
+	if (!nand->use_raw && page_bytes == (uint32_t)nand->page_size)
+		return ERROR_NAND_OPERATION_NOT_SUPPORTED;
+
+	if (!at91sam9_halted(nand->target, "write pages"))
+		return ERROR_NAND_OPERATION_FAILED;
+
+	/* the latches may have been moved by "at91sam9 cle/ale" */
+	io->cmd = info->cmd;
+	io->addr = info->addr;
+
+	at91sam9_enable(nand);
+	retval = arm_nand_write_pages(io, nand, page, count, buffer, page_bytes);
+	at91sam9_disable(nand);
+
+	return retval;
+}
+
+/**
+ * Read consecutive pages with a single hosted loop per batch. Only used with
+ * raw access, as at91sam9_read_page() checks the ECC after each page.
+ *
+ * @param nand NAND device to read from.
+ * @param page First page to read.
+ * @param count Number of pages.
+ * @param buffer Where to store the pages, each followed by its OOB.
+ * @param page_bytes Size of data plus OOB of each page.
+ * @return Success or failure of the hosted read.
+ */
+static int at91sam9_read_pages(struct nand_device *nand, uint32_t page,
+	uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	struct at91sam9_nand *info = nand->controller_priv;
+	struct arm_nand_data *io = &info->io;
+	int retval;
+
+	if (!nand->use_raw)
+		return ERROR_NAND_OPERATION_NOT_SUPPORTED;
+
+	if (!at91sam9_halted(nand->target, "read pages"))
+		return ERROR_NAND_OPERATION_FAILED;
+
+	io->cmd = info->cmd;
+	io->addr = info->addr;
+
+	at91sam9_enable(nand);
+	retval = arm_nand_read_pages(io, nand, page, count, buffer, page_bytes);
+	at91sam9_disable(nand);
+
+	return retval;
+}
+
 /**
  * Initialize the ECC controller on the AT91SAM9.
  *
@@ -719,4 +789,6 @@ struct nand_flash_controller at91sam9_nand_controller = {
 	.write_block_data = at91sam9_write_block_data,
 	.read_page = at91sam9_read_page,
 	.write_page = at91sam9_write_page,
+	.read_pages = at91sam9_read_pages,
+	.write_pages = at91sam9_write_pages,
 };
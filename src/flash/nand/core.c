@@ -223,6 +223,119 @@ COMMAND_HELPER(nand_command_get_device, unsigned name_index,
 	return ERROR_OK;
 }
 
+#define NAND_BBT_CACHE_MAGIC "openocd-nand-bbt 1"
+
+/* The part is identified by its ID bytes and geometry */
+static void nand_bbt_cache_key(struct nand_device *nand, char *key, size_t size)
+{
+	snprintf(key, size, "id %02x %02x %02x %02x %02x page %d block %d blocks %d",
+		nand->id[0], nand->id[1], nand->id[3], nand->id[4], nand->id[5],
+		nand->page_size, nand->erase_size, nand->num_blocks);
+}
+
+static void nand_bbt_cache_load(struct nand_device *nand)
+{
+	char key[80], line[80];
+	int first, last, bad = 0, known = 0;
+	char state[8];
+
+	if (!nand->bbt_cache || !nand->blocks)
+		return;
+
+	FILE *fd = fopen(nand->bbt_cache, "r");
+	if (!fd)
+		return;
+
+	nand_bbt_cache_key(nand, key, sizeof(key));
+	if (!fgets(line, sizeof(line), fd) || strncmp(line, NAND_BBT_CACHE_MAGIC, strlen(NAND_BBT_CACHE_MAGIC))
+			|| !fgets(line, sizeof(line), fd) || strncmp(line, key, strlen(key))
+			|| line[strlen(key)] != '\n') {
+		LOG_INFO("bad block cache \"%s\" doesn't match %s, ignoring it",
+			nand->bbt_cache, nand->device->name);
+		fclose(fd);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fd)) {
+		if (sscanf(line, "%7s %d %d", state, &first, &last) != 3
+				|| first < 0 || last < first || last >= nand->num_blocks)
+			continue;
+
+		int is_bad;
+		if (!strcmp(state, "bad"))
+			is_bad = 1;
+		else if (!strcmp(state, "good"))
+			is_bad = 0;
+		else
+			continue;
+
+		for (int i = first; i <= last; i++) {
+			if (nand->blocks[i].is_bad != -1)
+				continue;
+			nand->blocks[i].is_bad = is_bad;
+			bad += is_bad;
+			known++;
+		}
+	}
+	fclose(fd);
+
+	LOG_INFO("%s: %d blocks known from \"%s\", %d of them bad",
+		nand->device->name, known, nand->bbt_cache, bad);
+}
+
+static void nand_bbt_cache_save(struct nand_device *nand)
+{
+	char key[80];
+
+	if (!nand->bbt_cache || !nand->blocks)
+		return;
+
+	FILE *fd = fopen(nand->bbt_cache, "w");
+	if (!fd) {
+		LOG_ERROR("open(\"%s\"): %s", nand->bbt_cache, strerror(errno));
+		return;
+	}
+
+	nand_bbt_cache_key(nand, key, sizeof(key));
+	fprintf(fd, NAND_BBT_CACHE_MAGIC "\n%s\n", key);
+
+	/* runs of blocks with the same known state */
+	for (int first = 0; first < nand->num_blocks; ) {
+		int is_bad = nand->blocks[first].is_bad;
+		int last = first;
+
+		while (last + 1 < nand->num_blocks && nand->blocks[last + 1].is_bad == is_bad)
+			last++;
+		if (is_bad != -1)
+			fprintf(fd, "%s %d %d\n", is_bad ? "bad" : "good", first, last);
+		first = last + 1;
+	}
+
+	if (fclose(fd) != 0)
+		LOG_ERROR("fail to write bad block cache \"%s\"", nand->bbt_cache);
+}
+
+int nand_bbt_cache_set(struct nand_device *nand, const char *filename)
+{
+	free(nand->bbt_cache);
+	nand->bbt_cache = NULL;
+
+	if (!filename)
+		return ERROR_OK;
+
+	nand->bbt_cache = strdup(filename);
+	if (!nand->bbt_cache) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* already probed: take the blocks not checked yet from the cache */
+	if (nand->device)
+		nand_bbt_cache_load(nand);
+
+	return ERROR_OK;
+}
+
 int nand_build_bbt(struct nand_device *nand, int first, int last)
 {
 	uint32_t page;
@@ -254,6 +367,8 @@ int nand_build_bbt(struct nand_device *nand, int first, int last)
 		page += pages_per_block;
 	}
 
+	nand_bbt_cache_save(nand);
+
 	return ERROR_OK;
 }
 
@@ -351,6 +466,9 @@ int nand_probe(struct nand_device *nand)
 		device_id = data_buf & 0xff;
 	}
 
+	id_buff[0] = manufacturer_id;
+	id_buff[1] = device_id;
+
 	for (i = 0; nand_flash_ids[i].name; i++) {
 		if (nand_flash_ids[i].id == device_id &&
 				(nand_flash_ids[i].mfr_id == manufacturer_id ||
@@ -507,6 +625,9 @@ int nand_probe(struct nand_device *nand)
 		nand->blocks[i].is_bad = -1;
 	}
 
+	memcpy(nand->id, id_buff, sizeof(nand->id));
+	nand_bbt_cache_load(nand);
+
 	return ERROR_OK;
 }
 
@@ -701,6 +822,78 @@ int nand_read_page(struct nand_device *nand, uint32_t page,
 		return nand->controller->read_page(nand, page, data, data_size, oob, oob_size);
 }
 
+/* Programs count consecutive pages from buffer, each page data_size bytes of
+ * data (zero for OOB only) followed by oob_size bytes of OOB, batching them
+ * when the controller can. */
+int nand_write_pages(struct nand_device *nand, uint32_t page, uint32_t count,
+	uint8_t *buffer, uint32_t data_size, uint32_t oob_size)
+{
+	uint32_t pages_per_block;
+	int retval;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	if (count == 0)
+		return ERROR_OK;
+
+	if (data_size == (uint32_t)nand->page_size && nand->controller->write_pages) {
+		pages_per_block = nand->erase_size / nand->page_size;
+		for (uint32_t block = page / pages_per_block;
+				block <= (page + count - 1) / pages_per_block; block++) {
+			if (nand->blocks[block].is_erased == 1)
+				nand->blocks[block].is_erased = 0;
+		}
+
+		retval = nand->controller->write_pages(nand, page, count, buffer,
+				data_size + oob_size);
+		if (retval != ERROR_NAND_OPERATION_NOT_SUPPORTED && retval != ERROR_NAND_NO_BUFFER)
+			return retval;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		retval = nand_write_page(nand, page + i,
+				data_size ? buffer : NULL, data_size,
+				oob_size ? buffer + data_size : NULL, oob_size);
+		if (retval != ERROR_OK)
+			return retval;
+		buffer += data_size + oob_size;
+	}
+
+	return ERROR_OK;
+}
+
+/* Reads count consecutive pages into buffer, laid out as for nand_write_pages() */
+int nand_read_pages(struct nand_device *nand, uint32_t page, uint32_t count,
+	uint8_t *buffer, uint32_t data_size, uint32_t oob_size)
+{
+	int retval;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	if (count == 0)
+		return ERROR_OK;
+
+	if (data_size == (uint32_t)nand->page_size && nand->controller->read_pages) {
+		retval = nand->controller->read_pages(nand, page, count, buffer,
+				data_size + oob_size);
+		if (retval != ERROR_NAND_OPERATION_NOT_SUPPORTED && retval != ERROR_NAND_NO_BUFFER)
+			return retval;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		retval = nand_read_page(nand, page + i,
+				data_size ? buffer : NULL, data_size,
+				oob_size ? buffer + data_size : NULL, oob_size);
+		if (retval != ERROR_OK)
+			return retval;
+		buffer += data_size + oob_size;
+	}
+
+	return ERROR_OK;
+}
+
 int nand_page_command(struct nand_device *nand, uint32_t page,
 	uint8_t cmd, bool oob_only)
 {
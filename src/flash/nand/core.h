@@ -69,6 +69,10 @@ struct nand_device {
 	bool use_raw;
 	int num_blocks;
 	struct nand_block *blocks;
+	/** Raw ID bytes read by nand_probe(), the key of the bad block cache */
+	uint8_t id[6];
+	/** File caching the bad block table across sessions, or NULL */
+	char *bbt_cache;
 	struct nand_device *next;
 };
 
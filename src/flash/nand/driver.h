@@ -75,6 +75,20 @@ struct nand_flash_controller {
 	int (*read_page)(struct nand_device *nand, uint32_t page, uint8_t *data, uint32_t data_size,
 			 uint8_t *oob, uint32_t oob_size);
 
+	/**
+	 * Write consecutive full pages, each page data immediately followed
+	 * by its OOB, as nand_write_page_raw() would. Returning
+	 * ERROR_NAND_OPERATION_NOT_SUPPORTED or ERROR_NAND_NO_BUFFER makes
+	 * the core fall back to one page at a time, which drivers must do
+	 * when their write_page would add controller ECC.
+	 */
+	int (*write_pages)(struct nand_device *nand, uint32_t page, uint32_t count,
+			   uint8_t *buffer, uint32_t page_bytes);
+
+	/** Read consecutive full pages, the counterpart of write_pages. */
+	int (*read_pages)(struct nand_device *nand, uint32_t page, uint32_t count,
+			  uint8_t *buffer, uint32_t page_bytes);
+
 	/** Check if the NAND device is ready for more instructions with timeout. */
 	int (*nand_ready)(struct nand_device *nand, int timeout);
 };
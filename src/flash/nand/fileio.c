@@ -175,6 +175,19 @@ COMMAND_HELPER(nand_fileio_parse_args, struct nand_fileio_state *state,
 	return ERROR_OK;
 }
 
+/**
+ * @returns the number of bytes nand_fileio_read() takes from the file
+ * for each page.
+ */
+uint32_t nand_fileio_page_bytes(struct nand_fileio_state *s)
+{
+	uint32_t bytes = s->page ? s->page_size : 0;
+
+	if (s->oob && !(s->oob_format & (NAND_OOB_SW_ECC | NAND_OOB_SW_ECC_KW)))
+		bytes += s->oob_size;
+	return bytes;
+}
+
 /**
  * @returns If no error occurred, returns number of bytes consumed;
  * otherwise, returns a negative error code.)
@@ -51,6 +51,7 @@ COMMAND_HELPER(nand_fileio_parse_args, struct nand_fileio_state *state,
 	struct nand_device **dev, enum fileio_access filemode,
 	bool need_size, bool sw_ecc);
 
+uint32_t nand_fileio_page_bytes(struct nand_fileio_state *s);
 int nand_fileio_read(struct nand_device *nand, struct nand_fileio_state *s);
 
 #endif /* OPENOCD_FLASH_NAND_FILEIO_H */
@@ -31,8 +31,14 @@ int nand_read_page(struct nand_device *nand, uint32_t page,
 		uint8_t *data, uint32_t data_size,
 		uint8_t *oob, uint32_t oob_size);
 
+int nand_write_pages(struct nand_device *nand, uint32_t page, uint32_t count,
+		uint8_t *buffer, uint32_t data_size, uint32_t oob_size);
+int nand_read_pages(struct nand_device *nand, uint32_t page, uint32_t count,
+		uint8_t *buffer, uint32_t data_size, uint32_t oob_size);
+
 int nand_probe(struct nand_device *nand);
 int nand_erase(struct nand_device *nand, int first_block, int last_block);
 int nand_build_bbt(struct nand_device *nand, int first, int last);
+int nand_bbt_cache_set(struct nand_device *nand, const char *filename);
 
 #endif /* OPENOCD_FLASH_NAND_IMP_H */
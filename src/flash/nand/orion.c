@@ -105,6 +105,22 @@ static int orion_nand_fast_block_write(struct nand_device *nand, uint8_t *data,
 	return retval;
 }
 
+static int orion_nand_write_pages(struct nand_device *nand, uint32_t page,
+		uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	struct orion_nand_controller *hw = nand->controller_priv;
+
+	return arm_nand_write_pages(&hw->io, nand, page, count, buffer, page_bytes);
+}
+
+static int orion_nand_read_pages(struct nand_device *nand, uint32_t page,
+		uint32_t count, uint8_t *buffer, uint32_t page_bytes)
+{
+	struct orion_nand_controller *hw = nand->controller_priv;
+
+	return arm_nand_read_pages(&hw->io, nand, page, count, buffer, page_bytes);
+}
+
 static int orion_nand_reset(struct nand_device *nand)
 {
 	return orion_nand_command(nand, NAND_CMD_RESET);
@@ -137,6 +153,8 @@ NAND_DEVICE_COMMAND_HANDLER(orion_nand_device_command)
 
 	hw->io.target = nand->target;
 	hw->io.data = hw->data;
+	hw->io.cmd = hw->cmd;
+	hw->io.addr = hw->addr;
 	hw->io.op = ARM_NAND_NONE;
 
 	return ERROR_OK;
@@ -155,6 +173,8 @@ struct nand_flash_controller orion_nand_controller = {
 	.read_data = orion_nand_read,
 	.write_data = orion_nand_write,
 	.write_block_data = orion_nand_fast_block_write,
+	.write_pages = orion_nand_write_pages,
+	.read_pages = orion_nand_read_pages,
 	.reset = orion_nand_reset,
 	.nand_device_command = orion_nand_device_command,
 	.init = orion_nand_init,
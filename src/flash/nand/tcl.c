@@ -31,6 +31,9 @@
 /* to be removed */
 extern struct nand_device *nand_devices;
 
+/* Pages read or written per call, to let the controller batch them */
+#define NAND_BATCH_PAGES	64
+
 COMMAND_HANDLER(handle_nand_list_command)
 {
 	struct nand_device *p;
@@ -240,6 +243,31 @@ COMMAND_HANDLER(handle_nand_check_bad_blocks_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_nand_bbt_cache_command)
+{
+	if ((CMD_ARGC < 1) || (CMD_ARGC > 2))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct nand_device *p;
+	int retval = CALL_COMMAND_HANDLER(nand_command_get_device, 0, &p);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (CMD_ARGC == 2) {
+		retval = nand_bbt_cache_set(p,
+				strcmp(CMD_ARGV[1], "off") ? CMD_ARGV[1] : NULL);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (p->bbt_cache)
+		command_print(CMD, "bad block cache: %s", p->bbt_cache);
+	else
+		command_print(CMD, "bad block cache is off");
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_nand_write_command)
 {
 	struct nand_device *nand = NULL;
@@ -249,27 +277,51 @@ COMMAND_HANDLER(handle_nand_write_command)
 	if (retval != ERROR_OK)
 		return retval;
 
+	uint32_t page_bytes = s.page_size + s.oob_size;
+	uint8_t *batch = malloc(NAND_BATCH_PAGES * page_bytes);
+	if (!batch) {
+		LOG_ERROR("Out of memory");
+		nand_fileio_cleanup(&s);
+		return ERROR_FAIL;
+	}
+
 	uint32_t total_bytes = s.size;
 	while (s.size > 0) {
-		int bytes_read = nand_fileio_read(nand, &s);
-		if (bytes_read <= 0) {
-			command_print(CMD, "error while reading file");
-			nand_fileio_cleanup(&s);
-			return ERROR_FAIL;
+		uint32_t address = s.address;
+		uint32_t count = 0;
+
+		/* gather a batch of pages with their OOB */
+		while (s.size > 0 && count < NAND_BATCH_PAGES) {
+			int bytes_read = nand_fileio_read(nand, &s);
+			if (bytes_read <= 0) {
+				command_print(CMD, "error while reading file");
+				free(batch);
+				nand_fileio_cleanup(&s);
+				return ERROR_FAIL;
+			}
+			s.size -= bytes_read;
+
+			uint8_t *p = batch + count * page_bytes;
+			if (s.page)
+				memcpy(p, s.page, s.page_size);
+			if (s.oob)
+				memcpy(p + s.page_size, s.oob, s.oob_size);
+			count++;
+			s.address += nand->page_size;
 		}
-		s.size -= bytes_read;
 
-		retval = nand_write_page(nand, s.address / nand->page_size,
-				s.page, s.page_size, s.oob, s.oob_size);
+		retval = nand_write_pages(nand, address / nand->page_size, count,
+				batch, s.page_size, s.oob_size);
 		if (retval != ERROR_OK) {
 			command_print(CMD, "failed writing file %s "
 				"to NAND flash %s at offset 0x%8.8" PRIx32,
-				CMD_ARGV[1], CMD_ARGV[0], s.address);
+				CMD_ARGV[1], CMD_ARGV[0], address);
+			free(batch);
 			nand_fileio_cleanup(&s);
 			return retval;
 		}
-		s.address += s.page_size;
 	}
+	free(batch);
 
 	if (nand_fileio_finish(&s) == ERROR_OK) {
 		command_print(CMD, "wrote file %s to NAND flash %s up to "
@@ -298,36 +350,56 @@ COMMAND_HANDLER(handle_nand_verify_command)
 	if (retval != ERROR_OK)
 		return retval;
 
+	uint32_t page_bytes = dev.page_size + dev.oob_size;
+	uint32_t file_page_bytes = nand_fileio_page_bytes(&file);
+	uint8_t *batch = malloc(NAND_BATCH_PAGES * page_bytes);
+	if (!batch || !file_page_bytes) {
+		free(batch);
+		nand_fileio_cleanup(&dev);
+		nand_fileio_cleanup(&file);
+		return ERROR_FAIL;
+	}
+
 	while (file.size > 0) {
-		retval = nand_read_page(nand, dev.address / dev.page_size,
-				dev.page, dev.page_size, dev.oob, dev.oob_size);
+		uint32_t count = MIN(DIV_ROUND_UP(file.size, file_page_bytes), NAND_BATCH_PAGES);
+
+		retval = nand_read_pages(nand, dev.address / nand->page_size, count,
+				batch, dev.page_size, dev.oob_size);
 		if (retval != ERROR_OK) {
 			command_print(CMD, "reading NAND flash page failed");
+			free(batch);
 			nand_fileio_cleanup(&dev);
 			nand_fileio_cleanup(&file);
 			return retval;
 		}
 
-		int bytes_read = nand_fileio_read(nand, &file);
-		if (bytes_read <= 0) {
-			command_print(CMD, "error while reading file");
-			nand_fileio_cleanup(&dev);
-			nand_fileio_cleanup(&file);
-			return ERROR_FAIL;
-		}
-
-		if ((dev.page && memcmp(dev.page, file.page, dev.page_size)) ||
-				(dev.oob && memcmp(dev.oob, file.oob, dev.oob_size))) {
-			command_print(CMD, "NAND flash contents differ "
-				"at 0x%8.8" PRIx32, dev.address);
-			nand_fileio_cleanup(&dev);
-			nand_fileio_cleanup(&file);
-			return ERROR_FAIL;
+		for (uint32_t i = 0; i < count && file.size > 0; i++) {
+			uint8_t *p = batch + i * page_bytes;
+
+			int bytes_read = nand_fileio_read(nand, &file);
+			if (bytes_read <= 0) {
+				command_print(CMD, "error while reading file");
+				free(batch);
+				nand_fileio_cleanup(&dev);
+				nand_fileio_cleanup(&file);
+				return ERROR_FAIL;
+			}
+
+			if ((dev.page && memcmp(p, file.page, dev.page_size)) ||
+					(dev.oob && memcmp(p + dev.page_size, file.oob, dev.oob_size))) {
+				command_print(CMD, "NAND flash contents differ "
+					"at 0x%8.8" PRIx32, dev.address);
+				free(batch);
+				nand_fileio_cleanup(&dev);
+				nand_fileio_cleanup(&file);
+				return ERROR_FAIL;
+			}
+
+			file.size -= bytes_read;
+			dev.address += nand->page_size;
 		}
-
-		file.size -= bytes_read;
-		dev.address += nand->page_size;
 	}
+	free(batch);
 
 	if (nand_fileio_finish(&file) == ERROR_OK) {
 		command_print(CMD, "verified file %s in NAND flash %s "
@@ -349,25 +421,41 @@ COMMAND_HANDLER(handle_nand_dump_command)
 	if (retval != ERROR_OK)
 		return retval;
 
+	uint32_t page_bytes = s.page_size + s.oob_size;
+	uint8_t *batch = malloc(NAND_BATCH_PAGES * page_bytes);
+	if (!batch) {
+		LOG_ERROR("Out of memory");
+		nand_fileio_cleanup(&s);
+		return ERROR_FAIL;
+	}
+
 	while (s.size > 0) {
 		size_t size_written;
-		retval = nand_read_page(nand, s.address / nand->page_size,
-				s.page, s.page_size, s.oob, s.oob_size);
+		uint32_t count = MIN(s.size / nand->page_size, NAND_BATCH_PAGES);
+
+		retval = nand_read_pages(nand, s.address / nand->page_size, count,
+				batch, s.page_size, s.oob_size);
 		if (retval != ERROR_OK) {
 			command_print(CMD, "reading NAND flash page failed");
+			free(batch);
 			nand_fileio_cleanup(&s);
 			return retval;
 		}
 
-		if (s.page)
-			fileio_write(s.fileio, s.page_size, s.page, &size_written);
+		for (uint32_t i = 0; i < count; i++) {
+			uint8_t *p = batch + i * page_bytes;
 
-		if (s.oob)
-			fileio_write(s.fileio, s.oob_size, s.oob, &size_written);
+			if (s.page)
+				fileio_write(s.fileio, s.page_size, p, &size_written);
 
-		s.size -= nand->page_size;
-		s.address += nand->page_size;
+			if (s.oob)
+				fileio_write(s.fileio, s.oob_size, p + s.page_size, &size_written);
+		}
+
+		s.size -= count * nand->page_size;
+		s.address += count * nand->page_size;
 	}
+	free(batch);
 
 	retval = fileio_size(s.fileio, &filesize);
 	if (retval != ERROR_OK)
@@ -548,6 +636,9 @@ static COMMAND_HELPER(create_nand_device, const char *bank_name,
 	c->address_cycles = 0;
 	c->page_size = 0;
 	c->use_raw = false;
+	c->blocks = NULL;
+	memset(c->id, 0, sizeof(c->id));
+	c->bbt_cache = NULL;
 	c->next = NULL;
 
 	retval = CALL_COMMAND_HANDLER(controller->nand_device_command, c);
@@ -608,6 +699,13 @@ static const struct command_registration nand_config_command_handlers[] = {
 		.help = "initialize NAND devices",
 		.usage = ""
 	},
+	{
+		.name = "bbt_cache",
+		.mode = COMMAND_ANY,
+		.handler = &handle_nand_bbt_cache_command,
+		.help = "keep the bad block table of a NAND device in a file",
+		.usage = "bank_id [filename|'off']"
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
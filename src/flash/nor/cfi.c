@@ -32,6 +32,7 @@
 #include <target/armv7m.h>
 #include <target/mips32.h>
 #include <helper/binarybuffer.h>
+#include <helper/time_support.h>
 #include <target/algorithm.h>
 
 /* defines internal maximum size for code fragment in cfi_intel_write_block() */
@@ -320,31 +321,9 @@ static void cfi_intel_clear_status_register(struct flash_bank *bank)
 	cfi_send_command(bank, 0x50, cfi_flash_address(bank, 0, 0x0));
 }
 
-static int cfi_intel_wait_status_busy(struct flash_bank *bank, int timeout, uint8_t *val)
+/* Decodes the status of a finished operation, bit 0 (reserved) masked out */
+static int cfi_intel_check_status(struct flash_bank *bank, uint8_t status)
 {
-	uint8_t status;
-
-	int retval = ERROR_OK;
-
-	for (;; ) {
-		if (timeout-- < 0) {
-			LOG_ERROR("timeout while waiting for WSM to become ready");
-			return ERROR_FAIL;
-		}
-
-		retval = cfi_get_u8(bank, 0, 0x0, &status);
-		if (retval != ERROR_OK)
-			return retval;
-
-		if (status & 0x80)
-			break;
-
-		alive_sleep(1);
-	}
-
-	/* mask out bit 0 (reserved) */
-	status = status & 0xfe;
-
 	LOG_DEBUG("status: 0x%x", status);
 
 	if (status != 0x80) {
@@ -364,11 +343,36 @@ static int cfi_intel_wait_status_busy(struct flash_bank *bank, int timeout, uint
 
 		cfi_intel_clear_status_register(bank);
 
-		retval = ERROR_FAIL;
+		return ERROR_FAIL;
 	}
 
-	*val = status;
-	return retval;
+	return ERROR_OK;
+}
+
+static int cfi_intel_wait_status_busy(struct flash_bank *bank, int timeout, uint8_t *val)
+{
+	uint8_t status;
+
+	int retval = ERROR_OK;
+
+	for (;; ) {
+		if (timeout-- < 0) {
+			LOG_ERROR("timeout while waiting for WSM to become ready");
+			return ERROR_FAIL;
+		}
+
+		retval = cfi_get_u8(bank, 0, 0x0, &status);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (status & 0x80)
+			break;
+
+		alive_sleep(1);
+	}
+
+	*val = status & 0xfe;
+	return cfi_intel_check_status(bank, *val);
 }
 
 int cfi_spansion_wait_status_busy(struct flash_bank *bank, int timeout)
@@ -848,42 +852,6 @@ FLASH_BANK_COMMAND_HANDLER(cfi_flash_bank_command)
 	return cfi_flash_bank_cmd(bank, CMD_ARGC, CMD_ARGV);
 }
 
-static int cfi_intel_erase(struct flash_bank *bank, unsigned int first,
-		unsigned int last)
-{
-	int retval;
-	struct cfi_flash_bank *cfi_info = bank->driver_priv;
-
-	cfi_intel_clear_status_register(bank);
-
-	for (unsigned int i = first; i <= last; i++) {
-		retval = cfi_send_command(bank, 0x20, cfi_flash_address(bank, i, 0x0));
-		if (retval != ERROR_OK)
-			return retval;
-
-		retval = cfi_send_command(bank, 0xd0, cfi_flash_address(bank, i, 0x0));
-		if (retval != ERROR_OK)
-			return retval;
-
-		uint8_t status;
-		retval = cfi_intel_wait_status_busy(bank, cfi_info->block_erase_timeout, &status);
-		if (retval != ERROR_OK)
-			return retval;
-
-		if (status != 0x80) {
-			retval = cfi_send_command(bank, 0xff, cfi_flash_address(bank, 0, 0x0));
-			if (retval != ERROR_OK)
-				return retval;
-
-			LOG_ERROR("couldn't erase block %u of flash bank at base "
-					TARGET_ADDR_FMT, i, bank->base);
-			return ERROR_FLASH_OPERATION_FAILED;
-		}
-	}
-
-	return cfi_send_command(bank, 0xff, cfi_flash_address(bank, 0, 0x0));
-}
-
 int cfi_spansion_unlock_seq(struct flash_bank *bank)
 {
 	int retval;
@@ -901,45 +869,97 @@ int cfi_spansion_unlock_seq(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
-static int cfi_spansion_erase(struct flash_bank *bank, unsigned int first,
-		unsigned int last)
+/* Checks once, without waiting, whether the embedded algorithm of an
+ * AMD/Spansion device still runs: DQ6 toggles on every read while it does */
+static int cfi_spansion_poll_status(struct flash_bank *bank)
 {
-	int retval;
 	struct cfi_flash_bank *cfi_info = bank->driver_priv;
-	struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
+	uint8_t status, oldstatus;
+	int retval;
 
-	for (unsigned int i = first; i <= last; i++) {
-		retval = cfi_spansion_unlock_seq(bank);
-		if (retval != ERROR_OK)
-			return retval;
+	retval = cfi_get_u8(bank, 0, 0x0, &oldstatus);
+	if (retval == ERROR_OK)
+		retval = cfi_get_u8(bank, 0, 0x0, &status);
+	if (retval != ERROR_OK)
+		return retval;
 
-		retval = cfi_send_command(bank, 0x80, cfi_flash_address(bank, 0, pri_ext->_unlock1));
-		if (retval != ERROR_OK)
-			return retval;
+	if ((status ^ oldstatus) & 0x40) {
+		if (!(status & cfi_info->status_poll_mask & 0x20))
+			return ERROR_FLASH_BUSY;
 
-		retval = cfi_spansion_unlock_seq(bank);
+		/* DQ5 set: still toggling means the algorithm failed */
+		retval = cfi_get_u8(bank, 0, 0x0, &oldstatus);
+		if (retval == ERROR_OK)
+			retval = cfi_get_u8(bank, 0, 0x0, &status);
 		if (retval != ERROR_OK)
 			return retval;
+		if ((status ^ oldstatus) & 0x40) {
+			LOG_ERROR("dq5 timeout, status: 0x%x", status);
+			return ERROR_FLASH_OPERATION_FAILED;
+		}
+	}
 
-		retval = cfi_send_command(bank, 0x30, cfi_flash_address(bank, i, 0x0));
+	LOG_DEBUG("status: 0x%x", status);
+	return ERROR_OK;
+}
+
+/* Issues the erase of the sectors starting at erase_next without waiting
+ * for it, using a chip erase where the planner allows it */
+static int cfi_erase_issue(struct flash_bank *bank)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	unsigned int sector = cfi_info->erase_next;
+	uint32_t units[1];
+	unsigned int num_units = 0;
+	unsigned int count;
+	int retval;
+
+	if (cfi_info->pri_id == 1 || cfi_info->pri_id == 3) {
+		cfi_intel_clear_status_register(bank);
+
+		retval = cfi_send_command(bank, 0x20, cfi_flash_address(bank, sector, 0x0));
+		if (retval == ERROR_OK)
+			retval = cfi_send_command(bank, 0xd0, cfi_flash_address(bank, sector, 0x0));
 		if (retval != ERROR_OK)
 			return retval;
 
-		if (cfi_spansion_wait_status_busy(bank, cfi_info->block_erase_timeout) != ERROR_OK) {
-			retval = cfi_send_command(bank, 0xf0, cfi_flash_address(bank, 0, 0x0));
-			if (retval != ERROR_OK)
-				return retval;
+		cfi_info->erase_chip = false;
+		cfi_info->erase_count = 1;
+		cfi_info->erase_t0 = timeval_ms();
+		return ERROR_OK;
+	}
 
-			LOG_ERROR("couldn't erase block %i of flash bank at base "
-				TARGET_ADDR_FMT, i, bank->base);
-			return ERROR_FLASH_OPERATION_FAILED;
-		}
+	struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
+
+	/* a chip erase timeout of 0 means there is no chip erase, and it must
+	 * not reach past the bank */
+	if (cfi_info->chip_erase_timeout_typ && !cfi_info->erase_chip_failed &&
+			cfi_info->dev_size * bank->bus_width / bank->chip_width == bank->size)
+		units[num_units++] = bank->size;
+
+	cfi_info->erase_chip = flash_erase_plan(bank, sector, cfi_info->erase_last,
+			units, num_units, &count) == 0;
+
+	retval = cfi_spansion_unlock_seq(bank);
+	if (retval == ERROR_OK)
+		retval = cfi_send_command(bank, 0x80, cfi_flash_address(bank, 0, pri_ext->_unlock1));
+	if (retval == ERROR_OK)
+		retval = cfi_spansion_unlock_seq(bank);
+	if (retval == ERROR_OK) {
+		if (cfi_info->erase_chip)
+			retval = cfi_send_command(bank, 0x10, cfi_flash_address(bank, 0, pri_ext->_unlock1));
+		else
+			retval = cfi_send_command(bank, 0x30, cfi_flash_address(bank, sector, 0x0));
 	}
+	if (retval != ERROR_OK)
+		return retval;
 
-	return cfi_send_command(bank, 0xf0, cfi_flash_address(bank, 0, 0x0));
+	cfi_info->erase_count = count;
+	cfi_info->erase_t0 = timeval_ms();
+	return ERROR_OK;
 }
 
-int cfi_erase(struct flash_bank *bank, unsigned int first,
+static int cfi_erase_start(struct flash_bank *bank, unsigned int first,
 		unsigned int last)
 {
 	struct cfi_flash_bank *cfi_info = bank->driver_priv;
@@ -957,16 +977,86 @@ int cfi_erase(struct flash_bank *bank, unsigned int first,
 
 	switch (cfi_info->pri_id) {
 		case 1:
-		case 3:
-			return cfi_intel_erase(bank, first, last);
 		case 2:
-			return cfi_spansion_erase(bank, first, last);
+		case 3:
+			break;
 		default:
 			LOG_ERROR("cfi primary command set %i unsupported", cfi_info->pri_id);
+			return ERROR_FLASH_OPER_UNSUPPORTED;
+	}
+
+	cfi_info->erase_next = first;
+	cfi_info->erase_last = last;
+	cfi_info->erase_chip_failed = false;
+	return cfi_erase_issue(bank);
+}
+
+static int cfi_erase_poll(struct flash_bank *bank)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	bool intel = cfi_info->pri_id != 2;
+	uint8_t reset_cmd = intel ? 0xff : 0xf0;
+	uint8_t status;
+	int retval;
+
+	if (intel) {
+		retval = cfi_get_u8(bank, 0, 0x0, &status);
+		if (retval == ERROR_OK && !(status & 0x80))
+			retval = ERROR_FLASH_BUSY;
+		else if (retval == ERROR_OK)
+			retval = cfi_intel_check_status(bank, status & 0xfe);
+	} else {
+		retval = cfi_spansion_poll_status(bank);
+	}
+
+	int64_t dt = timeval_ms() - cfi_info->erase_t0;
+	if (retval == ERROR_FLASH_BUSY) {
+		unsigned int timeout = cfi_info->erase_chip ?
+			cfi_info->chip_erase_timeout : cfi_info->block_erase_timeout;
+		if (dt <= (int64_t)timeout)
+			return ERROR_FLASH_BUSY;
+
+		LOG_ERROR("timeout, erase still busy after %" PRId64 " ms", dt);
+		retval = ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	if (retval != ERROR_OK) {
+		cfi_send_command(bank, reset_cmd, cfi_flash_address(bank, 0, 0x0));
+
+		if (cfi_info->erase_chip) {
+			LOG_WARNING("chip erase failed, falling back to sector erase");
+			cfi_info->erase_chip_failed = true;
+			retval = cfi_erase_issue(bank);
+			return (retval == ERROR_OK) ? ERROR_FLASH_BUSY : retval;
+		}
+
+		LOG_ERROR("couldn't erase block %u of flash bank at base "
+			TARGET_ADDR_FMT, cfi_info->erase_next, bank->base);
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	cfi_info->erase_next += cfi_info->erase_count;
+	if (cfi_info->erase_next > cfi_info->erase_last)
+		return cfi_send_command(bank, reset_cmd, cfi_flash_address(bank, 0, 0x0));
+
+	retval = cfi_erase_issue(bank);
+	return (retval == ERROR_OK) ? ERROR_FLASH_BUSY : retval;
+}
+
+int cfi_erase(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	int retval = cfi_erase_start(bank, first, last);
+
+	while (retval == ERROR_OK) {
+		retval = cfi_erase_poll(bank);
+		if (retval != ERROR_FLASH_BUSY)
 			break;
+		alive_sleep(1);
+		retval = ERROR_OK;
 	}
 
-	return ERROR_OK;
+	return retval;
 }
 
 static int cfi_intel_protect(struct flash_bank *bank, int set,
@@ -2221,6 +2311,200 @@ static int cfi_write_words(struct flash_bank *bank, const uint8_t *word,
 	return ERROR_FLASH_OPERATION_FAILED;
 }
 
+/* see contrib/loaders/flash/cfi/armv7m_cfi_buffered.S for src */
+static const uint8_t armv7m_cfi_buffered_code[] = {
+#include "../../../contrib/loaders/flash/cfi/armv7m_cfi_buffered.inc"
+};
+
+/* the loader sends the word count - 1 in the lowest byte of each chip */
+#define CFI_STREAM_MAX_BUF_WORDS	256
+
+/* Streams wordcount bus words to the buffered write loader. The host keeps
+ * filling the FIFO while the flash programs the previous write buffer.
+ */
+static int cfi_write_stream_words(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t address, uint32_t wordcount)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	struct target *target = bank->target;
+	struct working_area *algorithm, *fifo;
+	struct reg_param reg_params[10];
+	struct armv7m_algorithm armv7m_info;
+	uint32_t buf_words, fifo_size, fifo_min;
+	bool amd = cfi_info->pri_id == 2;
+	int retval;
+
+	/* write buffer size in bus words, as in cfi_intel_write_words() */
+	buf_words = (1UL << cfi_info->max_buf_write_size) / bank->chip_width;
+	if (buf_words > CFI_STREAM_MAX_BUF_WORDS)
+		buf_words = CFI_STREAM_MAX_BUF_WORDS;
+
+	if (target_alloc_working_area(target, sizeof(armv7m_cfi_buffered_code),
+			&algorithm) != ERROR_OK) {
+		LOG_DEBUG("no working area for the CFI streaming loader");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	retval = target_write_buffer(target, algorithm->address,
+			sizeof(armv7m_cfi_buffered_code), armv7m_cfi_buffered_code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, algorithm);
+		return retval;
+	}
+
+	/* the loader waits for a whole write buffer in the FIFO, which can
+	 * never be completely full; take as much as is available */
+	fifo_min = 2 * sizeof(uint32_t) + 2 * buf_words * bank->bus_width;
+	fifo_size = target_get_working_area_avail(target) & ~3u;
+	if (fifo_size < fifo_min
+			|| target_alloc_working_area(target, fifo_size, &fifo) != ERROR_OK) {
+		target_free_working_area(target, algorithm);
+		LOG_DEBUG("not enough working area for the CFI streaming loader FIFO");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* fifo start, status (out) */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* fifo end */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* flash address */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* count (bus words) */
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);	/* log2 bus width */
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);	/* write buffer words */
+	init_reg_param(&reg_params[6], "r6", 32, PARAM_OUT);	/* command multiplier */
+	init_reg_param(&reg_params[7], "r7", 32, PARAM_OUT);	/* flags */
+	init_reg_param(&reg_params[8], "r8", 32, PARAM_OUT);	/* unlock address 1 */
+	init_reg_param(&reg_params[9], "r9", 32, PARAM_OUT);	/* unlock address 2 */
+
+	buf_set_u32(reg_params[0].value, 0, 32, fifo->address);
+	buf_set_u32(reg_params[1].value, 0, 32, fifo->address + fifo->size);
+	buf_set_u32(reg_params[2].value, 0, 32, address);
+	buf_set_u32(reg_params[3].value, 0, 32, wordcount);
+	buf_set_u32(reg_params[4].value, 0, 32, bank->bus_width == 4 ? 2 : bank->bus_width - 1);
+	buf_set_u32(reg_params[5].value, 0, 32, buf_words);
+	buf_set_u32(reg_params[6].value, 0, 32, cfi_command_val(bank, 1));
+	buf_set_u32(reg_params[7].value, 0, 32, amd ?
+			(cfi_info->status_poll_mask & (1 << 5) ? 3 : 1) : 0);
+	if (amd) {
+		struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
+
+		buf_set_u32(reg_params[8].value, 0, 32, cfi_flash_address(bank, 0, pri_ext->_unlock1));
+		buf_set_u32(reg_params[9].value, 0, 32, cfi_flash_address(bank, 0, pri_ext->_unlock2));
+	} else {
+		buf_set_u32(reg_params[8].value, 0, 32, 0);
+		buf_set_u32(reg_params[9].value, 0, 32, 0);
+		cfi_intel_clear_status_register(bank);
+	}
+
+	LOG_DEBUG("Streaming 0x%" PRIx32 " words to 0x%08" PRIx32 ", FIFO of %" PRIu32 " bytes",
+		wordcount, address, fifo_size);
+
+	retval = target_run_flash_async_algorithm(target, buffer, wordcount, bank->bus_width,
+			0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			fifo->address, fifo->size,
+			algorithm->address, 0,
+			&armv7m_info);
+
+	if (retval == ERROR_FLASH_OPERATION_FAILED) {
+		LOG_ERROR("flash write block failed status: 0x%" PRIx32,
+			buf_get_u32(reg_params[0].value, 0, 32));
+		if (amd) {
+			/* write to buffer abort reset */
+			if (cfi_spansion_unlock_seq(bank) == ERROR_OK)
+				cfi_send_command(bank, 0xf0, cfi_flash_address(bank, 0, 0x0));
+		} else {
+			cfi_intel_clear_status_register(bank);
+		}
+	}
+
+	target_free_working_area(target, fifo);
+	target_free_working_area(target, algorithm);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	return retval;
+}
+
+static void cfi_swap_words(struct flash_bank *bank, uint8_t *buffer, uint32_t count)
+{
+	switch (bank->bus_width) {
+	case 2:
+		buf_bswap16(buffer, buffer, count);
+		break;
+	case 4:
+		buf_bswap32(buffer, buffer, count);
+		break;
+	}
+}
+
+/* Writes count bytes at address with the streaming loader. Unaligned head
+ * and tail bytes are merged with the current flash contents, so they go
+ * through the write buffer together with the rest of the data.
+ */
+static int cfi_write_stream(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t address, uint32_t count)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	uint32_t start = address & ~(bank->bus_width - 1);
+	uint32_t end = (address + count + bank->bus_width - 1) & ~(bank->bus_width - 1);
+	uint32_t size = end - start;
+	uint32_t head = address - start;
+	uint32_t tail = end - (address + count);
+	uint8_t *words;
+	int retval;
+
+	if (!is_armv7m(target_to_armv7m(bank->target)))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* buffered writes only; custom accessors can't be used by the loader */
+	if (cfi_info->buf_write_timeout_typ == 0 || cfi_info->write_mem || cfi_info->read_mem)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (cfi_info->pri_id != 1 && cfi_info->pri_id != 2 && cfi_info->pri_id != 3)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (bank->bus_width != 1 && bank->bus_width != 2 && bank->bus_width != 4)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	words = malloc(size);
+	if (!words) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	if (head || tail) {
+		LOG_DEBUG("Merging %" PRIu32 " unaligned head and %" PRIu32 " tail bytes",
+			head, tail);
+
+		/* read array mode, to get the words to merge */
+		retval = cfi_reset(bank);
+		if (retval == ERROR_OK && head)
+			retval = cfi_target_read_memory(bank, start, 1, words);
+		if (retval == ERROR_OK && tail && (size > bank->bus_width || !head))
+			retval = cfi_target_read_memory(bank, end - bank->bus_width, 1,
+					words + size - bank->bus_width);
+		if (retval != ERROR_OK) {
+			free(words);
+			return retval;
+		}
+	}
+
+	/* data bytes are swapped (reverse endianness) on the bus */
+	if (cfi_info->data_swap)
+		cfi_swap_words(bank, words, size);
+	memcpy(words + head, buffer, count);
+	if (cfi_info->data_swap)
+		cfi_swap_words(bank, words, size);
+
+	retval = cfi_write_stream_words(bank, words, start, size / bank->bus_width);
+
+	free(words);
+	return retval;
+}
+
 static int cfi_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct cfi_flash_bank *cfi_info = bank->driver_priv;
@@ -2313,6 +2597,13 @@ static int cfi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t of
 	if (cfi_info->qry[0] != 'Q')
 		return ERROR_FLASH_BANK_NOT_PROBED;
 
+	/* stream all data through the write buffers if the target can */
+	retval = cfi_write_stream(bank, buffer, address, count);
+	if (retval == ERROR_OK)
+		return cfi_reset(bank);
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return retval;
+
 	/* start at the first byte of the first word (bus_width size) */
 	write_p = address & ~(bank->bus_width - 1);
 	align = address - write_p;
@@ -3050,6 +3341,8 @@ const struct flash_driver cfi_flash = {
 	.name = "cfi",
 	.flash_bank_command = cfi_flash_bank_command,
 	.erase = cfi_erase,
+	.erase_start = cfi_erase_start,
+	.erase_poll = cfi_erase_poll,
 	.protect = cfi_protect,
 	.write = cfi_write,
 	.read = cfi_read,
@@ -74,6 +74,14 @@ struct cfi_flash_bank {
 	unsigned block_erase_timeout;
 	unsigned chip_erase_timeout;
 
+	/* erase in progress, see cfi_erase_start() */
+	unsigned int erase_next;
+	unsigned int erase_last;
+	unsigned int erase_count;
+	bool erase_chip;
+	bool erase_chip_failed;
+	int64_t erase_t0;
+
 	/* memory accessors */
 	int (*write_mem)(struct flash_bank *bank, target_addr_t addr,
 			 uint32_t count, const uint8_t *buffer);
@@ -26,6 +26,7 @@
 #include <flash/common.h>
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
+#include <flash/nor/sector_cache.h>
 #include <target/image.h>
 
 /**
@@ -42,13 +43,67 @@ int flash_driver_erase(struct flash_bank *bank, unsigned int first,
 {
 	int retval;
 
+	flash_sector_cache_erase_begin(bank, first, last);
 	retval = bank->driver->erase(bank, first, last);
+	flash_sector_cache_erase_end(bank, retval);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %u to %u", first, last);
 
 	return retval;
 }
 
+/**
+ * Picks the cheapest way to start erasing sectors @a first .. @a last.
+ *
+ * Besides erasing sector by sector, many devices offer larger erase
+ * units (blocks, or the whole chip).  A unit is usable when it starts
+ * at the offset of sector @a first, is aligned to its own size and ends
+ * exactly on a sector boundary not past @a last.  Among the usable
+ * units, the one covering the most sectors wins.  A unit of bank->size
+ * therefore stands for a chip erase.
+ *
+ * @param bank The bank being erased.
+ * @param first The first sector still to erase.
+ * @param last The last sector to erase.
+ * @param units Erase unit sizes in bytes supported by the device.
+ * @param num_units Number of entries in @a units.
+ * @param count Returns the number of sectors covered by the chosen unit.
+ * @returns Index into @a units, or -1 to erase the single sector @a first.
+ */
+int flash_erase_plan(struct flash_bank *bank, unsigned int first,
+		unsigned int last, const uint32_t *units, unsigned int num_units,
+		unsigned int *count)
+{
+	uint32_t start = bank->sectors[first].offset;
+	int best = -1;
+
+	*count = 1;
+
+	for (unsigned int i = 0; i < num_units; i++) {
+		uint32_t unit = units[i];
+
+		if (unit <= bank->sectors[first].size || start % unit)
+			continue;
+
+		/* the unit must end on a sector boundary inside the range */
+		for (unsigned int k = first; k <= last; k++) {
+			uint32_t end = bank->sectors[k].offset + bank->sectors[k].size;
+
+			if (end > start + unit)
+				break;
+			if (end == start + unit) {
+				if (k - first + 1 > *count) {
+					*count = k - first + 1;
+					best = i;
+				}
+				break;
+			}
+		}
+	}
+
+	return best;
+}
+
 int flash_driver_protect(struct flash_bank *bank, int set, unsigned int first,
 		unsigned int last)
 {
@@ -99,6 +154,7 @@ int flash_driver_write(struct flash_bank *bank,
 	int retval;
 
 	retval = bank->driver->write(bank, buffer, offset, count);
+	flash_sector_cache_written(bank, buffer, offset, count, retval);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
 			"error writing to flash at address " TARGET_ADDR_FMT
@@ -244,6 +300,7 @@ void flash_free_all_banks(void)
 			free(bank->prot_blocks);
 		}
 
+		flash_sector_cache_free(bank);
 		free(bank->name);
 		free(bank);
 		bank = next;
@@ -617,11 +674,117 @@ static int flash_iterate_address_range(struct target *target,
 	return retval;
 }
 
+/* Starts erasing a range of one bank.  Banks whose driver supports
+ * asynchronous erase are only kicked off here and finished by
+ * flash_erase_wait(), so erases of independent banks overlap.
+ */
+static int flash_erase_start(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	if (!bank->driver->erase_start || !bank->driver->erase_poll)
+		return flash_driver_erase(bank, first, last);
+
+	if (bank->erase_pending) {
+		/* same bank hit twice in one range: finish the first part */
+		int retval = flash_erase_wait();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	flash_sector_cache_erase_begin(bank, first, last);
+	int retval = bank->driver->erase_start(bank, first, last);
+	if (retval != ERROR_OK) {
+		flash_sector_cache_erase_end(bank, retval);
+		LOG_ERROR("failed erasing sectors %u to %u", first, last);
+		return retval;
+	}
+
+	bank->erase_pending = true;
+	return ERROR_OK;
+}
+
+/* Polls all banks with an erase in flight until every one has finished.
+ * Returns the first error seen; remaining banks are still waited for.
+ */
+int flash_erase_wait(void)
+{
+	int retval = ERROR_OK;
+	bool pending;
+
+	do {
+		pending = false;
+		for (struct flash_bank *bank = flash_banks; bank; bank = bank->next) {
+			if (!bank->erase_pending)
+				continue;
+
+			int status = bank->driver->erase_poll(bank);
+			if (status == ERROR_FLASH_BUSY) {
+				pending = true;
+				continue;
+			}
+
+			bank->erase_pending = false;
+			flash_sector_cache_erase_end(bank, status);
+			if (status != ERROR_OK) {
+				LOG_ERROR("failed erasing flash bank %s", bank->name);
+				if (retval == ERROR_OK)
+					retval = status;
+			}
+		}
+
+		if (pending)
+			alive_sleep(1);
+	} while (pending);
+
+	return retval;
+}
+
+/* Erases sectors first .. last, leaving out the runs of sectors the
+ * sector cache knows to be erased still.
+ */
+static int flash_erase_start_skip_erased(struct flash_bank *bank,
+		unsigned int first, unsigned int last)
+{
+	while (first <= last) {
+		unsigned int n = flash_sector_cache_erased(bank, first, last);
+		if (n) {
+			LOG_INFO("sectors %u to %u are already erased", first, first + n - 1);
+			first += n;
+			continue;
+		}
+
+		unsigned int end = first;
+		while (end < last && !flash_sector_cache_maybe_erased(bank, end + 1))
+			end++;
+
+		int retval = flash_erase_start(bank, first, end);
+		if (retval != ERROR_OK)
+			return retval;
+		first = end + 1;
+	}
+
+	return ERROR_OK;
+}
+
+static int flash_erase_address_range_cb(struct target *target,
+	bool pad, target_addr_t addr, uint32_t length,
+	int (*callback)(struct flash_bank *bank, unsigned int first,
+		unsigned int last))
+{
+	int retval = flash_iterate_address_range(target, pad ? "erase" : NULL,
+		addr, length, false, callback);
+
+	/* always collect the banks already started, even after an error */
+	int retval2 = flash_erase_wait();
+
+	return (retval != ERROR_OK) ? retval : retval2;
+}
+
 int flash_erase_address_range(struct target *target,
 	bool pad, target_addr_t addr, uint32_t length)
 {
-	return flash_iterate_address_range(target, pad ? "erase" : NULL,
-		addr, length, false, &flash_driver_erase);
+	return flash_erase_address_range_cb(target, pad, addr, length,
+		&flash_erase_start);
 }
 
 static int flash_driver_unprotect(struct flash_bank *bank, unsigned int first,
@@ -734,6 +897,140 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
+/* Largest chunk written and then verified at once, rounded up to a sector */
+#define FLASH_WRITE_VERIFY_CHUNK	(64 * 1024)
+
+/* Erase and write again a chunk failing to verify this many times */
+#define FLASH_WRITE_VERIFY_RETRIES	1
+
+/* Size of the next chunk of a run at offset, ending on a sector boundary
+ * so that a chunk can be erased again without touching the others */
+static uint32_t flash_write_verify_chunk(struct flash_bank *bank,
+		uint32_t offset, uint32_t count)
+{
+	uint32_t end = offset + MIN(count, FLASH_WRITE_VERIFY_CHUNK);
+
+	for (unsigned int i = 0; i < bank->num_sectors; i++) {
+		uint32_t sector_end = bank->sectors[i].offset + bank->sectors[i].size;
+
+		if (sector_end >= end) {
+			end = sector_end;
+			break;
+		}
+	}
+
+	return MIN(end - offset, count);
+}
+
+/* Erases the sectors a chunk lies in. The first and last chunk of a run
+ * need not start and end on sector boundaries, and the rest of such a
+ * sector may hold data written before, e.g. by an earlier run in the same
+ * sector. Such a chunk is never erased, the write fails instead. */
+static int flash_write_verify_erase(struct flash_bank *bank,
+		uint32_t offset, uint32_t count)
+{
+	unsigned int first = bank->num_sectors, last = 0;
+
+	for (unsigned int i = 0; i < bank->num_sectors; i++) {
+		struct flash_sector *f = &bank->sectors[i];
+
+		if (f->offset + f->size <= offset || f->offset >= offset + count)
+			continue;
+		if (f->offset < offset || f->offset + f->size > offset + count) {
+			LOG_ERROR("flash sector at " TARGET_ADDR_FMT " is shared with data "
+				"outside this write, not erasing it", bank->base + f->offset);
+			return ERROR_FAIL;
+		}
+		if (first == bank->num_sectors)
+			first = i;
+		last = i;
+	}
+
+	if (first == bank->num_sectors)
+		return ERROR_FAIL;
+
+	return flash_driver_erase(bank, first, last);
+}
+
+/* Writes a run chunk by chunk, verifying each chunk as soon as it is
+ * written. A chunk failing to verify is erased and written again when
+ * the run was erased by us and the chunk covers whole sectors, otherwise
+ * the write fails at once. */
+static int flash_write_verify_run(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, bool erase)
+{
+	int retval = ERROR_OK;
+
+	while (count > 0) {
+		uint32_t chunk = flash_write_verify_chunk(bank, offset, count);
+
+		for (unsigned int retry = 0; ; retry++) {
+			retval = flash_driver_write(bank, buffer, offset, chunk);
+			if (retval == ERROR_OK)
+				retval = flash_driver_verify(bank, buffer, offset, chunk);
+			if (retval == ERROR_OK || !erase || !bank->num_sectors
+					|| retry == FLASH_WRITE_VERIFY_RETRIES)
+				break;
+
+			LOG_WARNING("writing flash at " TARGET_ADDR_FMT " failed, erasing and retrying",
+				bank->base + offset);
+			retval = flash_write_verify_erase(bank, offset, chunk);
+			if (retval != ERROR_OK)
+				break;
+		}
+		if (retval != ERROR_OK)
+			return retval;
+
+		buffer += chunk;
+		offset += chunk;
+		count -= chunk;
+	}
+
+	return ERROR_OK;
+}
+
+/* Verifies an image section outside of any flash bank against target
+ * memory, the way verify_image does: by checksum, or by reading it back
+ * when the target can't compute one */
+static int flash_write_verify_section(struct target *target, struct image *image,
+		unsigned int section_num)
+{
+	struct imagesection *section = &image->sections[section_num];
+	uint32_t checksum, mem_checksum;
+	size_t size_read;
+
+	uint8_t *buffer = malloc(section->size);
+	if (!buffer) {
+		LOG_ERROR("Out of memory for image section buffer");
+		return ERROR_FAIL;
+	}
+
+	int retval = image_read_section(image, section_num, 0, section->size, buffer, &size_read);
+	if (retval == ERROR_OK)
+		retval = image_calculate_checksum(buffer, size_read, &checksum);
+	if (retval == ERROR_OK)
+		retval = target_checksum_memory(target, section->base_address, size_read, &mem_checksum);
+	if (retval == ERROR_OK && checksum != mem_checksum) {
+		uint8_t *data = malloc(size_read);
+		if (!data) {
+			LOG_ERROR("Out of memory for image section buffer");
+			free(buffer);
+			return ERROR_FAIL;
+		}
+
+		retval = target_read_buffer(target, section->base_address, size_read, data);
+		if (retval == ERROR_OK && memcmp(data, buffer, size_read) != 0) {
+			LOG_ERROR("verification of image section at " TARGET_ADDR_FMT " failed",
+				section->base_address);
+			retval = ERROR_FAIL;
+		}
+		free(data);
+	}
+
+	free(buffer);
+	return retval;
+}
+
 int flash_write_unlock_verify(struct target *target, struct image *image,
 	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
 {
@@ -793,6 +1090,14 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			goto done;
 		if (!c) {
 			LOG_WARNING("no flash bank found for address " TARGET_ADDR_FMT, run_address);
+			if (write && verify) {
+				/* written by someone else, still part of the image to verify */
+				intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
+				retval = flash_write_verify_section(target, image,
+						diff / sizeof(struct imagesection));
+				if (retval != ERROR_OK)
+					goto done;
+			}
 			section++;	/* and skip it */
 			section_offset = 0;
 			continue;
@@ -962,21 +1267,26 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			retval = flash_unlock_address_range(target, run_address, run_size);
 		if (retval == ERROR_OK) {
 			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
+				/* calculate and erase sectors, except those known erased */
+				retval = flash_erase_address_range_cb(target,
+						true, run_address, run_size,
+						&flash_erase_start_skip_erased);
 			}
 		}
 
 		if (retval == ERROR_OK) {
-			if (write) {
+			if (write && verify) {
+				/* write and verify flash sectors chunk by chunk */
+				retval = flash_write_verify_run(c, buffer, run_address - c->base,
+						run_size, erase);
+			} else if (write) {
 				/* write flash sectors */
 				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
 			}
 		}
 
 		if (retval == ERROR_OK) {
-			if (verify) {
+			if (verify && !write) {
 				/* verify flash sectors */
 				retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
 			}
@@ -85,6 +85,8 @@ struct flash_sector {
  * may use the @c driver_priv member to store additional data on a
  * per-bank basis, if required.
  */
+struct flash_sector_cache;
+
 struct flash_bank {
 	char *name;
 
@@ -138,6 +140,12 @@ struct flash_bank {
 	/** Array of protection blocks, allocated and initialized by the flash driver */
 	struct flash_sector *prot_blocks;
 
+	/** Set while an erase started by flash_driver_s::erase_start runs. */
+	bool erase_pending;
+
+	/** Persistent sector state, see flash_sector_cache_enable() */
+	struct flash_sector_cache *sector_cache;
+
 	struct flash_bank *next; /**< The next flash bank on this chip */
 };
 
@@ -107,6 +107,33 @@ struct flash_driver {
 	int (*erase)(struct flash_bank *bank, unsigned int first,
 		unsigned int last);
 
+	/**
+	 * Optional non-blocking counterpart of flash_driver_s::erase.
+	 * Issues the first erase operation for the given sectors and
+	 * returns without waiting for it to complete, so the flash core
+	 * can keep erases on several banks in flight at the same time.
+	 * The remaining work is driven by flash_driver_s::erase_poll.
+	 *
+	 * @param bank The bank of flash to be erased.
+	 * @param first The number of the first sector to erase.
+	 * @param last The number of the last sector to erase.
+	 * @returns ERROR_OK if the erase was started; otherwise, an error code.
+	 */
+	int (*erase_start)(struct flash_bank *bank, unsigned int first,
+		unsigned int last);
+
+	/**
+	 * Advances an erase started by flash_driver_s::erase_start.
+	 * Must not block on the device; when the current operation has
+	 * completed, the driver issues the next one and returns.
+	 * The driver is responsible for its own timeouts.
+	 *
+	 * @param bank The bank being erased.
+	 * @returns ERROR_OK once all sectors are erased, ERROR_FLASH_BUSY
+	 * while the erase is still in progress; otherwise, an error code.
+	 */
+	int (*erase_poll)(struct flash_bank *bank);
+
 	/**
 	 * Bank/sector protection routine (target-specific).
 	 *
@@ -125,6 +125,12 @@ struct fespi_flash_bank {
 	bool probed;
 	target_addr_t ctrl_base;
 	const struct flash_device *dev;
+	unsigned int erase_next;	/* next sector to erase */
+	unsigned int erase_last;	/* last sector to erase */
+	unsigned int erase_count;	/* sectors covered by the operation in flight */
+	bool erase_chip;			/* operation in flight is a chip erase */
+	bool erase_chip_failed;		/* chip erase failed, erase sectors instead */
+	int64_t erase_t0;			/* start time of the operation in flight */
 };
 
 struct fespi_target {
@@ -319,11 +325,54 @@ static int fespi_wip(struct flash_bank *bank, int timeout)
 	return ERROR_FAIL;
 }
 
-static int fespi_erase_sector(struct flash_bank *bank, int sector)
+/* Reads the flash status register once, without waiting for WIP */
+static int fespi_read_status(struct flash_bank *bank, uint8_t *status)
+{
+	int retval;
+
+	fespi_set_dir(bank, FESPI_DIR_RX);
+
+	if (fespi_write_reg(bank, FESPI_REG_CSMODE, FESPI_CSMODE_HOLD) != ERROR_OK)
+		return ERROR_FAIL;
+
+	fespi_tx(bank, SPIFLASH_READ_STATUS);
+	retval = fespi_rx(bank, NULL);
+	if (retval == ERROR_OK) {
+		fespi_tx(bank, 0);
+		retval = fespi_rx(bank, status);
+	}
+	if (retval != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (fespi_write_reg(bank, FESPI_REG_CSMODE, FESPI_CSMODE_AUTO) != ERROR_OK)
+		return ERROR_FAIL;
+	fespi_set_dir(bank, FESPI_DIR_TX);
+	return ERROR_OK;
+}
+
+/* Issues the erase of the sectors starting at erase_next, using a block or
+ * chip erase where the planner allows it, without waiting for its end */
+static int fespi_erase_issue(struct flash_bank *bank)
 {
 	struct fespi_flash_bank *fespi_info = bank->driver_priv;
+	uint32_t units[SPIFLASH_ERASE_TYPES + 1];
+	uint8_t cmds[SPIFLASH_ERASE_TYPES + 1];
+	unsigned int num_units, count;
+	uint8_t cmd = fespi_info->dev->erase_cmd;
 	int retval;
 
+	num_units = spi_erase_units(fespi_info->dev, bank->size, units, cmds);
+	/* the chip erase is always the last unit */
+	if (fespi_info->erase_chip_failed && num_units > 0 && units[num_units - 1] == bank->size)
+		num_units--;
+
+	int unit = flash_erase_plan(bank, fespi_info->erase_next, fespi_info->erase_last,
+			units, num_units, &count);
+	fespi_info->erase_chip = unit >= 0 && units[unit] == bank->size &&
+		cmds[unit] == fespi_info->dev->chip_erase_cmd;
+	if (unit >= 0)
+		cmd = cmds[unit];
+
 	retval = fespi_tx(bank, SPIFLASH_WRITE_ENABLE);
 	if (retval != ERROR_OK)
 		return retval;
@@ -333,38 +382,38 @@ static int fespi_erase_sector(struct flash_bank *bank, int sector)
 
 	if (fespi_write_reg(bank, FESPI_REG_CSMODE, FESPI_CSMODE_HOLD) != ERROR_OK)
 		return ERROR_FAIL;
-	retval = fespi_tx(bank, fespi_info->dev->erase_cmd);
+	retval = fespi_tx(bank, cmd);
 	if (retval != ERROR_OK)
 		return retval;
-	sector = bank->sectors[sector].offset;
-	if (bank->size > 0x1000000) {
-		retval = fespi_tx(bank, sector >> 24);
+	if (!fespi_info->erase_chip) {
+		uint32_t offset = bank->sectors[fespi_info->erase_next].offset;
+		if (bank->size > 0x1000000) {
+			retval = fespi_tx(bank, offset >> 24);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		retval = fespi_tx(bank, offset >> 16);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = fespi_tx(bank, offset >> 8);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = fespi_tx(bank, offset);
 		if (retval != ERROR_OK)
 			return retval;
 	}
-	retval = fespi_tx(bank, sector >> 16);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = fespi_tx(bank, sector >> 8);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = fespi_tx(bank, sector);
-	if (retval != ERROR_OK)
-		return retval;
 	retval = fespi_txwm_wait(bank);
 	if (retval != ERROR_OK)
 		return retval;
 	if (fespi_write_reg(bank, FESPI_REG_CSMODE, FESPI_CSMODE_AUTO) != ERROR_OK)
 		return ERROR_FAIL;
 
-	retval = fespi_wip(bank, FESPI_MAX_TIMEOUT);
-	if (retval != ERROR_OK)
-		return retval;
-
+	fespi_info->erase_count = count;
+	fespi_info->erase_t0 = timeval_ms();
 	return ERROR_OK;
 }
 
-static int fespi_erase(struct flash_bank *bank, unsigned int first,
+static int fespi_erase_start(struct flash_bank *bank, unsigned int first,
 		unsigned int last)
 {
 	struct target *target = bank->target;
@@ -412,14 +461,52 @@ static int fespi_erase(struct flash_bank *bank, unsigned int first,
 
 	/* poll WIP */
 	retval = fespi_wip(bank, FESPI_PROBE_TIMEOUT);
+	if (retval == ERROR_OK) {
+		fespi_info->erase_next = first;
+		fespi_info->erase_last = last;
+		fespi_info->erase_chip_failed = false;
+		retval = fespi_erase_issue(bank);
+	}
+
+	/* Switch to HW mode before return to prompt */
+	if (retval != ERROR_OK && fespi_enable_hw_mode(bank) != ERROR_OK)
+		return ERROR_FAIL;
+	return retval;
+}
+
+static int fespi_erase_poll(struct flash_bank *bank)
+{
+	struct fespi_flash_bank *fespi_info = bank->driver_priv;
+	uint8_t status;
+	int retval;
+
+	retval = fespi_read_status(bank, &status);
 	if (retval != ERROR_OK)
 		goto done;
 
-	for (unsigned int sector = first; sector <= last; sector++) {
-		retval = fespi_erase_sector(bank, sector);
-		if (retval != ERROR_OK)
-			goto done;
-		keep_alive();
+	int64_t dt = timeval_ms() - fespi_info->erase_t0;
+	if (status & SPIFLASH_BSY_BIT) {
+		int64_t timeout = (int64_t)fespi_info->erase_count * FESPI_MAX_TIMEOUT;
+		if (dt <= timeout)
+			return ERROR_FLASH_BUSY;
+
+		LOG_ERROR("timeout");
+		retval = ERROR_FAIL;
+		if (fespi_info->erase_chip) {
+			LOG_WARNING("Bulk flash erase failed. Falling back to sector erase.");
+			fespi_info->erase_chip_failed = true;
+			retval = fespi_erase_issue(bank);
+			if (retval == ERROR_OK)
+				return ERROR_FLASH_BUSY;
+		}
+		goto done;
+	}
+
+	fespi_info->erase_next += fespi_info->erase_count;
+	if (fespi_info->erase_next <= fespi_info->erase_last) {
+		retval = fespi_erase_issue(bank);
+		if (retval == ERROR_OK)
+			return ERROR_FLASH_BUSY;
 	}
 
 	/* Switch to HW mode before return to prompt */
@@ -429,6 +516,22 @@ done:
 	return retval;
 }
 
+static int fespi_erase(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	int retval = fespi_erase_start(bank, first, last);
+
+	while (retval == ERROR_OK) {
+		retval = fespi_erase_poll(bank);
+		if (retval != ERROR_FLASH_BUSY)
+			break;
+		alive_sleep(1);
+		retval = ERROR_OK;
+	}
+
+	return retval;
+}
+
 static int fespi_protect(struct flash_bank *bank, int set,
 		unsigned int first, unsigned int last)
 {
@@ -856,6 +959,8 @@ const struct flash_driver fespi_flash = {
 	.name = "fespi",
 	.flash_bank_command = fespi_flash_bank_command,
 	.erase = fespi_erase,
+	.erase_start = fespi_erase_start,
+	.erase_poll = fespi_erase_poll,
 	.protect = fespi_protect,
 	.write = fespi_write,
 	.read = default_flash_read,
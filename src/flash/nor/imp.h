@@ -39,6 +39,10 @@ struct flash_bank *flash_bank_list(void);
 
 int flash_driver_erase(struct flash_bank *bank, unsigned int first,
 		unsigned int last);
+int flash_erase_plan(struct flash_bank *bank, unsigned int first,
+		unsigned int last, const uint32_t *units, unsigned int num_units,
+		unsigned int *count);
+int flash_erase_wait(void);
 int flash_driver_protect(struct flash_bank *bank, int set, unsigned int first,
 		unsigned int last);
 int flash_driver_write(struct flash_bank *bank,
@@ -48,7 +52,8 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/* write (optional verify) an image to flash memory of the given target;
+ * with both write and verify, each chunk is verified right after writing it */
 int flash_write_unlock_verify(struct target *target, struct image *image,
 		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
 
@@ -26,6 +26,16 @@
 
 #define JTAGSPI_MAX_TIMEOUT 3000
 
+/* longest single read command, keeps the scan length within int range */
+#define JTAGSPI_MAX_READ		(64 * 1024 * 1024)
+
+/* page program pipeline: page data and status polls queued between two
+ * JTAG flushes, and the bounds of the polls queued after each page */
+#define JTAGSPI_PIPE_BYTES		(64 * 1024)
+#define JTAGSPI_PIPE_SCANS		16384
+#define JTAGSPI_PIPE_POLLS_MIN	4
+#define JTAGSPI_PIPE_POLLS_MAX	2048
+
 
 struct jtagspi_flash_bank {
 	struct jtag_tap *tap;
@@ -35,6 +45,13 @@ struct jtagspi_flash_bank {
 	bool always_4byte;			/* use always 4-byte address except for basic read 0x03 */
 	uint32_t ir;
 	unsigned int addr_len;		/* address length in bytes */
+	unsigned int pipe_polls;	/* status polls queued after each page program */
+	unsigned int erase_next;	/* next sector to erase */
+	unsigned int erase_last;	/* last sector to erase */
+	unsigned int erase_count;	/* sectors covered by the operation in flight */
+	bool erase_chip;			/* operation in flight is a chip erase */
+	bool erase_chip_failed;		/* chip erase failed, erase sectors instead */
+	int64_t erase_t0;			/* start time of the operation in flight */
 };
 
 FLASH_BANK_COMMAND_HANDLER(jtagspi_flash_bank_command)
@@ -54,6 +71,7 @@ FLASH_BANK_COMMAND_HANDLER(jtagspi_flash_bank_command)
 
 	info->tap = NULL;
 	info->probed = false;
+	info->pipe_polls = JTAGSPI_PIPE_POLLS_MIN;
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[6], info->ir);
 
 	return ERROR_OK;
@@ -79,21 +97,38 @@ static void flip_u8(const uint8_t *in, uint8_t *out, unsigned int len)
 		out[i] = flip_u32(in[i], 8);
 }
 
-static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
-		uint8_t *write_buffer, unsigned int write_len, uint8_t *data_buffer, int data_len)
+/* Queue a command without flushing the JTAG queue. Read data is shifted into
+ * data_buffer bit reversed, the caller has to flip it after jtag_execute_queue().
+ * Write data is copied, the buffers may be reused as soon as this returns. */
+static int jtagspi_queue_cmd(struct flash_bank *bank, uint8_t cmd,
+		const uint8_t *write_buffer, unsigned int write_len, uint8_t *data_buffer, int data_len)
 {
 	assert(write_buffer || write_len == 0);
 	assert(data_buffer || data_len == 0);
 
+	struct jtagspi_flash_bank *info = bank->driver_priv;
 	struct scan_field fields[6];
-
-	LOG_DEBUG("cmd=0x%02x write_len=%d data_len=%d", cmd, write_len, data_len);
+	uint8_t *out_buffer = NULL;
 
 	/* negative data_len == read operation */
 	const bool is_read = (data_len < 0);
 	if (is_read)
 		data_len = -data_len;
 
+	/* the JTAG layer copies out_value when queuing, so flip into a
+	 * scratch buffer instead of modifying the caller's data */
+	unsigned int out_len = write_len + (is_read ? 0 : data_len);
+	if (out_len) {
+		out_buffer = malloc(out_len);
+		if (!out_buffer) {
+			LOG_ERROR("not enough memory");
+			return ERROR_FAIL;
+		}
+		flip_u8(write_buffer, out_buffer, write_len);
+		if (!is_read)
+			flip_u8(data_buffer, out_buffer + write_len, data_len);
+	}
+
 	int n = 0;
 	const uint8_t marker = 1;
 	fields[n].num_bits = 1;
@@ -118,9 +153,8 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 	n++;
 
 	if (write_len) {
-		flip_u8(write_buffer, write_buffer, write_len);
 		fields[n].num_bits = write_len * CHAR_BIT;
-		fields[n].out_value = write_buffer;
+		fields[n].out_value = out_buffer;
 		fields[n].in_value = NULL;
 		n++;
 	}
@@ -135,8 +169,7 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 			fields[n].out_value = NULL;
 			fields[n].in_value = data_buffer;
 		} else {
-			flip_u8(data_buffer, data_buffer, data_len);
-			fields[n].out_value = data_buffer;
+			fields[n].out_value = out_buffer + write_len;
 			fields[n].in_value = NULL;
 		}
 		fields[n].num_bits = data_len * CHAR_BIT;
@@ -145,12 +178,26 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 
 	jtagspi_set_ir(bank);
 	/* passing from an IR scan to SHIFT-DR clears BYPASS registers */
-	struct jtagspi_flash_bank *info = bank->driver_priv;
 	jtag_add_dr_scan(info->tap, n, fields, TAP_IDLE);
-	int retval = jtag_execute_queue();
 
-	if (is_read)
-		flip_u8(data_buffer, data_buffer, data_len);
+	free(out_buffer);
+	return ERROR_OK;
+}
+
+static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
+		const uint8_t *write_buffer, unsigned int write_len, uint8_t *data_buffer, int data_len)
+{
+	LOG_DEBUG("cmd=0x%02x write_len=%d data_len=%d", cmd, write_len, data_len);
+
+	int retval = jtagspi_queue_cmd(bank, cmd, write_buffer, write_len, data_buffer, data_len);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_execute_queue();
+
+	/* negative data_len == read operation */
+	if (data_len < 0)
+		flip_u8(data_buffer, data_buffer, -data_len);
 	return retval;
 }
 
@@ -516,28 +563,6 @@ static int jtagspi_write_enable(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
-static int jtagspi_bulk_erase(struct flash_bank *bank)
-{
-	struct jtagspi_flash_bank *info = bank->driver_priv;
-	int retval;
-	int64_t t0 = timeval_ms();
-
-	if (info->dev.chip_erase_cmd == 0x00)
-		return ERROR_FLASH_OPER_UNSUPPORTED;
-
-	retval = jtagspi_write_enable(bank);
-	if (retval != ERROR_OK)
-		return retval;
-
-	jtagspi_cmd(bank, info->dev.chip_erase_cmd, NULL, 0, NULL, 0);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = jtagspi_wait(bank, bank->num_sectors * JTAGSPI_MAX_TIMEOUT);
-	LOG_INFO("took %" PRId64 " ms", timeval_ms() - t0);
-	return retval;
-}
-
 static uint8_t *fill_addr(uint32_t addr, unsigned int addr_len, uint8_t *buffer)
 {
 	for (buffer += addr_len; addr_len > 0; --addr_len) {
@@ -548,12 +573,47 @@ static uint8_t *fill_addr(uint32_t addr, unsigned int addr_len, uint8_t *buffer)
 	return buffer;
 }
 
-static int jtagspi_sector_erase(struct flash_bank *bank, unsigned int sector)
+/* Issues the erase command for the sectors starting at info->erase_next,
+ * using a block or chip erase where the planner allows it, without waiting. */
+static int jtagspi_erase_issue(struct flash_bank *bank)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
-	int retval;
+	uint32_t units[SPIFLASH_ERASE_TYPES + 1];
+	uint8_t cmds[SPIFLASH_ERASE_TYPES + 1];
+	unsigned int num_units;
+	unsigned int count;
 	uint8_t addr[sizeof(uint32_t)];
-	int64_t t0 = timeval_ms();
+	uint8_t cmd = info->dev.erase_cmd;
+	int retval;
+
+	num_units = spi_erase_units(&info->dev, bank->size, units, cmds);
+	/* the chip erase is always the last unit */
+	if (info->erase_chip_failed && num_units > 0 && units[num_units - 1] == bank->size)
+		num_units--;
+
+	int unit = flash_erase_plan(bank, info->erase_next, info->erase_last,
+			units, num_units, &count);
+	if (unit >= 0 && units[unit] == bank->size && cmds[unit] == info->dev.chip_erase_cmd) {
+		LOG_DEBUG("Trying bulk erase.");
+		retval = jtagspi_write_enable(bank);
+		if (retval == ERROR_OK)
+			retval = jtagspi_cmd(bank, info->dev.chip_erase_cmd, NULL, 0, NULL, 0);
+		if (retval == ERROR_OK) {
+			info->erase_chip = true;
+			info->erase_count = count;
+			info->erase_t0 = timeval_ms();
+			return ERROR_OK;
+		}
+		LOG_WARNING("Bulk flash erase failed. Falling back to sector erase.");
+		info->erase_chip_failed = true;
+		unit = -1;
+		count = 1;
+	}
+
+	if (unit >= 0)
+		cmd = cmds[unit];
+	else if (info->dev.erase_cmd == 0x00)
+		return ERROR_FLASH_OPER_UNSUPPORTED;
 
 	retval = jtagspi_write_enable(bank);
 	if (retval != ERROR_OK)
@@ -562,21 +622,22 @@ static int jtagspi_sector_erase(struct flash_bank *bank, unsigned int sector)
 	/* ATXP032/064/128 use always 4-byte addresses except for 0x03 read */
 	unsigned int addr_len = info->always_4byte ? 4 : info->addr_len;
 
-	retval = jtagspi_cmd(bank, info->dev.erase_cmd, fill_addr(bank->sectors[sector].offset, addr_len, addr),
+	retval = jtagspi_cmd(bank, cmd,
+			fill_addr(bank->sectors[info->erase_next].offset, addr_len, addr),
 			addr_len, NULL, 0);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
-	LOG_INFO("sector %u took %" PRId64 " ms", sector, timeval_ms() - t0);
-	return retval;
+	info->erase_chip = false;
+	info->erase_count = count;
+	info->erase_t0 = timeval_ms();
+	return ERROR_OK;
 }
 
-static int jtagspi_erase(struct flash_bank *bank, unsigned int first,
+static int jtagspi_erase_start(struct flash_bank *bank, unsigned int first,
 		unsigned int last)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
-	int retval = ERROR_OK;
 
 	LOG_DEBUG("erase from sector %u to sector %u", first, last);
 
@@ -597,28 +658,68 @@ static int jtagspi_erase(struct flash_bank *bank, unsigned int first,
 		}
 	}
 
-	if (first == 0 && last == (bank->num_sectors - 1) &&
-		info->dev.chip_erase_cmd != 0x00 &&
-		info->dev.chip_erase_cmd != info->dev.erase_cmd) {
-		LOG_DEBUG("Trying bulk erase.");
-		retval = jtagspi_bulk_erase(bank);
-		if (retval == ERROR_OK)
-			return retval;
-		else
-			LOG_WARNING("Bulk flash erase failed. Falling back to sector erase.");
+	info->erase_next = first;
+	info->erase_last = last;
+	info->erase_chip_failed = false;
+	return jtagspi_erase_issue(bank);
+}
+
+static int jtagspi_erase_poll(struct flash_bank *bank)
+{
+	struct jtagspi_flash_bank *info = bank->driver_priv;
+	uint32_t status = (uint32_t)-1;
+	int retval;
+
+	retval = jtagspi_read_status(bank, &status);
+	if (retval != ERROR_OK)
+		return retval;
+
+	int64_t dt = timeval_ms() - info->erase_t0;
+	if (status & SPIFLASH_BSY_BIT) {
+		if (dt <= (int64_t)info->erase_count * JTAGSPI_MAX_TIMEOUT)
+			return ERROR_FLASH_BUSY;
+
+		LOG_ERROR("timeout, device still busy");
+		if (!info->erase_chip)
+			return ERROR_FAIL;
+
+		LOG_WARNING("Bulk flash erase failed. Falling back to sector erase.");
+		info->erase_chip_failed = true;
+		retval = jtagspi_erase_issue(bank);
+		return (retval == ERROR_OK) ? ERROR_FLASH_BUSY : retval;
 	}
 
-	if (info->dev.erase_cmd == 0x00)
-		return ERROR_FLASH_OPER_UNSUPPORTED;
+	if (info->erase_chip)
+		LOG_INFO("took %" PRId64 " ms", dt);
+	else if (info->erase_count > 1)
+		LOG_INFO("sectors %u to %u took %" PRId64 " ms", info->erase_next,
+			info->erase_next + info->erase_count - 1, dt);
+	else
+		LOG_INFO("sector %u took %" PRId64 " ms", info->erase_next, dt);
 
-	for (unsigned int sector = first; sector <= last; sector++) {
-		retval = jtagspi_sector_erase(bank, sector);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Sector erase failed.");
+	info->erase_next += info->erase_count;
+	if (info->erase_next > info->erase_last)
+		return ERROR_OK;
+
+	retval = jtagspi_erase_issue(bank);
+	return (retval == ERROR_OK) ? ERROR_FLASH_BUSY : retval;
+}
+
+static int jtagspi_erase(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	int retval = jtagspi_erase_start(bank, first, last);
+
+	while (retval == ERROR_OK) {
+		retval = jtagspi_erase_poll(bank);
+		if (retval != ERROR_FLASH_BUSY)
 			break;
-		}
+		alive_sleep(1);
+		retval = ERROR_OK;
 	}
 
+	if (retval != ERROR_OK)
+		LOG_ERROR("Sector erase failed.");
 	return retval;
 }
 
@@ -633,7 +734,7 @@ static int jtagspi_protect(struct flash_bank *bank, int set, unsigned int first,
 static int jtagspi_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
-	uint32_t pagesize, currsize;
+	uint32_t currsize;
 	uint8_t addr[sizeof(uint32_t)];
 	int retval;
 
@@ -642,28 +743,21 @@ static int jtagspi_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offse
 		return ERROR_FLASH_BANK_NOT_PROBED;
 	}
 
-	/* if no sectorsize, use reasonable default */
-	pagesize = info->dev.sectorsize ? info->dev.sectorsize : info->dev.pagesize;
-	if (pagesize == 0)
-		pagesize = (info->dev.size_in_bytes <= SPIFLASH_DEF_PAGESIZE) ?
-			info->dev.size_in_bytes : SPIFLASH_DEF_PAGESIZE;
-
 	/* ATXP032/064/128 use always 4-byte addresses except for 0x03 read */
 	unsigned int addr_len = ((info->dev.read_cmd != 0x03) && info->always_4byte) ? 4 : info->addr_len;
 
+	/* reads are not bound to pages or sectors, a single command streams
+	 * the whole range */
 	while (count > 0) {
-		/* length up to end of current page */
-		currsize = ((offset + pagesize) & ~(pagesize - 1)) - offset;
-		/* but no more than remaining size */
-		currsize = (count < currsize) ? count : currsize;
+		currsize = MIN(count, JTAGSPI_MAX_READ);
 
 		retval = jtagspi_cmd(bank, info->dev.read_cmd, fill_addr(offset, addr_len, addr),
-			addr_len, buffer, -currsize);
+			addr_len, buffer, -(int)currsize);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("page read error");
+			LOG_ERROR("read error");
 			return retval;
 		}
-		LOG_DEBUG("read page at 0x%08" PRIx32, offset);
+		LOG_DEBUG("read 0x%08" PRIx32 " bytes at 0x%08" PRIx32, currsize, offset);
 		offset += currsize;
 		buffer += currsize;
 		count -= currsize;
@@ -685,17 +779,35 @@ static int jtagspi_page_write(struct flash_bank *bank, const uint8_t *buffer, ui
 	unsigned int addr_len = ((info->dev.read_cmd != 0x03) && info->always_4byte) ? 4 : info->addr_len;
 
 	retval = jtagspi_cmd(bank, info->dev.pprog_cmd, fill_addr(offset, addr_len, addr),
-		addr_len, (uint8_t *) buffer, count);
+		addr_len, (uint8_t *)buffer, count);
 	if (retval != ERROR_OK)
 		return retval;
 	return jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
 }
 
+/* A write enable sent while the previous page program is still running is
+ * ignored by the flash, and so is the page program following it. The status
+ * read queued right after the write enable tells whether it was accepted. */
+static bool jtagspi_page_accepted(uint8_t status)
+{
+	return !(status & SPIFLASH_BSY_BIT) && (status & SPIFLASH_WE_BIT);
+}
+
+/* Pages are programmed without a host round trip in between: for each page
+ * the queue holds write enable, a status read, page program and a bounded
+ * number of status polls, and it is flushed once per block of pages. Pages
+ * the flash ignored because the polls of the previous page ran out before
+ * it finished are programmed again one by one. The number of polls adapts
+ * to the page program time observed at the current TCK rate, and blocks
+ * start small and grow while no page runs out of polls. */
 static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
 	uint32_t pagesize, currsize;
-	int retval;
+	uint8_t addr[sizeof(uint32_t)];
+	unsigned int block_pages = 1;
+	bool busy = false;
+	int retval = ERROR_OK;
 
 	if (!(info->probed)) {
 		LOG_ERROR("Flash bank not probed.");
@@ -705,23 +817,136 @@ static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_
 	/* if no write pagesize, use reasonable default */
 	pagesize = info->dev.pagesize ? info->dev.pagesize : SPIFLASH_DEF_PAGESIZE;
 
+	/* ATXP032/064/128 use always 4-byte addresses except for 0x03 read */
+	unsigned int addr_len = ((info->dev.read_cmd != 0x03) && info->always_4byte) ? 4 : info->addr_len;
+
+	uint8_t *status = malloc(JTAGSPI_PIPE_SCANS);
+	if (!status) {
+		LOG_ERROR("not enough memory");
+		return ERROR_FAIL;
+	}
+
 	while (count > 0) {
-		/* length up to end of current page */
-		currsize = ((offset + pagesize) & ~(pagesize - 1)) - offset;
-		/* but no more than remaining size */
-		currsize = (count < currsize) ? count : currsize;
+		/* the first write enable of a block must not hit a busy device */
+		if (busy) {
+			retval = jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
+			if (retval != ERROR_OK)
+				break;
+			busy = false;
+		}
 
-		retval = jtagspi_page_write(bank, buffer, offset, currsize);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("page write error");
-			return retval;
+		unsigned int stride = info->pipe_polls + 1;
+		unsigned int max_pages = MIN(JTAGSPI_PIPE_BYTES / pagesize, JTAGSPI_PIPE_SCANS / stride);
+		max_pages = MAX(MIN(max_pages, block_pages), 1u);
+
+		/* queue a block of pages */
+		unsigned int pages = 0;
+		uint32_t page_offset = offset, remaining = count;
+		const uint8_t *page_buffer = buffer;
+		while (pages < max_pages && remaining > 0) {
+			/* length up to end of current page */
+			currsize = ((page_offset + pagesize) & ~(pagesize - 1)) - page_offset;
+			/* but no more than remaining size */
+			currsize = (remaining < currsize) ? remaining : currsize;
+
+			uint8_t *page_status = &status[pages * stride];
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, 0, NULL, 0);
+			if (retval == ERROR_OK)
+				retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, 0, &page_status[0], -1);
+			if (retval == ERROR_OK)
+				retval = jtagspi_queue_cmd(bank, info->dev.pprog_cmd,
+					fill_addr(page_offset, addr_len, addr), addr_len, (uint8_t *)page_buffer, currsize);
+			for (unsigned int i = 1; i < stride && retval == ERROR_OK; i++)
+				retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, 0, &page_status[i], -1);
+			if (retval != ERROR_OK)
+				break;
+
+			pages++;
+			page_offset += currsize;
+			page_buffer += currsize;
+			remaining -= currsize;
 		}
-		LOG_DEBUG("wrote page at 0x%08" PRIx32, offset);
-		offset += currsize;
-		buffer += currsize;
-		count -= currsize;
+		if (retval == ERROR_OK)
+			retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			break;
+		flip_u8(status, status, pages * stride);
+
+		/* a block always starts on an idle device */
+		if (!jtagspi_page_accepted(status[0])) {
+			LOG_ERROR("Cannot enable write to flash. Status=0x%02" PRIx8, status[0]);
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		/* find out how long the accepted pages took */
+		unsigned int ignored = 0, polls_needed = 0;
+		bool overrun = false;
+		for (unsigned int page = 0; page < pages; page++) {
+			const uint8_t *page_status = &status[page * stride];
+
+			if (!jtagspi_page_accepted(page_status[0])) {
+				ignored++;
+				continue;
+			}
+
+			unsigned int i = 1;
+			while (i < stride && (page_status[i] & SPIFLASH_BSY_BIT))
+				i++;
+			busy = (i == stride);
+			if (busy)
+				overrun = true;
+			else
+				polls_needed = MAX(polls_needed, i);
+		}
+
+		LOG_DEBUG("wrote %u pages, %u ignored, %u polls per page, %u needed%s", pages, ignored,
+			info->pipe_polls, polls_needed, overrun ? " (overrun)" : "");
+		if (overrun) {
+			info->pipe_polls = MIN(info->pipe_polls * 2, JTAGSPI_PIPE_POLLS_MAX);
+			block_pages = 1;
+		} else {
+			if (pages == max_pages)
+				block_pages = 2 * max_pages;
+			if (polls_needed * 4 <= info->pipe_polls)
+				info->pipe_polls = MAX(info->pipe_polls / 2, JTAGSPI_PIPE_POLLS_MIN);
+		}
+
+		/* program the ignored pages again, waiting for each */
+		for (unsigned int page = 0; page < pages; page++) {
+			currsize = ((offset + pagesize) & ~(pagesize - 1)) - offset;
+			currsize = (count < currsize) ? count : currsize;
+
+			if (ignored && !jtagspi_page_accepted(status[page * stride])) {
+				if (busy) {
+					retval = jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
+					if (retval != ERROR_OK)
+						break;
+					busy = false;
+				}
+				retval = jtagspi_page_write(bank, buffer, offset, currsize);
+				if (retval != ERROR_OK)
+					break;
+				LOG_DEBUG("wrote page at 0x%08" PRIx32, offset);
+			}
+
+			offset += currsize;
+			buffer += currsize;
+			count -= currsize;
+		}
+		if (retval != ERROR_OK)
+			break;
+
+		keep_alive();
 	}
-	return ERROR_OK;
+
+	if (retval == ERROR_OK && busy)
+		retval = jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
+	if (retval != ERROR_OK)
+		LOG_ERROR("page write error");
+
+	free(status);
+	return retval;
 }
 
 static int jtagspi_info(struct flash_bank *bank, struct command_invocation *cmd)
@@ -794,6 +1019,8 @@ const struct flash_driver jtagspi_flash = {
 	.commands = jtagspi_command_handlers,
 	.flash_bank_command = jtagspi_flash_bank_command,
 	.erase = jtagspi_erase,
+	.erase_start = jtagspi_erase_start,
+	.erase_poll = jtagspi_erase_poll,
 	.protect = jtagspi_protect,
 	.write = jtagspi_write,
 	.read = jtagspi_read,
@@ -22,6 +22,7 @@
 
 #include "imp.h"
 #include "spi.h"
+#include "spi_loader.h"
 #include <jtag/jtag.h>
 #include <helper/time_support.h>
 #include <target/algorithm.h>
@@ -583,11 +584,7 @@ static int lpcspifi_write(struct flash_bank *bank, const uint8_t *buffer,
 {
 	struct target *target = bank->target;
 	struct lpcspifi_flash_bank *lpcspifi_info = bank->driver_priv;
-	uint32_t page_size, fifo_size;
-	struct working_area *fifo;
-	struct reg_param reg_params[5];
-	struct armv7m_algorithm armv7m_info;
-	struct working_area *write_algorithm;
+	uint32_t page_size;
 	int retval = ERROR_OK;
 
 	LOG_DEBUG("offset=0x%08" PRIx32 " count=0x%08" PRIx32,
@@ -680,88 +677,25 @@ static int lpcspifi_write(struct flash_bank *bank, const uint8_t *buffer,
 		0x00, 0xbe, 0xff, 0xff
 	};
 
-	if (target_alloc_working_area(target, sizeof(lpcspifi_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	static const struct spi_loader lpcspifi_write_loader = {
+		.code = lpcspifi_flash_write_code,
+		.code_size = sizeof(lpcspifi_flash_write_code),
+		.program_entry = 0,
+		.read_entry = -1,
+		.fifo_max = 0x2000,		/* Beyond this point, we start to get diminishing returns */
+	};
+
+	/* SSP base and commands are built into the loader */
+	retval = spi_loader_write(bank, &lpcspifi_write_loader, 0, 0, page_size,
+			buffer, offset, count);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
 		LOG_ERROR("Insufficient working area. You must configure"
 			" a working area > %zdB in order to write to SPIFI flash.",
 			sizeof(lpcspifi_flash_write_code));
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(lpcspifi_flash_write_code),
-			lpcspifi_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
-		return retval;
-	}
-
-	/* FIFO allocation */
-	fifo_size = target_get_working_area_avail(target);
-
-	if (fifo_size == 0) {
-		/* if we already allocated the writing code but failed to get fifo
-		 * space, free the algorithm */
-		target_free_working_area(target, write_algorithm);
-
-		LOG_ERROR("Insufficient working area. Please allocate at least"
-			" %zdB of working area to enable flash writes.",
-			sizeof(lpcspifi_flash_write_code) + 1
-		);
-
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	} else if (fifo_size < page_size)
-		LOG_WARNING("Working area size is limited; flash writes may be"
-			" slow. Increase working area size to at least %zdB"
-			" to reduce write times.",
-			(size_t)(sizeof(lpcspifi_flash_write_code) + page_size)
-		);
-	else if (fifo_size > 0x2000) /* Beyond this point, we start to get diminishing returns */
-		fifo_size = 0x2000;
-
-	if (target_alloc_working_area(target, fifo_size, &fifo) != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-	armv7m_info.core_mode = ARM_MODE_THREAD;
-
-	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);		/* buffer start, status (out) */
-	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);		/* buffer end */
-	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);		/* target address */
-	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);		/* count (halfword-16bit) */
-	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);		/* page size */
-
-	buf_set_u32(reg_params[0].value, 0, 32, fifo->address);
-	buf_set_u32(reg_params[1].value, 0, 32, fifo->address + fifo->size);
-	buf_set_u32(reg_params[2].value, 0, 32, offset);
-	buf_set_u32(reg_params[3].value, 0, 32, count);
-	buf_set_u32(reg_params[4].value, 0, 32, page_size);
-
-	retval = target_run_flash_async_algorithm(target, buffer, count, 1,
-			0, NULL,
-			5, reg_params,
-			fifo->address, fifo->size,
-			write_algorithm->address, 0,
-			&armv7m_info
-	);
-
-	if (retval != ERROR_OK)
-		LOG_ERROR("Error executing flash write algorithm");
-
-	target_free_working_area(target, fifo);
-	target_free_working_area(target, write_algorithm);
-
-	destroy_reg_param(&reg_params[0]);
-	destroy_reg_param(&reg_params[1]);
-	destroy_reg_param(&reg_params[2]);
-	destroy_reg_param(&reg_params[3]);
-	destroy_reg_param(&reg_params[4]);
 
 	/* Switch to HW mode before return to prompt */
-	retval = lpcspifi_set_hw_mode(bank);
-	return retval;
+	int retval2 = lpcspifi_set_hw_mode(bank);
+	return (retval != ERROR_OK) ? retval : retval2;
 }
 
 /* Return ID of flash device */
@@ -29,9 +29,8 @@
 
 #include "imp.h"
 #include "spi.h"
+#include "spi_loader.h"
 #include <helper/binarybuffer.h>
-#include <target/algorithm.h>
-#include <target/armv7m.h>
 
 #define QSPI_R_EN (0x0)
 #define QSPI_W_EN (0x1)
@@ -586,17 +585,26 @@ static int mrvlqspi_flash_erase(struct flash_bank *bank, unsigned int first,
 	return retval;
 }
 
+/* See contrib/loaders/flash/spi/mrvlqspi.S for src */
+static const uint8_t mrvlqspi_loader_code[] = {
+#include "../../../contrib/loaders/flash/spi/mrvlqspi.inc"
+};
+
+static const struct spi_loader mrvlqspi_loader = {
+	.code = mrvlqspi_loader_code,
+	.code_size = sizeof(mrvlqspi_loader_code),
+	.program_entry = 0,
+	.read_entry = 4,
+	.reports_remaining = true,
+};
+
 static int mrvlqspi_flash_write(struct flash_bank *bank, const uint8_t *buffer,
 	uint32_t offset, uint32_t count)
 {
 	struct target *target = bank->target;
 	struct mrvlqspi_flash_bank *mrvlqspi_info = bank->driver_priv;
-	int retval = ERROR_OK;
-	uint32_t page_size, fifo_size;
-	struct working_area *fifo;
-	struct reg_param reg_params[6];
-	struct armv7m_algorithm armv7m_info;
-	struct working_area *write_algorithm;
+	int retval;
+	uint32_t page_size;
 
 	LOG_DEBUG("offset=0x%08" PRIx32 " count=0x%08" PRIx32,
 		offset, count);
@@ -628,135 +636,12 @@ static int mrvlqspi_flash_write(struct flash_bank *bank, const uint8_t *buffer,
 	page_size = mrvlqspi_info->dev->pagesize ?
 		mrvlqspi_info->dev->pagesize : SPIFLASH_DEF_PAGESIZE;
 
-	/* See contrib/loaders/flash/mrvlqspi.S for src */
-	static const uint8_t mrvlqspi_flash_write_code[] = {
-		0x4f, 0xf0, 0x00, 0x0a, 0xa2, 0x44, 0x92, 0x45,
-		0x7f, 0xf6, 0xfc, 0xaf, 0x00, 0xf0, 0x6b, 0xf8,
-		0x5f, 0xf0, 0x01, 0x08, 0xc5, 0xf8, 0x1c, 0x80,
-		0x5f, 0xf0, 0x06, 0x08, 0xc5, 0xf8, 0x10, 0x80,
-		0x5f, 0xf0, 0x01, 0x09, 0x00, 0xf0, 0x6b, 0xf8,
-		0x00, 0xf0, 0x7d, 0xf8, 0x5f, 0xf0, 0x31, 0x08,
-		0xc5, 0xf8, 0x1c, 0x80, 0x90, 0x46, 0xc5, 0xf8,
-		0x14, 0x80, 0x5f, 0xf0, 0x02, 0x08, 0xc5, 0xf8,
-		0x10, 0x80, 0x5f, 0xf0, 0x01, 0x09, 0x00, 0xf0,
-		0x5a, 0xf8, 0xd0, 0xf8, 0x00, 0x80, 0xb8, 0xf1,
-		0x00, 0x0f, 0x00, 0xf0, 0x8b, 0x80, 0x47, 0x68,
-		0x47, 0x45, 0x3f, 0xf4, 0xf6, 0xaf, 0x17, 0xf8,
-		0x01, 0x9b, 0x00, 0xf0, 0x30, 0xf8, 0x8f, 0x42,
-		0x28, 0xbf, 0x00, 0xf1, 0x08, 0x07, 0x47, 0x60,
-		0x01, 0x3b, 0x00, 0x2b, 0x00, 0xf0, 0x05, 0x80,
-		0x02, 0xf1, 0x01, 0x02, 0x92, 0x45, 0x7f, 0xf4,
-		0xe4, 0xaf, 0x00, 0xf0, 0x50, 0xf8, 0xa2, 0x44,
-		0x00, 0xf0, 0x2d, 0xf8, 0x5f, 0xf0, 0x01, 0x08,
-		0xc5, 0xf8, 0x1c, 0x80, 0x5f, 0xf0, 0x00, 0x08,
-		0xc5, 0xf8, 0x20, 0x80, 0x5f, 0xf0, 0x05, 0x08,
-		0xc5, 0xf8, 0x10, 0x80, 0x5f, 0xf0, 0x00, 0x09,
-		0x00, 0xf0, 0x29, 0xf8, 0x00, 0xf0, 0x13, 0xf8,
-		0x09, 0xf0, 0x01, 0x09, 0xb9, 0xf1, 0x00, 0x0f,
-		0xf8, 0xd1, 0x00, 0xf0, 0x34, 0xf8, 0x00, 0x2b,
-		0xa4, 0xd1, 0x00, 0xf0, 0x53, 0xb8, 0xd5, 0xf8,
-		0x00, 0x80, 0x5f, 0xea, 0x08, 0x68, 0xfa, 0xd4,
-		0xc5, 0xf8, 0x08, 0x90, 0x70, 0x47, 0xd5, 0xf8,
-		0x00, 0x80, 0x5f, 0xea, 0xc8, 0x68, 0xfa, 0xd4,
-		0xd5, 0xf8, 0x0c, 0x90, 0x70, 0x47, 0xd5, 0xf8,
-		0x04, 0x80, 0x48, 0xf4, 0x00, 0x78, 0xc5, 0xf8,
-		0x04, 0x80, 0xd5, 0xf8, 0x04, 0x80, 0x5f, 0xea,
-		0x88, 0x58, 0xfa, 0xd4, 0x70, 0x47, 0xd5, 0xf8,
-		0x00, 0x80, 0x48, 0xf0, 0x01, 0x08, 0xc5, 0xf8,
-		0x00, 0x80, 0xd5, 0xf8, 0x00, 0x80, 0x5f, 0xea,
-		0x88, 0x78, 0xfa, 0xd5, 0xd5, 0xf8, 0x04, 0x80,
-		0x69, 0xf3, 0x4d, 0x38, 0x48, 0xf4, 0x00, 0x48,
-		0xc5, 0xf8, 0x04, 0x80, 0x70, 0x47, 0xd5, 0xf8,
-		0x00, 0x80, 0x5f, 0xea, 0x88, 0x78, 0xfa, 0xd5,
-		0xd5, 0xf8, 0x00, 0x80, 0x5f, 0xea, 0x48, 0x68,
-		0xfa, 0xd5, 0xd5, 0xf8, 0x04, 0x80, 0x48, 0xf4,
-		0x80, 0x48, 0xc5, 0xf8, 0x04, 0x80, 0xd5, 0xf8,
-		0x04, 0x80, 0x5f, 0xea, 0x08, 0x48, 0xfa, 0xd4,
-		0xd5, 0xf8, 0x00, 0x80, 0x28, 0xf0, 0x01, 0x08,
-		0xc5, 0xf8, 0x00, 0x80, 0xd5, 0xf8, 0x00, 0x80,
-		0x5f, 0xea, 0x88, 0x78, 0xfa, 0xd5, 0x70, 0x47,
-		0x00, 0x20, 0x50, 0x60, 0x30, 0x46, 0x00, 0xbe
-	};
-
-	if (target_alloc_working_area(target, sizeof(mrvlqspi_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = spi_loader_write(bank, &mrvlqspi_loader, mrvlqspi_info->reg_base,
+			mrvlqspi_info->dev->pprog_cmd, page_size, buffer, offset, count);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
 		LOG_ERROR("Insufficient working area. You must configure"
 			" a working area > %zdB in order to write to SPIFI flash.",
-			sizeof(mrvlqspi_flash_write_code));
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(mrvlqspi_flash_write_code),
-			mrvlqspi_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
-		return retval;
-	}
-
-	/* FIFO allocation */
-	fifo_size = target_get_working_area_avail(target);
-
-	if (fifo_size == 0) {
-		/* if we already allocated the writing code but failed to get fifo
-		 * space, free the algorithm */
-		target_free_working_area(target, write_algorithm);
-
-		LOG_ERROR("Insufficient working area. Please allocate at least"
-			" %zdB of working area to enable flash writes.",
-			sizeof(mrvlqspi_flash_write_code) + 1
-		);
-
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	} else if (fifo_size < page_size)
-		LOG_WARNING("Working area size is limited; flash writes may be"
-			" slow. Increase working area size to at least %zdB"
-			" to reduce write times.",
-			(size_t)(sizeof(mrvlqspi_flash_write_code) + page_size)
-		);
-
-	if (target_alloc_working_area(target, fifo_size, &fifo) != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-	armv7m_info.core_mode = ARM_MODE_THREAD;
-
-	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* buffer start, status (out) */
-	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* buffer end */
-	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* target address */
-	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* count (halfword-16bit) */
-	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);	/* page size */
-	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);	/* qspi base address */
-
-	buf_set_u32(reg_params[0].value, 0, 32, fifo->address);
-	buf_set_u32(reg_params[1].value, 0, 32, fifo->address + fifo->size);
-	buf_set_u32(reg_params[2].value, 0, 32, offset);
-	buf_set_u32(reg_params[3].value, 0, 32, count);
-	buf_set_u32(reg_params[4].value, 0, 32, page_size);
-	buf_set_u32(reg_params[5].value, 0, 32, (uint32_t) mrvlqspi_info->reg_base);
-
-	retval = target_run_flash_async_algorithm(target, buffer, count, 1,
-			0, NULL,
-			6, reg_params,
-			fifo->address, fifo->size,
-			write_algorithm->address, 0,
-			&armv7m_info
-	);
-
-	if (retval != ERROR_OK)
-		LOG_ERROR("Error executing flash write algorithm");
-
-	target_free_working_area(target, fifo);
-	target_free_working_area(target, write_algorithm);
-
-	destroy_reg_param(&reg_params[0]);
-	destroy_reg_param(&reg_params[1]);
-	destroy_reg_param(&reg_params[2]);
-	destroy_reg_param(&reg_params[3]);
-	destroy_reg_param(&reg_params[4]);
-	destroy_reg_param(&reg_params[5]);
+			sizeof(mrvlqspi_loader_code));
 
 	return retval;
 }
@@ -779,6 +664,12 @@ static int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
 		return ERROR_FLASH_BANK_NOT_PROBED;
 	}
 
+	retval = spi_loader_read(bank, &mrvlqspi_loader, mrvlqspi_info->reg_base,
+			SPIFLASH_READ, buffer, offset, count);
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return retval;
+
+	/* no working area, read byte by byte from the host */
 	/* Flush read/write fifos */
 	retval = mrvlqspi_fifo_flush(bank, FIFO_FLUSH_TIMEOUT);
 	if (retval != ERROR_OK)
@@ -0,0 +1,428 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "imp.h"
+#include "sector_cache.h"
+#include <helper/command.h>
+#include <target/image.h>
+
+#define SECTOR_CACHE_MAGIC	"openocd-sector-cache 1"
+
+enum sector_cache_state {
+	SECTOR_UNKNOWN = 0,
+	SECTOR_ERASED,
+	SECTOR_PROGRAMMED,
+};
+
+static const char * const sector_cache_state_names[] = {
+	[SECTOR_UNKNOWN] = "unknown",
+	[SECTOR_ERASED] = "erased",
+	[SECTOR_PROGRAMMED] = "programmed",
+};
+
+struct sector_cache_entry {
+	enum sector_cache_state state;
+	bool crc_valid;
+	uint32_t crc;
+};
+
+struct flash_sector_cache {
+	char *filename;
+	char *unique_id;
+	uint64_t key;
+
+	/* loaded lazily, the layout is only known after probe */
+	unsigned int num_sectors;
+	struct sector_cache_entry *entries;
+
+	/* erase in progress */
+	unsigned int erase_first;
+	unsigned int erase_last;
+};
+
+static uint64_t sector_cache_hash(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+/* Key of the cache: driver, unique ID and sector layout (FNV-1a) */
+static uint64_t sector_cache_key(struct flash_bank *bank, const char *unique_id)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	uint64_t base = bank->base;
+
+	hash = sector_cache_hash(hash, bank->driver->name, strlen(bank->driver->name) + 1);
+	hash = sector_cache_hash(hash, unique_id, strlen(unique_id) + 1);
+	hash = sector_cache_hash(hash, &base, sizeof(base));
+	hash = sector_cache_hash(hash, &bank->size, sizeof(bank->size));
+	hash = sector_cache_hash(hash, &bank->erased_value, sizeof(bank->erased_value));
+	for (unsigned int i = 0; i < bank->num_sectors; i++) {
+		hash = sector_cache_hash(hash, &bank->sectors[i].offset, sizeof(uint32_t));
+		hash = sector_cache_hash(hash, &bank->sectors[i].size, sizeof(uint32_t));
+	}
+	return hash;
+}
+
+static void sector_cache_save(struct flash_sector_cache *cache)
+{
+	FILE *fd = fopen(cache->filename, "w");
+	if (!fd) {
+		LOG_ERROR("open(\"%s\"): %s", cache->filename, strerror(errno));
+		return;
+	}
+
+	fprintf(fd, SECTOR_CACHE_MAGIC "\nkey %016" PRIx64 "\n", cache->key);
+	for (unsigned int i = 0; i < cache->num_sectors; i++) {
+		struct sector_cache_entry *e = &cache->entries[i];
+
+		if (e->state == SECTOR_UNKNOWN)
+			continue;
+		if (e->crc_valid)
+			fprintf(fd, "%u %s %08" PRIx32 "\n", i, sector_cache_state_names[e->state], e->crc);
+		else
+			fprintf(fd, "%u %s -\n", i, sector_cache_state_names[e->state]);
+	}
+
+	if (fclose(fd) != 0)
+		LOG_ERROR("fail to write sector cache \"%s\"", cache->filename);
+}
+
+static void sector_cache_load(struct flash_sector_cache *cache)
+{
+	char line[128];
+	uint64_t key;
+
+	FILE *fd = fopen(cache->filename, "r");
+	if (!fd)
+		return;
+
+	if (!fgets(line, sizeof(line), fd) || strncmp(line, SECTOR_CACHE_MAGIC, strlen(SECTOR_CACHE_MAGIC))
+			|| !fgets(line, sizeof(line), fd) || sscanf(line, "key %" SCNx64, &key) != 1) {
+		LOG_WARNING("sector cache \"%s\" is corrupt, ignoring it", cache->filename);
+		fclose(fd);
+		return;
+	}
+
+	if (key != cache->key) {
+		LOG_INFO("sector cache \"%s\" is for another device or layout, starting empty",
+			cache->filename);
+		fclose(fd);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fd)) {
+		unsigned int sector;
+		char state[16], crc[16];
+
+		if (sscanf(line, "%u %15s %15s", &sector, state, crc) != 3 || sector >= cache->num_sectors)
+			continue;
+
+		struct sector_cache_entry *e = &cache->entries[sector];
+		if (!strcmp(state, sector_cache_state_names[SECTOR_ERASED]))
+			e->state = SECTOR_ERASED;
+		else if (!strcmp(state, sector_cache_state_names[SECTOR_PROGRAMMED]))
+			e->state = SECTOR_PROGRAMMED;
+		else
+			continue;
+		e->crc_valid = sscanf(crc, "%" SCNx32, &e->crc) == 1;
+	}
+	fclose(fd);
+}
+
+/* Returns the cache of a probed bank, loading it on first use */
+static struct flash_sector_cache *sector_cache_get(struct flash_bank *bank)
+{
+	struct flash_sector_cache *cache = bank->sector_cache;
+
+	if (!cache || bank->num_sectors == 0 || !bank->sectors)
+		return NULL;
+
+	uint64_t key = sector_cache_key(bank, cache->unique_id);
+	if (cache->entries && cache->num_sectors == bank->num_sectors && cache->key == key)
+		return cache;
+
+	/* first use, or the bank was probed again with another layout */
+	free(cache->entries);
+	cache->entries = calloc(bank->num_sectors, sizeof(*cache->entries));
+	if (!cache->entries) {
+		LOG_ERROR("Out of memory");
+		cache->num_sectors = 0;
+		return NULL;
+	}
+	cache->num_sectors = bank->num_sectors;
+	cache->key = key;
+	cache->erase_first = 1;
+	cache->erase_last = 0;
+	sector_cache_load(cache);
+
+	return cache;
+}
+
+/* CRC of len bytes of erased flash, as computed by target_checksum_memory() */
+static int sector_cache_erased_crc(struct flash_bank *bank, uint32_t len, uint32_t *crc)
+{
+	uint8_t *buffer = malloc(len);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	memset(buffer, bank->erased_value, len);
+	int retval = image_calculate_checksum(buffer, len, crc);
+	free(buffer);
+	return retval;
+}
+
+/* Checks sectors first .. first + n - 1 are still erased */
+static bool sector_cache_check_erased(struct flash_bank *bank, unsigned int first, unsigned int n)
+{
+	uint32_t offset = bank->sectors[first].offset;
+	uint32_t len = bank->sectors[first + n - 1].offset + bank->sectors[first + n - 1].size - offset;
+	uint32_t expected, crc;
+	int retval;
+
+	if (bank->driver->read != default_flash_read) {
+		/* not memory mapped, compare what the driver reads */
+		uint8_t *buffer = malloc(len);
+		if (!buffer)
+			return false;
+
+		bool erased = flash_driver_read(bank, buffer, offset, len) == ERROR_OK;
+		for (uint32_t i = 0; erased && i < len; i++)
+			erased = buffer[i] == bank->erased_value;
+		free(buffer);
+		return erased;
+	}
+
+	retval = sector_cache_erased_crc(bank, len, &expected);
+	if (retval != ERROR_OK)
+		return false;
+
+	retval = target_checksum_memory(bank->target, bank->base + offset, len, &crc);
+	if (retval != ERROR_OK)
+		return false;
+
+	return crc == expected;
+}
+
+int flash_sector_cache_enable(struct flash_bank *bank, const char *filename,
+		const char *unique_id)
+{
+	flash_sector_cache_free(bank);
+
+	if (!filename)
+		return ERROR_OK;
+
+	struct flash_sector_cache *cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	cache->filename = strdup(filename);
+	cache->unique_id = strdup(unique_id ? unique_id : "");
+	if (!cache->filename || !cache->unique_id) {
+		free(cache->filename);
+		free(cache->unique_id);
+		free(cache);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	bank->sector_cache = cache;
+	return ERROR_OK;
+}
+
+void flash_sector_cache_free(struct flash_bank *bank)
+{
+	struct flash_sector_cache *cache = bank->sector_cache;
+
+	if (!cache)
+		return;
+
+	free(cache->entries);
+	free(cache->filename);
+	free(cache->unique_id);
+	free(cache);
+	bank->sector_cache = NULL;
+}
+
+void flash_sector_cache_info(struct flash_bank *bank, struct command_invocation *cmd)
+{
+	struct flash_sector_cache *cache = bank->sector_cache;
+	unsigned int count[ARRAY_SIZE(sector_cache_state_names)] = { 0 };
+
+	if (!cache) {
+		command_print(cmd, "flash bank %u has no sector cache", bank->bank_number);
+		return;
+	}
+
+	command_print(cmd, "flash bank %u sector cache \"%s\", unique ID \"%s\"",
+		bank->bank_number, cache->filename, cache->unique_id);
+
+	cache = sector_cache_get(bank);
+	if (!cache) {
+		command_print(cmd, "\tbank not probed yet");
+		return;
+	}
+
+	for (unsigned int i = 0; i < cache->num_sectors; i++)
+		count[cache->entries[i].state]++;
+	command_print(cmd, "\tkey %016" PRIx64 ": %u erased, %u programmed, %u unknown sectors",
+		cache->key, count[SECTOR_ERASED], count[SECTOR_PROGRAMMED], count[SECTOR_UNKNOWN]);
+}
+
+void flash_sector_cache_erase_begin(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	struct flash_sector_cache *cache = sector_cache_get(bank);
+
+	if (!cache || first > last || last >= cache->num_sectors)
+		return;
+
+	/* until the erase has completed nothing is known */
+	for (unsigned int i = first; i <= last; i++)
+		cache->entries[i].state = SECTOR_UNKNOWN;
+	cache->erase_first = first;
+	cache->erase_last = last;
+	sector_cache_save(cache);
+}
+
+void flash_sector_cache_erase_end(struct flash_bank *bank, int retval)
+{
+	struct flash_sector_cache *cache = sector_cache_get(bank);
+
+	if (!cache || cache->erase_first > cache->erase_last)
+		return;
+
+	if (retval == ERROR_OK) {
+		for (unsigned int i = cache->erase_first; i <= cache->erase_last; i++) {
+			struct sector_cache_entry *e = &cache->entries[i];
+
+			e->state = SECTOR_ERASED;
+			e->crc_valid = sector_cache_erased_crc(bank, bank->sectors[i].size,
+					&e->crc) == ERROR_OK;
+		}
+		sector_cache_save(cache);
+	}
+
+	cache->erase_first = 1;
+	cache->erase_last = 0;
+}
+
+void flash_sector_cache_written(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, int retval)
+{
+	struct flash_sector_cache *cache = sector_cache_get(bank);
+
+	if (!cache || count == 0)
+		return;
+
+	for (unsigned int i = 0; i < cache->num_sectors; i++) {
+		struct flash_sector *sector = &bank->sectors[i];
+		struct sector_cache_entry *e = &cache->entries[i];
+
+		if (sector->offset + sector->size <= offset || sector->offset >= offset + count)
+			continue;
+
+		if (retval != ERROR_OK) {
+			e->state = SECTOR_UNKNOWN;
+			continue;
+		}
+
+		/* the CRC is known without reading back if the whole sector was written */
+		e->state = SECTOR_PROGRAMMED;
+		e->crc_valid = sector->offset >= offset
+			&& sector->offset + sector->size <= offset + count
+			&& image_calculate_checksum(buffer + (sector->offset - offset),
+					sector->size, &e->crc) == ERROR_OK;
+	}
+	sector_cache_save(cache);
+}
+
+void flash_sector_cache_checked(struct flash_bank *bank)
+{
+	struct flash_sector_cache *cache = sector_cache_get(bank);
+
+	if (!cache)
+		return;
+
+	for (unsigned int i = 0; i < cache->num_sectors; i++) {
+		struct sector_cache_entry *e = &cache->entries[i];
+
+		if (bank->sectors[i].is_erased == 1) {
+			e->state = SECTOR_ERASED;
+			e->crc_valid = sector_cache_erased_crc(bank, bank->sectors[i].size,
+					&e->crc) == ERROR_OK;
+		} else if (bank->sectors[i].is_erased == 0 && e->state != SECTOR_PROGRAMMED) {
+			e->state = SECTOR_PROGRAMMED;
+			e->crc_valid = false;
+		}
+	}
+	sector_cache_save(cache);
+}
+
+bool flash_sector_cache_maybe_erased(struct flash_bank *bank, unsigned int sector)
+{
+	struct flash_sector_cache *cache = sector_cache_get(bank);
+
+	return cache && sector < cache->num_sectors
+		&& cache->entries[sector].state == SECTOR_ERASED;
+}
+
+/**
+ * Counts the sectors from @a first on that are recorded as erased and
+ * still are, as confirmed by a CRC of the whole run; sectors found to have
+ * changed are forgotten.
+ * @returns The number of erased sectors starting at @a first, at most
+ * up to @a last, zero if sector @a first may need an erase.
+ */
+unsigned int flash_sector_cache_erased(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	struct flash_sector_cache *cache = sector_cache_get(bank);
+	unsigned int n = 0;
+
+	if (!cache || last >= cache->num_sectors)
+		return 0;
+
+	while (first + n <= last && cache->entries[first + n].state == SECTOR_ERASED)
+		n++;
+	if (n == 0)
+		return 0;
+
+	/* one check for the whole run is the common case */
+	if (sector_cache_check_erased(bank, first, n))
+		return n;
+
+	/* something else wrote to the flash, find the first changed sector */
+	for (unsigned int i = 0; i < n; i++) {
+		if (!sector_cache_check_erased(bank, first + i, 1)) {
+			LOG_DEBUG("sector %u is no longer erased", first + i);
+			cache->entries[first + i].state = SECTOR_UNKNOWN;
+			sector_cache_save(cache);
+			return i;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_FLASH_NOR_SECTOR_CACHE_H
+#define OPENOCD_FLASH_NOR_SECTOR_CACHE_H
+
+#include <helper/types.h>
+
+struct flash_bank;
+struct command_invocation;
+
+/* Persistent host side record of the sector state of a flash bank.
+ *
+ * The cache lives in a file named by "flash sector_cache" and is keyed by
+ * the flash driver, a user supplied unique device ID and the sector
+ * layout, so it is only reused for the same device. Sectors are recorded
+ * as erased or programmed after each erase, write and erase check done by
+ * OpenOCD. The state is only a hint: an erased sector is confirmed with
+ * an on-target CRC before anything relies on it.
+ *
+ * All functions do nothing for banks without a cache. */
+
+int flash_sector_cache_enable(struct flash_bank *bank, const char *filename,
+		const char *unique_id);
+void flash_sector_cache_free(struct flash_bank *bank);
+void flash_sector_cache_info(struct flash_bank *bank, struct command_invocation *cmd);
+
+void flash_sector_cache_erase_begin(struct flash_bank *bank, unsigned int first,
+		unsigned int last);
+void flash_sector_cache_erase_end(struct flash_bank *bank, int retval);
+void flash_sector_cache_written(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, int retval);
+void flash_sector_cache_checked(struct flash_bank *bank);
+
+bool flash_sector_cache_maybe_erased(struct flash_bank *bank, unsigned int sector);
+unsigned int flash_sector_cache_erased(struct flash_bank *bank, unsigned int first,
+		unsigned int last);
+
+#endif /* OPENOCD_FLASH_NOR_SECTOR_CACHE_H */
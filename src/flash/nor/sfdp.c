@@ -182,6 +182,16 @@ int spi_sfdp(struct flash_bank *bank, struct flash_device *dev,
 			dev->erase_cmd = (erase >> 8) & 0xFF;
 			dev->sectorsize = 1UL << (erase & 0xFF);
 
+			/* keep all erase types, the flash core may combine them */
+			for (j = 0; j < SPIFLASH_ERASE_TYPES; j++) {
+				uint32_t type = (j < 2 ? table->erase_t12 : table->erase_t34) >> (16 * (j & 1));
+
+				if (type & 0xFF) {
+					dev->erase_types[j].cmd = (type >> 8) & 0xFF;
+					dev->erase_types[j].size = 1UL << (type & 0xFF);
+				}
+			}
+
 			if ((offsetof(struct sfdp_basic_flash_param, chip_byte) >> 2) < words) {
 				/* get Program Page Size, if chip_byte present, that's optional */
 				dev->pagesize = 1UL << ((table->chip_byte >> 4) & 0x0F);
@@ -209,6 +219,8 @@ int spi_sfdp(struct flash_bank *bank, struct flash_device *dev,
 					dev->read_cmd = 0x13;
 					dev->pprog_cmd = 0x12;
 					dev->erase_cmd = 0xDC;
+					/* the 4-byte instructions of the other types are unknown */
+					memset(dev->erase_types, 0, sizeof(dev->erase_types));
 					if (dev->qread_cmd != 0)
 						dev->qread_cmd = 0xEC;
 				} else if (((table->fast_addr >> 17) & 0x3) == 0x1)
@@ -238,6 +250,10 @@ int spi_sfdp(struct flash_bank *bank, struct flash_device *dev,
 					dev->erase_cmd = (table->erase_t1234 >> 16) & 0xFF;
 				else if ((erase_type == 4) && (table->flags & (1UL << 12)))
 					dev->erase_cmd = (table->erase_t1234 >> 24) & 0xFF;
+				for (j = 0; j < SPIFLASH_ERASE_TYPES; j++) {
+					if (table->flags & (1UL << (9 + j)))
+						dev->erase_types[j].cmd = (table->erase_t1234 >> (8 * j)) & 0xFF;
+				}
 			} else
 				LOG_ERROR("parameter table id=0x%04" PRIx16 " invalid length %d", id, words);
 		} else
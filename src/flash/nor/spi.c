@@ -88,7 +88,7 @@ const struct flash_device flash_devices[] = {
 	FLASH_ID("mac 25r1635f",        0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001528c2, 0x100, 0x10000, 0x200000),
 	FLASH_ID("mac 25r3235f",        0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001628c2, 0x100, 0x10000, 0x400000),
 	FLASH_ID("mac 25r6435f",        0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001728c2, 0x100, 0x10000, 0x800000),
-	FLASH_ID("mac 25u1635e",        0x03, 0xeb, 0x02, 0x20, 0xc7, 0x003525c2, 0x100, 0x1000,  0x100000),
+	FLASH_ID_4K("mac 25u1635e",     0x03, 0xeb, 0x02, 0xc7, 0x003525c2, 0x100, 0x100000),
 	FLASH_ID("micron n25q032",      0x03, 0xeb, 0x02, 0xd8, 0xc7, 0x0016ba20, 0x100, 0x10000, 0x400000),
 	FLASH_ID("micron n25q064",      0x03, 0xeb, 0x02, 0xd8, 0xc7, 0x0017ba20, 0x100, 0x10000, 0x800000),
 	FLASH_ID("micron n25q128",      0x03, 0xeb, 0x02, 0xd8, 0xc7, 0x0018ba20, 0x100, 0x10000, 0x1000000),
@@ -113,10 +113,10 @@ const struct flash_device flash_devices[] = {
 	FLASH_ID("win w25q256fv/jv",    0x03, 0xeb, 0x02, 0xd8, 0xc7, 0x001940ef, 0x100, 0x10000, 0x2000000),
 	FLASH_ID("win w25q256fv",       0x03, 0xeb, 0x02, 0xd8, 0xc7, 0x001960ef, 0x100, 0x10000, 0x2000000), /* QPI mode */
 	FLASH_ID("win w25q256jv",       0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001970ef, 0x100, 0x10000, 0x2000000),
-	FLASH_ID("gd gd25q512",         0x03, 0x00, 0x02, 0x20, 0xc7, 0x001040c8, 0x100, 0x1000,  0x10000),
-	FLASH_ID("gd gd25q10",          0x03, 0x00, 0x02, 0x20, 0xc7, 0x001140c8, 0x100, 0x1000,  0x20000),
-	FLASH_ID("gd gd25q20",          0x03, 0x00, 0x02, 0x20, 0xc7, 0x001240c8, 0x100, 0x1000,  0x40000),
-	FLASH_ID("gd gd25q40",          0x03, 0x00, 0x02, 0x20, 0xc7, 0x001340c8, 0x100, 0x1000,  0x80000),
+	FLASH_ID_4K("gd gd25q512",      0x03, 0x00, 0x02, 0xc7, 0x001040c8, 0x100, 0x10000),
+	FLASH_ID_4K("gd gd25q10",       0x03, 0x00, 0x02, 0xc7, 0x001140c8, 0x100, 0x20000),
+	FLASH_ID_4K("gd gd25q20",       0x03, 0x00, 0x02, 0xc7, 0x001240c8, 0x100, 0x40000),
+	FLASH_ID_4K("gd gd25q40",       0x03, 0x00, 0x02, 0xc7, 0x001340c8, 0x100, 0x80000),
 	FLASH_ID("gd gd25q16c",         0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001540c8, 0x100, 0x10000, 0x200000),
 	FLASH_ID("gd gd25q32c",         0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001640c8, 0x100, 0x10000, 0x400000),
 	FLASH_ID("gd gd25q64c",         0x03, 0x00, 0x02, 0xd8, 0xc7, 0x001740c8, 0x100, 0x10000, 0x800000),
@@ -151,3 +151,36 @@ const struct flash_device flash_devices[] = {
 
 	FLASH_ID(NULL,                  0,    0,    0,    0,    0,    0,          0,     0,       0)
 };
+
+/**
+ * Collects the erase units of a device for flash_erase_plan(): the erase
+ * types larger than a sector which fit into the bank, and the chip erase
+ * as a unit of the whole bank.
+ *
+ * @param dev The device.
+ * @param bank_size Size of the bank holding the device.
+ * @param units Returns the unit sizes, room for SPIFLASH_ERASE_TYPES + 1.
+ * @param cmds Returns the erase instruction of each unit.
+ * @returns The number of units.
+ */
+unsigned int spi_erase_units(const struct flash_device *dev, uint32_t bank_size,
+		uint32_t *units, uint8_t *cmds)
+{
+	unsigned int num_units = 0;
+
+	for (unsigned int i = 0; i < SPIFLASH_ERASE_TYPES; i++) {
+		uint32_t size = dev->erase_types[i].size;
+
+		if (size > dev->sectorsize && size <= bank_size && dev->erase_types[i].cmd) {
+			units[num_units] = size;
+			cmds[num_units++] = dev->erase_types[i].cmd;
+		}
+	}
+
+	if (dev->chip_erase_cmd != 0x00 && dev->chip_erase_cmd != dev->erase_cmd) {
+		units[num_units] = bank_size;
+		cmds[num_units++] = dev->chip_erase_cmd;
+	}
+
+	return num_units;
+}
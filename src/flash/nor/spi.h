@@ -27,6 +27,14 @@
 
 #ifndef __ASSEMBLER__
 
+#define SPIFLASH_ERASE_TYPES	4
+
+/* erase instruction for a unit other than the sector, e.g. a 32K block */
+struct flash_erase_type {
+	uint8_t cmd;
+	uint32_t size;				/* 0 if unused */
+};
+
 /* data structure to maintain flash ids from different vendors */
 struct flash_device {
 	const char *name;
@@ -39,6 +47,7 @@ struct flash_device {
 	uint32_t pagesize;
 	uint32_t sectorsize;
 	uint32_t size_in_bytes;
+	struct flash_erase_type erase_types[SPIFLASH_ERASE_TYPES];
 };
 
 #define FLASH_ID(n, re, qr, pp, es, ces, id, psize, ssize, size) \
@@ -55,6 +64,25 @@ struct flash_device {
 	.size_in_bytes = size,          \
 }
 
+/* device with 4K sectors which also has the usual 32K and 64K block erase */
+#define FLASH_ID_4K(n, re, qr, pp, ces, id, psize, size) \
+{	                                \
+	.name = n,                      \
+	.read_cmd = re,                 \
+	.qread_cmd = qr,                \
+	.pprog_cmd = pp,                \
+	.erase_cmd = 0x20,              \
+	.chip_erase_cmd = ces,          \
+	.device_id = id,                \
+	.pagesize = psize,              \
+	.sectorsize = 0x1000,           \
+	.size_in_bytes = size,          \
+	.erase_types = {                \
+		{ 0x52, 0x8000 },           \
+		{ 0xd8, 0x10000 },          \
+	},                              \
+}
+
 #define FRAM_ID(n, re, qr, pp, id, size) \
 {	                                \
 	.name = n,                      \
@@ -71,6 +99,9 @@ struct flash_device {
 
 extern const struct flash_device flash_devices[];
 
+unsigned int spi_erase_units(const struct flash_device *dev, uint32_t bank_size,
+		uint32_t *units, uint8_t *cmds);
+
 #endif
 
 /* fields in SPI flash status register */
@@ -0,0 +1,152 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "imp.h"
+#include "spi_loader.h"
+#include <helper/binarybuffer.h>
+#include <target/algorithm.h>
+#include <target/armv7m.h>
+
+/* smallest FIFO worth streaming through, header words included */
+#define SPI_LOADER_MIN_FIFO		(2 * sizeof(uint32_t) + 32)
+
+static int spi_loader_run(struct flash_bank *bank, const struct spi_loader *loader,
+	uint32_t ctrl_base, uint8_t spi_cmd, uint32_t page_size,
+	uint8_t *buffer, uint32_t offset, uint32_t count, bool write)
+{
+	struct target *target = bank->target;
+	struct working_area *algorithm, *fifo;
+	struct reg_param reg_params[7];
+	struct armv7m_algorithm armv7m_info;
+	uint32_t fifo_size;
+	int retval;
+
+	if (!write && loader->read_entry < 0)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (!is_armv7m(target_to_armv7m(target))) {
+		LOG_DEBUG("SPI flash loader needs a Cortex-M target");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	/* reads fall back to transfers driven from the host, only warn for writes */
+	if (target_alloc_working_area(target, loader->code_size, &algorithm) != ERROR_OK) {
+		if (write)
+			LOG_WARNING("no working area available, can't use the SPI flash loader");
+		else
+			LOG_DEBUG("no working area available, can't use the SPI flash loader");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	retval = target_write_buffer(target, algorithm->address,
+			loader->code_size, loader->code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, algorithm);
+		return retval;
+	}
+
+	/* FIFO allocation, take as much as is available */
+	fifo_size = target_get_working_area_avail(target);
+	if (loader->fifo_max && fifo_size > loader->fifo_max)
+		fifo_size = loader->fifo_max;
+	fifo_size &= ~3u;
+	if (fifo_size < SPI_LOADER_MIN_FIFO
+			|| target_alloc_working_area(target, fifo_size, &fifo) != ERROR_OK) {
+		target_free_working_area(target, algorithm);
+		if (write)
+			LOG_WARNING("not enough working area for the SPI flash loader FIFO,"
+				" at least %zu bytes needed", loader->code_size + SPI_LOADER_MIN_FIFO);
+		else
+			LOG_DEBUG("not enough working area for the SPI flash loader FIFO");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+	if (write && fifo_size < page_size)
+		LOG_WARNING("Working area size is limited; flash writes may be"
+			" slow. Increase working area size to at least %zuB"
+			" to reduce write times.",
+			(size_t)(loader->code_size + page_size));
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* fifo start, status (out) */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* fifo end */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* flash offset */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* count */
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);	/* page size */
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);	/* controller base */
+	init_reg_param(&reg_params[6], "r6", 32, PARAM_OUT);	/* SPI command */
+
+	buf_set_u32(reg_params[0].value, 0, 32, fifo->address);
+	buf_set_u32(reg_params[1].value, 0, 32, fifo->address + fifo->size);
+	buf_set_u32(reg_params[2].value, 0, 32, offset);
+	buf_set_u32(reg_params[3].value, 0, 32, count);
+	buf_set_u32(reg_params[4].value, 0, 32, page_size);
+	buf_set_u32(reg_params[5].value, 0, 32, ctrl_base);
+	buf_set_u32(reg_params[6].value, 0, 32, spi_cmd);
+
+	if (write)
+		retval = target_run_flash_async_algorithm(target, buffer, count, 1,
+				0, NULL,
+				ARRAY_SIZE(reg_params), reg_params,
+				fifo->address, fifo->size,
+				algorithm->address + loader->program_entry, 0,
+				&armv7m_info);
+	else
+		retval = target_run_read_async_algorithm(target, buffer, count, 1,
+				0, NULL,
+				ARRAY_SIZE(reg_params), reg_params,
+				fifo->address, fifo->size,
+				algorithm->address + loader->read_entry, 0,
+				&armv7m_info);
+
+	if (retval == ERROR_OK && loader->reports_remaining) {
+		uint32_t remaining = buf_get_u32(reg_params[0].value, 0, 32);
+		if (remaining) {
+			LOG_ERROR("SPI flash loader stopped with 0x%" PRIx32 " bytes left", remaining);
+			retval = ERROR_FLASH_OPERATION_FAILED;
+		}
+	}
+	if (retval != ERROR_OK)
+		LOG_ERROR("Error executing SPI flash %s algorithm", write ? "write" : "read");
+
+	target_free_working_area(target, fifo);
+	target_free_working_area(target, algorithm);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	return retval;
+}
+
+int spi_loader_write(struct flash_bank *bank, const struct spi_loader *loader,
+	uint32_t ctrl_base, uint8_t spi_cmd, uint32_t page_size,
+	const uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	return spi_loader_run(bank, loader, ctrl_base, spi_cmd, page_size,
+		(uint8_t *)buffer, offset, count, true);
+}
+
+int spi_loader_read(struct flash_bank *bank, const struct spi_loader *loader,
+	uint32_t ctrl_base, uint8_t spi_cmd,
+	uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	return spi_loader_run(bank, loader, ctrl_base, spi_cmd, 0,
+		buffer, offset, count, false);
+}
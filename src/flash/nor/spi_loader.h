@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_FLASH_NOR_SPI_LOADER_H
+#define OPENOCD_FLASH_NOR_SPI_LOADER_H
+
+/* Target resident SPI flash loader streaming data through a FIFO in the
+ * working area, run with target_run_flash_async_algorithm() for page
+ * program and target_run_read_async_algorithm() for reads.
+ *
+ * Register interface on entry (Cortex-M):
+ * r0 = FIFO start (write pointer, read pointer, data), r1 = FIFO end,
+ * r2 = flash offset, r3 = byte count, r4 = page size,
+ * r5 = controller base address, r6 = SPI command.
+ *
+ * The loaders built from contrib/loaders/flash/spi/armv7m_spi_loader.S
+ * have the page program entry at offset 0, the read entry at offset 4 and
+ * return the number of bytes not processed in r0.
+ *
+ * Users: mrvlqspi (program and read) and lpcspifi (program). Not users:
+ * - fespi and sh_qspi, as their RISC-V and Cortex-A targets only offer
+ *   run_algorithm(), not the start/wait_algorithm() the FIFO needs; they
+ *   keep their own block wise loaders;
+ * - stmqspi, which has its own FIFO read/write, CRC verify and blank
+ *   check loaders already.
+ * The loader neither erases nor verifies, and transfers on a single data
+ * line only: erase is driven by the host through the flash core's erase
+ * planner, verify by the drivers' verify methods. */
+struct spi_loader {
+	const uint8_t *code;
+	size_t code_size;
+	uint32_t program_entry;		/* offset of the page program entry point */
+	int read_entry;				/* offset of the read entry point, -1 if none */
+	bool reports_remaining;		/* r0 holds the bytes left on exit */
+	uint32_t fifo_max;			/* FIFO size limit, 0 if none */
+};
+
+/* Both return ERROR_TARGET_RESOURCE_NOT_AVAILABLE without touching the
+ * flash when the loader cannot run, so the caller may fall back to a
+ * host driven transfer. */
+int spi_loader_write(struct flash_bank *bank, const struct spi_loader *loader,
+	uint32_t ctrl_base, uint8_t spi_cmd, uint32_t page_size,
+	const uint8_t *buffer, uint32_t offset, uint32_t count);
+int spi_loader_read(struct flash_bank *bank, const struct spi_loader *loader,
+	uint32_t ctrl_base, uint8_t spi_cmd,
+	uint8_t *buffer, uint32_t offset, uint32_t count);
+
+#endif /* OPENOCD_FLASH_NOR_SPI_LOADER_H */
@@ -84,9 +84,11 @@
 	((QSPI_MODE & ~QSPI_DCYC_MASK & QSPI_NO_ADDR & QSPI_NO_ALTB & QSPI_NO_DATA) | \
 	(QSPI_WRITE_MODE | SPIFLASH_WRITE_ENABLE))
 
-#define QSPI_CCR_SECTOR_ERASE \
+#define QSPI_CCR_SECTOR_ERASE QSPI_CCR_ERASE(stmqspi_info->dev.erase_cmd)
+
+#define QSPI_CCR_ERASE(cmd) \
 	((QSPI_MODE & ~QSPI_DCYC_MASK & QSPI_NO_ALTB & QSPI_NO_DATA) | \
-	(QSPI_WRITE_MODE | stmqspi_info->dev.erase_cmd))
+	(QSPI_WRITE_MODE | (cmd)))
 
 #define QSPI_CCR_MASS_ERASE \
 	((QSPI_MODE & ~QSPI_DCYC_MASK & QSPI_NO_ADDR & QSPI_NO_ALTB & QSPI_NO_DATA) | \
@@ -182,6 +184,12 @@ struct stmqspi_flash_bank {
 	uint32_t saved_ir;	/* only for OCTOSPI */
 	unsigned int sfdp_dummy1;	/* number of dummy bytes for SFDP read for flash1 and octo */
 	unsigned int sfdp_dummy2;	/* number of dummy bytes for SFDP read for flash2 */
+	unsigned int erase_next;	/* next sector to erase */
+	unsigned int erase_last;	/* last sector to erase */
+	unsigned int erase_count;	/* sectors covered by the operation in flight */
+	bool erase_chip;			/* operation in flight is a chip erase */
+	bool erase_chip_failed;		/* chip erase failed, erase sectors instead */
+	int64_t erase_t0;			/* start time of the operation in flight */
 };
 
 static inline int octospi_cmd(struct flash_bank *bank, uint32_t mode,
@@ -935,29 +943,57 @@ err:
 	return retval;
 }
 
-static int qspi_erase_sector(struct flash_bank *bank, unsigned int sector)
+/* Issues the erase of the sectors starting at erase_next, using a block or
+ * chip erase where the planner allows it, without waiting for its end */
+static int qspi_erase_issue(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
 	struct stmqspi_flash_bank *stmqspi_info = bank->driver_priv;
 	uint32_t io_base = stmqspi_info->io_base;
+	unsigned int dual = (stmqspi_info->saved_cr & BIT(SPI_DUAL_FLASH)) ? 1 : 0;
+	unsigned int sector = stmqspi_info->erase_next;
+	uint32_t units[SPIFLASH_ERASE_TYPES + 1];
+	uint8_t cmds[SPIFLASH_ERASE_TYPES + 1];
+	unsigned int num_units, count;
+	uint8_t cmd = stmqspi_info->dev.erase_cmd;
 	uint16_t status;
 	int retval;
 
-	retval = qspi_write_enable(bank);
-	if (retval != ERROR_OK)
-		goto err;
+	/* in dual flash mode, each unit spans both devices */
+	num_units = spi_erase_units(&stmqspi_info->dev, stmqspi_info->dev.size_in_bytes,
+			units, cmds);
+	for (unsigned int i = 0; i < num_units; i++)
+		units[i] <<= dual;
+	/* the chip erase is always the last unit */
+	if (stmqspi_info->erase_chip_failed && num_units > 0 && units[num_units - 1] == bank->size)
+		num_units--;
+
+	int unit = flash_erase_plan(bank, sector, stmqspi_info->erase_last,
+			units, num_units, &count);
+	stmqspi_info->erase_chip = unit >= 0 && units[unit] == bank->size &&
+		cmds[unit] == stmqspi_info->dev.chip_erase_cmd;
+	if (unit >= 0)
+		cmd = cmds[unit];
 
-	/* Send Sector Erase command */
-	if (IS_OCTOSPI)
-		retval = octospi_cmd(bank, OCTOSPI_WRITE_MODE, OCTOSPI_CCR_SECTOR_ERASE,
-			stmqspi_info->dev.erase_cmd);
-	else
-		retval = target_write_u32(target, io_base + QSPI_CCR, QSPI_CCR_SECTOR_ERASE);
+	retval = qspi_write_enable(bank);
 	if (retval != ERROR_OK)
 		goto err;
 
-	/* Address is sector offset, this write initiates command transmission */
-	retval = target_write_u32(target, io_base + SPI_AR, bank->sectors[sector].offset);
+	/* Send Erase command */
+	if (stmqspi_info->erase_chip) {
+		if (IS_OCTOSPI)
+			retval = octospi_cmd(bank, OCTOSPI_WRITE_MODE, OCTOSPI_CCR_MASS_ERASE, cmd);
+		else
+			retval = target_write_u32(target, io_base + QSPI_CCR, QSPI_CCR_MASS_ERASE);
+	} else {
+		if (IS_OCTOSPI)
+			retval = octospi_cmd(bank, OCTOSPI_WRITE_MODE, OCTOSPI_CCR_SECTOR_ERASE, cmd);
+		else
+			retval = target_write_u32(target, io_base + QSPI_CCR, QSPI_CCR_ERASE(cmd));
+		/* Address is sector offset, this write initiates command transmission */
+		if (retval == ERROR_OK)
+			retval = target_write_u32(target, io_base + SPI_AR, bank->sectors[sector].offset);
+	}
 	if (retval != ERROR_OK)
 		goto err;
 
@@ -978,7 +1014,7 @@ static int qspi_erase_sector(struct flash_bank *bank, unsigned int sector)
 	if (((stmqspi_info->saved_cr & (BIT(SPI_DUAL_FLASH) | BIT(SPI_FSEL_FLASH)))
 		!= BIT(SPI_FSEL_FLASH)) && ((status & SPIFLASH_BSY_BIT) == 0) &&
 		((status & SPIFLASH_WE_BIT) != 0)) {
-		LOG_ERROR("Sector erase command not accepted by flash1. Status=0x%02x",
+		LOG_ERROR("Erase command not accepted by flash1. Status=0x%02x",
 			status & 0xFFU);
 		retval = ERROR_FLASH_OPERATION_FAILED;
 		goto err;
@@ -990,28 +1026,38 @@ static int qspi_erase_sector(struct flash_bank *bank, unsigned int sector)
 	if (((stmqspi_info->saved_cr & (BIT(SPI_DUAL_FLASH) | BIT(SPI_FSEL_FLASH))) != 0) &&
 		((status & SPIFLASH_BSY_BIT) == 0) &&
 		((status & SPIFLASH_WE_BIT) != 0)) {
-		LOG_ERROR("Sector erase command not accepted by flash2. Status=0x%02x",
+		LOG_ERROR("Erase command not accepted by flash2. Status=0x%02x",
 			status & 0xFFU);
 		retval = ERROR_FLASH_OPERATION_FAILED;
 		goto err;
 	}
 
 	/* Erase takes a long time, so some sort of progress message is a good idea */
-	LOG_DEBUG("erasing sector %4u", sector);
+	if (stmqspi_info->erase_chip)
+		LOG_DEBUG("erasing chip");
+	else
+		LOG_DEBUG("erasing sectors %4u to %4u", sector, sector + count - 1);
 
-	/* Poll WIP for end of self timed Sector Erase cycle */
-	retval = wait_till_ready(bank, SPI_MAX_TIMEOUT);
+	stmqspi_info->erase_count = count;
+	stmqspi_info->erase_t0 = timeval_ms();
 
 err:
+	if (retval != ERROR_OK && stmqspi_info->erase_chip) {
+		LOG_WARNING("Mass erase failed. Falling back to sector erase.");
+		stmqspi_info->erase_chip_failed = true;
+		return qspi_erase_issue(bank);
+	}
+
 	return retval;
 }
 
-static int stmqspi_erase(struct flash_bank *bank, unsigned int first, unsigned int last)
+static int stmqspi_erase_start(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
 {
 	struct target *target = bank->target;
 	struct stmqspi_flash_bank *stmqspi_info = bank->driver_priv;
 	unsigned int sector;
-	int retval = ERROR_OK;
+	int retval;
 
 	LOG_DEBUG("%s: from sector %u to sector %u", __func__, first, last);
 
@@ -1042,16 +1088,63 @@ static int stmqspi_erase(struct flash_bank *bank, unsigned int first, unsigned i
 		}
 	}
 
-	for (sector = first; sector <= last; sector++) {
-		retval = qspi_erase_sector(bank, sector);
-		if (retval != ERROR_OK)
-			break;
-		alive_sleep(10);
-		keep_alive();
+	stmqspi_info->erase_next = first;
+	stmqspi_info->erase_last = last;
+	stmqspi_info->erase_chip_failed = false;
+
+	retval = qspi_erase_issue(bank);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Flash sector_erase failed on sector %u", first);
+		/* Switch to memory mapped mode before return to prompt */
+		set_mm_mode(bank);
+	}
+
+	return retval;
+}
+
+static int stmqspi_erase_poll(struct flash_bank *bank)
+{
+	struct stmqspi_flash_bank *stmqspi_info = bank->driver_priv;
+	uint16_t status;
+	int retval;
+
+	/* Check WIP for end of self timed erase cycle */
+	retval = read_status_reg(bank, &status);
+	if (retval != ERROR_OK)
+		goto err;
+
+	int64_t dt = timeval_ms() - stmqspi_info->erase_t0;
+	if (status & ((SPIFLASH_BSY_BIT << 8) | SPIFLASH_BSY_BIT)) {
+		int64_t timeout = stmqspi_info->erase_chip ? SPI_MASS_ERASE_TIMEOUT
+			: (int64_t)stmqspi_info->erase_count * SPI_MAX_TIMEOUT;
+		if (dt <= timeout)
+			return ERROR_FLASH_BUSY;
+
+		LOG_ERROR("timeout");
+		if (stmqspi_info->erase_chip) {
+			LOG_WARNING("Mass erase failed. Falling back to sector erase.");
+			stmqspi_info->erase_chip_failed = true;
+			retval = qspi_erase_issue(bank);
+			if (retval == ERROR_OK)
+				return ERROR_FLASH_BUSY;
+		} else {
+			retval = ERROR_FLASH_OPERATION_FAILED;
+		}
+		goto err;
 	}
 
+	LOG_DEBUG("erase took %" PRId64 " ms", dt);
+
+	stmqspi_info->erase_next += stmqspi_info->erase_count;
+	if (stmqspi_info->erase_next <= stmqspi_info->erase_last) {
+		retval = qspi_erase_issue(bank);
+		if (retval == ERROR_OK)
+			return ERROR_FLASH_BUSY;
+	}
+
+err:
 	if (retval != ERROR_OK)
-		LOG_ERROR("Flash sector_erase failed on sector %u", sector);
+		LOG_ERROR("Flash sector_erase failed on sector %u", stmqspi_info->erase_next);
 
 	/* Switch to memory mapped mode before return to prompt */
 	set_mm_mode(bank);
@@ -1059,6 +1152,22 @@ static int stmqspi_erase(struct flash_bank *bank, unsigned int first, unsigned i
 	return retval;
 }
 
+static int stmqspi_erase(struct flash_bank *bank, unsigned int first, unsigned int last)
+{
+	int retval = stmqspi_erase_start(bank, first, last);
+
+	while (retval == ERROR_OK) {
+		retval = stmqspi_erase_poll(bank);
+		if (retval != ERROR_FLASH_BUSY)
+			break;
+		alive_sleep(1);
+		keep_alive();
+		retval = ERROR_OK;
+	}
+
+	return retval;
+}
+
 static int stmqspi_protect(struct flash_bank *bank, int set,
 	unsigned int first, unsigned int last)
 {
@@ -2466,6 +2575,8 @@ struct flash_driver stmqspi_flash = {
 	.commands = stmqspi_command_handlers,
 	.flash_bank_command = stmqspi_flash_bank_command,
 	.erase = stmqspi_erase,
+	.erase_start = stmqspi_erase_start,
+	.erase_poll = stmqspi_erase_poll,
 	.protect = stmqspi_protect,
 	.write = stmqspi_write,
 	.read = stmqspi_read,
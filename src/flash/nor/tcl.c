@@ -22,6 +22,7 @@
 #include "config.h"
 #endif
 #include "imp.h"
+#include "sector_cache.h"
 #include <helper/time_support.h>
 #include <target/image.h>
 
@@ -199,9 +200,10 @@ COMMAND_HANDLER(handle_flash_erase_check_command)
 		return retval;
 
 	retval = p->driver->erase_check(p);
-	if (retval == ERROR_OK)
+	if (retval == ERROR_OK) {
+		flash_sector_cache_checked(p);
 		command_print(CMD, "successfully checked erase state");
-	else {
+	} else {
 		command_print(CMD,
 			"unknown error when checking erase state of flash bank #%s at "
 			TARGET_ADDR_FMT,
@@ -412,6 +414,7 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool verify = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -424,6 +427,10 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "verify") == 0) {
+			verify = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
 		} else
 			break;
 	}
@@ -454,15 +461,15 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		return retval;
 
 	retval = flash_write_unlock_verify(target, &image, &written, auto_erase,
-		auto_unlock, true, false);
+		auto_unlock, true, verify);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
 	}
 
 	if ((retval == ERROR_OK) && (duration_measure(&bench) == ERROR_OK)) {
-		command_print(CMD, "wrote %" PRIu32 " bytes from file %s "
-			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
+		command_print(CMD, "wrote %s%" PRIu32 " bytes from file %s "
+			"in %fs (%0.3f KiB/s)", verify ? "and verified " : "", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
 	}
 
@@ -1083,6 +1090,30 @@ COMMAND_HANDLER(handle_flash_padded_value_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_flash_sector_cache_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct flash_bank *p;
+	int retval = CALL_COMMAND_HANDLER(flash_command_get_bank, 0, &p);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (CMD_ARGC == 2 && strcmp(CMD_ARGV[1], "off") == 0)
+		return flash_sector_cache_enable(p, NULL, NULL);
+
+	if (CMD_ARGC > 1) {
+		retval = flash_sector_cache_enable(p, CMD_ARGV[1],
+				CMD_ARGC > 2 ? CMD_ARGV[2] : NULL);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	flash_sector_cache_info(p, CMD);
+	return ERROR_OK;
+}
+
 static const struct command_registration flash_exec_command_handlers[] = {
 	{
 		.name = "probe",
@@ -1192,9 +1223,10 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [verify] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
-			"and/or erase the region to be used. Allow optional "
+			"and/or erase the region to be used, and verify each "
+			"chunk as it is written. Allow optional "
 			"offset from beginning of bank (defaults to zero)",
 	},
 	{
@@ -1239,6 +1271,15 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.usage = "bank_id value",
 		.help = "Set default flash padded value",
 	},
+	{
+		.name = "sector_cache",
+		.handler = handle_flash_sector_cache_command,
+		.mode = COMMAND_EXEC,
+		.usage = "bank_id [filename [unique_id] | 'off']",
+		.help = "Keep the erase state of the bank's sectors in a file "
+			"across sessions, so already erased sectors are not "
+			"erased again when programming.",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -66,17 +66,16 @@ proc program {filename args} {
 	if {$needsflash == 1} {
 		echo "** Programming Started **"
 
-		if {[catch {eval flash write_image erase $flash_args}] == 0} {
-			echo "** Programming Finished **"
-			if {[info exists verify]} {
-				# verify phase
-				echo "** Verify Started **"
-				if {[catch {eval verify_image $flash_args}] == 0} {
-					echo "** Verified OK **"
-				} else {
-					program_error "** Verify Failed **" $exit
-				}
+		if {[info exists verify]} {
+			# verify each chunk while programming
+			if {[catch {eval flash write_image erase verify $flash_args}] == 0} {
+				echo "** Programming Finished **"
+				echo "** Verified OK **"
+			} else {
+				program_error "** Programming or Verify Failed **" $exit
 			}
+		} elseif {[catch {eval flash write_image erase $flash_args}] == 0} {
+			echo "** Programming Finished **"
 		} else {
 			program_error "** Programming Failed **" $exit
 		}
@@ -62,6 +62,451 @@ static const char * const log_strings[6] = {
 
 static int count;
 
+/* Binary trace ring buffer.
+ *
+ * While the trace is running, debug messages are not formatted nor written to
+ * the log output. Instead, the format string pointer and the raw argument
+ * values are stored in a ring of fixed size slots, and formatting is deferred
+ * until the ring is dumped. This keeps debug_level 3 and 4 cheap enough not to
+ * change the timing of the run being debugged. The oldest records are silently
+ * overwritten once the ring is full.
+ *
+ * File, function and format strings must outlive the trace, which holds for
+ * the string literals used by all the LOG_* macros.
+ */
+#define LOG_TRACE_SLOT_SIZE		256
+#define LOG_TRACE_DEFAULT_SLOTS	16384
+
+struct log_trace_slot {
+	int64_t time;
+	const char *file;
+	const char *function;
+	const char *format;
+	int count;
+	unsigned int line;
+	enum log_levels level;
+	bool truncated;
+	uint8_t data[LOG_TRACE_SLOT_SIZE - 48];
+};
+
+static struct log_trace_slot *log_trace_slots;
+static unsigned int log_trace_num_slots = LOG_TRACE_DEFAULT_SLOTS;
+static uint64_t log_trace_head;
+static bool log_trace_running;
+
+enum log_trace_arg {
+	LOG_TRACE_ARG_NONE,
+	LOG_TRACE_ARG_INT,
+	LOG_TRACE_ARG_LONG,
+	LOG_TRACE_ARG_LLONG,
+	LOG_TRACE_ARG_INTMAX,
+	LOG_TRACE_ARG_SIZE,
+	LOG_TRACE_ARG_PTRDIFF,
+	LOG_TRACE_ARG_DOUBLE,
+	LOG_TRACE_ARG_LDOUBLE,
+	LOG_TRACE_ARG_PTR,
+	LOG_TRACE_ARG_STRING,
+};
+
+/* NULL string marker stored in place of the string length */
+#define LOG_TRACE_NULL_STRING	0xffff
+
+/**
+ * Parse the printf() conversion specification starting at @a p, which points
+ * to the character following the '%'. Returns a pointer past the conversion
+ * character, sets @a stars to the number of '*' int arguments consumed before
+ * the value and @a arg to the type of the value itself. @a precision is set to
+ * the explicit precision, -1 if there is none or -2 if it is given by a '*'.
+ */
+static const char *log_trace_parse_spec(const char *p, unsigned int *stars,
+		enum log_trace_arg *arg, int *precision)
+{
+	enum { LEN_NONE, LEN_LONG, LEN_LLONG, LEN_INTMAX, LEN_SIZE, LEN_PTRDIFF,
+		LEN_LDOUBLE } len = LEN_NONE;
+
+	*stars = 0;
+	*arg = LOG_TRACE_ARG_NONE;
+	*precision = -1;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		(*stars)++;
+		p++;
+	}
+	while (isdigit((unsigned char)*p))
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			(*stars)++;
+			*precision = -2;
+			p++;
+		} else {
+			*precision = 0;
+			while (isdigit((unsigned char)*p))
+				*precision = *precision * 10 + (*p++ - '0');
+		}
+	}
+
+	switch (*p) {
+	case 'h':
+		p++;
+		if (*p == 'h')
+			p++;
+		break;
+	case 'l':
+		p++;
+		len = LEN_LONG;
+		if (*p == 'l') {
+			p++;
+			len = LEN_LLONG;
+		}
+		break;
+	case 'q':
+		p++;
+		len = LEN_LLONG;
+		break;
+	case 'j':
+		p++;
+		len = LEN_INTMAX;
+		break;
+	case 'z':
+		p++;
+		len = LEN_SIZE;
+		break;
+	case 't':
+		p++;
+		len = LEN_PTRDIFF;
+		break;
+	case 'L':
+		p++;
+		len = LEN_LDOUBLE;
+		break;
+	}
+
+	switch (*p) {
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		switch (len) {
+		case LEN_LONG:
+			*arg = LOG_TRACE_ARG_LONG;
+			break;
+		case LEN_LLONG:
+			*arg = LOG_TRACE_ARG_LLONG;
+			break;
+		case LEN_INTMAX:
+			*arg = LOG_TRACE_ARG_INTMAX;
+			break;
+		case LEN_SIZE:
+			*arg = LOG_TRACE_ARG_SIZE;
+			break;
+		case LEN_PTRDIFF:
+			*arg = LOG_TRACE_ARG_PTRDIFF;
+			break;
+		default:
+			*arg = LOG_TRACE_ARG_INT;
+			break;
+		}
+		break;
+	case 'c':
+		*arg = LOG_TRACE_ARG_INT;
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		*arg = (len == LEN_LDOUBLE) ? LOG_TRACE_ARG_LDOUBLE : LOG_TRACE_ARG_DOUBLE;
+		break;
+	case 's':
+		*arg = LOG_TRACE_ARG_STRING;
+		break;
+	case 'p':
+	case 'n':
+		*arg = LOG_TRACE_ARG_PTR;
+		break;
+	case '\0':
+		return p;
+	}
+
+	return p + 1;
+}
+
+#define LOG_TRACE_STORE(type) \
+	do { \
+		type v = va_arg(args, type); \
+		if (pos + sizeof(v) > sizeof(slot->data)) \
+			goto truncated; \
+		memcpy(slot->data + pos, &v, sizeof(v)); \
+		pos += sizeof(v); \
+	} while (0)
+
+static void log_trace_record(enum log_levels level, const char *file, unsigned int line,
+		const char *function, const char *format, va_list args)
+{
+	struct log_trace_slot *slot = &log_trace_slots[log_trace_head++ % log_trace_num_slots];
+	size_t pos = 0;
+
+	slot->time = timeval_ms() - start;
+	slot->file = file;
+	slot->function = function;
+	slot->format = format;
+	slot->count = count;
+	slot->line = line;
+	slot->level = level;
+	slot->truncated = false;
+
+	for (const char *p = format; *p; ) {
+		unsigned int stars;
+		enum log_trace_arg arg;
+		int precision;
+
+		if (*p++ != '%')
+			continue;
+
+		p = log_trace_parse_spec(p, &stars, &arg, &precision);
+		for (unsigned int i = 0; i < stars; i++) {
+			int star = va_arg(args, int);
+			if (pos + sizeof(star) > sizeof(slot->data))
+				goto truncated;
+			memcpy(slot->data + pos, &star, sizeof(star));
+			pos += sizeof(star);
+			if (precision == -2 && i == stars - 1)
+				precision = star;
+		}
+
+		switch (arg) {
+		case LOG_TRACE_ARG_NONE:
+			break;
+		case LOG_TRACE_ARG_INT:
+			LOG_TRACE_STORE(int);
+			break;
+		case LOG_TRACE_ARG_LONG:
+			LOG_TRACE_STORE(long);
+			break;
+		case LOG_TRACE_ARG_LLONG:
+			LOG_TRACE_STORE(long long);
+			break;
+		case LOG_TRACE_ARG_INTMAX:
+			LOG_TRACE_STORE(intmax_t);
+			break;
+		case LOG_TRACE_ARG_SIZE:
+			LOG_TRACE_STORE(size_t);
+			break;
+		case LOG_TRACE_ARG_PTRDIFF:
+			LOG_TRACE_STORE(ptrdiff_t);
+			break;
+		case LOG_TRACE_ARG_DOUBLE:
+			LOG_TRACE_STORE(double);
+			break;
+		case LOG_TRACE_ARG_LDOUBLE:
+			LOG_TRACE_STORE(long double);
+			break;
+		case LOG_TRACE_ARG_PTR:
+			LOG_TRACE_STORE(void *);
+			break;
+		case LOG_TRACE_ARG_STRING: {
+			/* strings may live on the caller's stack, keep a copy */
+			const char *str = va_arg(args, const char *);
+			uint16_t str_len = str ? 0 : LOG_TRACE_NULL_STRING;
+			if (pos + sizeof(str_len) > sizeof(slot->data))
+				goto truncated;
+			size_t room = sizeof(slot->data) - pos - sizeof(str_len);
+			if (precision >= 0 && (size_t)precision < room)
+				room = precision;
+			if (str) {
+				str_len = strnlen(str, room);
+				memcpy(slot->data + pos + sizeof(str_len), str, str_len);
+			}
+			memcpy(slot->data + pos, &str_len, sizeof(str_len));
+			pos += sizeof(str_len);
+			if (str) {
+				pos += str_len;
+				if (str_len == room && (precision < 0 || room < (size_t)precision) &&
+						str[str_len] != '\0')
+					goto truncated;
+			}
+			break;
+		}
+		}
+	}
+	return;
+
+truncated:
+	slot->truncated = true;
+}
+
+#define LOG_TRACE_LOAD(type) \
+	do { \
+		type v; \
+		if (pos + sizeof(v) > sizeof(slot->data)) \
+			return false; \
+		memcpy(&v, slot->data + pos, sizeof(v)); \
+		pos += sizeof(v); \
+		if (stars == 2) \
+			n = snprintf(out, room, spec, star[0], star[1], v); \
+		else if (stars == 1) \
+			n = snprintf(out, room, spec, star[0], v); \
+		else \
+			n = snprintf(out, room, spec, v); \
+	} while (0)
+
+/**
+ * Format one conversion of a trace record into @a out. Returns false once the
+ * arguments stored in the slot are exhausted, i.e. the record was truncated.
+ */
+static bool log_trace_format_arg(const struct log_trace_slot *slot, size_t *data_pos,
+		const char *spec, unsigned int stars, enum log_trace_arg arg,
+		char *out, size_t room, int *written)
+{
+	size_t pos = *data_pos;
+	int star[2] = { 0, 0 };
+	int n = 0;
+
+	for (unsigned int i = 0; i < stars; i++) {
+		if (pos + sizeof(int) > sizeof(slot->data))
+			return false;
+		memcpy(&star[i], slot->data + pos, sizeof(int));
+		pos += sizeof(int);
+	}
+
+	switch (arg) {
+	case LOG_TRACE_ARG_NONE:
+		n = snprintf(out, room, "%s", spec[1] == '%' ? "%" : "");
+		break;
+	case LOG_TRACE_ARG_INT:
+		LOG_TRACE_LOAD(int);
+		break;
+	case LOG_TRACE_ARG_LONG:
+		LOG_TRACE_LOAD(long);
+		break;
+	case LOG_TRACE_ARG_LLONG:
+		LOG_TRACE_LOAD(long long);
+		break;
+	case LOG_TRACE_ARG_INTMAX:
+		LOG_TRACE_LOAD(intmax_t);
+		break;
+	case LOG_TRACE_ARG_SIZE:
+		LOG_TRACE_LOAD(size_t);
+		break;
+	case LOG_TRACE_ARG_PTRDIFF:
+		LOG_TRACE_LOAD(ptrdiff_t);
+		break;
+	case LOG_TRACE_ARG_DOUBLE:
+		LOG_TRACE_LOAD(double);
+		break;
+	case LOG_TRACE_ARG_LDOUBLE:
+		LOG_TRACE_LOAD(long double);
+		break;
+	case LOG_TRACE_ARG_PTR:
+		if (spec[strlen(spec) - 1] == 'n') {
+			/* nothing to print, just skip the stored pointer */
+			pos += sizeof(void *);
+			break;
+		}
+		LOG_TRACE_LOAD(void *);
+		break;
+	case LOG_TRACE_ARG_STRING: {
+		uint16_t str_len;
+		char str[LOG_TRACE_SLOT_SIZE];
+		if (pos + sizeof(str_len) > sizeof(slot->data))
+			return false;
+		memcpy(&str_len, slot->data + pos, sizeof(str_len));
+		pos += sizeof(str_len);
+		if (str_len == LOG_TRACE_NULL_STRING) {
+			strcpy(str, "(null)");
+		} else {
+			if (pos + str_len > sizeof(slot->data))
+				return false;
+			memcpy(str, slot->data + pos, str_len);
+			str[str_len] = '\0';
+			pos += str_len;
+		}
+		if (stars == 2)
+			n = snprintf(out, room, spec, star[0], star[1], str);
+		else if (stars == 1)
+			n = snprintf(out, room, spec, star[0], str);
+		else
+			n = snprintf(out, room, spec, str);
+		break;
+	}
+	}
+
+	*data_pos = pos;
+	*written = n;
+	return true;
+}
+
+/* Format a trace record the same way log_puts() would have done at debug level */
+static void log_trace_format(const struct log_trace_slot *slot, char *buf, size_t size)
+{
+	const char *file = strrchr(slot->file, '/');
+	size_t len, pos = 0;
+	bool truncated = slot->truncated;
+
+	len = snprintf(buf, size, "%s%d %" PRId64 " %s:%u %s(): ",
+			log_strings[slot->level + 1], slot->count, slot->time,
+			file ? file + 1 : slot->file, slot->line, slot->function);
+	if (len >= size)
+		len = size - 1;
+
+	for (const char *p = slot->format; *p && len < size - 1; ) {
+		if (*p != '%') {
+			buf[len++] = *p++;
+			continue;
+		}
+
+		unsigned int stars;
+		enum log_trace_arg arg;
+		int precision;
+		const char *end = log_trace_parse_spec(p + 1, &stars, &arg, &precision);
+		char spec[32];
+		int written = 0;
+
+		snprintf(spec, sizeof(spec), "%.*s", (int)(end - p), p);
+		p = end;
+
+		if (!log_trace_format_arg(slot, &pos, spec, stars, arg,
+				buf + len, size - len, &written)) {
+			truncated = true;
+			break;
+		}
+		if (written > 0)
+			len += MIN((size_t)written, size - len - 1);
+	}
+	buf[len] = '\0';
+
+	/* the format normally carries the trailing newline, keep lines intact */
+	if (len > 0 && buf[len - 1] == '\n')
+		buf[--len] = '\0';
+	if (truncated)
+		snprintf(buf + len, size - len, " [...]");
+}
+
+static int log_trace_start(unsigned int num_slots)
+{
+	struct log_trace_slot *slots = calloc(num_slots, sizeof(*slots));
+	if (!slots) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	free(log_trace_slots);
+	log_trace_slots = slots;
+	log_trace_num_slots = num_slots;
+	log_trace_head = 0;
+	log_trace_running = true;
+	return ERROR_OK;
+}
+
 /* forward the log to the listeners */
 static void log_forward(const char *file, unsigned line, const char *function, const char *string)
 {
@@ -162,6 +607,12 @@ void log_printf(enum log_levels level,
 
 	va_start(ap, format);
 
+	if (log_trace_running && level >= LOG_LVL_DEBUG) {
+		log_trace_record(level, file, line, function, format, ap);
+		va_end(ap);
+		return;
+	}
+
 	string = alloc_vprintf(format, ap);
 	if (string) {
 		log_puts(level, file, line, function, string);
@@ -181,6 +632,12 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
 	if (level > debug_level)
 		return;
 
+	if (log_trace_running && level >= LOG_LVL_DEBUG) {
+		/* log_printf_lf() appends the newline, so does the dump */
+		log_trace_record(level, file, line, function, format, args);
+		return;
+	}
+
 	tmp = alloc_vprintf(format, args);
 
 	if (!tmp)
@@ -256,6 +713,123 @@ COMMAND_HANDLER(handle_log_output_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(handle_log_trace_start_command)
+{
+	unsigned int num_slots = log_trace_num_slots;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], num_slots);
+		if (num_slots == 0) {
+			command_print(CMD, "trace buffer needs at least one entry");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	int retval = log_trace_start(num_slots);
+	if (retval != ERROR_OK)
+		return retval;
+
+	command_print(CMD, "log trace running, %u entries of %u bytes",
+			log_trace_num_slots, (unsigned int)sizeof(struct log_trace_slot));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_trace_stop_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	log_trace_running = false;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_trace_dump_command)
+{
+	FILE *file = NULL;
+	char line[2 * LOG_TRACE_SLOT_SIZE + 128];
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!log_trace_slots || log_trace_head == 0) {
+		command_print(CMD, "log trace is empty");
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1) {
+		file = fopen(CMD_ARGV[0], "w");
+		if (!file) {
+			command_print(CMD, "failed to open '%s'", CMD_ARGV[0]);
+			return ERROR_FAIL;
+		}
+	}
+
+	uint64_t first = 0;
+	if (log_trace_head > log_trace_num_slots)
+		first = log_trace_head - log_trace_num_slots;
+
+	for (uint64_t i = first; i < log_trace_head; i++) {
+		log_trace_format(&log_trace_slots[i % log_trace_num_slots], line, sizeof(line));
+		if (file)
+			fprintf(file, "%s\n", line);
+		else
+			command_print(CMD, "%s", line);
+	}
+
+	if (file) {
+		fclose(file);
+		command_print(CMD, "%" PRIu64 " trace entries written to '%s'",
+				log_trace_head - first, CMD_ARGV[0]);
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_trace_clear_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	log_trace_head = 0;
+	return ERROR_OK;
+}
+
+static const struct command_registration log_trace_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_log_trace_start_command,
+		.mode = COMMAND_ANY,
+		.help = "start recording debug messages into the binary trace "
+			"ring buffer instead of the log output",
+		.usage = "[entries]",
+	},
+	{
+		.name = "stop",
+		.handler = handle_log_trace_stop_command,
+		.mode = COMMAND_ANY,
+		.help = "stop recording, keeping the content of the trace buffer",
+		.usage = "",
+	},
+	{
+		.name = "dump",
+		.handler = handle_log_trace_dump_command,
+		.mode = COMMAND_ANY,
+		.help = "format the content of the trace buffer, oldest first",
+		.usage = "[file_name]",
+	},
+	{
+		.name = "clear",
+		.handler = handle_log_trace_clear_command,
+		.mode = COMMAND_ANY,
+		.help = "discard the content of the trace buffer",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -274,6 +848,13 @@ static const struct command_registration log_command_handlers[] = {
 			"4 adds extra verbose debugging.",
 		.usage = "number",
 	},
+	{
+		.name = "log_trace",
+		.mode = COMMAND_ANY,
+		.help = "low overhead binary trace of debug messages",
+		.usage = "",
+		.chain = log_trace_subcommand_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -309,6 +890,10 @@ void log_exit(void)
 		fclose(log_output);
 	}
 	log_output = NULL;
+
+	log_trace_running = false;
+	free(log_trace_slots);
+	log_trace_slots = NULL;
 }
 
 int set_log_output(struct command_context *cmd_ctx, FILE *output)
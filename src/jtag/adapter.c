@@ -12,6 +12,7 @@
 #endif
 
 #include "adapter.h"
+#include "adapter_stats.h"
 #include "jtag.h"
 #include "minidriver.h"
 #include "interface.h"
@@ -865,6 +866,9 @@ static const struct command_registration adapter_command_handlers[] = {
 		.usage = "",
 		.chain = adapter_usb_command_handlers,
 	},
+	{
+		.chain = adapter_stats_command_handlers,
+	},
 	{
 		.name = "assert",
 		.handler = handle_adapter_reset_de_assert,
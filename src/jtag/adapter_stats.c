@@ -0,0 +1,406 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <helper/command.h>
+#include <helper/log.h>
+#include <helper/replacements.h>
+#include <helper/time_support.h>
+#include "adapter_stats.h"
+
+/* Histogram bucket i counts values from 2^i up to 2^(i+1) - 1, bucket 0
+ * also counts 0 and the last bucket everything above. */
+#define ADAPTER_STATS_BUCKETS	24
+
+/* pcap link type of the Linux usbmon capture format with 48 byte headers */
+#define PCAP_LINKTYPE_USB_LINUX	189
+#define PCAP_SNAPLEN		0x40000
+
+/* usbmon status values are negative Linux errno values */
+#define USBMON_EIO		5
+#define USBMON_ETIMEDOUT	110
+#define USBMON_EINPROGRESS	115
+
+enum adapter_stats_dir {
+	ADAPTER_STATS_OUT,
+	ADAPTER_STATS_IN,
+	ADAPTER_STATS_DIRS,
+};
+
+static const char * const adapter_stats_dir_name[ADAPTER_STATS_DIRS] = {
+	[ADAPTER_STATS_OUT] = "out",
+	[ADAPTER_STATS_IN] = "in",
+};
+
+struct adapter_stats_counters {
+	uint64_t transfers;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t timeouts;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint64_t latency[ADAPTER_STATS_BUCKETS];
+	uint64_t size[ADAPTER_STATS_BUCKETS];
+};
+
+static struct adapter_stats_counters adapter_stats[ADAPTER_STATS_DIRS];
+
+struct pcap_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t network;
+};
+
+/* Per packet header of PCAP_LINKTYPE_USB_LINUX, in host byte order. */
+struct usbmon_packet {
+	uint64_t id;
+	uint8_t type;		/* 'S' submission, 'C' completion */
+	uint8_t xfer_type;
+	uint8_t epnum;
+	uint8_t devnum;
+	uint16_t busnum;
+	int8_t flag_setup;	/* 0 if setup is valid */
+	int8_t flag_data;	/* 0 if data follows */
+	int64_t ts_sec;
+	int32_t ts_usec;
+	int32_t status;
+	uint32_t length;
+	uint32_t len_cap;
+	uint8_t setup[8];
+};
+
+static FILE *adapter_stats_capture;
+static uint64_t adapter_stats_capture_id;
+
+int64_t adapter_stats_timestamp(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static unsigned int adapter_stats_bucket(uint64_t value)
+{
+	unsigned int bucket = 0;
+
+	while (value > 1 && bucket < ADAPTER_STATS_BUCKETS - 1) {
+		value >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static void adapter_stats_capture_packet(int64_t ts, uint8_t type, enum adapter_stats_type xfer_type,
+		uint8_t endpoint, const uint8_t *setup, const uint8_t *data, int length, int status)
+{
+	struct usbmon_packet packet = {
+		.id = adapter_stats_capture_id,
+		.type = type,
+		.xfer_type = xfer_type,
+		.epnum = endpoint,
+		.flag_setup = (setup && type == 'S') ? 0 : '-',
+		.flag_data = data ? 0 : ((endpoint & 0x80) ? '<' : '>'),
+		.ts_sec = ts / 1000000,
+		.ts_usec = ts % 1000000,
+		.status = status,
+		.length = length,
+		.len_cap = data ? MIN((uint32_t)length, PCAP_SNAPLEN - sizeof(packet)) : 0,
+	};
+	if (!packet.flag_setup)
+		memcpy(packet.setup, setup, sizeof(packet.setup));
+
+	uint32_t record[4] = {
+		packet.ts_sec,
+		packet.ts_usec,
+		sizeof(packet) + packet.len_cap,
+		sizeof(packet) + packet.len_cap,
+	};
+
+	if (fwrite(record, sizeof(record), 1, adapter_stats_capture) != 1 ||
+			fwrite(&packet, sizeof(packet), 1, adapter_stats_capture) != 1 ||
+			(packet.len_cap && fwrite(data, packet.len_cap, 1, adapter_stats_capture) != 1)) {
+		LOG_ERROR("error writing USB capture file, capture stopped");
+		fclose(adapter_stats_capture);
+		adapter_stats_capture = NULL;
+	}
+}
+
+void adapter_stats_record(int64_t start, enum adapter_stats_type type,
+		uint8_t endpoint, const uint8_t *setup, const uint8_t *data,
+		int length, int retval)
+{
+	int64_t end = adapter_stats_timestamp();
+	uint64_t latency = end > start ? end - start : 0;
+	struct adapter_stats_counters *stats =
+		&adapter_stats[(endpoint & 0x80) ? ADAPTER_STATS_IN : ADAPTER_STATS_OUT];
+
+	if (length < 0)
+		length = 0;
+
+	if (retval == ERROR_TIMEOUT_REACHED) {
+		stats->timeouts++;
+	} else if (retval != ERROR_OK) {
+		stats->errors++;
+	} else {
+		stats->transfers++;
+		stats->bytes += length;
+		stats->total_us += latency;
+		if (latency > stats->max_us)
+			stats->max_us = latency;
+		stats->latency[adapter_stats_bucket(latency)]++;
+		stats->size[adapter_stats_bucket(length)]++;
+	}
+
+	if (!adapter_stats_capture)
+		return;
+
+	int status = 0;
+	if (retval == ERROR_TIMEOUT_REACHED)
+		status = -USBMON_ETIMEDOUT;
+	else if (retval != ERROR_OK)
+		status = -USBMON_EIO;
+
+	bool in = endpoint & 0x80;
+	adapter_stats_capture_id++;
+	adapter_stats_capture_packet(start, 'S', type, endpoint, setup, in ? NULL : data, length,
+			-USBMON_EINPROGRESS);
+	if (adapter_stats_capture)
+		adapter_stats_capture_packet(end, 'C', type, endpoint, NULL, in ? data : NULL, length, status);
+}
+
+static void adapter_stats_reset(void)
+{
+	memset(adapter_stats, 0, sizeof(adapter_stats));
+}
+
+static int adapter_stats_capture_start(const char *filename)
+{
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		LOG_ERROR("cannot create USB capture file '%s'", filename);
+		return ERROR_FAIL;
+	}
+
+	const struct pcap_header header = {
+		.magic = 0xa1b2c3d4,	/* microsecond timestamps */
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = PCAP_SNAPLEN,
+		.network = PCAP_LINKTYPE_USB_LINUX,
+	};
+
+	if (fwrite(&header, sizeof(header), 1, f) != 1) {
+		LOG_ERROR("error writing USB capture file '%s'", filename);
+		fclose(f);
+		return ERROR_FAIL;
+	}
+
+	if (adapter_stats_capture)
+		fclose(adapter_stats_capture);
+	adapter_stats_capture = f;
+	return ERROR_OK;
+}
+
+static void adapter_stats_capture_stop(void)
+{
+	if (adapter_stats_capture) {
+		fclose(adapter_stats_capture);
+		adapter_stats_capture = NULL;
+	}
+}
+
+static int adapter_stats_append(char *buf, size_t size, size_t *len, const char *format, ...)
+	__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 4, 5)));
+
+static int adapter_stats_append(char *buf, size_t size, size_t *len, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	int n = vsnprintf(buf + *len, size - *len, format, ap);
+	va_end(ap);
+
+	if (n < 0 || (size_t)n >= size - *len)
+		return ERROR_BUF_TOO_SMALL;
+	*len += n;
+	return ERROR_OK;
+}
+
+static int adapter_stats_json(char *buf, size_t size)
+{
+	size_t len = 0;
+	int retval = adapter_stats_append(buf, size, &len, "{");
+
+	for (unsigned int dir = 0; dir < ADAPTER_STATS_DIRS && retval == ERROR_OK; dir++) {
+		const struct adapter_stats_counters *stats = &adapter_stats[dir];
+
+		retval = adapter_stats_append(buf, size, &len,
+			"%s\n\t\"%s\": {\n"
+			"\t\t\"transfers\": %" PRIu64 ",\n"
+			"\t\t\"bytes\": %" PRIu64 ",\n"
+			"\t\t\"errors\": %" PRIu64 ",\n"
+			"\t\t\"timeouts\": %" PRIu64 ",\n"
+			"\t\t\"total_us\": %" PRIu64 ",\n"
+			"\t\t\"max_us\": %" PRIu64 ",\n"
+			"\t\t\"latency_us_log2\": [",
+			dir ? "," : "", adapter_stats_dir_name[dir],
+			stats->transfers, stats->bytes, stats->errors, stats->timeouts,
+			stats->total_us, stats->max_us);
+
+		for (unsigned int i = 0; i < ADAPTER_STATS_BUCKETS && retval == ERROR_OK; i++)
+			retval = adapter_stats_append(buf, size, &len, "%s%" PRIu64,
+				i ? ", " : "", stats->latency[i]);
+		if (retval == ERROR_OK)
+			retval = adapter_stats_append(buf, size, &len, "],\n\t\t\"size_log2\": [");
+		for (unsigned int i = 0; i < ADAPTER_STATS_BUCKETS && retval == ERROR_OK; i++)
+			retval = adapter_stats_append(buf, size, &len, "%s%" PRIu64,
+				i ? ", " : "", stats->size[i]);
+		if (retval == ERROR_OK)
+			retval = adapter_stats_append(buf, size, &len, "]\n\t}");
+	}
+
+	if (retval == ERROR_OK)
+		retval = adapter_stats_append(buf, size, &len, "\n}");
+
+	return retval;
+}
+
+static void adapter_stats_print_histogram(struct command_invocation *cmd, const char *title,
+		bool size)
+{
+	const struct adapter_stats_counters *stats_out = &adapter_stats[ADAPTER_STATS_OUT];
+	const struct adapter_stats_counters *stats_in = &adapter_stats[ADAPTER_STATS_IN];
+	const uint64_t *out = size ? stats_out->size : stats_out->latency;
+	const uint64_t *in = size ? stats_in->size : stats_in->latency;
+
+	command_print(cmd, "%-16s %12s %12s", title,
+		adapter_stats_dir_name[ADAPTER_STATS_OUT], adapter_stats_dir_name[ADAPTER_STATS_IN]);
+
+	for (unsigned int i = 0; i < ADAPTER_STATS_BUCKETS; i++) {
+		if (!out[i] && !in[i])
+			continue;
+
+		char range[16];
+		if (i == ADAPTER_STATS_BUCKETS - 1)
+			snprintf(range, sizeof(range), ">= %u", 1u << i);
+		else
+			snprintf(range, sizeof(range), "< %u", 2u << i);
+		command_print(cmd, "  %-14s %12" PRIu64 " %12" PRIu64, range, out[i], in[i]);
+	}
+}
+
+static void adapter_stats_print(struct command_invocation *cmd)
+{
+	command_print(cmd, "%-4s %12s %14s %8s %8s %10s %10s", "",
+		"transfers", "bytes", "errors", "timeouts", "avg us", "max us");
+
+	for (unsigned int dir = 0; dir < ADAPTER_STATS_DIRS; dir++) {
+		const struct adapter_stats_counters *stats = &adapter_stats[dir];
+
+		command_print(cmd, "%-4s %12" PRIu64 " %14" PRIu64 " %8" PRIu64 " %8" PRIu64
+			" %10" PRIu64 " %10" PRIu64,
+			adapter_stats_dir_name[dir], stats->transfers, stats->bytes,
+			stats->errors, stats->timeouts,
+			stats->transfers ? stats->total_us / stats->transfers : 0,
+			stats->max_us);
+	}
+
+	adapter_stats_print_histogram(cmd, "latency (us)", false);
+	adapter_stats_print_histogram(cmd, "size (bytes)", true);
+
+	if (adapter_stats_capture)
+		command_print(cmd, "capturing transfers");
+}
+
+COMMAND_HANDLER(handle_adapter_stats_command)
+{
+	if (CMD_ARGC == 0) {
+		adapter_stats_print(CMD);
+		return ERROR_OK;
+	}
+
+	if (strcmp(CMD_ARGV[0], "reset") == 0) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		adapter_stats_reset();
+		return ERROR_OK;
+	}
+
+	if (strcmp(CMD_ARGV[0], "json") == 0) {
+		if (CMD_ARGC > 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		char json[8192];
+		int retval = adapter_stats_json(json, sizeof(json));
+		if (retval != ERROR_OK) {
+			LOG_ERROR("USB statistics do not fit the JSON buffer");
+			return retval;
+		}
+
+		if (CMD_ARGC == 1) {
+			command_print(CMD, "%s", json);
+			return ERROR_OK;
+		}
+
+		FILE *f = fopen(CMD_ARGV[1], "w");
+		if (!f) {
+			LOG_ERROR("cannot create '%s'", CMD_ARGV[1]);
+			return ERROR_FAIL;
+		}
+		retval = fprintf(f, "%s\n", json) < 0 ? ERROR_FAIL : ERROR_OK;
+		if (fclose(f) != 0)
+			retval = ERROR_FAIL;
+		if (retval != ERROR_OK)
+			LOG_ERROR("error writing '%s'", CMD_ARGV[1]);
+		return retval;
+	}
+
+	if (strcmp(CMD_ARGV[0], "capture") == 0) {
+		if (CMD_ARGC != 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		if (strcmp(CMD_ARGV[1], "off") == 0) {
+			adapter_stats_capture_stop();
+			return ERROR_OK;
+		}
+		return adapter_stats_capture_start(CMD_ARGV[1]);
+	}
+
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
+const struct command_registration adapter_stats_command_handlers[] = {
+	{
+		.name = "stats",
+		.handler = handle_adapter_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "Show, reset or export the USB transfer statistics of the adapter, "
+			"or capture the transfers to a pcap file.",
+		.usage = "['reset' | 'json' [filename] | 'capture' (filename | 'off')]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
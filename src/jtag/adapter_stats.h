@@ -0,0 +1,58 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_JTAG_ADAPTER_STATS_H
+#define OPENOCD_JTAG_ADAPTER_STATS_H
+
+#include <helper/command.h>
+
+/* Statistics of the USB transfers done by the debug adapter drivers.
+ *
+ * Drivers take a timestamp with adapter_stats_timestamp() before a
+ * transfer and hand it to adapter_stats_record() once the transfer has
+ * completed. Completed transfers are counted per direction together with
+ * log2 histograms of their latency and size; failed and timed out
+ * transfers are only counted. The "adapter stats" command shows, resets
+ * and exports the statistics and can capture the transfers to a pcap
+ * file in the Linux usbmon format. */
+
+/** Transfer types, numbered as in the usbmon capture format. */
+enum adapter_stats_type {
+	ADAPTER_STATS_INTERRUPT = 1,
+	ADAPTER_STATS_CONTROL = 2,
+	ADAPTER_STATS_BULK = 3,
+};
+
+/** @returns the current time in microseconds, to pass to adapter_stats_record() */
+int64_t adapter_stats_timestamp(void);
+
+/**
+ * Record one completed transfer.
+ *
+ * @param start Timestamp taken before the transfer was submitted.
+ * @param type Transfer type.
+ * @param endpoint Endpoint address, bit 7 set for IN transfers.
+ * @param setup The 8 byte setup packet of control transfers, else NULL.
+ * @param data The data transferred, only used for the capture file.
+ * @param length Number of bytes actually transferred.
+ * @param retval ERROR_OK, ERROR_TIMEOUT_REACHED or another error code.
+ */
+void adapter_stats_record(int64_t start, enum adapter_stats_type type,
+		uint8_t endpoint, const uint8_t *setup, const uint8_t *data,
+		int length, int retval);
+
+extern const struct command_registration adapter_stats_command_handlers[];
+
+#endif /* OPENOCD_JTAG_ADAPTER_STATS_H */
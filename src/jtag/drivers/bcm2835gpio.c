@@ -60,13 +60,16 @@ static int bcm2835gpio_swd_write(int swclk, int swdio);
 static int bcm2835gpio_init(void);
 static int bcm2835gpio_quit(void);
 
+static struct bitbang_gpio_bank bcm2835gpio_bank;
+
 static struct bitbang_interface bcm2835gpio_bitbang = {
 	.read = bcm2835gpio_read,
 	.write = bcm2835gpio_write,
 	.swdio_read = bcm2835_swdio_read,
 	.swdio_drive = bcm2835_swdio_drive,
 	.swd_write = bcm2835gpio_swd_write,
-	.blink = NULL
+	.blink = NULL,
+	.gpio = &bcm2835gpio_bank,
 };
 
 /* GPIO numbers for each signal. Negative values are invalid */
@@ -96,13 +99,13 @@ static unsigned int jtag_delay;
 
 static bb_value_t bcm2835gpio_read(void)
 {
-	return (GPIO_LEV & 1<<tdo_gpio) ? BB_HIGH : BB_LOW;
+	return (GPIO_LEV & 1u << tdo_gpio) ? BB_HIGH : BB_LOW;
 }
 
 static int bcm2835gpio_write(int tck, int tms, int tdi)
 {
-	uint32_t set = tck<<tck_gpio | tms<<tms_gpio | tdi<<tdi_gpio;
-	uint32_t clear = !tck<<tck_gpio | !tms<<tms_gpio | !tdi<<tdi_gpio;
+	uint32_t set = (uint32_t)tck << tck_gpio | (uint32_t)tms << tms_gpio | (uint32_t)tdi << tdi_gpio;
+	uint32_t clear = (uint32_t)!tck << tck_gpio | (uint32_t)!tms << tms_gpio | (uint32_t)!tdi << tdi_gpio;
 
 	GPIO_SET = set;
 	GPIO_CLR = clear;
@@ -115,8 +118,8 @@ static int bcm2835gpio_write(int tck, int tms, int tdi)
 
 static int bcm2835gpio_swd_write(int swclk, int swdio)
 {
-	uint32_t set = swclk << swclk_gpio | swdio << swdio_gpio;
-	uint32_t clear = !swclk << swclk_gpio | !swdio << swdio_gpio;
+	uint32_t set = (uint32_t)swclk << swclk_gpio | (uint32_t)swdio << swdio_gpio;
+	uint32_t clear = (uint32_t)!swclk << swclk_gpio | (uint32_t)!swdio << swdio_gpio;
 
 	GPIO_SET = set;
 	GPIO_CLR = clear;
@@ -134,13 +137,13 @@ static int bcm2835gpio_reset(int trst, int srst)
 	uint32_t clear = 0;
 
 	if (trst_gpio > 0) {
-		set |= !trst<<trst_gpio;
-		clear |= trst<<trst_gpio;
+		set |= (uint32_t)!trst << trst_gpio;
+		clear |= (uint32_t)trst << trst_gpio;
 	}
 
 	if (srst_gpio > 0) {
-		set |= !srst<<srst_gpio;
-		clear |= srst<<srst_gpio;
+		set |= (uint32_t)!srst << srst_gpio;
+		clear |= (uint32_t)srst << srst_gpio;
 	}
 
 	GPIO_SET = set;
@@ -153,11 +156,11 @@ static void bcm2835_swdio_drive(bool is_output)
 {
 	if (swdio_dir_gpio > 0) {
 		if (is_output) {
-			GPIO_SET = 1 << swdio_dir_gpio;
+			GPIO_SET = 1u << swdio_dir_gpio;
 			OUT_GPIO(swdio_gpio);
 		} else {
 			INP_GPIO(swdio_gpio);
-			GPIO_CLR = 1 << swdio_dir_gpio;
+			GPIO_CLR = 1u << swdio_dir_gpio;
 		}
 	} else {
 		if (is_output)
@@ -169,7 +172,7 @@ static void bcm2835_swdio_drive(bool is_output)
 
 static int bcm2835_swdio_read(void)
 {
-	return !!(GPIO_LEV & 1 << swdio_gpio);
+	return !!(GPIO_LEV & 1u << swdio_gpio);
 }
 
 static int bcm2835gpio_khz(int khz, int *jtag_speed)
@@ -193,6 +196,7 @@ static int bcm2835gpio_speed_div(int speed, int *khz)
 static int bcm2835gpio_speed(int speed)
 {
 	jtag_delay = speed;
+	bcm2835gpio_bank.delay = speed;
 	return ERROR_OK;
 }
 
@@ -442,6 +446,9 @@ static const struct command_registration bcm2835gpio_command_handlers[] = {
 		.chain = bcm2835gpio_subcommand_handlers,
 		.usage = "",
 	},
+	{
+		.chain = bitbang_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -538,6 +545,21 @@ static int bcm2835gpio_init(void)
 	/* set 4mA drive strength, slew rate limited, hysteresis on */
 	pads_base[BCM2835_PADS_GPIO_0_27_OFFSET] = 0x5a000008 + 1;
 
+	/* all usable pins live in bank 0, so the bitbang fast path always applies */
+	bcm2835gpio_bank.set = &GPIO_SET;
+	bcm2835gpio_bank.clear = &GPIO_CLR;
+	bcm2835gpio_bank.level = &GPIO_LEV;
+	if (transport_is_jtag()) {
+		bcm2835gpio_bank.tck = 1u << tck_gpio;
+		bcm2835gpio_bank.tms = 1u << tms_gpio;
+		bcm2835gpio_bank.tdi = 1u << tdi_gpio;
+		bcm2835gpio_bank.tdo = 1u << tdo_gpio;
+	}
+	if (transport_is_swd()) {
+		bcm2835gpio_bank.swclk = 1u << swclk_gpio;
+		bcm2835gpio_bank.swdio = 1u << swdio_gpio;
+	}
+
 	/*
 	 * Configure TDO as an input, and TDI, TCK, TMS, TRST, SRST
 	 * as outputs.  Drive TDI and TCK low, and TMS/TRST/SRST high.
@@ -550,8 +572,8 @@ static int bcm2835gpio_init(void)
 
 		INP_GPIO(tdo_gpio);
 
-		GPIO_CLR = 1<<tdi_gpio | 1<<tck_gpio;
-		GPIO_SET = 1<<tms_gpio;
+		GPIO_CLR = 1u << tdi_gpio | 1u << tck_gpio;
+		GPIO_SET = 1u << tms_gpio;
 
 		OUT_GPIO(tdi_gpio);
 		OUT_GPIO(tck_gpio);
@@ -559,7 +581,7 @@ static int bcm2835gpio_init(void)
 
 		if (trst_gpio != -1) {
 			trst_gpio_mode = MODE_GPIO(trst_gpio);
-			GPIO_SET = 1 << trst_gpio;
+			GPIO_SET = 1u << trst_gpio;
 			OUT_GPIO(trst_gpio);
 		}
 	}
@@ -568,7 +590,7 @@ static int bcm2835gpio_init(void)
 		swclk_gpio_mode = MODE_GPIO(swclk_gpio);
 		swdio_gpio_mode = MODE_GPIO(swdio_gpio);
 
-		GPIO_CLR = 1<<swdio_gpio | 1<<swclk_gpio;
+		GPIO_CLR = 1u << swdio_gpio | 1u << swclk_gpio;
 
 		OUT_GPIO(swclk_gpio);
 		OUT_GPIO(swdio_gpio);
@@ -576,13 +598,13 @@ static int bcm2835gpio_init(void)
 
 	if (srst_gpio != -1) {
 		srst_gpio_mode = MODE_GPIO(srst_gpio);
-		GPIO_SET = 1 << srst_gpio;
+		GPIO_SET = 1u << srst_gpio;
 		OUT_GPIO(srst_gpio);
 	}
 
 	if (swdio_dir_gpio != -1) {
 		swdio_dir_gpio_mode = MODE_GPIO(swdio_dir_gpio);
-		GPIO_SET = 1 << swdio_dir_gpio;
+		GPIO_SET = 1u << swdio_dir_gpio;
 		OUT_GPIO(swdio_dir_gpio);
 	}
 
@@ -29,6 +29,8 @@
 #include "bitbang.h"
 #include <jtag/interface.h>
 #include <jtag/commands.h>
+#include <helper/time_support.h>
+#include <transport/transport.h>
 
 /**
  * Function bitbang_stableclocks
@@ -64,6 +66,100 @@ struct bitbang_interface *bitbang_interface;
  */
 #define CLOCK_IDLE() 0
 
+/* Drive a memory-mapped GPIO bank. 'rmw' is a constant at every call site,
+ * so the set/clear register and the data register flavour each get their
+ * own fully inlined loop. */
+static inline void bitbang_gpio_out(const struct bitbang_gpio_bank *gpio, bool rmw,
+		uint32_t set, uint32_t clear)
+{
+	if (rmw) {
+		*gpio->data = (*gpio->data & ~clear) | set;
+	} else {
+		*gpio->set = set;
+		*gpio->clear = clear;
+	}
+
+	for (unsigned int i = 0; i < gpio->delay; i++)
+		asm volatile ("");
+}
+
+/* Clock 'num_bits' bits, LSB first, a byte at a time. TMS comes from 'tms',
+ * or from 'tms_fill' when 'tms' is NULL, and is forced high on the last bit
+ * when 'tms_last' is set. TDI comes from 'tdi' (low when NULL) and TDO is
+ * captured into 'tdo' when not NULL. 'tdi' and 'tdo' may be the same buffer.
+ * TCK is left high. */
+static inline void bitbang_gpio_shift(const struct bitbang_gpio_bank *gpio, bool rmw,
+		const uint8_t *tms, bool tms_fill, bool tms_last,
+		const uint8_t *tdi, uint8_t *tdo, unsigned int num_bits)
+{
+	/* pins to set, indexed by (tms << 1) | tdi */
+	const uint32_t pins[4] = {
+		0, gpio->tdi, gpio->tms, gpio->tms | gpio->tdi
+	};
+	const uint32_t data_mask = gpio->tms | gpio->tdi;
+	const unsigned int num_bytes = DIV_ROUND_UP(num_bits, 8);
+
+	for (unsigned int byte = 0; byte < num_bytes; byte++) {
+		unsigned int bits = MIN(num_bits - 8 * byte, 8u);
+		unsigned int tms_byte = tms ? tms[byte] : (tms_fill ? 0xff : 0);
+		unsigned int tdi_byte = tdi ? tdi[byte] : 0;
+		unsigned int tdo_byte = 0;
+
+		if (tms_last && byte == num_bytes - 1)
+			tms_byte |= 1 << (bits - 1);
+
+		for (unsigned int i = 0; i < bits; i++) {
+			uint32_t set = pins[(tms_byte & 1) << 1 | (tdi_byte & 1)];
+			uint32_t clear = data_mask & ~set;
+
+			tms_byte >>= 1;
+			tdi_byte >>= 1;
+
+			bitbang_gpio_out(gpio, rmw, set, clear | gpio->tck);
+			if (tdo && (*gpio->level & gpio->tdo))
+				tdo_byte |= 1 << i;
+			bitbang_gpio_out(gpio, rmw, set | gpio->tck, clear);
+		}
+
+		if (tdo) {
+			uint8_t keep = 0xff << bits;
+			tdo[byte] = (tdo[byte] & keep) | tdo_byte;
+		}
+	}
+}
+
+static void bitbang_gpio_jtag_shift(const struct bitbang_gpio_bank *gpio,
+		const uint8_t *tms, bool tms_fill, bool tms_last,
+		const uint8_t *tdi, uint8_t *tdo, unsigned int num_bits)
+{
+	if (gpio->set)
+		bitbang_gpio_shift(gpio, false, tms, tms_fill, tms_last, tdi, tdo, num_bits);
+	else
+		bitbang_gpio_shift(gpio, true, tms, tms_fill, tms_last, tdi, tdo, num_bits);
+}
+
+static inline void bitbang_gpio_swd_shift(const struct bitbang_gpio_bank *gpio, bool rmw,
+		bool rnw, uint8_t *buf, unsigned int offset, unsigned int bit_cnt)
+{
+	for (unsigned int i = offset; i < bit_cnt + offset; i++) {
+		int bytec = i/8;
+		int bcval = 1 << (i % 8);
+		uint32_t set = (!rnw && (buf[bytec] & bcval)) ? gpio->swdio : 0;
+		uint32_t clear = gpio->swdio & ~set;
+
+		bitbang_gpio_out(gpio, rmw, set, clear | gpio->swclk);
+
+		if (rnw && buf) {
+			if (*gpio->level & gpio->swdio)
+				buf[bytec] |= bcval;
+			else
+				buf[bytec] &= ~bcval;
+		}
+
+		bitbang_gpio_out(gpio, rmw, set | gpio->swclk, clear);
+	}
+}
+
 /* The bitbang driver leaves the TCK 0 when in idle */
 static void bitbang_end_state(tap_state_t state)
 {
@@ -71,20 +167,46 @@ static void bitbang_end_state(tap_state_t state)
 	tap_set_end_state(state);
 }
 
-static int bitbang_state_move(int skip)
+/**
+ * Clock 'num_bits' TMS bits with TDI low, then return TCK to idle.
+ * TMS comes from 'bits', or is 'tms_fill' for every bit when 'bits' is NULL.
+ */
+static int bitbang_clock_tms(const uint8_t *bits, int tms_fill, unsigned int num_bits)
 {
-	int i = 0, tms = 0;
-	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
-	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
+	struct bitbang_gpio_bank *gpio = bitbang_interface->gpio;
+	int tms = 0;
 
-	for (i = skip; i < tms_count; i++) {
-		tms = (tms_scan >> i) & 1;
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
+	if (num_bits)
+		tms = bits ? (bits[(num_bits - 1) / 8] >> ((num_bits - 1) % 8)) & 1 : tms_fill;
+
+	if (gpio) {
+		uint32_t set = tms ? gpio->tms : 0;
+
+		bitbang_gpio_jtag_shift(gpio, bits, tms_fill, false, NULL, NULL, num_bits);
+		bitbang_gpio_out(gpio, !gpio->set, set,
+			(gpio->tck | gpio->tms | gpio->tdi) & ~set);
+		return ERROR_OK;
+	}
+
+	for (unsigned int i = 0; i < num_bits; i++) {
+		int bit = bits ? (bits[i / 8] >> (i % 8)) & 1 : tms_fill;
+		if (bitbang_interface->write(0, bit, 0) != ERROR_OK)
 			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
+		if (bitbang_interface->write(1, bit, 0) != ERROR_OK)
 			return ERROR_FAIL;
 	}
-	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
+
+	return bitbang_interface->write(CLOCK_IDLE(), tms, 0);
+}
+
+static int bitbang_state_move(int skip)
+{
+	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
+	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
+
+	/* the whole path goes out in one go, skipping the bits already clocked */
+	tms_scan >>= skip;
+	if (bitbang_clock_tms(&tms_scan, 0, tms_count > skip ? tms_count - skip : 0) != ERROR_OK)
 		return ERROR_FAIL;
 
 	tap_set_state(tap_get_end_state());
@@ -102,18 +224,7 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 
 	LOG_DEBUG_IO("TMS: %d bits", num_bits);
 
-	int tms = 0;
-	for (unsigned i = 0; i < num_bits; i++) {
-		tms = ((bits[i/8] >> (i % 8)) & 1);
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-	}
-	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
-		return ERROR_FAIL;
-
-	return ERROR_OK;
+	return bitbang_clock_tms(bits, 0, num_bits);
 }
 
 static int bitbang_path_move(struct pathmove_command *cmd)
@@ -154,8 +265,6 @@ static int bitbang_path_move(struct pathmove_command *cmd)
 
 static int bitbang_runtest(int num_cycles)
 {
-	int i;
-
 	tap_state_t saved_end_state = tap_get_end_state();
 
 	/* only do a state_move when we're not already in IDLE */
@@ -166,13 +275,7 @@ static int bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-	}
-	if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
+	if (bitbang_clock_tms(NULL, 0, num_cycles) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* finish in end_state */
@@ -187,41 +290,30 @@ static int bitbang_runtest(int num_cycles)
 static int bitbang_stableclocks(int num_cycles)
 {
 	int tms = (tap_get_state() == TAP_RESET ? 1 : 0);
-	int i;
 
 	/* send num_cycles clocks onto the cable */
-	for (i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-	}
-
-	return ERROR_OK;
+	return bitbang_clock_tms(NULL, tms, num_cycles);
 }
 
-static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
-		unsigned scan_size)
+/**
+ * Shift 'scan_size' bits through the current shift state. TMS is raised on
+ * the last bit when 'exit_shift' is set. TCK is left high.
+ */
+static int bitbang_shift(enum scan_type type, uint8_t *buffer, unsigned int scan_size,
+		bool exit_shift)
 {
-	tap_state_t saved_end_state = tap_get_end_state();
-	unsigned bit_cnt;
-
-	if (!((!ir_scan &&
-			(tap_get_state() == TAP_DRSHIFT)) ||
-			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
-		if (ir_scan)
-			bitbang_end_state(TAP_IRSHIFT);
-		else
-			bitbang_end_state(TAP_DRSHIFT);
+	unsigned int bit_cnt;
 
-		if (bitbang_state_move(0) != ERROR_OK)
-			return ERROR_FAIL;
-		bitbang_end_state(saved_end_state);
+	if (bitbang_interface->gpio) {
+		bitbang_gpio_jtag_shift(bitbang_interface->gpio, NULL, false, exit_shift,
+			type != SCAN_IN ? buffer : NULL,
+			type != SCAN_OUT ? buffer : NULL, scan_size);
+		return ERROR_OK;
 	}
 
 	size_t buffered = 0;
 	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
+		int tms = (exit_shift && bit_cnt == scan_size-1) ? 1 : 0;
 		int tdi;
 		int bytec = bit_cnt/8;
 		int bcval = 1 << (bit_cnt % 8);
@@ -278,6 +370,30 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		}
 	}
 
+	return ERROR_OK;
+}
+
+static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
+		unsigned scan_size)
+{
+	tap_state_t saved_end_state = tap_get_end_state();
+
+	if (!((!ir_scan &&
+			(tap_get_state() == TAP_DRSHIFT)) ||
+			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
+		if (ir_scan)
+			bitbang_end_state(TAP_IRSHIFT);
+		else
+			bitbang_end_state(TAP_DRSHIFT);
+
+		if (bitbang_state_move(0) != ERROR_OK)
+			return ERROR_FAIL;
+		bitbang_end_state(saved_end_state);
+	}
+
+	if (bitbang_shift(type, buffer, scan_size, true) != ERROR_OK)
+		return ERROR_FAIL;
+
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
 		 * the shift state, so we skip the first state
@@ -382,6 +498,7 @@ int bitbang_execute_queue(void)
 }
 
 static int queued_retval;
+static struct swd_run_stats swd_stats;
 
 static int bitbang_swd_init(void)
 {
@@ -398,21 +515,28 @@ static void bitbang_swd_exchange(bool rnw, uint8_t buf[], unsigned int offset, u
 		bitbang_interface->blink(1);
 	}
 
-	for (unsigned int i = offset; i < bit_cnt + offset; i++) {
-		int bytec = i/8;
-		int bcval = 1 << (i % 8);
-		int swdio = !rnw && (buf[bytec] & bcval);
-
-		bitbang_interface->swd_write(0, swdio);
+	struct bitbang_gpio_bank *gpio = bitbang_interface->gpio;
+	if (gpio && gpio->set) {
+		bitbang_gpio_swd_shift(gpio, false, rnw, buf, offset, bit_cnt);
+	} else if (gpio) {
+		bitbang_gpio_swd_shift(gpio, true, rnw, buf, offset, bit_cnt);
+	} else {
+		for (unsigned int i = offset; i < bit_cnt + offset; i++) {
+			int bytec = i/8;
+			int bcval = 1 << (i % 8);
+			int swdio = !rnw && (buf[bytec] & bcval);
+
+			bitbang_interface->swd_write(0, swdio);
+
+			if (rnw && buf) {
+				if (bitbang_interface->swdio_read())
+					buf[bytec] |= bcval;
+				else
+					buf[bytec] &= ~bcval;
+			}
 
-		if (rnw && buf) {
-			if (bitbang_interface->swdio_read())
-				buf[bytec] |= bcval;
-			else
-				buf[bytec] &= ~bcval;
+			bitbang_interface->swd_write(1, swdio);
 		}
-
-		bitbang_interface->swd_write(1, swdio);
 	}
 
 	if (bitbang_interface->blink) {
@@ -468,6 +592,23 @@ static void swd_clear_sticky_errors(void)
 		STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR, 0);
 }
 
+/* Account for a WAIT acknowledge. Returns true, with the queue failed, once
+ * the transaction has been stalling for too long. */
+static bool bitbang_swd_wait_timeout(int64_t *wait_start)
+{
+	swd_stats.waits++;
+
+	if (!*wait_start) {
+		*wait_start = timeval_ms();
+	} else if (timeval_ms() - *wait_start > SWD_WAIT_TIMEOUT_MS) {
+		LOG_DEBUG("SWD transaction still stalled after %d ms", SWD_WAIT_TIMEOUT_MS);
+		queued_retval = ERROR_WAIT;
+		return true;
+	}
+
+	return false;
+}
+
 static void bitbang_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_clk)
 {
 	LOG_DEBUG("bitbang_swd_read_reg");
@@ -478,6 +619,8 @@ static void bitbang_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay
 		return;
 	}
 
+	int64_t wait_start = 0;
+
 	for (;;) {
 		uint8_t trn_ack_data_parity_trn[DIV_ROUND_UP(4 + 3 + 32 + 1 + 4, 8)];
 
@@ -499,6 +642,8 @@ static void bitbang_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay
 			  data);
 
 		if (ack == SWD_ACK_WAIT) {
+			if (bitbang_swd_wait_timeout(&wait_start))
+				return;
 			swd_clear_sticky_errors();
 			continue;
 		} else if (ack != SWD_ACK_OK) {
@@ -513,8 +658,10 @@ static void bitbang_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay
 		}
 		if (value)
 			*value = data;
-		if (cmd & SWD_CMD_APNDP)
+		if (cmd & SWD_CMD_APNDP) {
+			swd_stats.ap_transactions++;
 			bitbang_swd_exchange(true, NULL, 0, ap_delay_clk);
+		}
 		return;
 	}
 }
@@ -531,6 +678,7 @@ static void bitbang_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay
 
 	/* Devices do not reply to DP_TARGETSEL write cmd, ignore received ack */
 	bool check_ack = swd_cmd_returns_ack(cmd);
+	int64_t wait_start = 0;
 
 	for (;;) {
 		uint8_t trn_ack_data_parity_trn[DIV_ROUND_UP(4 + 3 + 32 + 1 + 4, 8)];
@@ -556,6 +704,8 @@ static void bitbang_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay
 
 		if (check_ack) {
 			if (ack == SWD_ACK_WAIT) {
+				if (bitbang_swd_wait_timeout(&wait_start))
+					return;
 				swd_clear_sticky_errors();
 				continue;
 			} else if (ack != SWD_ACK_OK) {
@@ -564,8 +714,10 @@ static void bitbang_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay
 			}
 		}
 
-		if (cmd & SWD_CMD_APNDP)
+		if (cmd & SWD_CMD_APNDP) {
+			swd_stats.ap_transactions++;
 			bitbang_swd_exchange(true, NULL, 0, ap_delay_clk);
+		}
 		return;
 	}
 }
@@ -583,10 +735,125 @@ static int bitbang_swd_run_queue(void)
 	return retval;
 }
 
+static void bitbang_swd_run_stats(struct swd_run_stats *stats)
+{
+	*stats = swd_stats;
+	memset(&swd_stats, 0, sizeof(swd_stats));
+}
+
 const struct swd_driver bitbang_swd = {
 	.init = bitbang_swd_init,
 	.switch_seq = bitbang_swd_switch_seq,
 	.read_reg = bitbang_swd_read_reg,
 	.write_reg = bitbang_swd_write_reg,
 	.run = bitbang_swd_run_queue,
+	.run_stats = bitbang_swd_run_stats,
+};
+
+static int bitbang_benchmark_run(struct command_invocation *cmd, const char *path,
+		uint8_t *buffer, unsigned int num_bits)
+{
+	struct duration bench;
+	int retval = ERROR_OK;
+
+	memset(buffer, 0, DIV_ROUND_UP(num_bits, 8));
+
+	duration_start(&bench);
+	if (transport_is_swd()) {
+		/* SWDIO stays low, which the target sees as idle cycles */
+		bitbang_swd_exchange(true, buffer, 0, num_bits);
+	} else {
+		/* the TAP stays in Run-Test/Idle, TDO is sampled anyway */
+		retval = bitbang_shift(SCAN_IO, buffer, num_bits, false);
+		if (retval == ERROR_OK)
+			retval = bitbang_clock_tms(NULL, 0, 0);
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (duration_measure(&bench) == ERROR_OK) {
+		float elapsed = duration_elapsed(&bench);
+		command_print(CMD, "%s: %u clocks in %fs (%0.3f kHz)", path, num_bits,
+			elapsed, elapsed > 0 ? num_bits / elapsed / 1000 : 0);
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_bitbang_benchmark_command)
+{
+	unsigned int num_bits = 1024 * 1024;
+	int retval;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], num_bits);
+	if (!num_bits)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	if (!bitbang_interface) {
+		command_print(CMD, "bitbang interface not initialized");
+		return ERROR_FAIL;
+	}
+
+	tap_state_t saved_state = tap_get_state();
+	if (!transport_is_swd()) {
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			return retval;
+
+		saved_state = tap_get_state();
+		if (saved_state != TAP_IDLE) {
+			bitbang_end_state(TAP_IDLE);
+			if (bitbang_state_move(0) != ERROR_OK)
+				return ERROR_FAIL;
+		}
+	}
+
+	uint8_t *buffer = malloc(DIV_ROUND_UP(num_bits, 8));
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* first the generic callbacks, then the GPIO fast path if the backend has one */
+	struct bitbang_gpio_bank *gpio = bitbang_interface->gpio;
+	bitbang_interface->gpio = NULL;
+	retval = bitbang_benchmark_run(CMD, "callbacks", buffer, num_bits);
+	bitbang_interface->gpio = gpio;
+	if (retval == ERROR_OK && gpio)
+		retval = bitbang_benchmark_run(CMD, "gpio fast path", buffer, num_bits);
+
+	free(buffer);
+
+	if (!transport_is_swd() && saved_state != TAP_IDLE) {
+		bitbang_end_state(saved_state);
+		if (bitbang_state_move(0) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	return retval;
+}
+
+static const struct command_registration bitbang_subcommand_handlers[] = {
+	{
+		.name = "benchmark",
+		.handler = handle_bitbang_benchmark_command,
+		.mode = COMMAND_EXEC,
+		.help = "measure the clock rate of the bitbang core on the current adapter",
+		.usage = "[clocks]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration bitbang_command_handlers[] = {
+	{
+		.name = "bitbang",
+		.mode = COMMAND_ANY,
+		.help = "bitbang core commands",
+		.chain = bitbang_subcommand_handlers,
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
 };
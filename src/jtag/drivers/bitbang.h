@@ -23,6 +23,7 @@
 #define OPENOCD_JTAG_DRIVERS_BITBANG_H
 
 #include <jtag/swd.h>
+#include <helper/command.h>
 
 typedef enum {
 	BB_LOW,
@@ -30,6 +31,36 @@ typedef enum {
 	BB_ERROR
 } bb_value_t;
 
+/** Memory-mapped GPIO bank, used by the bitbang fast path.
+ *
+ * A backend whose signals all live in one 32-bit GPIO bank can describe the
+ * bank here. The bitbang core then drives the pins from an inlined loop with
+ * precomputed masks instead of calling write() and read() for every half
+ * clock. Only the masks of the active transport need to be filled in. */
+struct bitbang_gpio_bank {
+	/** Write-one-to-set register, or NULL to update @a data with a
+	 * read-modify-write cycle. */
+	volatile uint32_t *set;
+
+	/** Write-one-to-clear register, used together with @a set. */
+	volatile uint32_t *clear;
+
+	/** Output data register, used when @a set is NULL. */
+	volatile uint32_t *data;
+
+	/** Input level register. */
+	const volatile uint32_t *level;
+
+	/** Pin masks for JTAG. */
+	uint32_t tck, tms, tdi, tdo;
+
+	/** Pin masks for SWD. */
+	uint32_t swclk, swdio;
+
+	/** Number of busy loop iterations after every pin change. */
+	unsigned int delay;
+};
+
 /** Low level callbacks (for bitbang).
  *
  * Either read(), or sample() and read_sample() must be implemented.
@@ -65,9 +96,14 @@ struct bitbang_interface {
 
 	/** Set SWCLK and SWDIO to the given value. */
 	int (*swd_write)(int swclk, int swdio);
+
+	/** Memory-mapped GPIO bank for the fast path (optional). When set,
+	 * write(), read(), swd_write() and swdio_read() are bypassed. */
+	struct bitbang_gpio_bank *gpio;
 };
 
 extern const struct swd_driver bitbang_swd;
+extern const struct command_registration bitbang_command_handlers[];
 
 int bitbang_execute_queue(void);
 
@@ -39,6 +39,7 @@
 #include <libusb.h>
 #include <helper/log.h>
 #include <helper/replacements.h>
+#include <jtag/adapter_stats.h>
 
 #include "cmsis_dap.h"
 
@@ -407,8 +408,12 @@ static int cmsis_dap_usb_read(struct cmsis_dap *dap, int timeout_ms)
 	int transferred = 0;
 	int err;
 
+	int64_t start = adapter_stats_timestamp();
 	err = libusb_bulk_transfer(dap->bdata->dev_handle, dap->bdata->ep_in,
 							dap->packet_buffer, dap->packet_size, &transferred, timeout_ms);
+	adapter_stats_record(start, ADAPTER_STATS_BULK, dap->bdata->ep_in, NULL,
+		dap->packet_buffer, transferred,
+		err == LIBUSB_ERROR_TIMEOUT ? ERROR_TIMEOUT_REACHED : err ? ERROR_FAIL : ERROR_OK);
 	if (err) {
 		if (err == LIBUSB_ERROR_TIMEOUT) {
 			return ERROR_TIMEOUT_REACHED;
@@ -429,8 +434,12 @@ static int cmsis_dap_usb_write(struct cmsis_dap *dap, int txlen, int timeout_ms)
 	int err;
 
 	/* skip the first byte that is only used by the HID backend */
+	int64_t start = adapter_stats_timestamp();
 	err = libusb_bulk_transfer(dap->bdata->dev_handle, dap->bdata->ep_out,
 							dap->packet_buffer, txlen, &transferred, timeout_ms);
+	adapter_stats_record(start, ADAPTER_STATS_BULK, dap->bdata->ep_out, NULL,
+		dap->packet_buffer, transferred,
+		err == LIBUSB_ERROR_TIMEOUT ? ERROR_TIMEOUT_REACHED : err ? ERROR_FAIL : ERROR_OK);
 	if (err) {
 		if (err == LIBUSB_ERROR_TIMEOUT) {
 			return ERROR_TIMEOUT_REACHED;
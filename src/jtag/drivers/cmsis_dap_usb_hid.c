@@ -38,6 +38,7 @@
 #include <string.h>
 #include <hidapi.h>
 #include <helper/log.h>
+#include <jtag/adapter_stats.h>
 
 #include "cmsis_dap.h"
 
@@ -180,10 +181,19 @@ static void cmsis_dap_hid_close(struct cmsis_dap *dap)
 	dap->packet_buffer = NULL;
 }
 
+/* hidapi hides the endpoints, record HID reports as interrupt transfers on endpoint 1 */
+#define CMSIS_DAP_HID_STATS_EP_IN	0x81
+#define CMSIS_DAP_HID_STATS_EP_OUT	0x01
+
 static int cmsis_dap_hid_read(struct cmsis_dap *dap, int timeout_ms)
 {
+	int64_t start = adapter_stats_timestamp();
 	int retval = hid_read_timeout(dap->bdata->dev_handle, dap->packet_buffer, dap->packet_buffer_size, timeout_ms);
 
+	adapter_stats_record(start, ADAPTER_STATS_INTERRUPT, CMSIS_DAP_HID_STATS_EP_IN, NULL,
+		dap->packet_buffer, retval,
+		retval == 0 ? ERROR_TIMEOUT_REACHED : retval < 0 ? ERROR_FAIL : ERROR_OK);
+
 	if (retval == 0) {
 		return ERROR_TIMEOUT_REACHED;
 	} else if (retval == -1) {
@@ -204,7 +214,10 @@ static int cmsis_dap_hid_write(struct cmsis_dap *dap, int txlen, int timeout_ms)
 	memset(dap->command + txlen, 0, dap->packet_size - txlen);
 
 	/* write data to device */
+	int64_t start = adapter_stats_timestamp();
 	int retval = hid_write(dap->bdata->dev_handle, dap->packet_buffer, dap->packet_buffer_size);
+	adapter_stats_record(start, ADAPTER_STATS_INTERRUPT, CMSIS_DAP_HID_STATS_EP_OUT, NULL,
+		dap->packet_buffer, retval, retval < 0 ? ERROR_FAIL : ERROR_OK);
 	if (retval == -1) {
 		LOG_ERROR("error writing data: %ls", hid_error(dap->bdata->dev_handle));
 		return ERROR_FAIL;
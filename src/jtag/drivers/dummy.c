@@ -138,6 +138,9 @@ static const struct command_registration dummy_command_handlers[] = {
 		.chain = hello_command_handlers,
 		.usage = "",
 	},
+	{
+		.chain = bitbang_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
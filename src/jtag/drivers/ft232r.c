@@ -69,6 +69,15 @@
 
 #define FT232R_BUF_SIZE_EXTRA	4096
 
+/* Sync bitbang FIFO limits, see ft232r_send_recv() */
+#define FT232R_TX_FIFO_SIZE	128
+#define FT232R_MAX_TRANSFER	64
+
+/* Queued samples and pending scans after which the queue is executed
+ * before the rest of the JTAG command queue is encoded. */
+#define FT232R_FLUSH_SIZE	(64 * 1024)
+#define FT232R_MAX_PENDING_SCANS	128
+
 static uint16_t ft232r_vid = 0x0403; /* FTDI */
 static uint16_t ft232r_pid = 0x6001; /* FT232R */
 static struct libusb_device_handle *adapter;
@@ -76,6 +85,26 @@ static struct libusb_device_handle *adapter;
 static uint8_t *ft232r_output;
 static size_t ft232r_output_len;
 
+/**
+ * Pin states for the eight TCK low/high sample pairs that shift out one
+ * TDI byte, LSB first, with TMS low.  Built at init from the configured
+ * GPIO numbers.
+ */
+static uint8_t ft232r_tdi_expand[256][16];
+
+/**
+ * Scan whose TDO samples are still in (or on their way to) ft232r_output.
+ */
+struct ft232r_pending_scan {
+	struct scan_command *command;
+	uint8_t *buffer;
+	size_t bit0_index;
+	int scan_size;
+};
+
+static struct ft232r_pending_scan ft232r_pending_scans[FT232R_MAX_PENDING_SCANS];
+static unsigned int ft232r_pending_scan_count;
+
 /**
  * FT232R GPIO bit number to RS232 name
  */
@@ -121,13 +150,13 @@ static int ft232r_send_recv(void)
 
 	size_t total_written = 0;
 	size_t total_read = 0;
-	int rxfifo_free = 128;
+	int rxfifo_free = FT232R_TX_FIFO_SIZE;
 
 	while (total_read < ft232r_output_len) {
 		/* Write */
 		int bytes_to_write = ft232r_output_len - total_written;
-		if (bytes_to_write > 64)
-			bytes_to_write = 64;
+		if (bytes_to_write > FT232R_MAX_TRANSFER)
+			bytes_to_write = FT232R_MAX_TRANSFER;
 		if (bytes_to_write > rxfifo_free)
 			bytes_to_write = rxfifo_free;
 
@@ -146,7 +175,7 @@ static int ft232r_send_recv(void)
 		}
 
 		/* Read */
-		uint8_t reply[64];
+		uint8_t reply[FT232R_MAX_TRANSFER];
 		int n;
 
 		if (jtag_libusb_bulk_read(adapter, OUT_EP, (char *) reply,
@@ -206,11 +235,117 @@ static void ft232r_write(int tck, int tms, int tdi)
 	ft232r_output[ft232r_output_len++] = out_value;
 }
 
+static void ft232r_init_tdi_expand(void)
+{
+	uint8_t idle = (1<<ntrst_gpio) | (1<<nsysrst_gpio);
+
+	for (unsigned int value = 0; value < 256; value++) {
+		for (unsigned int bit = 0; bit < 8; bit++) {
+			uint8_t sample = idle;
+			if (value & (1 << bit))
+				sample |= (1<<tdi_gpio);
+			ft232r_tdi_expand[value][2 * bit] = sample;
+			ft232r_tdi_expand[value][2 * bit + 1] = sample | (1<<tck_gpio);
+		}
+	}
+}
+
+/**
+ * Add the TCK low/high sample pairs that clock num_bits bits of tdi
+ * (zeros if tdi is NULL) with a constant TMS value.  Whole TDI bytes are
+ * copied from the expansion table instead of being built bit by bit.
+ * Returns ERROR_FAIL, writing nothing, if the buffer can't hold them.
+ */
+static int ft232r_write_bits(const uint8_t *tdi, unsigned int num_bits, int tms)
+{
+	size_t len = 2 * (size_t)num_bits;
+
+	ft232r_increase_buf_size(ft232r_output_len + len);
+
+	if (ft232r_output_len + len > ft232r_buf_size) {
+		LOG_ERROR("ft232r_write_bits: buffer overflow");
+		return ERROR_FAIL;
+	}
+
+	uint8_t *out = ft232r_output + ft232r_output_len;
+	unsigned int i;
+	for (i = 0; i + 8 <= num_bits; i += 8, out += 16)
+		memcpy(out, ft232r_tdi_expand[tdi ? tdi[i / 8] : 0], 16);
+	if (i < num_bits)
+		memcpy(out, ft232r_tdi_expand[tdi ? tdi[i / 8] : 0], 2 * (num_bits - i));
+
+	if (tms) {
+		out = ft232r_output + ft232r_output_len;
+		for (size_t j = 0; j < len; j++)
+			out[j] |= (1<<tms_gpio);
+	}
+
+	ft232r_output_len += len;
+	return ERROR_OK;
+}
+
+/**
+ * Collect num_bits TDO bits, LSB first, from the samples returned for
+ * the TCK high half of each bit pair starting at samples[0].
+ */
+static void ft232r_read_tdo(const uint8_t *samples, uint8_t *buffer, unsigned int num_bits)
+{
+	unsigned int i;
+
+	/* Eight bits at a time: the odd bytes of two 64 bit words hold the
+	 * samples, the multiply moves bit 16 * n of each word to bit 48 + n
+	 * without any of the partial products overlapping. */
+	const uint64_t mask = 0x0001000100010001ULL;
+	const uint64_t gather = (1ULL << 48) | (1ULL << 33) | (1ULL << 18) | (1ULL << 3);
+	for (i = 0; i + 8 <= num_bits; i += 8, samples += 16) {
+		uint64_t lo = (le_to_h_u64(samples) >> (8 + tdo_gpio)) & mask;
+		uint64_t hi = (le_to_h_u64(samples + 8) >> (8 + tdo_gpio)) & mask;
+		buffer[i / 8] = ((lo * gather) >> 48 & 0x0f) | ((hi * gather) >> 44 & 0xf0);
+	}
+
+	for (unsigned int j = 0; i < num_bits; i++, j++) {
+		int bcval = 1 << (i % 8);
+
+		if (samples[2 * j + 1] & (1<<tdo_gpio))
+			buffer[i / 8] |= bcval;
+		else
+			buffer[i / 8] &= ~bcval;
+	}
+}
+
+/**
+ * Run the queued samples through the adapter, then fill in and complete
+ * the scans waiting for their TDO bits.
+ */
+static int ft232r_flush(void)
+{
+	int retval = ERROR_OK;
+
+	if (ft232r_output_len > 0) {
+		retval = ft232r_send_recv();
+		ft232r_output_len = 0;
+	}
+
+	for (unsigned int i = 0; i < ft232r_pending_scan_count; i++) {
+		struct ft232r_pending_scan *scan = &ft232r_pending_scans[i];
+
+		if (retval == ERROR_OK) {
+			ft232r_read_tdo(ft232r_output + scan->bit0_index, scan->buffer, scan->scan_size);
+			if (jtag_read_buffer(scan->buffer, scan->command) != ERROR_OK)
+				retval = ERROR_JTAG_QUEUE_FAILED;
+		}
+		free(scan->buffer);
+	}
+	ft232r_pending_scan_count = 0;
+
+	return retval;
+}
+
 /**
  * Control /TRST and /SYSRST pins.
  * Perform immediate bitbang transaction.
  */
-static void ft232r_reset(int trst, int srst)
+static int ft232r_reset(int trst, int srst)
 {
 	unsigned out_value = (1<<ntrst_gpio) | (1<<nsysrst_gpio);
 	LOG_DEBUG("ft232r_reset(%d,%d)", trst, srst);
@@ -230,11 +365,11 @@ static void ft232r_reset(int trst, int srst)
 	if (ft232r_output_len >= ft232r_buf_size) {
 		/* FIXME: should we just execute queue here? */
 		LOG_ERROR("ft232r_write: buffer overflow");
-		return;
+		return ERROR_FAIL;
 	}
 
 	ft232r_output[ft232r_output_len++] = out_value;
-	ft232r_send_recv();
+	return ft232r_flush();
 }
 
 static int ft232r_speed(int divisor)
@@ -316,6 +451,8 @@ static int ft232r_init(void)
 		return ERROR_JTAG_INIT_FAILED;
 	}
 
+	ft232r_init_tdi_expand();
+
 	return ERROR_OK;
 }
 
@@ -715,8 +852,6 @@ static void syncbb_path_move(struct pathmove_command *cmd)
 
 static void syncbb_runtest(int num_cycles)
 {
-	int i;
-
 	tap_state_t saved_end_state = tap_get_end_state();
 
 	/* only do a state_move when we're not already in IDLE */
@@ -726,10 +861,7 @@ static void syncbb_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		ft232r_write(0, 0, 0);
-		ft232r_write(1, 0, 0);
-	}
+	ft232r_write_bits(NULL, num_cycles, 0);
 	ft232r_write(0, 0, 0);
 
 	/* finish in end_state */
@@ -749,19 +881,22 @@ static void syncbb_runtest(int num_cycles)
 static void syncbb_stableclocks(int num_cycles)
 {
 	int tms = (tap_get_state() == TAP_RESET ? 1 : 0);
-	int i;
 
 	/* send num_cycles clocks onto the cable */
-	for (i = 0; i < num_cycles; i++) {
-		ft232r_write(1, tms, 0);
-		ft232r_write(0, tms, 0);
-	}
+	ft232r_write_bits(NULL, num_cycles, tms);
+	ft232r_write(0, tms, 0);
 }
 
-static void syncbb_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int scan_size)
+/**
+ * Queue the samples for a scan.  Scans that capture TDO are completed by
+ * ft232r_flush(), which takes ownership of buffer; otherwise it is freed
+ * right away, as it is when the samples don't fit the buffer.
+ */
+static int syncbb_scan(struct scan_command *command, enum scan_type type, uint8_t *buffer, int scan_size)
 {
+	bool ir_scan = command->ir_scan;
 	tap_state_t saved_end_state = tap_get_end_state();
-	int bit_cnt, bit0_index;
+	size_t bit0_index;
 
 	if (!((!ir_scan && (tap_get_state() == TAP_DRSHIFT)) || (ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
 		if (ir_scan)
@@ -774,24 +909,20 @@ static void syncbb_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 	}
 
 	bit0_index = ft232r_output_len;
-	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
-		int tdi;
-		int bytec = bit_cnt/8;
-		int bcval = 1 << (bit_cnt % 8);
-
-		/* if we're just reading the scan, but don't care about the output
-		 * default to outputting 'low', this also makes valgrind traces more readable,
-		 * as it removes the dependency on an uninitialised value
-		 */
-		tdi = 0;
-		if ((type != SCAN_IN) && (buffer[bytec] & bcval))
-			tdi = 1;
 
-		ft232r_write(0, tms, tdi);
-		ft232r_write(1, tms, tdi);
+	/* if we're just reading the scan, but don't care about the output
+	 * default to outputting 'low', this also makes valgrind traces more readable,
+	 * as it removes the dependency on an uninitialised value
+	 */
+	if (ft232r_write_bits(type != SCAN_IN ? buffer : NULL, scan_size, 0) != ERROR_OK) {
+		free(buffer);
+		return ERROR_FAIL;
 	}
 
+	/* leave the shift state on the last bit */
+	ft232r_output[ft232r_output_len - 2] |= (1<<tms_gpio);
+	ft232r_output[ft232r_output_len - 1] |= (1<<tms_gpio);
+
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
 		 * the shift state, so we skip the first state
@@ -799,19 +930,18 @@ static void syncbb_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 		 */
 		syncbb_state_move(1);
 	}
-	ft232r_send_recv();
 
-	if (type != SCAN_OUT)
-		for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-			int bytec = bit_cnt/8;
-			int bcval = 1 << (bit_cnt % 8);
-			int val = ft232r_output[bit0_index + bit_cnt*2 + 1];
+	if (type == SCAN_OUT) {
+		free(buffer);
+		return ERROR_OK;
+	}
 
-			if (val & (1<<tdo_gpio))
-				buffer[bytec] |= bcval;
-			else
-				buffer[bytec] &= ~bcval;
-		}
+	struct ft232r_pending_scan *scan = &ft232r_pending_scans[ft232r_pending_scan_count++];
+	scan->command = command;
+	scan->buffer = buffer;
+	scan->bit0_index = bit0_index;
+	scan->scan_size = scan_size;
+	return ERROR_OK;
 }
 
 static int syncbb_execute_queue(void)
@@ -839,7 +969,8 @@ static int syncbb_execute_queue(void)
 					(jtag_get_reset_config() & RESET_SRST_PULLS_TRST))) {
 					tap_set_state(TAP_RESET);
 				}
-				ft232r_reset(cmd->cmd.reset->trst, cmd->cmd.reset->srst);
+				if (ft232r_reset(cmd->cmd.reset->trst, cmd->cmd.reset->srst) != ERROR_OK)
+					retval = ERROR_JTAG_QUEUE_FAILED;
 				break;
 
 			case JTAG_RUNTEST:
@@ -878,15 +1009,15 @@ static int syncbb_execute_queue(void)
 				syncbb_end_state(cmd->cmd.scan->end_state);
 				scan_size = jtag_build_buffer(cmd->cmd.scan, &buffer);
 				type = jtag_scan_type(cmd->cmd.scan);
-				syncbb_scan(cmd->cmd.scan->ir_scan, type, buffer, scan_size);
-				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
+				if (syncbb_scan(cmd->cmd.scan, type, buffer, scan_size) != ERROR_OK)
 					retval = ERROR_JTAG_QUEUE_FAILED;
-				free(buffer);
 				break;
 
 			case JTAG_SLEEP:
 				LOG_DEBUG_IO("sleep %" PRIu32, cmd->cmd.sleep->us);
 
+				if (ft232r_flush() != ERROR_OK)
+					retval = ERROR_JTAG_QUEUE_FAILED;
 				jtag_sleep(cmd->cmd.sleep->us);
 				break;
 
@@ -897,10 +1028,16 @@ static int syncbb_execute_queue(void)
 				LOG_ERROR("BUG: unknown JTAG command type encountered");
 				exit(-1);
 		}
-		if (ft232r_output_len > 0)
-			ft232r_send_recv();
+		/* keep encoding until the buffer or the pending scan table fills up */
+		if (ft232r_output_len >= FT232R_FLUSH_SIZE ||
+				ft232r_pending_scan_count == FT232R_MAX_PENDING_SCANS) {
+			if (ft232r_flush() != ERROR_OK)
+				retval = ERROR_JTAG_QUEUE_FAILED;
+		}
 		cmd = cmd->next;
 	}
+	if (ft232r_flush() != ERROR_OK)
+		retval = ERROR_JTAG_QUEUE_FAILED;
 /*	ft232r_blink(0);*/
 
 	return retval;
@@ -119,10 +119,13 @@ static struct signal *signals;
 static struct swd_cmd_queue_entry {
 	uint8_t cmd;
 	uint32_t *dst;
+	uint32_t data;
+	uint32_t ap_delay_clk;
 	uint8_t trn_ack_data_parity_trn[DIV_ROUND_UP(4 + 3 + 32 + 1 + 4, 8)];
 } *swd_cmd_queue;
 static size_t swd_cmd_queue_length;
 static size_t swd_cmd_queue_alloced;
+static struct swd_run_stats swd_stats;
 static int queued_retval;
 static int freq;
 
@@ -319,11 +322,22 @@ static void ftdi_end_state(tap_state_t state)
 	}
 }
 
-static void ftdi_execute_runtest(struct jtag_command *cmd)
+/* Clock num_cycles with TMS held at the given level and TDI low. Only the
+ * first few cycles go out as a TMS command, to put TMS at the level; data
+ * commands leave TMS alone, so the rest is clocked as plain zero data, which
+ * the MPSSE layer turns into clock-only commands on high speed chips. */
+static void ftdi_clock_stable(unsigned num_cycles, bool tms)
 {
-	int i;
-	uint8_t zero = 0;
+	uint8_t tms_bits = tms ? 0x7f : 0x00;
+	unsigned this_len = num_cycles > 7 ? 7 : num_cycles;
+
+	mpsse_clock_tms_cs_out(mpsse_ctx, &tms_bits, 0, this_len, false, ftdi_jtag_mode);
+	if (num_cycles > this_len)
+		mpsse_clock_data_out(mpsse_ctx, NULL, 0, num_cycles - this_len, ftdi_jtag_mode);
+}
 
+static void ftdi_execute_runtest(struct jtag_command *cmd)
+{
 	LOG_DEBUG_IO("runtest %i cycles, end in %s",
 		cmd->cmd.runtest->num_cycles,
 		tap_state_name(cmd->cmd.runtest->end_state));
@@ -331,14 +345,8 @@ static void ftdi_execute_runtest(struct jtag_command *cmd)
 	if (tap_get_state() != TAP_IDLE)
 		move_to_state(TAP_IDLE);
 
-	/* TODO: Reuse ftdi_execute_stableclocks */
-	i = cmd->cmd.runtest->num_cycles;
-	while (i > 0) {
-		/* there are no state transitions in this code, so omit state tracking */
-		unsigned this_len = i > 7 ? 7 : i;
-		mpsse_clock_tms_cs_out(mpsse_ctx, &zero, 0, this_len, false, ftdi_jtag_mode);
-		i -= this_len;
-	}
+	/* there are no state transitions in this code, so omit state tracking */
+	ftdi_clock_stable(cmd->cmd.runtest->num_cycles, false);
 
 	ftdi_end_state(cmd->cmd.runtest->end_state);
 
@@ -586,19 +594,8 @@ static void ftdi_execute_stableclocks(struct jtag_command *cmd)
 	/* this is only allowed while in a stable state.  A check for a stable
 	 * state was done in jtag_add_clocks()
 	 */
-	int num_cycles = cmd->cmd.stableclocks->num_cycles;
-
-	/* 7 bits of either ones or zeros. */
-	uint8_t tms = tap_get_state() == TAP_RESET ? 0x7f : 0x00;
-
-	/* TODO: Use mpsse_clock_data with in=out=0 for this, if TMS can be set to
-	 * the correct level and remain there during the scan */
-	while (num_cycles > 0) {
-		/* there are no state transitions in this code, so omit state tracking */
-		unsigned this_len = num_cycles > 7 ? 7 : num_cycles;
-		mpsse_clock_tms_cs_out(mpsse_ctx, &tms, 0, this_len, false, ftdi_jtag_mode);
-		num_cycles -= this_len;
-	}
+	/* there are no state transitions in this code, so omit state tracking */
+	ftdi_clock_stable(cmd->cmd.stableclocks->num_cycles, tap_get_state() == TAP_RESET);
 
 	LOG_DEBUG_IO("clocks %i while in %s",
 		cmd->cmd.stableclocks->num_cycles,
@@ -1068,8 +1065,96 @@ static void ftdi_swd_swdio_en(bool enable)
 	}
 }
 
+/* Clock out the queued transaction at position i of the SWD command queue */
+static void ftdi_swd_queue_entry(size_t i)
+{
+	struct swd_cmd_queue_entry *e = &swd_cmd_queue[i];
+
+	mpsse_clock_data_out(mpsse_ctx, &e->cmd, 0, 8, SWD_MODE);
+
+	if (e->cmd & SWD_CMD_RNW) {
+		/* Queue a read transaction */
+		ftdi_swd_swdio_en(false);
+		mpsse_clock_data_in(mpsse_ctx, e->trn_ack_data_parity_trn,
+				0, 1 + 3 + 32 + 1 + 1, SWD_MODE);
+		ftdi_swd_swdio_en(true);
+	} else {
+		/* Queue a write transaction */
+		ftdi_swd_swdio_en(false);
+
+		mpsse_clock_data_in(mpsse_ctx, e->trn_ack_data_parity_trn,
+				0, 1 + 3 + 1, SWD_MODE);
+
+		ftdi_swd_swdio_en(true);
+
+		buf_set_u32(e->trn_ack_data_parity_trn, 1 + 3 + 1, 32, e->data);
+		buf_set_u32(e->trn_ack_data_parity_trn, 1 + 3 + 1 + 32, 1, parity_u32(e->data));
+
+		mpsse_clock_data_out(mpsse_ctx, e->trn_ack_data_parity_trn,
+				1 + 3 + 1, 32 + 1, SWD_MODE);
+	}
+
+	/* Insert idle cycles after AP accesses to avoid WAIT */
+	if (e->cmd & SWD_CMD_APNDP)
+		mpsse_clock_data_out(mpsse_ctx, NULL, 0, e->ap_delay_clk, SWD_MODE);
+}
+
+/* Check whether the transactions from position first on can be sent again
+ * after the one at that position received WAIT. This is the case when the
+ * target ignored all of them: after the WAIT, overrun detection makes it
+ * answer FAULT (or WAIT) to anything but DP reads, which have no side
+ * effect and are simply repeated. */
+static bool ftdi_swd_can_resubmit(size_t first)
+{
+	for (size_t i = first + 1; i < swd_cmd_queue_length; i++) {
+		uint8_t cmd = swd_cmd_queue[i].cmd;
+		int ack = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1, 3);
+
+		if (!swd_cmd_returns_ack(cmd))
+			return false;
+		if (ack == SWD_ACK_WAIT || ack == SWD_ACK_FAULT)
+			continue;
+		if (ack == SWD_ACK_OK && !(cmd & SWD_CMD_APNDP) && (cmd & SWD_CMD_RNW))
+			continue;
+		return false;
+	}
+
+	return true;
+}
+
+/* Queue the transactions from position first on again, after a write to
+ * DP ABORT which clears the sticky overrun flag set by the WAIT */
+static int ftdi_swd_resubmit(size_t first)
+{
+	size_t count = swd_cmd_queue_length - first;
+
+	if (count + 1 > swd_cmd_queue_alloced) {
+		/* mpsse holds no pointer into the queue after a flush */
+		struct swd_cmd_queue_entry *q = realloc(swd_cmd_queue, (count + 1) * sizeof(*swd_cmd_queue));
+		if (!q)
+			return ERROR_FAIL;
+		swd_cmd_queue = q;
+		swd_cmd_queue_alloced = count + 1;
+	}
+
+	memmove(&swd_cmd_queue[1], &swd_cmd_queue[first], count * sizeof(*swd_cmd_queue));
+	swd_cmd_queue[0].cmd = swd_cmd(false, false, DP_ABORT) | SWD_CMD_START | SWD_CMD_PARK;
+	swd_cmd_queue[0].dst = NULL;
+	swd_cmd_queue[0].data = ORUNERRCLR;
+	swd_cmd_queue[0].ap_delay_clk = 0;
+	swd_cmd_queue_length = count + 1;
+
+	for (size_t i = 0; i < swd_cmd_queue_length; i++)
+		ftdi_swd_queue_entry(i);
+
+	return ERROR_OK;
+}
+
 /**
  * Flush the MPSSE queue and process the SWD transaction queue
+ *
+ * When a transaction receives WAIT, the rest of the queue is sent again
+ * from that transaction on, as long as the target keeps making progress.
  * @return
  */
 static int ftdi_swd_run_queue(void)
@@ -1077,58 +1162,95 @@ static int ftdi_swd_run_queue(void)
 	LOG_DEBUG_IO("Executing %zu queued transactions", swd_cmd_queue_length);
 	int retval;
 	struct signal *led = find_signal_by_name("LED");
+	int64_t wait_start = 0;
+	/* index of the first transaction from the caller's queue, after the
+	 * DP ABORT write a resubmitted queue starts with */
+	size_t first_queued = 0;
 
 	if (queued_retval != ERROR_OK) {
 		LOG_DEBUG_IO("Skipping due to previous errors: %d", queued_retval);
 		goto skip;
 	}
 
-	/* A transaction must be followed by another transaction or at least 8 idle cycles to
-	 * ensure that data is clocked through the AP. */
-	mpsse_clock_data_out(mpsse_ctx, NULL, 0, 8, SWD_MODE);
+	for (;;) {
+		/* A transaction must be followed by another transaction or at least 8 idle cycles to
+		 * ensure that data is clocked through the AP. */
+		mpsse_clock_data_out(mpsse_ctx, NULL, 0, 8, SWD_MODE);
 
-	/* Terminate the "blink", if the current layout has that feature */
-	if (led)
-		ftdi_set_signal(led, '0');
+		/* Terminate the "blink", if the current layout has that feature */
+		if (led)
+			ftdi_set_signal(led, '0');
 
-	queued_retval = mpsse_flush(mpsse_ctx);
-	if (queued_retval != ERROR_OK) {
-		LOG_ERROR("MPSSE failed");
-		goto skip;
-	}
+		queued_retval = mpsse_flush(mpsse_ctx);
+		if (queued_retval != ERROR_OK) {
+			LOG_ERROR("MPSSE failed");
+			goto skip;
+		}
 
-	for (size_t i = 0; i < swd_cmd_queue_length; i++) {
-		int ack = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1, 3);
+		size_t wait_pos = swd_cmd_queue_length;
 
-		/* Devices do not reply to DP_TARGETSEL write cmd, ignore received ack */
-		bool check_ack = swd_cmd_returns_ack(swd_cmd_queue[i].cmd);
+		for (size_t i = 0; i < swd_cmd_queue_length; i++) {
+			int ack = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1, 3);
 
-		LOG_DEBUG_IO("%s%s %s %s reg %X = %08"PRIx32,
-				check_ack ? "" : "ack ignored ",
-				ack == SWD_ACK_OK ? "OK" : ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK",
-				swd_cmd_queue[i].cmd & SWD_CMD_APNDP ? "AP" : "DP",
-				swd_cmd_queue[i].cmd & SWD_CMD_RNW ? "read" : "write",
-				(swd_cmd_queue[i].cmd & SWD_CMD_A32) >> 1,
-				buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn,
-						1 + 3 + (swd_cmd_queue[i].cmd & SWD_CMD_RNW ? 0 : 1), 32));
+			/* Devices do not reply to DP_TARGETSEL write cmd, ignore received ack */
+			bool check_ack = swd_cmd_returns_ack(swd_cmd_queue[i].cmd);
 
-		if (ack != SWD_ACK_OK && check_ack) {
-			queued_retval = swd_ack_to_error_code(ack);
-			goto skip;
+			LOG_DEBUG_IO("%s%s %s %s reg %X = %08"PRIx32,
+					check_ack ? "" : "ack ignored ",
+					ack == SWD_ACK_OK ? "OK" : ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK",
+					swd_cmd_queue[i].cmd & SWD_CMD_APNDP ? "AP" : "DP",
+					swd_cmd_queue[i].cmd & SWD_CMD_RNW ? "read" : "write",
+					(swd_cmd_queue[i].cmd & SWD_CMD_A32) >> 1,
+					buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn,
+							1 + 3 + (swd_cmd_queue[i].cmd & SWD_CMD_RNW ? 0 : 1), 32));
 
-		} else if (swd_cmd_queue[i].cmd & SWD_CMD_RNW) {
-			uint32_t data = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3, 32);
-			int parity = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 32, 1);
+			if (ack == SWD_ACK_WAIT && check_ack) {
+				wait_pos = i;
+				break;
 
-			if (parity != parity_u32(data)) {
-				LOG_ERROR("SWD Read data parity mismatch");
-				queued_retval = ERROR_FAIL;
+			} else if (ack != SWD_ACK_OK && check_ack) {
+				queued_retval = swd_ack_to_error_code(ack);
 				goto skip;
+
+			} else if (swd_cmd_queue[i].cmd & SWD_CMD_RNW) {
+				uint32_t data = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3, 32);
+				int parity = buf_get_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 32, 1);
+
+				if (parity != parity_u32(data)) {
+					LOG_ERROR("SWD Read data parity mismatch");
+					queued_retval = ERROR_FAIL;
+					goto skip;
+				}
+
+				if (swd_cmd_queue[i].dst)
+					*swd_cmd_queue[i].dst = data;
 			}
 
-			if (swd_cmd_queue[i].dst)
-				*swd_cmd_queue[i].dst = data;
+			if (swd_cmd_queue[i].cmd & SWD_CMD_APNDP)
+				swd_stats.ap_transactions++;
 		}
+
+		if (wait_pos == swd_cmd_queue_length)
+			break;
+
+		swd_stats.waits++;
+
+		/* The timeout restarts whenever one of the caller's transactions
+		 * went through; the injected DP ABORT always does and is no progress */
+		if (!wait_start || wait_pos > first_queued)
+			wait_start = timeval_ms();
+
+		if (!ftdi_swd_can_resubmit(wait_pos)
+				|| timeval_ms() - wait_start > SWD_WAIT_TIMEOUT_MS) {
+			queued_retval = ERROR_WAIT;
+			goto skip;
+		}
+
+		LOG_DEBUG_IO("WAIT, resubmitting %zu transactions", swd_cmd_queue_length - wait_pos);
+		queued_retval = ftdi_swd_resubmit(wait_pos);
+		if (queued_retval != ERROR_OK)
+			goto skip;
+		first_queued = 1;
 	}
 
 skip:
@@ -1143,6 +1265,12 @@ skip:
 	return retval;
 }
 
+static void ftdi_swd_run_stats(struct swd_run_stats *stats)
+{
+	*stats = swd_stats;
+	memset(&swd_stats, 0, sizeof(swd_stats));
+}
+
 static void ftdi_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data, uint32_t ap_delay_clk)
 {
 	if (swd_cmd_queue_length >= swd_cmd_queue_alloced) {
@@ -1163,37 +1291,11 @@ static void ftdi_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data, uint32
 
 	size_t i = swd_cmd_queue_length++;
 	swd_cmd_queue[i].cmd = cmd | SWD_CMD_START | SWD_CMD_PARK;
+	swd_cmd_queue[i].dst = dst;
+	swd_cmd_queue[i].data = data;
+	swd_cmd_queue[i].ap_delay_clk = ap_delay_clk;
 
-	mpsse_clock_data_out(mpsse_ctx, &swd_cmd_queue[i].cmd, 0, 8, SWD_MODE);
-
-	if (swd_cmd_queue[i].cmd & SWD_CMD_RNW) {
-		/* Queue a read transaction */
-		swd_cmd_queue[i].dst = dst;
-
-		ftdi_swd_swdio_en(false);
-		mpsse_clock_data_in(mpsse_ctx, swd_cmd_queue[i].trn_ack_data_parity_trn,
-				0, 1 + 3 + 32 + 1 + 1, SWD_MODE);
-		ftdi_swd_swdio_en(true);
-	} else {
-		/* Queue a write transaction */
-		ftdi_swd_swdio_en(false);
-
-		mpsse_clock_data_in(mpsse_ctx, swd_cmd_queue[i].trn_ack_data_parity_trn,
-				0, 1 + 3 + 1, SWD_MODE);
-
-		ftdi_swd_swdio_en(true);
-
-		buf_set_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 1, 32, data);
-		buf_set_u32(swd_cmd_queue[i].trn_ack_data_parity_trn, 1 + 3 + 1 + 32, 1, parity_u32(data));
-
-		mpsse_clock_data_out(mpsse_ctx, swd_cmd_queue[i].trn_ack_data_parity_trn,
-				1 + 3 + 1, 32 + 1, SWD_MODE);
-	}
-
-	/* Insert idle cycles after AP accesses to avoid WAIT */
-	if (cmd & SWD_CMD_APNDP)
-		mpsse_clock_data_out(mpsse_ctx, NULL, 0, ap_delay_clk, SWD_MODE);
-
+	ftdi_swd_queue_entry(i);
 }
 
 static void ftdi_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_clk)
@@ -1260,6 +1362,7 @@ static const struct swd_driver ftdi_swd = {
 	.read_reg = ftdi_swd_read_reg,
 	.write_reg = ftdi_swd_write_reg,
 	.run = ftdi_swd_run_queue,
+	.run_stats = ftdi_swd_run_stats,
 };
 
 static const char * const ftdi_transports[] = { "jtag", "swd", NULL };
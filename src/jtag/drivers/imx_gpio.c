@@ -93,6 +93,8 @@ static int imx_gpio_swd_write(int swclk, int swdio);
 static int imx_gpio_init(void);
 static int imx_gpio_quit(void);
 
+static struct bitbang_gpio_bank imx_gpio_bank;
+
 static struct bitbang_interface imx_gpio_bitbang = {
 	.read = imx_gpio_read,
 	.write = imx_gpio_write,
@@ -203,6 +205,7 @@ static int imx_gpio_speed_div(int speed, int *khz)
 static int imx_gpio_speed(int speed)
 {
 	jtag_delay = speed;
+	imx_gpio_bank.delay = speed;
 	return ERROR_OK;
 }
 
@@ -424,6 +427,9 @@ static const struct command_registration imx_gpio_command_handlers[] = {
 		.help = "peripheral base to access GPIOs (0x0209c000 for most IMX).",
 		.usage = "[base]",
 	},
+	{
+		.chain = bitbang_command_handlers,
+	},
 
 	COMMAND_REGISTRATION_DONE
 };
@@ -473,6 +479,41 @@ static bool imx_gpio_swd_mode_possible(void)
 	return 1;
 }
 
+/* The bitbang fast path needs all signals of the transport in one bank */
+static void imx_gpio_setup_fast_path(void)
+{
+	int bank;
+
+	imx_gpio_bitbang.gpio = NULL;
+
+	if (transport_is_jtag()) {
+		bank = tck_gpio / 32;
+		if (tms_gpio / 32 != bank || tdi_gpio / 32 != bank || tdo_gpio / 32 != bank) {
+			LOG_DEBUG("JTAG gpios span several banks, no fast path");
+			return;
+		}
+		imx_gpio_bank.tck = 1u << (tck_gpio & 0x1F);
+		imx_gpio_bank.tms = 1u << (tms_gpio & 0x1F);
+		imx_gpio_bank.tdi = 1u << (tdi_gpio & 0x1F);
+		imx_gpio_bank.tdo = 1u << (tdo_gpio & 0x1F);
+	} else if (transport_is_swd()) {
+		bank = swclk_gpio / 32;
+		if (swdio_gpio / 32 != bank) {
+			LOG_DEBUG("SWD gpios span several banks, no fast path");
+			return;
+		}
+		imx_gpio_bank.swclk = 1u << (swclk_gpio & 0x1F);
+		imx_gpio_bank.swdio = 1u << (swdio_gpio & 0x1F);
+	} else {
+		return;
+	}
+
+	/* no set/clear registers, outputs are updated read-modify-write */
+	imx_gpio_bank.data = &pio_base[bank].dr;
+	imx_gpio_bank.level = &pio_base[bank].dr;
+	imx_gpio_bitbang.gpio = &imx_gpio_bank;
+}
+
 static int imx_gpio_init(void)
 {
 	bitbang_interface = &imx_gpio_bitbang;
@@ -549,6 +590,8 @@ static int imx_gpio_init(void)
 		gpio_mode_output_set(srst_gpio);
 	}
 
+	imx_gpio_setup_fast_path();
+
 	LOG_DEBUG("saved pinmux settings: tck %d tms %d tdi %d "
 		  "tdo %d trst %d srst %d", tck_gpio_mode, tms_gpio_mode,
 		  tdi_gpio_mode, tdo_gpio_mode, trst_gpio_mode, srst_gpio_mode);
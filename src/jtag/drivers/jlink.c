@@ -61,8 +61,10 @@ static bool trace_enabled;
 
 #define JLINK_MAX_SPEED			12000
 #define JLINK_TAP_BUFFER_SIZE	2048
+/* libjaylink takes the length of a JTAG or SWD transfer in bits as uint16_t */
+#define JLINK_TAP_BUFFER_MAX_SIZE	(UINT16_MAX / 8)
 
-static unsigned int swd_buffer_size = JLINK_TAP_BUFFER_SIZE;
+static unsigned int tap_buffer_size = JLINK_TAP_BUFFER_SIZE;
 
 /* Maximum SWO frequency deviation. */
 #define SWO_MAX_FREQ_DEV	0.03
@@ -458,11 +460,13 @@ static int jlink_register(void)
 }
 
 /*
- * Adjust the SWD transaction buffer size depending on the free device internal
- * memory. This ensures that the SWD transactions sent to the device do not
- * exceed the internal memory of the device.
+ * Adjust the JTAG and SWD transaction buffer size depending on the free device
+ * internal memory. This ensures that the transactions sent to the device do not
+ * exceed the internal memory of the device, while probes with plenty of memory
+ * get fewer and larger transfers. Without the capability to query the free
+ * memory the conservative default is kept.
  */
-static bool adjust_swd_buffer_size(void)
+static bool adjust_tap_buffer_size(void)
 {
 	int ret;
 	uint32_t tmp;
@@ -483,12 +487,12 @@ static bool adjust_swd_buffer_size(void)
 		return false;
 	}
 
-	tmp = MIN(JLINK_TAP_BUFFER_SIZE, (tmp - 16) / 2);
+	tmp = MIN(JLINK_TAP_BUFFER_MAX_SIZE, (tmp - 16) / 2);
 
-	if (tmp != swd_buffer_size) {
-		swd_buffer_size = tmp;
-		LOG_DEBUG("Adjusted SWD transaction buffer size to %u bytes",
-			swd_buffer_size);
+	if (tmp != tap_buffer_size) {
+		tap_buffer_size = tmp;
+		LOG_DEBUG("Adjusted transaction buffer size to %u bytes",
+			tap_buffer_size);
 	}
 
 	return true;
@@ -762,18 +766,16 @@ static int jlink_init(void)
 			jtag_command_version = JAYLINK_JTAG_VERSION_3;
 	}
 
-	if (iface == JAYLINK_TIF_SWD) {
-		/*
-		 * Adjust the SWD transaction buffer size in case there is already
-		 * allocated memory on the device. This happens for example if the
-		 * memory for SWO capturing is still allocated because the software
-		 * which used the device before has not been shut down properly.
-		 */
-		if (!adjust_swd_buffer_size()) {
-			jaylink_close(devh);
-			jaylink_exit(jayctx);
-			return ERROR_JTAG_INIT_FAILED;
-		}
+	/*
+	 * Size the transaction buffer from the free device memory. This also
+	 * accounts for already allocated memory on the device, for example if
+	 * the memory for SWO capturing is still allocated because the software
+	 * which used the device before has not been shut down properly.
+	 */
+	if (!adjust_tap_buffer_size()) {
+		jaylink_close(devh);
+		jaylink_exit(jayctx);
+		return ERROR_JTAG_INIT_FAILED;
 	}
 
 	if (jaylink_has_cap(caps, JAYLINK_DEV_CAP_READ_CONFIG)) {
@@ -1334,10 +1336,10 @@ static int config_trace(bool enabled, enum tpiu_pin_protocol pin_protocol,
 
 	if (!enabled) {
 		/*
-		 * Adjust the SWD transaction buffer size as stopping SWO capturing
+		 * Adjust the transaction buffer size as stopping SWO capturing
 		 * deallocates device internal memory.
 		 */
-		if (!adjust_swd_buffer_size())
+		if (!adjust_tap_buffer_size())
 			return ERROR_FAIL;
 
 		return ERROR_OK;
@@ -1415,10 +1417,10 @@ static int config_trace(bool enabled, enum tpiu_pin_protocol pin_protocol,
 		buffer_size);
 
 	/*
-	 * Adjust the SWD transaction buffer size as starting SWO capturing
+	 * Adjust the transaction buffer size as starting SWO capturing
 	 * allocates device internal memory.
 	 */
-	if (!adjust_swd_buffer_size())
+	if (!adjust_tap_buffer_size())
 		return ERROR_FAIL;
 
 	return ERROR_OK;
@@ -1974,9 +1976,9 @@ static void jlink_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_c
 
 static unsigned tap_length;
 /* In SWD mode use tms buffer for direction control */
-static uint8_t tms_buffer[JLINK_TAP_BUFFER_SIZE];
-static uint8_t tdi_buffer[JLINK_TAP_BUFFER_SIZE];
-static uint8_t tdo_buffer[JLINK_TAP_BUFFER_SIZE];
+static uint8_t tms_buffer[JLINK_TAP_BUFFER_MAX_SIZE];
+static uint8_t tdi_buffer[JLINK_TAP_BUFFER_MAX_SIZE];
+static uint8_t tdo_buffer[JLINK_TAP_BUFFER_MAX_SIZE];
 
 struct pending_scan_result {
 	/** First bit position in tdo_buffer to read. */
@@ -1989,17 +1991,19 @@ struct pending_scan_result {
 	unsigned buffer_offset;
 };
 
-#define MAX_PENDING_SCAN_RESULTS 256
+/* enough for a full buffer of SWD transactions */
+#define MAX_PENDING_SCAN_RESULTS	(JLINK_TAP_BUFFER_MAX_SIZE * 8 / 46)
 
 static int pending_scan_results_length;
 static struct pending_scan_result pending_scan_results_buffer[MAX_PENDING_SCAN_RESULTS];
 
 static void jlink_tap_init(void)
 {
+	/* only the part used since the last flush can be dirty */
+	memset(tms_buffer, 0, DIV_ROUND_UP(tap_length, 8));
+	memset(tdi_buffer, 0, DIV_ROUND_UP(tap_length, 8));
 	tap_length = 0;
 	pending_scan_results_length = 0;
-	memset(tms_buffer, 0, sizeof(tms_buffer));
-	memset(tdi_buffer, 0, sizeof(tdi_buffer));
 }
 
 static void jlink_clock_data(const uint8_t *out, unsigned out_offset,
@@ -2008,13 +2012,14 @@ static void jlink_clock_data(const uint8_t *out, unsigned out_offset,
 			     unsigned length)
 {
 	do {
-		unsigned available_length = JLINK_TAP_BUFFER_SIZE - tap_length / 8;
+		unsigned available_length = tap_length < tap_buffer_size * 8 ?
+			tap_buffer_size * 8 - tap_length : 0;
 
 		if (!available_length ||
 		    (in && pending_scan_results_length == MAX_PENDING_SCAN_RESULTS)) {
 			if (jlink_flush() != ERROR_OK)
 				return;
-			available_length = JLINK_TAP_BUFFER_SIZE;
+			available_length = tap_buffer_size * 8;
 		}
 
 		struct pending_scan_result *pending_scan_result =
@@ -2223,7 +2228,7 @@ skip:
 static void jlink_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data, uint32_t ap_delay_clk)
 {
 	uint8_t data_parity_trn[DIV_ROUND_UP(32 + 1, 8)];
-	if (tap_length + 46 + 8 + ap_delay_clk >= swd_buffer_size * 8 ||
+	if (tap_length + 46 + 8 + ap_delay_clk >= tap_buffer_size * 8 ||
 	    pending_scan_results_length == MAX_PENDING_SCAN_RESULTS) {
 		/* Not enough room in the queue. Run the queue. */
 		queued_retval = jlink_swd_run_queue();
@@ -31,9 +31,13 @@
 
 #ifndef _WIN32
 #include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
 #endif
 
 #include "helper/replacements.h"
+#include "helper/time_support.h"
 
 #define NO_TAP_SHIFT	0
 #define TAP_SHIFT	1
@@ -48,6 +52,12 @@
 #define CMD_SCAN_CHAIN		2
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
+#define CMD_SHM_ATTACH		5
+
+#define SHM_MAGIC		0x4d485356	/* "VSHM" */
+#define SHM_DEFAULT_SLOTS	64
+/* how long to wait for the server to answer CMD_SHM_ATTACH */
+#define SHM_ATTACH_TIMEOUT_MS	5000
 
 /* jtag_vpi server port and address to connect to */
 static int server_port = DEFAULT_SERVER_PORT;
@@ -59,6 +69,10 @@ static bool stop_sim_on_exit;
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
+/* Shared memory file requested with "jtag_vpi shared_memory" */
+static char *shm_path;
+static unsigned int shm_slots = SHM_DEFAULT_SLOTS;
+
 /* One jtag_vpi "packet" as sent over a TCP channel. */
 struct vpi_cmd {
 	union {
@@ -77,6 +91,43 @@ struct vpi_cmd {
 	};
 };
 
+/* One slot of the shared memory ring. The simulator sets done once it has
+ * executed the command and, for scans, filled in buffer_in. */
+struct vpi_shm_slot {
+	struct vpi_cmd cmd;
+	volatile uint32_t done;
+};
+
+/* Shared memory ring, created by OpenOCD and attached by the simulator with
+ * CMD_SHM_ATTACH. OpenOCD writes commands into consecutive slots and then
+ * advances head; the simulator executes the slots up to head in order. Both
+ * sides run on the same host, the fields use the same little endian layout
+ * as on the socket anyway. */
+struct vpi_shm {
+	uint32_t magic;
+	uint32_t slots;
+	volatile uint32_t head;
+	uint32_t reserved;
+	struct vpi_shm_slot slot[];
+};
+
+/* Scan waiting for the results of its transfers */
+struct vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+};
+
+static struct vpi_shm *shm;
+static size_t shm_size;
+/* Number of commands the simulator has completed and we have collected */
+static uint32_t shm_tail;
+/* Where the buffer_in of each slot has to be copied, and how much of it */
+static uint8_t **shm_dest;
+static unsigned int *shm_dest_len;
+static struct vpi_pending_scan *pending_scans;
+static unsigned int pending_scan_count;
+static unsigned int pending_scan_size;
+
 static char *jtag_vpi_cmd_to_str(int cmd_num)
 {
 	switch (cmd_num) {
@@ -90,12 +141,24 @@ static char *jtag_vpi_cmd_to_str(int cmd_num)
 		return "CMD_SCAN_CHAIN_FLIP_TMS";
 	case CMD_STOP_SIMU:
 		return "CMD_STOP_SIMU";
+	case CMD_SHM_ATTACH:
+		return "CMD_SHM_ATTACH";
 	default:
 		return "<unknown>";
 	}
 }
 
-static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_shm_post(struct vpi_cmd *vpi, uint8_t *dest, unsigned int dest_len);
+static int jtag_vpi_connect(void);
+
+/**
+ * jtag_vpi_send_cmd - send a command to the server
+ * @param vpi the command
+ * @param result with the shared memory transport, where buffer_in is copied
+ * once the command completed (or NULL)
+ * @param result_len number of bytes to copy to result
+ */
+static int jtag_vpi_send_cmd(struct vpi_cmd *vpi, uint8_t *result, unsigned int result_len)
 {
 	int retval;
 
@@ -136,6 +199,9 @@ static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 	h_u32_to_le(vpi->length_buf, vpi->length);
 	h_u32_to_le(vpi->nb_bits_buf, vpi->nb_bits);
 
+	if (shm)
+		return jtag_vpi_shm_post(vpi, result, result_len);
+
 retry_write:
 	retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
 
@@ -206,6 +272,260 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+#ifndef _WIN32
+/**
+ * jtag_vpi_server_closed - check whether the server closed the connection
+ *
+ * The socket stays open while the shared memory ring is used, so the end of
+ * the simulation shows up as end of file on it.
+ */
+static bool jtag_vpi_server_closed(void)
+{
+	char c;
+	int retval = recv(sockfd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+	if (retval == 0)
+		return true;
+	if (retval < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		log_socket_error("jtag_vpi recv");
+		return true;
+	}
+	return false;
+}
+
+/**
+ * jtag_vpi_shm_collect - wait for the oldest outstanding command
+ *
+ * Waits until the simulator has completed the oldest command in the ring and
+ * copies its result to where the command asked for it. Fails if the server
+ * goes away in the meantime.
+ */
+static int jtag_vpi_shm_collect(void)
+{
+	struct vpi_shm_slot *slot = &shm->slot[shm_tail % shm->slots];
+	int64_t start = timeval_ms();
+	int64_t warn_after = 2000;
+
+	while (!slot->done) {
+		usleep(1);
+		if (jtag_vpi_server_closed()) {
+			LOG_ERROR("jtag_vpi: connection closed by the server while waiting for a command");
+			return ERROR_FAIL;
+		}
+		int64_t now = timeval_ms();
+		if (now - start > warn_after) {
+			LOG_WARNING("jtag_vpi: simulator has not completed a command for %" PRId64 " ms",
+				now - start);
+			warn_after *= 2;
+		}
+		keep_alive();
+	}
+	__sync_synchronize();
+
+	unsigned int i = shm_tail % shm->slots;
+	if (shm_dest[i]) {
+		memcpy(shm_dest[i], slot->cmd.buffer_in, shm_dest_len[i]);
+		shm_dest[i] = NULL;
+	}
+	shm_tail++;
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_shm_post - queue a command in the shared memory ring
+ * @param vpi command, with the header already in little endian
+ * @param dest where to copy buffer_in once the command completed, or NULL
+ * @param dest_len number of bytes to copy to dest
+ *
+ * The command is only handed to the simulator, use jtag_vpi_shm_flush() to
+ * wait for it.
+ */
+static int jtag_vpi_shm_post(struct vpi_cmd *vpi, uint8_t *dest, unsigned int dest_len)
+{
+	uint32_t head = shm->head;
+
+	if (head - shm_tail == shm->slots) {
+		int retval = jtag_vpi_shm_collect();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	unsigned int i = head % shm->slots;
+	struct vpi_shm_slot *slot = &shm->slot[i];
+	memcpy(&slot->cmd, vpi, sizeof(struct vpi_cmd));
+	slot->done = 0;
+	shm_dest[i] = dest;
+	shm_dest_len[i] = dest_len;
+
+	/* Make the slot visible before the simulator can see the new head */
+	__sync_synchronize();
+	shm->head = head + 1;
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_shm_flush - wait for all queued commands
+ *
+ * Collects the results of all commands in the ring and completes the scans
+ * that were waiting for them.
+ */
+static int jtag_vpi_shm_flush(void)
+{
+	int retval = ERROR_OK;
+
+	if (!shm)
+		return ERROR_OK;
+
+	while (shm_tail != shm->head && retval == ERROR_OK)
+		retval = jtag_vpi_shm_collect();
+
+	if (retval != ERROR_OK) {
+		/* drop the commands left, their scan buffers are freed below */
+		memset(shm_dest, 0, shm->slots * sizeof(*shm_dest));
+		shm_tail = shm->head;
+	}
+
+	for (unsigned int i = 0; i < pending_scan_count; i++) {
+		struct vpi_pending_scan *p = &pending_scans[i];
+		if (retval == ERROR_OK)
+			retval = jtag_read_buffer(p->buf, p->cmd);
+		free(p->buf);
+	}
+	pending_scan_count = 0;
+
+	return retval;
+}
+
+/**
+ * jtag_vpi_shm_attach - set up the shared memory ring
+ *
+ * Creates the shared memory file, sized for shm_slots commands, and asks the
+ * server to attach to it. A server that refuses leaves us on the socket. One
+ * that doesn't answer in time may still do so later, so the connection is
+ * opened again to not take that answer for the reply to another command.
+ */
+static int jtag_vpi_shm_attach(void)
+{
+	int retval = ERROR_OK;
+	struct vpi_cmd vpi;
+	size_t size = sizeof(struct vpi_shm) + shm_slots * sizeof(struct vpi_shm_slot);
+
+	if (strlen(shm_path) >= XFERT_MAX_SIZE) {
+		LOG_ERROR("jtag_vpi: shared memory path too long");
+		return ERROR_FAIL;
+	}
+
+	int fd = open(shm_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LOG_ERROR("jtag_vpi: can't create %s: %s", shm_path, strerror(errno));
+		return ERROR_FAIL;
+	}
+	if (ftruncate(fd, size) != 0) {
+		LOG_ERROR("jtag_vpi: can't size %s: %s", shm_path, strerror(errno));
+		close(fd);
+		unlink(shm_path);
+		return ERROR_FAIL;
+	}
+	struct vpi_shm *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		LOG_ERROR("jtag_vpi: can't map %s: %s", shm_path, strerror(errno));
+		unlink(shm_path);
+		return ERROR_FAIL;
+	}
+
+	shm_dest = calloc(shm_slots, sizeof(*shm_dest));
+	shm_dest_len = calloc(shm_slots, sizeof(*shm_dest_len));
+	if (!shm_dest || !shm_dest_len) {
+		LOG_ERROR("jtag_vpi: out of memory");
+		goto error;
+	}
+
+	mem->magic = SHM_MAGIC;
+	mem->slots = shm_slots;
+	mem->head = 0;
+	shm_tail = 0;
+
+	memset(&vpi, 0, sizeof(struct vpi_cmd));
+	vpi.cmd = CMD_SHM_ATTACH;
+	strcpy((char *)vpi.buffer_out, shm_path);
+	vpi.length = strlen(shm_path) + 1;
+	vpi.nb_bits = shm_slots;
+	if (jtag_vpi_send_cmd(&vpi, NULL, 0) != ERROR_OK)
+		goto error;
+
+	/* a server that doesn't know the command won't answer it */
+	struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+	int ready = poll(&pfd, 1, SHM_ATTACH_TIMEOUT_MS);
+	if (ready <= 0) {
+		LOG_WARNING("jtag_vpi: server did not answer the shared memory request, reconnecting to stay on the socket");
+		close_socket(sockfd);
+		retval = jtag_vpi_connect();
+		goto error;
+	}
+	if (jtag_vpi_receive_cmd(&vpi) != ERROR_OK)
+		goto error;
+
+	if (vpi.cmd != CMD_SHM_ATTACH || vpi.nb_bits != shm_slots) {
+		LOG_WARNING("jtag_vpi: server did not attach to %s, staying on the socket", shm_path);
+		goto error;
+	}
+
+	shm = mem;
+	shm_size = size;
+	LOG_INFO("jtag_vpi: using shared memory %s with %u slots", shm_path, shm_slots);
+
+	return ERROR_OK;
+
+error:
+	free(shm_dest);
+	free(shm_dest_len);
+	shm_dest = NULL;
+	shm_dest_len = NULL;
+	munmap(mem, size);
+	unlink(shm_path);
+	return retval;
+}
+
+static void jtag_vpi_shm_detach(void)
+{
+	if (!shm)
+		return;
+
+	munmap(shm, shm_size);
+	shm = NULL;
+	unlink(shm_path);
+	free(shm_dest);
+	free(shm_dest_len);
+	free(pending_scans);
+	shm_dest = NULL;
+	shm_dest_len = NULL;
+	pending_scans = NULL;
+}
+#else
+static int jtag_vpi_shm_post(struct vpi_cmd *vpi, uint8_t *dest, unsigned int dest_len)
+{
+	return ERROR_FAIL;
+}
+
+static int jtag_vpi_shm_flush(void)
+{
+	return ERROR_OK;
+}
+
+static int jtag_vpi_shm_attach(void)
+{
+	LOG_WARNING("jtag_vpi: shared memory is not supported on this host, staying on the socket");
+	return ERROR_OK;
+}
+
+static void jtag_vpi_shm_detach(void)
+{
+}
+#endif
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @param trst 1 if TRST is to be asserted
@@ -218,7 +538,7 @@ static int jtag_vpi_reset(int trst, int srst)
 
 	vpi.cmd = CMD_RESET;
 	vpi.length = 0;
-	return jtag_vpi_send_cmd(&vpi);
+	return jtag_vpi_send_cmd(&vpi, NULL, 0);
 }
 
 /**
@@ -245,7 +565,7 @@ static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 	vpi.length = nb_bytes;
 	vpi.nb_bits = nb_bits;
 
-	return jtag_vpi_send_cmd(&vpi);
+	return jtag_vpi_send_cmd(&vpi, NULL, 0);
 }
 
 /**
@@ -317,10 +637,14 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	vpi.length = nb_bytes;
 	vpi.nb_bits = nb_bits;
 
-	int retval = jtag_vpi_send_cmd(&vpi);
+	int retval = jtag_vpi_send_cmd(&vpi, bits, nb_bytes);
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* The result is collected by jtag_vpi_shm_flush() */
+	if (shm)
+		return ERROR_OK;
+
 	retval = jtag_vpi_receive_cmd(&vpi);
 	if (retval != ERROR_OK)
 		return retval;
@@ -436,11 +760,29 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (shm) {
+		/* Complete the scan once its results have arrived */
+		if (pending_scan_count == pending_scan_size) {
+			unsigned int size = pending_scan_size ? 2 * pending_scan_size : 16;
+			struct vpi_pending_scan *p = realloc(pending_scans, size * sizeof(*p));
+			if (!p) {
+				LOG_ERROR("jtag_vpi: out of memory");
+				free(buf);
+				return ERROR_FAIL;
+			}
+			pending_scans = p;
+			pending_scan_size = size;
+		}
+		pending_scans[pending_scan_count].cmd = cmd;
+		pending_scans[pending_scan_count].buf = buf;
+		pending_scan_count++;
+	} else {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
 
-	free(buf);
+		free(buf);
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -519,6 +861,7 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			retval = jtag_vpi_shm_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -532,10 +875,14 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	int flush_retval = jtag_vpi_shm_flush();
+	if (retval == ERROR_OK)
+		retval = flush_retval;
+
 	return retval;
 }
 
-static int jtag_vpi_init(void)
+static int jtag_vpi_connect(void)
 {
 	int flag = 1;
 
@@ -545,6 +892,26 @@ static int jtag_vpi_init(void)
 		return ERROR_FAIL;
 	}
 
+	if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+		close(sockfd);
+		LOG_ERROR("jtag_vpi: Can't connect to %s : %u", server_address, server_port);
+		return ERROR_COMMAND_CLOSE_CONNECTION;
+	}
+
+	if (serv_addr.sin_addr.s_addr == htonl(INADDR_LOOPBACK)) {
+		/* This increases performance dramatically for local
+		 * connections, which is the most likely arrangement
+		 * for a VPI connection. */
+		setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+	}
+
+	return ERROR_OK;
+}
+
+static int jtag_vpi_init(void)
+{
+	int retval;
+
 	memset(&serv_addr, 0, sizeof(serv_addr));
 
 	serv_addr.sin_family = AF_INET;
@@ -560,21 +927,15 @@ static int jtag_vpi_init(void)
 		return ERROR_FAIL;
 	}
 
-	if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-		close(sockfd);
-		LOG_ERROR("jtag_vpi: Can't connect to %s : %u", server_address, server_port);
-		return ERROR_COMMAND_CLOSE_CONNECTION;
-	}
-
-	if (serv_addr.sin_addr.s_addr == htonl(INADDR_LOOPBACK)) {
-		/* This increases performance dramatically for local
-		 * connections, which is the most likely arrangement
-		 * for a VPI connection. */
-		setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
-	}
+	retval = jtag_vpi_connect();
+	if (retval != ERROR_OK)
+		return retval;
 
 	LOG_INFO("jtag_vpi: Connection to %s : %u successful", server_address, server_port);
 
+	if (shm_path)
+		return jtag_vpi_shm_attach();
+
 	return ERROR_OK;
 }
 
@@ -585,7 +946,7 @@ static int jtag_vpi_stop_simulation(void)
 	cmd.length = 0;
 	cmd.nb_bits = 0;
 	cmd.cmd = CMD_STOP_SIMU;
-	return jtag_vpi_send_cmd(&cmd);
+	return jtag_vpi_send_cmd(&cmd, NULL, 0);
 }
 
 static int jtag_vpi_quit(void)
@@ -594,11 +955,13 @@ static int jtag_vpi_quit(void)
 		if (jtag_vpi_stop_simulation() != ERROR_OK)
 			LOG_WARNING("jtag_vpi: failed to send \"stop simulation\" command");
 	}
+	jtag_vpi_shm_detach();
 	if (close_socket(sockfd) != 0) {
 		LOG_WARNING("jtag_vpi: could not close jtag_vpi client socket");
 		log_socket_error("jtag_vpi");
 	}
 	free(server_address);
+	free(shm_path);
 	return ERROR_OK;
 }
 
@@ -641,6 +1004,26 @@ COMMAND_HANDLER(jtag_vpi_stop_sim_on_exit_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_shared_memory_handler)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 2) {
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], shm_slots);
+		if (shm_slots == 0) {
+			LOG_ERROR("jtag_vpi: the ring needs at least one slot");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	free(shm_path);
+	shm_path = strdup(CMD_ARGV[0]);
+	LOG_INFO("jtag_vpi: shared memory file set to %s", shm_path);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -664,6 +1047,14 @@ static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 			"before OpenOCD exits (default: off)",
 		.usage = "<on|off>",
 	},
+	{
+		.name = "shared_memory",
+		.handler = &jtag_vpi_shared_memory_handler,
+		.mode = COMMAND_CONFIG,
+		.help = "exchange commands with the server through a shared memory "
+			"ring in the given file instead of the socket",
+		.usage = "file [slots]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
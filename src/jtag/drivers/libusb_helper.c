@@ -25,6 +25,7 @@
 
 #include <helper/log.h>
 #include <jtag/adapter.h>
+#include <jtag/adapter_stats.h>
 #include "libusb_helper.h"
 
 /*
@@ -230,10 +231,19 @@ int jtag_libusb_control_transfer(struct libusb_device_handle *dev, uint8_t reque
 		uint16_t size, unsigned int timeout)
 {
 	int transferred = 0;
+	int64_t start = adapter_stats_timestamp();
 
 	transferred = libusb_control_transfer(dev, request_type, request, value, index,
 				(unsigned char *)bytes, size, timeout);
 
+	uint8_t setup[8] = { request_type, request };
+	h_u16_to_le(setup + 2, value);
+	h_u16_to_le(setup + 4, index);
+	h_u16_to_le(setup + 6, size);
+	adapter_stats_record(start, ADAPTER_STATS_CONTROL, request_type & LIBUSB_ENDPOINT_IN,
+		setup, (uint8_t *)bytes, transferred,
+		transferred < 0 ? jtag_libusb_error(transferred) : ERROR_OK);
+
 	if (transferred < 0)
 		transferred = 0;
 
@@ -247,8 +257,11 @@ int jtag_libusb_bulk_write(struct libusb_device_handle *dev, int ep, char *bytes
 
 	*transferred = 0;
 
+	int64_t start = adapter_stats_timestamp();
 	ret = libusb_bulk_transfer(dev, ep, (unsigned char *)bytes, size,
 				   transferred, timeout);
+	adapter_stats_record(start, ADAPTER_STATS_BULK, ep, NULL, (uint8_t *)bytes,
+		*transferred, jtag_libusb_error(ret));
 	if (ret != LIBUSB_SUCCESS) {
 		LOG_ERROR("libusb_bulk_write error: %s", libusb_error_name(ret));
 		return jtag_libusb_error(ret);
@@ -264,8 +277,11 @@ int jtag_libusb_bulk_read(struct libusb_device_handle *dev, int ep, char *bytes,
 
 	*transferred = 0;
 
+	int64_t start = adapter_stats_timestamp();
 	ret = libusb_bulk_transfer(dev, ep, (unsigned char *)bytes, size,
 				   transferred, timeout);
+	adapter_stats_record(start, ADAPTER_STATS_BULK, ep, NULL, (uint8_t *)bytes,
+		*transferred, jtag_libusb_error(ret));
 	if (ret != LIBUSB_SUCCESS) {
 		LOG_ERROR("libusb_bulk_read error: %s", libusb_error_name(ret));
 		return jtag_libusb_error(ret);
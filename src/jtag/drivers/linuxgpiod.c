@@ -714,6 +714,9 @@ static const struct command_registration linuxgpiod_command_handlers[] = {
 		.chain = linuxgpiod_subcommand_handlers,
 		.usage = "",
 	},
+	{
+		.chain = bitbang_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
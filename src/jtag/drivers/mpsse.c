@@ -24,6 +24,7 @@
 #include "helper/log.h"
 #include "helper/replacements.h"
 #include "helper/time_support.h"
+#include "jtag/adapter_stats.h"
 #include <libusb.h>
 
 /* Compatibility define for older libusb-1.0 */
@@ -62,6 +63,11 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+/* Command buffer size used by default and on full speed chips, and the
+ * largest one a high speed chip grows to at fast clocks */
+#define MPSSE_BUFFER_SIZE 16384
+#define MPSSE_BUFFER_SIZE_MAX 65536
+
 struct mpsse_ctx {
 	struct libusb_context *usb_ctx;
 	struct libusb_device_handle *usb_dev;
@@ -76,6 +82,11 @@ struct mpsse_ctx {
 	uint8_t *write_buffer;
 	unsigned write_size;
 	unsigned write_count;
+	/* Buffer space charged for clock-only commands, so that a flush never
+	 * clocks more than a buffer full of data would */
+	unsigned idle_bytes;
+	/* End of the last TMS command if it can still take more bits, or 0 */
+	unsigned tms_merge_end;
 	uint8_t *read_buffer;
 	unsigned read_size;
 	unsigned read_count;
@@ -329,16 +340,16 @@ struct mpsse_ctx *mpsse_open(const uint16_t *vid, const uint16_t *pid, const cha
 
 	bit_copy_queue_init(&ctx->read_queue);
 	ctx->read_chunk_size = 16384;
-	ctx->read_size = 16384;
-	ctx->write_size = 16384;
+	ctx->read_size = MPSSE_BUFFER_SIZE;
+	ctx->write_size = MPSSE_BUFFER_SIZE;
 	ctx->read_chunk = malloc(ctx->read_chunk_size);
-	ctx->read_buffer = malloc(ctx->read_size);
+	ctx->read_buffer = malloc(MPSSE_BUFFER_SIZE_MAX);
 
 	/* Use calloc to make valgrind happy: buffer_write() sets payload
 	 * on bit basis, so some bits can be left uninitialized in write_buffer.
 	 * Although this is perfectly ok with MPSSE, valgrind reports
 	 * Syscall param ioctl(USBDEVFS_SUBMITURB).buffer points to uninitialised byte(s) */
-	ctx->write_buffer = calloc(1, ctx->write_size);
+	ctx->write_buffer = calloc(1, MPSSE_BUFFER_SIZE_MAX);
 
 	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
 		goto error;
@@ -422,6 +433,8 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 	int err;
 	LOG_DEBUG("-");
 	ctx->write_count = 0;
+	ctx->idle_bytes = 0;
+	ctx->tms_merge_end = 0;
 	ctx->read_count = 0;
 	ctx->retval = ERROR_OK;
 	bit_copy_discard(&ctx->read_queue);
@@ -443,7 +456,7 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 static unsigned buffer_write_space(struct mpsse_ctx *ctx)
 {
 	/* Reserve one byte for SEND_IMMEDIATE */
-	return ctx->write_size - ctx->write_count - 1;
+	return ctx->write_size - ctx->write_count - ctx->idle_bytes - 1;
 }
 
 static unsigned buffer_read_space(struct mpsse_ctx *ctx)
@@ -491,6 +504,46 @@ void mpsse_clock_data_in(struct mpsse_ctx *ctx, uint8_t *in, unsigned in_offset,
 	mpsse_clock_data(ctx, 0, 0, in, in_offset, length, mode);
 }
 
+/* Clock length cycles with the data output held low, using the clock-only
+ * commands of the high speed chips instead of shifting out zero bytes */
+static void mpsse_clock_idle(struct mpsse_ctx *ctx, unsigned length, uint8_t mode)
+{
+	if (buffer_write_space(ctx) < 3)
+		ctx->retval = mpsse_flush(ctx);
+
+	/* The clock-only commands leave the data output alone, so drive it low
+	 * with one ordinary zero bit first */
+	buffer_write_byte(ctx, 0x12 | mode);
+	buffer_write_byte(ctx, 0);
+	buffer_write_byte(ctx, 0x00);
+	length--;
+
+	while (length > 0) {
+		if (buffer_write_space(ctx) < 4)
+			ctx->retval = mpsse_flush(ctx);
+
+		if (length < 8) {
+			buffer_write_byte(ctx, 0x8e);
+			buffer_write_byte(ctx, length - 1);
+			length = 0;
+		} else {
+			unsigned this_bytes = length / 8;
+			/* MPSSE command limit */
+			if (this_bytes > 65536)
+				this_bytes = 65536;
+			/* Charge the clocks to the buffer as if they were data bytes */
+			if (this_bytes + 3 > buffer_write_space(ctx))
+				this_bytes = buffer_write_space(ctx) - 3;
+
+			buffer_write_byte(ctx, 0x8f);
+			buffer_write_byte(ctx, (this_bytes - 1) & 0xff);
+			buffer_write_byte(ctx, (this_bytes - 1) >> 8);
+			ctx->idle_bytes += this_bytes;
+			length -= this_bytes * 8;
+		}
+	}
+}
+
 void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_offset, uint8_t *in,
 	unsigned in_offset, unsigned length, uint8_t mode)
 {
@@ -502,7 +555,12 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 		return;
 	}
 
-	/* TODO: On H chips, use command 0x8E/0x8F if in and out are both 0 */
+	/* Below 32 cycles the zero bytes are no longer than the clock-only commands */
+	if (!out && !in && length >= 32 && mpsse_is_high_speed(ctx)) {
+		mpsse_clock_idle(ctx, length, mode);
+		return;
+	}
+
 	if (out || (!out && !in))
 		mode |= 0x10;
 	if (in)
@@ -584,10 +642,6 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 		mode |= 0x20;
 
 	while (length > 0) {
-		/* Guarantee buffer space enough for a minimum size transfer */
-		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
-
 		/* Byte transfer */
 		unsigned this_bits = length;
 		/* MPSSE command limit */
@@ -600,6 +654,27 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 		if (this_bits > 7)
 			this_bits = 7;
 
+		/* Append to the previous command if it is the same kind of TMS
+		 * command, still last in the buffer and not yet full */
+		if (!in && ctx->tms_merge_end == ctx->write_count && ctx->tms_merge_end >= 3) {
+			uint8_t *cmd = ctx->write_buffer + ctx->write_count - 3;
+			unsigned prev_bits = cmd[1] + 1;
+			if (cmd[0] == mode && (cmd[2] & 0x80) == (tdi ? 0x80 : 0x00) && prev_bits < 7) {
+				if (this_bits > 7 - prev_bits)
+					this_bits = 7 - prev_bits;
+				LOG_DEBUG_IO("merging %d bits into previous TMS command", this_bits);
+				bit_copy(&cmd[2], prev_bits, out, out_offset, this_bits);
+				cmd[1] += this_bits;
+				out_offset += this_bits;
+				length -= this_bits;
+				continue;
+			}
+		}
+
+		/* Guarantee buffer space enough for a minimum size transfer */
+		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
+			ctx->retval = mpsse_flush(ctx);
+
 		if (this_bits > 0) {
 			buffer_write_byte(ctx, mode);
 			buffer_write_byte(ctx, this_bits - 1);
@@ -614,6 +689,8 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 						in_offset,
 						this_bits,
 						8 - this_bits);
+			else
+				ctx->tms_merge_end = ctx->write_count;
 			length -= this_bits;
 		}
 	}
@@ -744,14 +821,37 @@ int mpsse_rtck_config(struct mpsse_ctx *ctx, bool enable)
 	return ERROR_OK;
 }
 
+/* Change the command buffer size, flushing first if the queued commands
+ * would not fit anymore */
+static void mpsse_set_buffer_size(struct mpsse_ctx *ctx, unsigned size)
+{
+	if (!mpsse_is_high_speed(ctx) || size < MPSSE_BUFFER_SIZE)
+		size = MPSSE_BUFFER_SIZE;
+	if (size > MPSSE_BUFFER_SIZE_MAX)
+		size = MPSSE_BUFFER_SIZE_MAX;
+
+	if (size == ctx->write_size)
+		return;
+
+	if (ctx->write_count + ctx->idle_bytes + 1 > size || ctx->read_count > size)
+		ctx->retval = mpsse_flush(ctx);
+
+	LOG_DEBUG("command buffer %u bytes", size);
+	ctx->write_size = size;
+	ctx->read_size = size;
+}
+
 int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 {
 	LOG_DEBUG("target %d Hz", frequency);
 	assert(frequency >= 0);
 	int base_clock;
 
-	if (frequency == 0)
+	if (frequency == 0) {
+		/* The adaptive clock can be arbitrarily slow */
+		mpsse_set_buffer_size(ctx, MPSSE_BUFFER_SIZE);
 		return mpsse_rtck_config(ctx, true);
+	}
 
 	mpsse_rtck_config(ctx, false); /* just try */
 
@@ -772,6 +872,10 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 	frequency = base_clock / 2 / (1 + divisor);
 	LOG_DEBUG("actually %d Hz", frequency);
 
+	/* Queue more per flush as long as a full buffer takes no more than about
+	 * a quarter second to clock out */
+	mpsse_set_buffer_size(ctx, frequency / 8 / 4);
+
 	return frequency;
 }
 
@@ -780,8 +884,23 @@ struct transfer_result {
 	struct mpsse_ctx *ctx;
 	bool done;
 	unsigned transferred;
+	int64_t submitted;
 };
 
+static void mpsse_record_transfer(struct libusb_transfer *transfer)
+{
+	struct transfer_result *res = transfer->user_data;
+	int retval = ERROR_OK;
+
+	if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT)
+		retval = ERROR_TIMEOUT_REACHED;
+	else if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
+		retval = ERROR_FAIL;
+
+	adapter_stats_record(res->submitted, ADAPTER_STATS_BULK, transfer->endpoint, NULL,
+		transfer->buffer, transfer->actual_length, retval);
+}
+
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 {
 	struct transfer_result *res = transfer->user_data;
@@ -789,6 +908,7 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 
 	unsigned packet_size = ctx->max_packet_size;
 
+	mpsse_record_transfer(transfer);
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
 	/* Strip the two status bytes sent at the beginning of each USB packet
@@ -815,9 +935,11 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 	LOG_DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
 		ctx->read_count);
 
-	if (!res->done)
+	if (!res->done) {
+		res->submitted = adapter_stats_timestamp();
 		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
+	}
 }
 
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
@@ -827,6 +949,7 @@ static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 
 	res->transferred += transfer->actual_length;
 
+	mpsse_record_transfer(transfer);
 	LOG_DEBUG_IO("transferred %d of %d", res->transferred, ctx->write_count);
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
@@ -836,6 +959,7 @@ static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 	else {
 		transfer->length = ctx->write_count - res->transferred;
 		transfer->buffer = ctx->write_buffer + res->transferred;
+		res->submitted = adapter_stats_timestamp();
 		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
 	}
@@ -845,6 +969,8 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 {
 	int retval = ctx->retval;
 
+	ctx->tms_merge_end = 0;
+
 	if (retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring flush due to previous error");
 		assert(ctx->write_count == 0 && ctx->read_count == 0);
@@ -872,6 +998,7 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
 	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
 		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
+	write_result.submitted = adapter_stats_timestamp();
 	retval = libusb_submit_transfer(write_transfer);
 	if (retval != LIBUSB_SUCCESS)
 		goto error_check;
@@ -881,6 +1008,7 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
 			ctx->read_chunk_size, read_cb, &read_result,
 			ctx->usb_read_timeout);
+		read_result.submitted = adapter_stats_timestamp();
 		retval = libusb_submit_transfer(read_transfer);
 		if (retval != LIBUSB_SUCCESS)
 			goto error_check;
@@ -936,11 +1064,13 @@ error_check:
 		retval = ERROR_FAIL;
 	} else if (ctx->read_count) {
 		ctx->write_count = 0;
+		ctx->idle_bytes = 0;
 		ctx->read_count = 0;
 		bit_copy_execute(&ctx->read_queue);
 		retval = ERROR_OK;
 	} else {
 		ctx->write_count = 0;
+		ctx->idle_bytes = 0;
 		bit_copy_discard(&ctx->read_queue);
 		retval = ERROR_OK;
 	}
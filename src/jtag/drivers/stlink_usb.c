@@ -561,6 +561,7 @@ static void stlink_dump_speed_map(const struct speed_map *map, unsigned int map_
 static int stlink_get_com_freq(void *handle, bool is_jtag, struct speed_map *map);
 static int stlink_speed(void *handle, int khz, bool query);
 static int stlink_usb_open_ap(void *handle, unsigned short apsel);
+static struct stlink_backend_s stlink_usb_backend;
 
 /** */
 static unsigned int stlink_usb_block(void *handle)
@@ -2789,6 +2790,116 @@ static int stlink_usb_write_mem32_noaddrinc(void *handle, uint8_t ap_num, uint32
 	return stlink_usb_get_rw_status(handle);
 }
 
+/*
+ * STLINK-V3 over USB: several memory commands, each with its data phase and
+ * the read of its status, go out as one batch of asynchronous bulk transfers.
+ * The probe works through them back to back instead of idling for a USB
+ * round trip between blocks. A failing block doesn't stop the ones queued
+ * behind it, only the blocks before the first error are reported as done.
+ */
+#define STLINK_V3_PIPELINE_DEPTH	8
+
+struct stlink_mem_block {
+	uint32_t addr;
+	uint32_t len;
+	uint8_t *buffer;
+};
+
+static bool stlink_usb_can_pipeline(void *handle)
+{
+#ifdef USE_LIBUSB_ASYNCIO
+	struct stlink_usb_handle_s *h = handle;
+
+	return h->backend == &stlink_usb_backend && h->version.stlink >= 3 &&
+		h->st_mode != STLINK_MODE_DEBUG_SWIM &&
+		(h->version.flags & STLINK_F_HAS_GETLASTRWSTATUS2) &&
+		(h->version.flags & STLINK_F_HAS_CSW);
+#else
+	return false;
+#endif
+}
+
+#ifdef USE_LIBUSB_ASYNCIO
+static int stlink_usb_rw_mem_blocks(void *handle, uint8_t ap_num, uint32_t csw,
+		uint32_t size, bool write, const struct stlink_mem_block *blocks,
+		unsigned int count, unsigned int *done)
+{
+	struct stlink_usb_handle_s *h = handle;
+	uint8_t cmd[2 * STLINK_V3_PIPELINE_DEPTH][STLINK_CMD_SIZE_V2];
+	uint8_t status[STLINK_V3_PIPELINE_DEPTH][12];
+	struct jtag_xfer transfers[4 * STLINK_V3_PIPELINE_DEPTH];
+	size_t n_transfers = 0;
+	uint8_t opcode;
+	int retval;
+
+	assert(count <= STLINK_V3_PIPELINE_DEPTH);
+
+	*done = 0;
+
+	if (size == 2)
+		opcode = write ? STLINK_DEBUG_APIV2_WRITEMEM_16BIT : STLINK_DEBUG_APIV2_READMEM_16BIT;
+	else
+		opcode = write ? STLINK_DEBUG_WRITEMEM_32BIT : STLINK_DEBUG_READMEM_32BIT;
+
+	memset(cmd, 0, sizeof(cmd));
+	memset(status, 0, sizeof(status));
+	memset(transfers, 0, sizeof(transfers));
+
+	for (unsigned int i = 0; i < count; i++) {
+		uint8_t *mem_cmd = cmd[2 * i];
+		uint8_t *status_cmd = cmd[2 * i + 1];
+
+		LOG_DEBUG_IO("%s 0x%08" PRIx32 " %" PRIu32 " bytes in batch of %u",
+			write ? "write" : "read", blocks[i].addr, blocks[i].len, count);
+
+		mem_cmd[0] = STLINK_DEBUG_COMMAND;
+		mem_cmd[1] = opcode;
+		h_u32_to_le(&mem_cmd[2], blocks[i].addr);
+		h_u16_to_le(&mem_cmd[6], blocks[i].len);
+		mem_cmd[8] = ap_num;
+		h_u24_to_le(&mem_cmd[9], csw >> 8);
+
+		status_cmd[0] = STLINK_DEBUG_COMMAND;
+		status_cmd[1] = STLINK_DEBUG_APIV2_GETLASTRWSTATUS2;
+
+		transfers[n_transfers].ep = h->tx_ep;
+		transfers[n_transfers].buf = mem_cmd;
+		transfers[n_transfers++].size = STLINK_CMD_SIZE_V2;
+		transfers[n_transfers].ep = write ? h->tx_ep : h->rx_ep;
+		transfers[n_transfers].buf = blocks[i].buffer;
+		transfers[n_transfers++].size = blocks[i].len;
+		transfers[n_transfers].ep = h->tx_ep;
+		transfers[n_transfers].buf = status_cmd;
+		transfers[n_transfers++].size = STLINK_CMD_SIZE_V2;
+		transfers[n_transfers].ep = h->rx_ep;
+		transfers[n_transfers].buf = status[i];
+		transfers[n_transfers++].size = sizeof(status[i]);
+	}
+
+	retval = jtag_libusb_bulk_transfer_n(h->usb_backend_priv.fd, transfers,
+			n_transfers, STLINK_WRITE_TIMEOUT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (; *done < count; (*done)++) {
+		memcpy(h->databuf, status[*done], sizeof(status[0]));
+		retval = stlink_usb_error_check(h);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+#else
+static int stlink_usb_rw_mem_blocks(void *handle, uint8_t ap_num, uint32_t csw,
+		uint32_t size, bool write, const struct stlink_mem_block *blocks,
+		unsigned int count, unsigned int *done)
+{
+	*done = 0;
+	return ERROR_COMMAND_NOTFOUND;
+}
+#endif
+
 static uint32_t stlink_max_block_size(uint32_t tar_autoincr_block, uint32_t address)
 {
 	uint32_t max_tar_block = (tar_autoincr_block - ((tar_autoincr_block - 1) & address));
@@ -2797,6 +2908,39 @@ static uint32_t stlink_max_block_size(uint32_t tar_autoincr_block, uint32_t addr
 	return max_tar_block;
 }
 
+/* Batched version of one or more rounds of the block loop in
+ * stlink_usb_read_ap_mem() and stlink_usb_write_ap_mem(), for aligned 16
+ * and 32 bit accesses. Returns in *done the bytes transferred before any
+ * error; a tail that is not a whole number of items is left to the loop. */
+static int stlink_usb_rw_ap_mem_pipelined(void *handle, uint8_t ap_num, uint32_t csw,
+		uint32_t addr, uint32_t size, uint32_t count, uint8_t *buffer, bool write,
+		uint32_t *done)
+{
+	struct stlink_usb_handle_s *h = handle;
+	struct stlink_mem_block blocks[STLINK_V3_PIPELINE_DEPTH];
+	unsigned int n, ok;
+
+	for (n = 0; n < STLINK_V3_PIPELINE_DEPTH && count; n++) {
+		uint32_t len = MIN(stlink_max_block_size(h->max_mem_packet, addr), count);
+		if (len % size)
+			break;
+		blocks[n].addr = addr;
+		blocks[n].len = len;
+		blocks[n].buffer = buffer;
+		addr += len;
+		buffer += len;
+		count -= len;
+	}
+
+	int retval = stlink_usb_rw_mem_blocks(handle, ap_num, csw, size, write, blocks, n, &ok);
+
+	*done = 0;
+	for (unsigned int i = 0; i < ok; i++)
+		*done += blocks[i].len;
+
+	return retval;
+}
+
 static int stlink_usb_read_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 		uint32_t addr, uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -2819,6 +2963,24 @@ static int stlink_usb_read_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 		if (count < bytes_remaining)
 			bytes_remaining = count;
 
+		/* more than one aligned block: let a V3 probe run them back to back */
+		if (size != 1 && count > bytes_remaining && !(addr & (size - 1)) &&
+				stlink_usb_can_pipeline(h)) {
+			uint32_t done;
+			retval = stlink_usb_rw_ap_mem_pipelined(handle, ap_num, csw, addr, size,
+					count, buffer, false, &done);
+			buffer += done;
+			addr += done;
+			count -= done;
+			if (retval == ERROR_WAIT && retries < MAX_WAIT_RETRIES) {
+				usleep((1 << retries++) * 1000);
+				continue;
+			}
+			if (retval != ERROR_OK)
+				return retval;
+			continue;
+		}
+
 		/*
 		 * all stlink support 8/32bit memory read/writes and only from
 		 * stlink V2J26 there is support for 16 bit memory read/write.
@@ -2905,6 +3067,24 @@ static int stlink_usb_write_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 		if (count < bytes_remaining)
 			bytes_remaining = count;
 
+		/* more than one aligned block: let a V3 probe run them back to back */
+		if (size != 1 && count > bytes_remaining && !(addr & (size - 1)) &&
+				stlink_usb_can_pipeline(h)) {
+			uint32_t done;
+			retval = stlink_usb_rw_ap_mem_pipelined(handle, ap_num, csw, addr, size,
+					count, (uint8_t *)buffer, true, &done);
+			buffer += done;
+			addr += done;
+			count -= done;
+			if (retval == ERROR_WAIT && retries < MAX_WAIT_RETRIES) {
+				usleep((1 << retries++) * 1000);
+				continue;
+			}
+			if (retval != ERROR_OK)
+				return retval;
+			continue;
+		}
+
 		/*
 		 * all stlink support 8/32bit memory read/writes and only from
 		 * stlink V2J26 there is support for 16 bit memory read/write.
@@ -3940,6 +4120,54 @@ static int stlink_usb_rw_misc_in(void *handle, uint32_t items, uint8_t *buffer)
 	return ERROR_OK;
 }
 
+/* RW_MISC_OUT and RW_MISC_IN submitted together, the results end up in buffer */
+static int stlink_usb_rw_misc_pipelined(void *handle, uint32_t items, uint8_t *buffer)
+{
+#ifdef USE_LIBUSB_ASYNCIO
+	struct stlink_usb_handle_s *h = handle;
+	unsigned int out_len = ALIGN_UP(items, 4) + 4 * items;
+	unsigned int in_len = 2 * 4 * items;
+	uint8_t cmd[2][STLINK_CMD_SIZE_V2];
+	uint8_t in[in_len];
+	struct jtag_xfer transfers[4];
+
+	LOG_DEBUG_IO("%s(%" PRIu32 ")", __func__, items);
+
+	memset(cmd, 0, sizeof(cmd));
+	memset(transfers, 0, sizeof(transfers));
+
+	cmd[0][0] = STLINK_DEBUG_COMMAND;
+	cmd[0][1] = STLINK_DEBUG_APIV2_RW_MISC_OUT;
+	h_u32_to_le(&cmd[0][2], items);
+	cmd[1][0] = STLINK_DEBUG_COMMAND;
+	cmd[1][1] = STLINK_DEBUG_APIV2_RW_MISC_IN;
+
+	transfers[0].ep = h->tx_ep;
+	transfers[0].buf = cmd[0];
+	transfers[0].size = STLINK_CMD_SIZE_V2;
+	transfers[1].ep = h->tx_ep;
+	transfers[1].buf = buffer;
+	transfers[1].size = out_len;
+	transfers[2].ep = h->tx_ep;
+	transfers[2].buf = cmd[1];
+	transfers[2].size = STLINK_CMD_SIZE_V2;
+	transfers[3].ep = h->rx_ep;
+	transfers[3].buf = in;
+	transfers[3].size = in_len;
+
+	int retval = jtag_libusb_bulk_transfer_n(h->usb_backend_priv.fd, transfers,
+			ARRAY_SIZE(transfers), STLINK_WRITE_TIMEOUT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	memcpy(buffer, in, in_len);
+
+	return ERROR_OK;
+#else
+	return ERROR_COMMAND_NOTFOUND;
+#endif
+}
+
 /** */
 static int stlink_read_dap_register(void *handle, unsigned short dap_port,
 			unsigned short addr, uint32_t *val)
@@ -4347,11 +4575,14 @@ static int stlink_usb_misc_rw_segment(void *handle, const struct dap_queue *q, u
 	while (!IS_ALIGNED(cmd_index, 4))
 		buf[cmd_index++] = 0;
 
-	int retval = stlink_usb_rw_misc_out(handle, items, buf);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = stlink_usb_rw_misc_in(handle, items, buf);
+	int retval;
+	if (stlink_usb_can_pipeline(handle)) {
+		retval = stlink_usb_rw_misc_pipelined(handle, items, buf);
+	} else {
+		retval = stlink_usb_rw_misc_out(handle, items, buf);
+		if (retval == ERROR_OK)
+			retval = stlink_usb_rw_misc_in(handle, items, buf);
+	}
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -4393,6 +4624,35 @@ static int stlink_usb_misc_rw_segment(void *handle, const struct dap_queue *q, u
 	return ERROR_OK;
 }
 
+/* Incrementing 16 or 32 bit access of a buffer segment; segments longer than
+ * one command are only built for probes that can pipeline the blocks */
+static int stlink_usb_buf_rw_mem(void *handle, uint8_t ap_num, uint32_t csw,
+		uint32_t addr, uint32_t size, uint32_t len, uint8_t *buf, bool write)
+{
+	struct stlink_mem_block blocks[STLINK_V3_PIPELINE_DEPTH];
+	unsigned int n, ok;
+
+	if (len <= STLINK_MAX_RW16_32) {
+		if (size == 2)
+			return write ? stlink_usb_write_mem16(handle, ap_num, csw, addr, len, buf)
+				: stlink_usb_read_mem16(handle, ap_num, csw, addr, len, buf);
+		return write ? stlink_usb_write_mem32(handle, ap_num, csw, addr, len, buf)
+			: stlink_usb_read_mem32(handle, ap_num, csw, addr, len, buf);
+	}
+
+	for (n = 0; len; n++) {
+		assert(n < STLINK_V3_PIPELINE_DEPTH);
+		blocks[n].addr = addr;
+		blocks[n].len = MIN(len, STLINK_MAX_RW16_32);
+		blocks[n].buffer = buf;
+		addr += blocks[n].len;
+		buf += blocks[n].len;
+		len -= blocks[n].len;
+	}
+
+	return stlink_usb_rw_mem_blocks(handle, ap_num, csw, size, write, blocks, n, &ok);
+}
+
 static int stlink_usb_buf_rw_segment(void *handle, const struct dap_queue *q, unsigned int count)
 {
 	uint32_t bufsize = count * CMD_MEM_AP_2_SIZE(q[0].cmd);
@@ -4414,7 +4674,7 @@ static int stlink_usb_buf_rw_segment(void *handle, const struct dap_queue *q, un
 	case CMD_MEM_AP_WRITE16:
 		for (unsigned int i = 0; i < count; i++)
 			h_u16_to_le(&buf[2 * i], q[i].mem_ap.data >> 8 * (q[i].mem_ap.addr & 2));
-		return stlink_usb_write_mem16(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
+		return stlink_usb_buf_rw_mem(stlink_dap_handle, ap_num, csw, addr, 2, bufsize, buf, true);
 
 	case CMD_MEM_AP_WRITE32:
 		for (unsigned int i = 0; i < count; i++)
@@ -4422,7 +4682,7 @@ static int stlink_usb_buf_rw_segment(void *handle, const struct dap_queue *q, un
 		if (count > 1 && q[0].mem_ap.addr == q[1].mem_ap.addr)
 			return stlink_usb_write_mem32_noaddrinc(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
 		else
-			return stlink_usb_write_mem32(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
+			return stlink_usb_buf_rw_mem(stlink_dap_handle, ap_num, csw, addr, 4, bufsize, buf, true);
 
 	case CMD_MEM_AP_READ8:
 		retval = stlink_usb_read_mem8(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
@@ -4432,7 +4692,7 @@ static int stlink_usb_buf_rw_segment(void *handle, const struct dap_queue *q, un
 		return retval;
 
 	case CMD_MEM_AP_READ16:
-		retval = stlink_usb_read_mem16(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
+		retval = stlink_usb_buf_rw_mem(stlink_dap_handle, ap_num, csw, addr, 2, bufsize, buf, false);
 		if (retval == ERROR_OK)
 			for (unsigned int i = 0; i < count; i++)
 				*q[i].mem_ap.p_data = le_to_h_u16(&buf[2 * i]) << 8 * (q[i].mem_ap.addr & 2);
@@ -4442,7 +4702,7 @@ static int stlink_usb_buf_rw_segment(void *handle, const struct dap_queue *q, un
 		if (count > 1 && q[0].mem_ap.addr == q[1].mem_ap.addr)
 			retval = stlink_usb_read_mem32_noaddrinc(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
 		else
-			retval = stlink_usb_read_mem32(stlink_dap_handle, ap_num, csw, addr, bufsize, buf);
+			retval = stlink_usb_buf_rw_mem(stlink_dap_handle, ap_num, csw, addr, 4, bufsize, buf, false);
 		if (retval == ERROR_OK)
 			for (unsigned int i = 0; i < count; i++)
 				*q[i].mem_ap.p_data = le_to_h_u32(&buf[4 * i]);
@@ -4508,6 +4768,8 @@ static int stlink_usb_count_buf_rw_queue(const struct dap_queue *q, unsigned int
 	/* check for no address increment, 32 bits only */
 	if (len > 1 && incr == 4 && q[0].mem_ap.addr == q[1].mem_ap.addr)
 		incr = 0;
+	else if (incr != 1 && stlink_usb_can_pipeline(stlink_dap_handle))
+		len_max *= STLINK_V3_PIPELINE_DEPTH;
 
 	if (len > len_max)
 		len = len_max;
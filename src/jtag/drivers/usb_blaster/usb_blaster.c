@@ -100,6 +100,28 @@
 /* USB-Blaster II specific command */
 #define CMD_COPY_TDO_BUFFER	0x5F
 
+/*
+ * TDO bytes that may be requested from the device before they are read back.
+ * The USB-Blaster read FIFO holds 384 bytes. The USB-Blaster II returns each
+ * CMD_COPY_TDO_BUFFER as a packet of its own, and its IN endpoint is only
+ * known to hold two of them, so no more copies are left outstanding.
+ */
+#define TDO_QUEUE_SIZE		256
+#define TDO_QUEUE_COPIES	2
+
+/* TDO bytes requested from the device, to be stored in buf once read */
+struct ublast_tdo_read {
+	uint8_t *buf;
+	int nb_bytes;
+	bool bitbang;
+};
+
+/* Scan waiting for its TDO bytes to be read back */
+struct ublast_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+};
+
 enum gpio_steer {
 	FIXED_0 = 0,
 	FIXED_1,
@@ -117,6 +139,15 @@ struct ublast_info {
 	uint8_t buf[BUF_LEN];
 	int bufidx;
 
+	struct ublast_tdo_read tdo_reads[TDO_QUEUE_SIZE];
+	int nb_tdo_reads;
+	int tdo_pending;
+	int tdo_copies;
+	int tdo_error;
+	struct ublast_pending_scan *scans;
+	int nb_scans;
+	int scans_size;
+
 	char *lowlevel_name;
 	struct ublast_lowlevel *drv;
 	uint16_t ublast_vid, ublast_pid;
@@ -523,71 +554,107 @@ static void ublast_state_move(tap_state_t state, int skip)
 }
 
 /**
- * ublast_read_byteshifted_tdos - read TDO of byteshift writes
- * @param buf the buffer to store the bits
- * @param nb_bytes the number of bytes
+ * ublast_read_tdos - read back all requested TDO bytes
  *
- * Reads back from USB Blaster TDO bits, triggered by a 'byteshift write', ie. eight
- * bits per received byte from USB interface, and store them in buffer.
+ * Flushes the write buffer and reads the TDO bytes of all the byte-shift and
+ * bitbang reads requested since the last call in one go, then stores them
+ * where each read asked for them:
+ *  - a byte-shift read returns eight TDO bits per byte, LSB first, which is
+ *    what we want to return, so the bytes are copied as they are
+ *  - a bitbang read returns one TDO bit per byte, they are packed into one
+ *    byte, first bit in bit 0
  *
- * As the USB blaster stores the TDO bits in LSB (ie. first bit in (byte0,
- * bit0), second bit in (byte0, bit1), ...), which is what we want to return,
- * simply read bytes from USB interface and store them.
+ * The first read error is also kept in info.tdo_error until the pending scans
+ * are completed, as reads made to free room in the queue can't report it.
  *
  * Returns ERROR_OK if OK, ERROR_xxx if a read error occurred
  */
-static int ublast_read_byteshifted_tdos(uint8_t *buf, int nb_bytes)
+static int ublast_read_tdos(void)
 {
+	static uint8_t tdos[TDO_QUEUE_SIZE];
 	uint32_t retlen;
-	int ret = ERROR_OK;
+	int nb_read = 0, ret = ERROR_OK;
+
+	if (info.tdo_pending == 0)
+		return ERROR_OK;
 
-	LOG_DEBUG_IO("%s(buf=%p, num_bits=%d)", __func__, buf, nb_bytes * 8);
+	LOG_DEBUG_IO("%s(reads=%d, nb_bytes=%d)", __func__, info.nb_tdo_reads,
+		      info.tdo_pending);
+
+	/*
+	 * Ensure all previous writes were issued to the dongle, so that it
+	 * returns back the read values.
+	 */
 	ublast_flush_buffer();
-	while (ret == ERROR_OK && nb_bytes > 0) {
-		ret = ublast_buf_read(buf, nb_bytes, &retlen);
-		nb_bytes -= retlen;
+	while (ret == ERROR_OK && nb_read < info.tdo_pending) {
+		ret = ublast_buf_read(tdos + nb_read, info.tdo_pending - nb_read, &retlen);
+		nb_read += retlen;
+	}
+
+	uint8_t *tdo = tdos;
+	for (int i = 0; ret == ERROR_OK && i < info.nb_tdo_reads; i++) {
+		struct ublast_tdo_read *rd = &info.tdo_reads[i];
+
+		if (rd->bitbang) {
+			for (int j = 0; j < rd->nb_bytes; j++)
+				if (tdo[j] & READ_TDO)
+					*rd->buf |= (1 << j);
+				else
+					*rd->buf &= ~(1 << j);
+		} else {
+			memcpy(rd->buf, tdo, rd->nb_bytes);
+		}
+		tdo += rd->nb_bytes;
+	}
+
+	if (ret != ERROR_OK) {
+		LOG_ERROR("reading back %d TDO bytes failed", info.tdo_pending);
+		if (info.tdo_error == ERROR_OK)
+			info.tdo_error = ret;
 	}
+
+	info.nb_tdo_reads = 0;
+	info.tdo_pending = 0;
+	info.tdo_copies = 0;
 	return ret;
 }
 
 /**
- * ublast_read_bitbang_tdos - read TDO of bitbang writes
- * @param buf the buffer to store the bits
- * @param nb_bits the number of bits
- *
- * Reads back from USB Blaster TDO bits, triggered by a 'bitbang write', ie. one
- * bit per received byte from USB interface, and store them in buffer, where :
- *  - first bit is stored in byte0, bit0 (LSB)
- *  - second bit is stored in byte0, bit 1
- *  ...
- *  - eight bit is stored in byte0, bit 7
- *  - ninth bit is stored in byte1, bit 0
- *  - etc ...
+ * ublast_reserve_tdos - make room for TDO bytes about to be requested
+ * @param nb_bytes the number of bytes
  *
- * Returns ERROR_OK if OK, ERROR_xxx if a read error occurred
+ * Reads back the outstanding TDO bytes first if the device could not hold
+ * nb_bytes more. To be called before queuing the bytes requesting the read.
  */
-static int ublast_read_bitbang_tdos(uint8_t *buf, int nb_bits)
+static void ublast_reserve_tdos(int nb_bytes)
 {
-	int nb1 = nb_bits;
-	int i, ret = ERROR_OK;
-	uint32_t retlen;
-	uint8_t tmp[8];
-
-	LOG_DEBUG_IO("%s(buf=%p, num_bits=%d)", __func__, buf, nb_bits);
+	if (info.tdo_pending + nb_bytes > TDO_QUEUE_SIZE ||
+	    info.nb_tdo_reads == TDO_QUEUE_SIZE ||
+	    ((info.flags & COPY_TDO_BUFFER) && info.tdo_copies == TDO_QUEUE_COPIES))
+		ublast_read_tdos();
+}
 
-	/*
-	 * Ensure all previous bitbang writes were issued to the dongle, so that
-	 * it returns back the read values.
-	 */
-	ublast_flush_buffer();
+/**
+ * ublast_queue_tdos - account for requested TDO bytes
+ * @param buf where to store the bits once read
+ * @param nb_bytes the number of bytes the device will return
+ * @param bitbang true if the bytes carry one bit each (bitbang mode)
+ *
+ * Records a read triggered by the bytes just queued, after
+ * ublast_reserve_tdos() made room for it.
+ */
+static void ublast_queue_tdos(uint8_t *buf, int nb_bytes, bool bitbang)
+{
+	struct ublast_tdo_read *rd = &info.tdo_reads[info.nb_tdo_reads++];
 
-	ret = ublast_buf_read(tmp, nb1, &retlen);
-	for (i = 0; ret == ERROR_OK && i < nb1; i++)
-		if (tmp[i] & READ_TDO)
-			*buf |= (1 << i);
-		else
-			*buf &= ~(1 << i);
-	return ret;
+	if (info.flags & COPY_TDO_BUFFER) {
+		ublast_queue_byte(CMD_COPY_TDO_BUFFER);
+		info.tdo_copies++;
+	}
+	rd->buf = buf;
+	rd->nb_bytes = nb_bytes;
+	rd->bitbang = bitbang;
+	info.tdo_pending += nb_bytes;
 }
 
 /**
@@ -600,8 +667,9 @@ static int ublast_read_bitbang_tdos(uint8_t *buf, int nb_bits)
  * As a side effect, the last TDI bit is sent along a TMS=1, and triggers a JTAG
  * TAP state shift if input bits were non NULL.
  *
- * In order to not saturate the USB Blaster queues, this method reads back TDO
- * if the scan type requests it, and stores them back in bits.
+ * If the scan type requests it, TDO is stored back in bits. The reads are
+ * only requested here and collected by ublast_read_tdos(), so bits must stay
+ * around until then. Every TDO byte overwrites TDI bits already queued.
  *
  * As a side note, the state of TCK when entering this function *must* be
  * low. This is because byteshift mode outputs TDI on rising TCK and reads TDO
@@ -614,7 +682,6 @@ static void ublast_queue_tdi(uint8_t *bits, int nb_bits, enum scan_type scan)
 	int nb8 = nb_bits / 8;
 	int nb1 = nb_bits % 8;
 	int nbfree_in_packet, i, trans = 0, read_tdos;
-	uint8_t *tdos = calloc(1, nb_bits / 8 + 1);
 	static uint8_t byte0[BUF_LEN];
 
 	/*
@@ -633,6 +700,9 @@ static void ublast_queue_tdi(uint8_t *bits, int nb_bits, enum scan_type scan)
 
 	read_tdos = (scan == SCAN_IN || scan == SCAN_IO);
 	for (i = 0; i < nb8; i += trans) {
+		if (read_tdos)
+			ublast_reserve_tdos(MIN(MAX_PACKET_SIZE - 1, nb8 - i));
+
 		/*
 		 * Calculate number of bytes to fill USB packet of size MAX_PACKET_SIZE
 		 */
@@ -653,16 +723,15 @@ static void ublast_queue_tdi(uint8_t *bits, int nb_bits, enum scan_type scan)
 			ublast_queue_bytes(&bits[i], trans);
 		else
 			ublast_queue_bytes(byte0, trans);
-		if (read_tdos) {
-			if (info.flags & COPY_TDO_BUFFER)
-				ublast_queue_byte(CMD_COPY_TDO_BUFFER);
-			ublast_read_byteshifted_tdos(&tdos[i], trans);
-		}
+		if (read_tdos)
+			ublast_queue_tdos(&bits[i], trans, false);
 	}
 
 	/*
 	 * Queue the remaining TDI bits in bitbang mode.
 	 */
+	if (nb1 && read_tdos)
+		ublast_reserve_tdos(nb1);
 	for (i = 0; i < nb1; i++) {
 		int tdi = bits ? bits[nb8 + i / 8] & (1 << i) : 0;
 		if (bits && i == nb1 - 1)
@@ -670,15 +739,8 @@ static void ublast_queue_tdi(uint8_t *bits, int nb_bits, enum scan_type scan)
 		else
 			ublast_clock_tdi(tdi, scan);
 	}
-	if (nb1 && read_tdos) {
-		if (info.flags & COPY_TDO_BUFFER)
-			ublast_queue_byte(CMD_COPY_TDO_BUFFER);
-		ublast_read_bitbang_tdos(&tdos[nb8], nb1);
-	}
-
-	if (bits)
-		memcpy(bits, tdos, DIV_ROUND_UP(nb_bits, 8));
-	free(tdos);
+	if (nb1 && read_tdos)
+		ublast_queue_tdos(&bits[nb8], nb1, true);
 
 	/*
 	 * Ensure clock is in lower state
@@ -735,8 +797,27 @@ static int ublast_scan(struct scan_command *cmd)
 
 	ublast_queue_tdi(buf, scan_bits, type);
 
-	ret = jtag_read_buffer(buf, cmd);
-	free(buf);
+	if (type == SCAN_OUT) {
+		ret = jtag_read_buffer(buf, cmd);
+		free(buf);
+	} else {
+		/* Completed by ublast_complete_scans() once TDO is read back */
+		if (info.nb_scans == info.scans_size) {
+			int size = info.scans_size ? 2 * info.scans_size : 16;
+			struct ublast_pending_scan *p = realloc(info.scans, size * sizeof(*p));
+			if (!p) {
+				LOG_ERROR("out of memory");
+				ublast_read_tdos();
+				free(buf);
+				return ERROR_FAIL;
+			}
+			info.scans = p;
+			info.scans_size = size;
+		}
+		info.scans[info.nb_scans].cmd = cmd;
+		info.scans[info.nb_scans].buf = buf;
+		info.nb_scans++;
+	}
 	/*
 	 * ublast_queue_tdi sends the last bit with TMS=1. We are therefore
 	 * already in Exit1-DR/IR and have to skip the first step on our way
@@ -746,9 +827,35 @@ static int ublast_scan(struct scan_command *cmd)
 	return ret;
 }
 
+/**
+ * ublast_complete_scans - read back TDO and complete the pending scans
+ *
+ * Returns ERROR_OK if OK, ERROR_xxx if a read error occurred or a scan
+ * failed its checks.
+ */
+static int ublast_complete_scans(void)
+{
+	int ret = ublast_read_tdos();
+
+	/* a failed earlier read back left some of the scans without TDO */
+	if (info.tdo_error != ERROR_OK) {
+		ret = info.tdo_error;
+		info.tdo_error = ERROR_OK;
+	}
+
+	for (int i = 0; i < info.nb_scans; i++) {
+		if (ret == ERROR_OK)
+			ret = jtag_read_buffer(info.scans[i].buf, info.scans[i].cmd);
+		free(info.scans[i].buf);
+	}
+	info.nb_scans = 0;
+	return ret;
+}
+
 static void ublast_usleep(int us)
 {
 	LOG_DEBUG_IO("%s(us=%d)",  __func__, us);
+	ublast_flush_buffer();
 	jtag_sleep(us);
 }
 
@@ -823,6 +930,9 @@ static int ublast_execute_queue(void)
 		}
 	}
 
+	int complete_ret = ublast_complete_scans();
+	if (ret == ERROR_OK)
+		ret = complete_ret;
 	ublast_flush_buffer();
 	return ret;
 }
@@ -903,6 +1013,7 @@ static int ublast_quit(void)
 	uint32_t retlen;
 
 	ublast_buf_write(&byte0, 1, &retlen);
+	free(info.scans);
 	return info.drv->close(info.drv);
 }
 
@@ -78,6 +78,7 @@
 #define VD_SHEADER_LEN 16
 
 #define VD_MAX_MEMORIES 4
+#define VD_MAX_REQUESTS (VD_BUFFER_LEN / 16) /* 8B header and at least 8B TDI/TMS each */
 #define VD_POLL_INTERVAL 500
 #define VD_SCALE_PSTOMS 1000000000
 
@@ -218,11 +219,15 @@ struct vd_client {
 	uint32_t poll_min;
 	uint32_t poll_max;
 	uint32_t targ_time;
+	uint32_t batch_max_reqs;     /* batch window, 0 for no limit */
+	uint32_t batch_max_bytes;
+	uint32_t batch_max_cycles;
+	uint32_t batch_cycles;       /* TCK cycles of the buffered requests */
 	int hsocket;
 	char server_name[32];
 	char bfm_path[128];
 	char mem_path[VD_MAX_MEMORIES][128];
-	uint8_t *tdo;
+	uint8_t *tdo[VD_MAX_REQUESTS]; /* where to put TDO of each buffered request */
 };
 
 struct vd_jtag_hdr {
@@ -380,7 +385,7 @@ int vdebug_run_jtag_queue(int hsock, struct vd_shm *pm, unsigned int count)
 		vdc.trans_last = (req + 1) < count ? 0 : 1;
 		vdc.trans_first = waddr ? 0 : 1;
 		if (hdr->cmd == 3) { /* read */
-			tdo = vdc.tdo;
+			tdo = vdc.tdo[req];
 			for (unsigned int j = 0; j < bytes; j++) {
 				tdo[j] = (pm->rd8[rwords * 8 + j] >> num_pre) | (pm->rd8[rwords * 8 + j + 1] << (8 - num_pre));
 				LOG_DEBUG_IO("%04x D0[%02x]:%02x", pm->wid - count + req, j, tdo[j]);
@@ -410,10 +415,23 @@ int vdebug_run_jtag_queue(int hsock, struct vd_shm *pm, unsigned int count)
 	pm->offset = 0;
 	pm->rwords = 0;
 	pm->waddr = 0;
+	vdc.batch_cycles = 0;
 
 	return rc;
 }
 
+/* execute the buffered JTAG requests before a command that must not overtake them */
+static int vdebug_jtag_flush(int hsock, struct vd_shm *pm)
+{
+	if (!pm->waddr)                    /* nothing buffered */
+		return ERROR_OK;
+
+	pm->cmd = VD_CMD_JTAGSHTAP;
+	vdc.trans_first = 1;
+
+	return vdebug_run_jtag_queue(hsock, pm, pm->waddr);
+}
+
 static int vdebug_open(int hsock, struct vd_shm *pm, const char *path,
 						uint8_t type, uint32_t period_ps, uint32_t sig_mask)
 {
@@ -465,6 +483,7 @@ static int vdebug_open(int hsock, struct vd_shm *pm, const char *path,
 
 static int vdebug_close(int hsock, struct vd_shm *pm, uint8_t type)
 {
+	vdebug_jtag_flush(hsock, pm);
 	pm->cmd = VD_CMD_DISCONNECT;
 	pm->type = type;              /* BFM type, here JTAG */
 	pm->wbytes = 0;
@@ -486,6 +505,9 @@ static int vdebug_close(int hsock, struct vd_shm *pm, uint8_t type)
 
 static int vdebug_wait(int hsock, struct vd_shm *pm, uint32_t cycles)
 {
+	if (vdebug_jtag_flush(hsock, pm) != ERROR_OK)
+		return ERROR_FAIL;
+
 	if (cycles) {
 		pm->cmd = VD_CMD_WAIT;
 		pm->wbytes = 0;
@@ -504,6 +526,9 @@ static int vdebug_wait(int hsock, struct vd_shm *pm, uint32_t cycles)
 
 static int vdebug_sig_set(int hsock, struct vd_shm *pm, uint32_t write_mask, uint32_t value)
 {
+	if (vdebug_jtag_flush(hsock, pm) != ERROR_OK)
+		return ERROR_FAIL;
+
 	pm->cmd = VD_CMD_SIGSET;
 	pm->wbytes = 0;
 	pm->rbytes = 0;
@@ -521,6 +546,9 @@ static int vdebug_sig_set(int hsock, struct vd_shm *pm, uint32_t write_mask, uin
 
 static int vdebug_jtag_clock(int hsock, struct vd_shm *pm, uint32_t value)
 {
+	if (vdebug_jtag_flush(hsock, pm) != ERROR_OK)
+		return ERROR_FAIL;
+
 	pm->cmd = VD_CMD_JTAGCLOCK;
 	pm->wbytes = 0;
 	pm->rbytes = 0;
@@ -546,7 +574,10 @@ static int vdebug_jtag_shift_tap(int hsock, struct vd_shm *pm, uint8_t num_pre,
 	int rc = 0;
 
 	pm->cmd = VD_CMD_JTAGSHTAP;
-	vdc.trans_last = f_last || (vdc.trans_batch == VD_BATCH_NO) || tdo;
+	/* Nothing in a queue depends on the TDO of a previous request, so with
+	 * read batching the reads only have to arrive by the end of the queue */
+	vdc.trans_last = f_last || (vdc.trans_batch == VD_BATCH_NO) ||
+		(tdo && vdc.trans_batch != VD_BATCH_WR);
 	if (vdc.trans_first)
 		waddr = 0;             /* reset buffer offset */
 	else
@@ -558,14 +589,25 @@ static int vdebug_jtag_shift_tap(int hsock, struct vd_shm *pm, uint8_t num_pre,
 	hwords = (anum + 4 * vdc.buf_width - 1) / (4 * vdc.buf_width); /* in 4B TDI/TMS words */
 	words = (hwords + 1) / 2;    /* in 8B TDO words to read */
 	bytes = (num + 7) / 8;       /* data only portion in bytes */
+	/* a request that does not fit behind the buffered ones starts a new batch */
+	if (waddr && 4 * waddr + sizeof(struct vd_jtag_hdr) + 8 * hwords > VD_BUFFER_LEN) {
+		rc = vdebug_run_jtag_queue(hsock, pm, pm->waddr);
+		waddr = 0;
+	}
 	/* buffer overflow check and flush */
-	if (4 * waddr + sizeof(struct vd_jtag_hdr) + 8 * hwords + 64 > VD_BUFFER_LEN) {
-		vdc.trans_last = 1;        /* force flush within 64B of buffer end */
-	} else if (4 * waddr + sizeof(struct vd_jtag_hdr) + 8 * hwords > VD_BUFFER_LEN) {
+	if (4 * waddr + sizeof(struct vd_jtag_hdr) + 8 * hwords > VD_BUFFER_LEN) {
 		/* this req does not fit, discard it */
 		LOG_ERROR("%04x L:%02d O:%05x @%04x too many bits to shift",
 			pm->wid, anum, (vdc.trans_first << 14) | (vdc.trans_last << 15), waddr);
 		rc = ERROR_FAIL;
+	} else if (4 * waddr + sizeof(struct vd_jtag_hdr) + 8 * hwords + 64 > VD_BUFFER_LEN ||
+			pm->waddr + 1 >= VD_MAX_REQUESTS) {
+		vdc.trans_last = 1;        /* force flush within 64B of buffer end */
+	} else if ((vdc.batch_max_reqs && pm->waddr + 1 >= vdc.batch_max_reqs) ||
+			(vdc.batch_max_bytes &&
+			 4 * waddr + sizeof(struct vd_jtag_hdr) + 8 * hwords >= vdc.batch_max_bytes) ||
+			(vdc.batch_max_cycles && vdc.batch_cycles + anum >= vdc.batch_max_cycles)) {
+		vdc.trans_last = 1;        /* batch window reached */
 	}
 
 	if (!rc && anum) {
@@ -614,10 +656,10 @@ static int vdebug_jtag_shift_tap(int hsock, struct vd_shm *pm, uint8_t num_pre,
 				pm->wd8[j + i + 4 + 1] = tms_post >> (8 - (num + num_pre - 1) % 8); /* and higher part */
 		}
 
-		if (tdo) {
+		if (tdo)
 			pm->rwords += words;       /* keep track of the words to read */
-			vdc.tdo = tdo;
-		}
+		vdc.tdo[pm->waddr] = tdo;
+		vdc.batch_cycles += anum;
 		pm->wwords = waddr / 2 + hwords;   /* payload size *2 to include both TDI and TMS data */
 		pm->waddr++;
 	}
@@ -910,6 +952,11 @@ static int vdebug_jtag_execute_queue(void)
 		}
 	}
 
+	/* TDO of the buffered requests must be in place when the queue returns */
+	int flush_rc = vdebug_jtag_flush(vdc.hsocket, pbuf);
+	if (rc == ERROR_OK)
+		rc = flush_rc;
+
 	return rc;
 }
 
@@ -995,6 +1042,20 @@ COMMAND_HANDLER(vdebug_set_batching)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(vdebug_set_batch_window)
+{
+	if (CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], vdc.batch_max_reqs);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], vdc.batch_max_bytes);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], vdc.batch_max_cycles);
+	LOG_DEBUG("batch_window: requests %u bytes %u cycles %u",
+		vdc.batch_max_reqs, vdc.batch_max_bytes, vdc.batch_max_cycles);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(vdebug_set_polling)
 {
 	if (CMD_ARGC != 2)
@@ -1036,6 +1097,14 @@ static const struct command_registration vdebug_command_handlers[] = {
 		.help = "set the transaction batching no|wr|rd [0|1|2]",
 		.usage = "<level>",
 	},
+	{
+		.name = "batch_window",
+		.handler = &vdebug_set_batch_window,
+		.mode = COMMAND_ANY,
+		.help = "limit a batch of JTAG requests to a number of requests, "
+			"buffer bytes and TCK cycles, 0 for no limit",
+		.usage = "<requests> <bytes> <cycles>",
+	},
 	{
 		.name = "polling",
 		.handler = &vdebug_set_polling,
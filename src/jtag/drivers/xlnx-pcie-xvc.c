@@ -12,6 +12,8 @@
 #include <stdlib.h>
 #include <math.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <linux/pci.h>
 
 #include <jtag/interface.h>
@@ -19,6 +21,8 @@
 #include <jtag/commands.h>
 #include <helper/replacements.h>
 #include <helper/bits.h>
+#include <helper/time_support.h>
+#include <transport/transport.h>
 
 /* Available only from kernel v4.10 */
 #ifndef PCI_CFG_SPACE_EXP_SIZE
@@ -37,6 +41,17 @@
 #define XLNX_XVC_VSEC_ID	0x8
 #define XLNX_XVC_MAX_BITS	0x20
 
+/* Register window of a debug bridge in PCIe-to-BSCAN (BAR) mode */
+#define XLNX_XVC_BAR_LEN_REG	0x00
+#define XLNX_XVC_BAR_TMS_REG	0x04
+#define XLNX_XVC_BAR_TDI_REG	0x08
+#define XLNX_XVC_BAR_TDO_REG	0x0C
+#define XLNX_XVC_BAR_CTRL_REG	0x10
+#define XLNX_XVC_BAR_SIZE	0x14
+
+#define XLNX_XVC_BAR_CTRL_START	BIT(0)
+#define XLNX_XVC_BAR_TIMEOUT_MS	100
+
 #define MASK_ACK(x) (((x) >> 9) & 0x7)
 #define MASK_PAR(x) ((int)((x) & 0x1))
 
@@ -44,6 +59,19 @@ struct xlnx_pcie_xvc {
 	int fd;
 	unsigned offset;
 	char *device;
+
+	/* BAR mode: registers accessed through a mapping of resource<bar> */
+	bool use_bar;
+	unsigned bar;
+	unsigned bar_offset;
+	void *bar_map;
+	size_t bar_map_size;
+	volatile uint32_t *bar_regs;
+
+	/* bits that don't need TDO, waiting to share a shift with later ones */
+	unsigned pending_bits;
+	uint32_t pending_tms;
+	uint32_t pending_tdi;
 };
 
 static struct xlnx_pcie_xvc xlnx_pcie_xvc_state;
@@ -71,43 +99,79 @@ static int xlnx_pcie_xvc_read_reg(const int offset, uint32_t *val)
 	return ERROR_OK;
 }
 
-static int xlnx_pcie_xvc_write_reg(const int offset, const uint32_t val)
+static uint32_t xlnx_pcie_xvc_bar_read(const unsigned offset)
 {
-	int err;
+	uint32_t val = xlnx_pcie_xvc->bar_regs[offset / 4];
 
-	/* Note: This should be ok endianness-wise because by going
-	 * through sysfs the kernel does the conversion in the config
-	 * space accessor functions
-	 */
-	err = pwrite(xlnx_pcie_xvc->fd, &val, sizeof(val),
-		     xlnx_pcie_xvc->offset + offset);
-	if (err != sizeof(val)) {
-		LOG_ERROR("Failed to write offset: %x with value: %" PRIx32,
-			  offset, val);
-		return ERROR_JTAG_DEVICE_ERROR;
+	return le_to_h_u32((const uint8_t *)&val);
+}
+
+static void xlnx_pcie_xvc_bar_write(const unsigned offset, const uint32_t val)
+{
+	uint32_t raw;
+
+	h_u32_to_le((uint8_t *)&raw, val);
+	xlnx_pcie_xvc->bar_regs[offset / 4] = raw;
+}
+
+static int xlnx_pcie_xvc_bar_shift(size_t num_bits, uint32_t tms, uint32_t tdi,
+				   uint32_t *tdo)
+{
+	int64_t start = 0;
+
+	xlnx_pcie_xvc_bar_write(XLNX_XVC_BAR_LEN_REG, num_bits);
+	xlnx_pcie_xvc_bar_write(XLNX_XVC_BAR_TMS_REG, tms);
+	xlnx_pcie_xvc_bar_write(XLNX_XVC_BAR_TDI_REG, tdi);
+	xlnx_pcie_xvc_bar_write(XLNX_XVC_BAR_CTRL_REG, XLNX_XVC_BAR_CTRL_START);
+
+	/* a shift takes a few microseconds, only look at the clock now and then */
+	for (unsigned int i = 0; xlnx_pcie_xvc_bar_read(XLNX_XVC_BAR_CTRL_REG) &
+	     XLNX_XVC_BAR_CTRL_START; i++) {
+		if (i % 256)
+			continue;
+		if (!start) {
+			start = timeval_ms();
+		} else if (timeval_ms() - start > XLNX_XVC_BAR_TIMEOUT_MS) {
+			LOG_ERROR("Timeout waiting for XVC shift to complete");
+			return ERROR_JTAG_DEVICE_ERROR;
+		}
 	}
 
+	if (tdo)
+		*tdo = xlnx_pcie_xvc_bar_read(XLNX_XVC_BAR_TDO_REG);
+
 	return ERROR_OK;
 }
 
-static int xlnx_pcie_xvc_transact(size_t num_bits, uint32_t tms, uint32_t tdi,
-				  uint32_t *tdo)
+static int xlnx_pcie_xvc_cfg_shift(size_t num_bits, uint32_t tms, uint32_t tdi,
+				   uint32_t *tdo)
 {
+	/* LEN, TMS and TDX are adjacent, and the kernel splits a config
+	 * space write into dword writes in ascending order, so one pwrite
+	 * sets up the shift and starts it with the final TDX write.
+	 */
+	uint32_t regs[3] = { num_bits, tms, tdi };
 	int err;
 
-	err = xlnx_pcie_xvc_write_reg(XLNX_XVC_LEN_REG, num_bits);
-	if (err != ERROR_OK)
-		return err;
+	err = pwrite(xlnx_pcie_xvc->fd, regs, sizeof(regs),
+		     xlnx_pcie_xvc->offset + XLNX_XVC_LEN_REG);
+	if (err != sizeof(regs)) {
+		LOG_ERROR("Failed to write offset: %x", XLNX_XVC_LEN_REG);
+		return ERROR_JTAG_DEVICE_ERROR;
+	}
 
-	err = xlnx_pcie_xvc_write_reg(XLNX_XVC_TMS_REG, tms);
-	if (err != ERROR_OK)
-		return err;
+	return xlnx_pcie_xvc_read_reg(XLNX_XVC_TDX_REG, tdo);
+}
 
-	err = xlnx_pcie_xvc_write_reg(XLNX_XVC_TDX_REG, tdi);
-	if (err != ERROR_OK)
-		return err;
+static int xlnx_pcie_xvc_shift(size_t num_bits, uint32_t tms, uint32_t tdi,
+			       uint32_t *tdo)
+{
+	int err;
 
-	err = xlnx_pcie_xvc_read_reg(XLNX_XVC_TDX_REG, tdo);
+	if (xlnx_pcie_xvc->use_bar)
+		err = xlnx_pcie_xvc_bar_shift(num_bits, tms, tdi, tdo);
+	else
+		err = xlnx_pcie_xvc_cfg_shift(num_bits, tms, tdi, tdo);
 	if (err != ERROR_OK)
 		return err;
 
@@ -120,6 +184,75 @@ static int xlnx_pcie_xvc_transact(size_t num_bits, uint32_t tms, uint32_t tdi,
 	return ERROR_OK;
 }
 
+static int xlnx_pcie_xvc_flush(void)
+{
+	unsigned num_bits = xlnx_pcie_xvc->pending_bits;
+
+	if (!num_bits)
+		return ERROR_OK;
+
+	xlnx_pcie_xvc->pending_bits = 0;
+	return xlnx_pcie_xvc_shift(num_bits, xlnx_pcie_xvc->pending_tms,
+				   xlnx_pcie_xvc->pending_tdi, NULL);
+}
+
+/* Shift up to 32 bits. Bits whose TDO nobody wants are only collected and
+ * go out together with later ones, so runs of state moves, idle cycles and
+ * SWD phases share a single shift; a capture shifts whatever is pending
+ * ahead of its own bits. xlnx_pcie_xvc_flush() pushes out the rest.
+ */
+static int xlnx_pcie_xvc_transact(size_t num_bits, uint32_t tms, uint32_t tdi,
+				  uint32_t *tdo)
+{
+	unsigned skip;
+	uint32_t res;
+	int err;
+
+	if (num_bits < XLNX_XVC_MAX_BITS) {
+		tms &= BIT(num_bits) - 1;
+		tdi &= BIT(num_bits) - 1;
+	}
+
+	if (!tdo) {
+		while (num_bits) {
+			skip = xlnx_pcie_xvc->pending_bits;
+			size_t n = MIN(XLNX_XVC_MAX_BITS - skip, num_bits);
+			xlnx_pcie_xvc->pending_tms = skip ? xlnx_pcie_xvc->pending_tms | tms << skip : tms;
+			xlnx_pcie_xvc->pending_tdi = skip ? xlnx_pcie_xvc->pending_tdi | tdi << skip : tdi;
+			xlnx_pcie_xvc->pending_bits += n;
+			if (xlnx_pcie_xvc->pending_bits == XLNX_XVC_MAX_BITS) {
+				err = xlnx_pcie_xvc_flush();
+				if (err != ERROR_OK)
+					return err;
+			}
+			num_bits -= n;
+			tms = n < XLNX_XVC_MAX_BITS ? tms >> n : 0;
+			tdi = n < XLNX_XVC_MAX_BITS ? tdi >> n : 0;
+		}
+		return ERROR_OK;
+	}
+
+	if (xlnx_pcie_xvc->pending_bits + num_bits > XLNX_XVC_MAX_BITS) {
+		err = xlnx_pcie_xvc_flush();
+		if (err != ERROR_OK)
+			return err;
+	}
+
+	skip = xlnx_pcie_xvc->pending_bits;
+	if (skip) {
+		tms = xlnx_pcie_xvc->pending_tms | tms << skip;
+		tdi = xlnx_pcie_xvc->pending_tdi | tdi << skip;
+		xlnx_pcie_xvc->pending_bits = 0;
+	}
+
+	err = xlnx_pcie_xvc_shift(skip + num_bits, tms, tdi, &res);
+	if (err != ERROR_OK)
+		return err;
+
+	*tdo = res >> skip;
+	return ERROR_OK;
+}
+
 static int xlnx_pcie_xvc_execute_stableclocks(struct jtag_command *cmd)
 {
 	int tms = tap_get_state() == TAP_RESET ? 1 : 0;
@@ -332,6 +465,8 @@ static int xlnx_pcie_xvc_execute_tms(struct jtag_command *cmd)
 
 static int xlnx_pcie_xvc_execute_command(struct jtag_command *cmd)
 {
+	int err;
+
 	LOG_DEBUG("%s: cmd->type: %u", __func__, cmd->type);
 	switch (cmd->type) {
 	case JTAG_STABLECLOCKS:
@@ -349,6 +484,9 @@ static int xlnx_pcie_xvc_execute_command(struct jtag_command *cmd)
 		xlnx_pcie_xvc_execute_reset(cmd);
 		break;
 	case JTAG_SLEEP:
+		err = xlnx_pcie_xvc_flush();
+		if (err != ERROR_OK)
+			return err;
 		xlnx_pcie_xvc_execute_sleep(cmd);
 		break;
 	case JTAG_TMS:
@@ -375,9 +513,53 @@ static int xlnx_pcie_xvc_execute_queue(void)
 		cmd = cmd->next;
 	}
 
-	return ERROR_OK;
+	return xlnx_pcie_xvc_flush();
 }
 
+static int xlnx_pcie_xvc_init_bar(void)
+{
+	char filename[PATH_MAX];
+	long page_size = sysconf(_SC_PAGESIZE);
+	off_t map_offset;
+	struct stat st;
+
+	snprintf(filename, PATH_MAX, "/sys/bus/pci/devices/%s/resource%u",
+		 xlnx_pcie_xvc->device, xlnx_pcie_xvc->bar);
+	xlnx_pcie_xvc->fd = open(filename, O_RDWR | O_SYNC);
+	if (xlnx_pcie_xvc->fd < 0) {
+		LOG_ERROR("Failed to open device: %s", filename);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	if (fstat(xlnx_pcie_xvc->fd, &st) ||
+	    (off_t)xlnx_pcie_xvc->bar_offset + XLNX_XVC_BAR_SIZE > st.st_size) {
+		LOG_ERROR("XVC registers at offset 0x%x don't fit in %s",
+			  xlnx_pcie_xvc->bar_offset, filename);
+		close(xlnx_pcie_xvc->fd);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	map_offset = xlnx_pcie_xvc->bar_offset & ~(page_size - 1);
+	xlnx_pcie_xvc->bar_map_size = xlnx_pcie_xvc->bar_offset - map_offset +
+		XLNX_XVC_BAR_SIZE;
+	xlnx_pcie_xvc->bar_map_size = DIV_ROUND_UP(xlnx_pcie_xvc->bar_map_size,
+						   page_size) * page_size;
+	xlnx_pcie_xvc->bar_map = mmap(NULL, xlnx_pcie_xvc->bar_map_size,
+				      PROT_READ | PROT_WRITE, MAP_SHARED,
+				      xlnx_pcie_xvc->fd, map_offset);
+	if (xlnx_pcie_xvc->bar_map == MAP_FAILED) {
+		LOG_ERROR("Failed to map %s", filename);
+		close(xlnx_pcie_xvc->fd);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+	xlnx_pcie_xvc->bar_regs = (volatile uint32_t *)((uint8_t *)xlnx_pcie_xvc->bar_map +
+		xlnx_pcie_xvc->bar_offset - map_offset);
+
+	LOG_INFO("Using Xilinx XVC/PCIe registers in BAR%u of %s at offset: 0x%x",
+		 xlnx_pcie_xvc->bar, xlnx_pcie_xvc->device, xlnx_pcie_xvc->bar_offset);
+
+	return ERROR_OK;
+}
 
 static int xlnx_pcie_xvc_init(void)
 {
@@ -385,6 +567,9 @@ static int xlnx_pcie_xvc_init(void)
 	uint32_t cap, vh;
 	int err;
 
+	if (xlnx_pcie_xvc->use_bar)
+		return xlnx_pcie_xvc_init_bar();
+
 	snprintf(filename, PATH_MAX, "/sys/bus/pci/devices/%s/config",
 		 xlnx_pcie_xvc->device);
 	xlnx_pcie_xvc->fd = open(filename, O_RDWR | O_SYNC);
@@ -438,6 +623,9 @@ static int xlnx_pcie_xvc_quit(void)
 {
 	int err;
 
+	if (xlnx_pcie_xvc->use_bar)
+		munmap(xlnx_pcie_xvc->bar_map, xlnx_pcie_xvc->bar_map_size);
+
 	err = close(xlnx_pcie_xvc->fd);
 	if (err)
 		return err;
@@ -460,6 +648,80 @@ COMMAND_HANDLER(xlnx_pcie_xvc_handle_config_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(xlnx_pcie_xvc_handle_bar_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], xlnx_pcie_xvc->bar);
+	xlnx_pcie_xvc->bar_offset = 0;
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], xlnx_pcie_xvc->bar_offset);
+	if (xlnx_pcie_xvc->bar_offset % 4)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	xlnx_pcie_xvc->use_bar = true;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(xlnx_pcie_xvc_handle_benchmark_command)
+{
+	unsigned int count = 10000;
+	struct duration bench;
+	uint32_t tdo;
+	int err;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], count);
+	if (!count)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	tap_state_t saved_state = tap_get_state();
+	if (!transport_is_swd()) {
+		err = jtag_execute_queue();
+		if (err != ERROR_OK)
+			return err;
+
+		/* the TAP stays in Run-Test/Idle while TMS is low */
+		saved_state = tap_get_state();
+		if (saved_state != TAP_IDLE) {
+			tap_set_end_state(TAP_IDLE);
+			err = xlnx_pcie_xvc_execute_statemove(0);
+			if (err != ERROR_OK)
+				return err;
+		}
+	}
+	err = xlnx_pcie_xvc_flush();
+	if (err != ERROR_OK)
+		return err;
+
+	/* full width shifts with TDO read back, as a scan does them */
+	duration_start(&bench);
+	for (unsigned int i = 0; i < count && err == ERROR_OK; i++)
+		err = xlnx_pcie_xvc_shift(XLNX_XVC_MAX_BITS, 0, 0, &tdo);
+	if (err != ERROR_OK)
+		return err;
+
+	if (duration_measure(&bench) == ERROR_OK) {
+		float elapsed = duration_elapsed(&bench);
+		command_print(CMD, "%s: %u shifts in %fs (%0.0f shifts/s, %0.3f kHz)",
+			      xlnx_pcie_xvc->use_bar ? "BAR" : "config space", count, elapsed,
+			      elapsed > 0 ? count / elapsed : 0,
+			      elapsed > 0 ? count * XLNX_XVC_MAX_BITS / elapsed / 1000 : 0);
+	}
+
+	if (!transport_is_swd() && saved_state != TAP_IDLE) {
+		tap_set_end_state(saved_state);
+		err = xlnx_pcie_xvc_execute_statemove(0);
+		if (err == ERROR_OK)
+			err = xlnx_pcie_xvc_flush();
+	}
+
+	return err;
+}
+
 static const struct command_registration xlnx_pcie_xvc_subcommand_handlers[] = {
 	{
 		.name = "config",
@@ -468,6 +730,20 @@ static const struct command_registration xlnx_pcie_xvc_subcommand_handlers[] = {
 		.help = "Configure XVC/PCIe JTAG adapter",
 		.usage = "device",
 	},
+	{
+		.name = "bar",
+		.handler = xlnx_pcie_xvc_handle_bar_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Use the memory mapped XVC registers of a debug bridge in BAR mode",
+		.usage = "index [offset]",
+	},
+	{
+		.name = "benchmark",
+		.handler = xlnx_pcie_xvc_handle_benchmark_command,
+		.mode = COMMAND_EXEC,
+		.help = "measure the shift rate of the XVC/PCIe adapter",
+		.usage = "[shifts]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -503,7 +779,7 @@ static int xlnx_pcie_xvc_swd_sequence(const uint8_t *seq, size_t length)
 		seq += sizeof(uint32_t);
 	};
 
-	return ERROR_OK;
+	return xlnx_pcie_xvc_flush();
 }
 
 static int xlnx_pcie_xvc_swd_switch_seq(enum swd_special_seq seq)
@@ -531,6 +807,18 @@ static int xlnx_pcie_xvc_swd_switch_seq(enum swd_special_seq seq)
 
 static int queued_retval;
 
+/* An SWD packet takes two shifts: command and acknowledge with the head of
+ * the data, then the rest. Pending bits go in front of the first shift, but
+ * must leave it at least two data bits so the rest fits the second one.
+ */
+static int xlnx_pcie_xvc_swd_make_room(unsigned first_bits)
+{
+	if (xlnx_pcie_xvc->pending_bits + first_bits <= XLNX_XVC_MAX_BITS)
+		return ERROR_OK;
+
+	return xlnx_pcie_xvc_flush();
+}
+
 static void xlnx_pcie_xvc_swd_write_reg(uint8_t cmd, uint32_t value,
 					uint32_t ap_delay_clk);
 
@@ -543,28 +831,32 @@ static void swd_clear_sticky_errors(void)
 static void xlnx_pcie_xvc_swd_read_reg(uint8_t cmd, uint32_t *value,
 				       uint32_t ap_delay_clk)
 {
-	uint32_t res, ack, rpar;
+	uint32_t res, ack, rpar, tail;
+	unsigned head;
 	int err;
 
 	assert(cmd & SWD_CMD_RNW);
 
+	err = xlnx_pcie_xvc_swd_make_room(14);
+	if (err != ERROR_OK)
+		goto err_out;
+
 	cmd |= SWD_CMD_START | SWD_CMD_PARK;
-	/* cmd + ack */
-	err = xlnx_pcie_xvc_transact(12, cmd, 0, &res);
+	/* cmd + ack + as much data as fits in one shift */
+	head = XLNX_XVC_MAX_BITS - 12 - xlnx_pcie_xvc->pending_bits;
+	err = xlnx_pcie_xvc_transact(12 + head, cmd, 0, &res);
 	if (err != ERROR_OK)
 		goto err_out;
 
 	ack = MASK_ACK(res);
 
-	/* read data */
-	err = xlnx_pcie_xvc_transact(32, 0, 0, &res);
+	/* rest of the data + parity + trn */
+	err = xlnx_pcie_xvc_transact(XLNX_XVC_MAX_BITS - head + 2, 0, 0, &tail);
 	if (err != ERROR_OK)
 		goto err_out;
 
-	/* parity + trn */
-	err = xlnx_pcie_xvc_transact(2, 0, 0, &rpar);
-	if (err != ERROR_OK)
-		goto err_out;
+	res = ((res >> 12) & (BIT(head) - 1)) | tail << head;
+	rpar = tail >> (XLNX_XVC_MAX_BITS - head);
 
 	LOG_DEBUG("%s %s %s reg %X = %08"PRIx32,
 		  ack == SWD_ACK_OK ? "OK" : ack == SWD_ACK_WAIT ?
@@ -607,25 +899,28 @@ static void xlnx_pcie_xvc_swd_write_reg(uint8_t cmd, uint32_t value,
 					uint32_t ap_delay_clk)
 {
 	uint32_t res, ack;
+	unsigned head;
 	int err;
 
 	assert(!(cmd & SWD_CMD_RNW));
 
-	cmd |= SWD_CMD_START | SWD_CMD_PARK;
-	/* cmd + trn + ack */
-	err = xlnx_pcie_xvc_transact(13, cmd, 0, &res);
+	err = xlnx_pcie_xvc_swd_make_room(15);
 	if (err != ERROR_OK)
 		goto err_out;
 
-	ack = MASK_ACK(res);
-
-	/* write data */
-	err = xlnx_pcie_xvc_transact(32, value, 0, NULL);
+	cmd |= SWD_CMD_START | SWD_CMD_PARK;
+	/* cmd + trn + ack + trn + as much data as fits in one shift */
+	head = XLNX_XVC_MAX_BITS - 13 - xlnx_pcie_xvc->pending_bits;
+	err = xlnx_pcie_xvc_transact(13 + head, cmd | value << 13, 0, &res);
 	if (err != ERROR_OK)
 		goto err_out;
 
-	/* parity + trn */
-	err = xlnx_pcie_xvc_transact(2, parity_u32(value), 0, NULL);
+	ack = MASK_ACK(res);
+
+	/* rest of the data + parity, then the idle cycles are queued behind */
+	err = xlnx_pcie_xvc_transact(XLNX_XVC_MAX_BITS - head + 2,
+				     value >> head | parity_u32(value) << (XLNX_XVC_MAX_BITS - head),
+				     0, NULL);
 	if (err != ERROR_OK)
 		goto err_out;
 
@@ -667,6 +962,8 @@ static int xlnx_pcie_xvc_swd_run_queue(void)
 
 	/* we want at least 8 idle cycles between each transaction */
 	err = xlnx_pcie_xvc_transact(8, 0, 0, NULL);
+	if (err == ERROR_OK)
+		err = xlnx_pcie_xvc_flush();
 	if (err != ERROR_OK)
 		return err;
 
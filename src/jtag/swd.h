@@ -94,6 +94,22 @@ static inline int swd_ack_to_error_code(uint8_t ack)
 	}
 }
 
+/**
+ * Give up retrying a transaction which keeps receiving WAIT after this
+ * many milliseconds without progress.
+ */
+#define SWD_WAIT_TIMEOUT_MS 1000
+
+/**
+ * Transaction statistics of an SWD driver, see swd_driver::run_stats.
+ */
+struct swd_run_stats {
+	/** AP transactions completed */
+	unsigned int ap_transactions;
+	/** WAIT acknowledges received, each followed by a retry */
+	unsigned int waits;
+};
+
 /*
  * The following sequences are updated to
  * ARM(tm) Debug Interface v5 Architecture Specification    ARM IHI 0031E
@@ -302,6 +318,17 @@ struct swd_driver {
 	 */
 	int (*run)(void);
 
+	/**
+	 * Optional: collect the transaction statistics since the previous
+	 * call. Drivers providing this retry transactions which receive a
+	 * WAIT acknowledge themselves, and only return ERROR_WAIT from run()
+	 * when the target keeps stalling. The ADIv5 layer uses the statistics
+	 * to tune the idle cycles after AP accesses.
+	 *
+	 * @param stats Where to store the statistics
+	 */
+	void (*run_stats)(struct swd_run_stats *stats);
+
 	/**
 	 * Configures data collection from the Single-wire
 	 * trace (SWO) signal.
@@ -210,6 +210,7 @@ struct svf_check_tdo_para {
 #define SVF_CHECK_TDO_PARA_SIZE 1024
 static struct svf_check_tdo_para *svf_check_tdo_para;
 static int svf_check_tdo_para_index;
+static int svf_check_tdo_para_size;
 
 static int svf_read_command_from_file(FILE *fd);
 static int svf_check_tdo(void);
@@ -218,6 +219,7 @@ static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
 static int svf_execute_tap(void);
 
 static FILE *svf_fd;
+static FILE *svf_compile_fd;
 static char *svf_read_line;
 static size_t svf_read_line_size;
 static char *svf_command_buffer;
@@ -257,6 +259,10 @@ static void svf_hexbuf_print(int dbg_lvl, const char *file, unsigned line,
 	int byte_len = DIV_ROUND_UP(bit_len, 8);
 	int msbits = bit_len % 8;
 
+	/* don't format whole bitstreams just to have them filtered out */
+	if (dbg_lvl > debug_level)
+		return;
+
 	/* allocate 2 bytes per hex digit */
 	char *prbuf = malloc((byte_len * 2) + 2 + 1);
 	if (!prbuf)
@@ -351,11 +357,470 @@ int svf_add_statemove(tap_state_t state_to)
 	return ERROR_FAIL;
 }
 
+/*
+ * Compiled SVF
+ *
+ * With the "-cache" option the player runs in two stages. The parser turns
+ * the SVF file into a stream of operations, with all scan data already
+ * converted to binary and padded with the header and trailer bits, and
+ * writes it to the cache file. The executor then streams that file into
+ * the JTAG queue, with a large queue window and the TDO checks of a whole
+ * window done at once. The cache is reused as long as the SVF file and
+ * the -tap padding are unchanged, so a second run skips the parser.
+ *
+ * The svf_op_*() helpers below are what the parser calls; they either
+ * queue the operation directly or, while compiling, append it to the
+ * stream.
+ */
+
+#define SVF_CACHE_MAGIC		"OOCDSVFC"
+#define SVF_CACHE_VERSION	1
+
+/* queue window of the compiled executor */
+#define SVF_STREAM_WINDOW			(4 * 1024 * 1024)
+#define SVF_STREAM_CHECK_TDO_PARA_SIZE	16384
+
+enum svf_op_type {
+	SVF_OP_SCAN = 1,
+	SVF_OP_STATEMOVE,
+	SVF_OP_PATHMOVE,
+	SVF_OP_TLR,
+	SVF_OP_CLOCKS,
+	SVF_OP_SLEEP,
+	SVF_OP_TRST,
+	SVF_OP_FREQUENCY,
+};
+
+#define SVF_OP_IR			(1 << 0)	/* SCAN: IR scan, otherwise DR */
+#define SVF_OP_CHECK		(1 << 1)	/* SCAN: TDO and MASK follow TDI */
+#define SVF_OP_IF_NEEDED	(1 << 2)	/* STATEMOVE: only when not already there */
+
+struct svf_op {
+	uint8_t type;
+	uint8_t flags;
+	uint8_t state;		/* end or goal state */
+	uint8_t reserved;
+	uint32_t line;		/* SVF line, for error messages */
+	uint32_t arg;		/* bits, cycles, microseconds, states or kHz */
+};
+
+struct svf_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t op_size;
+	uint64_t key;
+	uint64_t num_commands;
+	uint64_t num_lines;
+};
+
+static int svf_emit(uint8_t type, uint8_t flags, tap_state_t state, uint32_t arg,
+		const void *data, size_t size)
+{
+	struct svf_op op = {
+		.type = type,
+		.flags = flags,
+		.state = state,
+		.line = svf_line_number,
+		.arg = arg,
+	};
+
+	if (fwrite(&op, sizeof(op), 1, svf_compile_fd) != 1
+			|| (size && fwrite(data, size, 1, svf_compile_fd) != 1)) {
+		LOG_ERROR("fail to write svf cache: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static int svf_op_statemove(tap_state_t state, bool if_needed)
+{
+	if (svf_compile_fd)
+		return svf_emit(SVF_OP_STATEMOVE, if_needed ? SVF_OP_IF_NEEDED : 0, state, 0, NULL, 0);
+
+	if (if_needed && cmd_queue_cur_state == state)
+		return ERROR_OK;
+
+	/* FIXME handle statemove failures */
+	svf_add_statemove(state);
+	return ERROR_OK;
+}
+
+static int svf_op_pathmove(int num_states, const tap_state_t *path)
+{
+	if (svf_compile_fd) {
+		/* paths come from a single STATE command, at most 255 states */
+		uint8_t states[256];
+
+		assert(num_states <= (int)ARRAY_SIZE(states));
+		for (int i = 0; i < num_states; i++)
+			states[i] = path[i];
+		return svf_emit(SVF_OP_PATHMOVE, 0, 0, num_states, states, num_states);
+	}
+
+	if (!svf_nil)
+		jtag_add_pathmove(num_states, path);
+	return ERROR_OK;
+}
+
+static int svf_op_tlr(void)
+{
+	if (svf_compile_fd)
+		return svf_emit(SVF_OP_TLR, 0, 0, 0, NULL, 0);
+
+	if (!svf_nil)
+		jtag_add_tlr();
+	return ERROR_OK;
+}
+
+static int svf_op_clocks(int num_cycles)
+{
+	if (svf_compile_fd)
+		return svf_emit(SVF_OP_CLOCKS, 0, 0, num_cycles, NULL, 0);
+
+	if (!svf_nil)
+		jtag_add_clocks(num_cycles);
+	return ERROR_OK;
+}
+
+static int svf_op_sleep(uint32_t us)
+{
+	if (svf_compile_fd)
+		return svf_emit(SVF_OP_SLEEP, 0, 0, us, NULL, 0);
+
+	if (!svf_nil)
+		jtag_add_sleep(us);
+	return ERROR_OK;
+}
+
+static int svf_op_trst(int trst)
+{
+	if (svf_compile_fd)
+		return svf_emit(SVF_OP_TRST, 0, 0, trst, NULL, 0);
+
+	if (!svf_nil)
+		jtag_add_reset(trst, 0);
+	return ERROR_OK;
+}
+
+static int svf_op_frequency(struct command_context *cmd_ctx, int khz)
+{
+	if (svf_compile_fd)
+		return svf_emit(SVF_OP_FREQUENCY, 0, 0, khz, NULL, 0);
+
+	command_run_linef(cmd_ctx, "adapter speed %d", khz);
+	return ERROR_OK;
+}
+
+/* Scan the data assembled at svf_buffer_index */
+static int svf_op_scan(bool ir, int num_bits, tap_state_t end_state, bool check)
+{
+	uint8_t *tdi = &svf_tdi_buffer[svf_buffer_index];
+	int num_bytes = DIV_ROUND_UP(num_bits, 8);
+
+	if (svf_compile_fd) {
+		uint8_t flags = (ir ? SVF_OP_IR : 0) | (check ? SVF_OP_CHECK : 0);
+
+		if (svf_emit(SVF_OP_SCAN, flags, end_state, num_bits, tdi, num_bytes) != ERROR_OK)
+			return ERROR_FAIL;
+		if (check && (fwrite(&svf_tdo_buffer[svf_buffer_index], num_bytes, 1, svf_compile_fd) != 1
+				|| fwrite(&svf_mask_buffer[svf_buffer_index], num_bytes, 1, svf_compile_fd) != 1)) {
+			LOG_ERROR("fail to write svf cache: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		return ERROR_OK;
+	}
+
+	svf_add_check_para(check, svf_buffer_index, num_bits);
+	if (!svf_nil) {
+		/* NOTE:  doesn't use SVF-specified state paths */
+		if (ir)
+			jtag_add_plain_ir_scan(num_bits, tdi, check ? tdi : NULL, end_state);
+		else
+			jtag_add_plain_dr_scan(num_bits, tdi, check ? tdi : NULL, end_state);
+	}
+
+	svf_buffer_index += num_bytes;
+	return ERROR_OK;
+}
+
+/* Key of the cache: the SVF file contents and the -tap padding (FNV-1a) */
+static int svf_cache_key(FILE *fd, uint64_t *key)
+{
+	const size_t chunk_size = 64 * 1024;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t len;
+
+	uint8_t *chunk = malloc(chunk_size);
+	if (!chunk) {
+		LOG_ERROR("not enough memory");
+		return ERROR_FAIL;
+	}
+
+	while ((len = fread(chunk, 1, chunk_size, fd)) > 0) {
+		for (size_t i = 0; i < len; i++)
+			hash = (hash ^ chunk[i]) * 0x100000001b3ull;
+	}
+	free(chunk);
+
+	if (ferror(fd)) {
+		LOG_ERROR("fail to read svf file");
+		return ERROR_FAIL;
+	}
+	rewind(fd);
+
+	const int padding[] = {
+		svf_tap_is_specified,
+		svf_para.hir_para.len, svf_para.hdr_para.len,
+		svf_para.tir_para.len, svf_para.tdr_para.len,
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(padding); i++)
+		hash = (hash ^ padding[i]) * 0x100000001b3ull;
+
+	*key = hash;
+	return ERROR_OK;
+}
+
+static int svf_stream_read(FILE *fd, void *buf, size_t size)
+{
+	if (size && fread(buf, size, 1, fd) != 1) {
+		LOG_ERROR("svf cache is truncated or corrupt");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int svf_stream_scan(FILE *fd, const struct svf_op *op)
+{
+	bool check = op->flags & SVF_OP_CHECK;
+	int num_bytes = DIV_ROUND_UP(op->arg, 8);
+
+	if (svf_buffer_size - svf_buffer_index < num_bytes) {
+		if (svf_execute_tap() != ERROR_OK)
+			return ERROR_FAIL;
+		if (svf_buffer_size < num_bytes && svf_realloc_buffers(num_bytes) != ERROR_OK) {
+			LOG_ERROR("not enough memory");
+			return ERROR_FAIL;
+		}
+	}
+
+	if (svf_stream_read(fd, &svf_tdi_buffer[svf_buffer_index], num_bytes) != ERROR_OK)
+		return ERROR_FAIL;
+	if (check) {
+		if (svf_stream_read(fd, &svf_tdo_buffer[svf_buffer_index], num_bytes) != ERROR_OK
+				|| svf_stream_read(fd, &svf_mask_buffer[svf_buffer_index], num_bytes) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	if (svf_op_scan(op->flags & SVF_OP_IR, op->arg, op->state, check) != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* TDO checks are deferred until the whole window has been shifted */
+	if (svf_buffer_index >= SVF_STREAM_WINDOW
+			|| svf_check_tdo_para_index >= svf_check_tdo_para_size / 2)
+		return svf_execute_tap();
+
+	return ERROR_OK;
+}
+
+static int svf_execute_stream(struct command_context *cmd_ctx, FILE *fd,
+		const struct svf_cache_header *header)
+{
+	tap_state_t path[256];
+	struct svf_op op;
+	int retval = ERROR_OK;
+
+	void *ptr = realloc(svf_check_tdo_para,
+			sizeof(struct svf_check_tdo_para) * SVF_STREAM_CHECK_TDO_PARA_SIZE);
+	if (!ptr) {
+		LOG_ERROR("not enough memory");
+		return ERROR_FAIL;
+	}
+	svf_check_tdo_para = ptr;
+	svf_check_tdo_para_size = SVF_STREAM_CHECK_TDO_PARA_SIZE;
+
+	if (svf_realloc_buffers(SVF_STREAM_WINDOW + SVF_MAX_BUFFER_SIZE_TO_COMMIT) != ERROR_OK) {
+		LOG_ERROR("not enough memory");
+		return ERROR_FAIL;
+	}
+
+	while (retval == ERROR_OK && fread(&op, sizeof(op), 1, fd) == 1) {
+		svf_line_number = op.line;
+
+		switch (op.type) {
+		case SVF_OP_SCAN:
+			retval = svf_stream_scan(fd, &op);
+			break;
+		case SVF_OP_STATEMOVE:
+			retval = svf_op_statemove(op.state, op.flags & SVF_OP_IF_NEEDED);
+			break;
+		case SVF_OP_PATHMOVE:
+			if (op.arg > ARRAY_SIZE(path)) {
+				LOG_ERROR("svf cache is truncated or corrupt");
+				return ERROR_FAIL;
+			}
+			for (unsigned int i = 0; i < op.arg && retval == ERROR_OK; i++) {
+				uint8_t state;
+				retval = svf_stream_read(fd, &state, 1);
+				path[i] = state;
+			}
+			if (retval == ERROR_OK)
+				retval = svf_op_pathmove(op.arg, path);
+			break;
+		case SVF_OP_TLR:
+			retval = svf_op_tlr();
+			break;
+		case SVF_OP_CLOCKS:
+			retval = svf_op_clocks(op.arg);
+			break;
+		case SVF_OP_SLEEP:
+			retval = svf_op_sleep(op.arg);
+			break;
+		case SVF_OP_TRST:
+			retval = svf_execute_tap();
+			if (retval == ERROR_OK)
+				retval = svf_op_trst(op.arg);
+			break;
+		case SVF_OP_FREQUENCY:
+			retval = svf_execute_tap();
+			if (retval == ERROR_OK)
+				retval = svf_op_frequency(cmd_ctx, op.arg);
+			break;
+		default:
+			LOG_ERROR("svf cache is truncated or corrupt");
+			return ERROR_FAIL;
+		}
+
+		if (svf_progress_enabled && header->num_lines) {
+			svf_percentage = ((svf_line_number * 20) / header->num_lines) * 5;
+			if (svf_last_printed_percentage != svf_percentage) {
+				LOG_USER_N("\r%d%%    ", svf_percentage);
+				svf_last_printed_percentage = svf_percentage;
+			}
+		}
+	}
+
+	if (retval != ERROR_OK)
+		LOG_ERROR("fail to run command at line %d", svf_line_number);
+	else if (ferror(fd)) {
+		LOG_ERROR("fail to read svf cache");
+		retval = ERROR_FAIL;
+	}
+
+	return retval;
+}
+
+static int svf_parse_file(struct command_context *cmd_ctx, int *command_num)
+{
+	while (svf_read_command_from_file(svf_fd) == ERROR_OK) {
+		/* Log Output */
+		if (svf_quiet) {
+			if (svf_progress_enabled) {
+				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
+				if (svf_last_printed_percentage != svf_percentage) {
+					LOG_USER_N("\r%d%%    ", svf_percentage);
+					svf_last_printed_percentage = svf_percentage;
+				}
+			}
+		} else {
+			if (svf_progress_enabled) {
+				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
+				LOG_USER_N("%3d%%  %s", svf_percentage, svf_read_line);
+			} else
+				LOG_USER_N("%s", svf_read_line);
+		}
+		/* Run Command */
+		if (svf_run_command(cmd_ctx, svf_command_buffer) != ERROR_OK) {
+			LOG_ERROR("fail to run command at line %d", svf_line_number);
+			return ERROR_FAIL;
+		}
+		(*command_num)++;
+	}
+
+	return ERROR_OK;
+}
+
+/* Run the SVF file through its compiled form, compiling it first if the cache is stale */
+static int svf_run_cached(struct command_context *cmd_ctx, const char *cache_name, int *command_num)
+{
+	struct svf_cache_header header;
+	uint64_t key;
+	int retval;
+
+	retval = svf_cache_key(svf_fd, &key);
+	if (retval != ERROR_OK)
+		return retval;
+
+	FILE *fd = fopen(cache_name, "rb");
+	if (fd) {
+		if (fread(&header, sizeof(header), 1, fd) == 1
+				&& !memcmp(header.magic, SVF_CACHE_MAGIC, sizeof(header.magic))
+				&& header.version == SVF_CACHE_VERSION
+				&& header.op_size == sizeof(struct svf_op)
+				&& header.key == key) {
+			LOG_USER("svf using compiled cache \"%s\"", cache_name);
+		} else {
+			fclose(fd);
+			fd = NULL;
+		}
+	}
+
+	if (!fd) {
+		fd = fopen(cache_name, "w+b");
+		if (!fd) {
+			LOG_ERROR("open(\"%s\"): %s", cache_name, strerror(errno));
+			return ERROR_FAIL;
+		}
+		LOG_USER("svf compiling into cache \"%s\"", cache_name);
+
+		/* the real header is only written once the whole file has compiled */
+		memset(&header, 0, sizeof(header));
+		if (fwrite(&header, sizeof(header), 1, fd) != 1) {
+			LOG_ERROR("fail to write svf cache: %s", strerror(errno));
+			retval = ERROR_FAIL;
+		}
+
+		if (retval == ERROR_OK) {
+			svf_compile_fd = fd;
+			retval = svf_parse_file(cmd_ctx, command_num);
+			svf_compile_fd = NULL;
+		}
+
+		if (retval == ERROR_OK) {
+			memcpy(header.magic, SVF_CACHE_MAGIC, sizeof(header.magic));
+			header.version = SVF_CACHE_VERSION;
+			header.op_size = sizeof(struct svf_op);
+			header.key = key;
+			header.num_commands = *command_num;
+			header.num_lines = svf_line_number;
+			if (fseek(fd, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fd) != 1
+					|| fflush(fd) != 0 || fseek(fd, sizeof(header), SEEK_SET) != 0) {
+				LOG_ERROR("fail to write svf cache: %s", strerror(errno));
+				retval = ERROR_FAIL;
+			}
+		}
+
+		if (retval != ERROR_OK) {
+			fclose(fd);
+			remove(cache_name);
+			return retval;
+		}
+	}
+
+	*command_num = header.num_commands;
+	svf_line_number = 0;
+	retval = svf_execute_stream(cmd_ctx, fd, &header);
+	fclose(fd);
+
+	return retval;
+}
+
 COMMAND_HANDLER(handle_svf_command)
 {
 #define SVF_MIN_NUM_OF_OPTIONS 1
-#define SVF_MAX_NUM_OF_OPTIONS 5
+#define SVF_MAX_NUM_OF_OPTIONS 9
 	int command_num = 0;
+	const char *cache_name = NULL;
 	int ret = ERROR_OK;
 	int64_t time_measure_ms;
 	int time_measure_s, time_measure_m;
@@ -382,6 +847,10 @@ COMMAND_HANDLER(handle_svf_command)
 				return ERROR_FAIL;
 			}
 			i++;
+		} else if (strcmp(CMD_ARGV[i], "-cache") == 0) {
+			if (i + 1 >= CMD_ARGC)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			cache_name = CMD_ARGV[++i];
 		} else if ((strcmp(CMD_ARGV[i],
 				"quiet") == 0) || (strcmp(CMD_ARGV[i], "-quiet") == 0))
 			svf_quiet = 1;
@@ -416,6 +885,7 @@ COMMAND_HANDLER(handle_svf_command)
 	svf_command_buffer_size = 0;
 
 	svf_check_tdo_para_index = 0;
+	svf_check_tdo_para_size = SVF_CHECK_TDO_PARA_SIZE;
 	svf_check_tdo_para = malloc(sizeof(struct svf_check_tdo_para) * SVF_CHECK_TDO_PARA_SIZE);
 	if (!svf_check_tdo_para) {
 		LOG_ERROR("not enough memory");
@@ -492,31 +962,10 @@ COMMAND_HANDLER(handle_svf_command)
 		}
 		rewind(svf_fd);
 	}
-	while (svf_read_command_from_file(svf_fd) == ERROR_OK) {
-		/* Log Output */
-		if (svf_quiet) {
-			if (svf_progress_enabled) {
-				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
-				if (svf_last_printed_percentage != svf_percentage) {
-					LOG_USER_N("\r%d%%    ", svf_percentage);
-					svf_last_printed_percentage = svf_percentage;
-				}
-			}
-		} else {
-			if (svf_progress_enabled) {
-				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
-				LOG_USER_N("%3d%%  %s", svf_percentage, svf_read_line);
-			} else
-				LOG_USER_N("%s", svf_read_line);
-		}
-		/* Run Command */
-		if (svf_run_command(CMD_CTX, svf_command_buffer) != ERROR_OK) {
-			LOG_ERROR("fail to run command at line %d", svf_line_number);
-			ret = ERROR_FAIL;
-			break;
-		}
-		command_num++;
-	}
+	if (cache_name)
+		ret = svf_run_cached(CMD_CTX, cache_name, &command_num);
+	else
+		ret = svf_parse_file(CMD_CTX, &command_num);
 
 	if ((!svf_nil) && (jtag_execute_queue() != ERROR_OK))
 		ret = ERROR_FAIL;
@@ -549,6 +998,7 @@ free_all:
 	free(svf_check_tdo_para);
 	svf_check_tdo_para = NULL;
 	svf_check_tdo_para_index = 0;
+	svf_check_tdo_para_size = 0;
 
 	free(svf_tdi_buffer);
 	svf_tdi_buffer = NULL;
@@ -602,8 +1052,14 @@ static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 			return -1;
 		}
 		if ((i + 2) > *n) {
-			*n += MIN_CHUNK;
-			*lineptr = realloc(*lineptr, *n);
+			/* grow geometrically, bitstream lines can be very long */
+			char *ptr = realloc(*lineptr, 2 * *n);
+			if (!ptr) {
+				(*lineptr)[0] = 0;
+				return -1;
+			}
+			*lineptr = ptr;
+			*n *= 2;
 		}
 	}
 
@@ -673,8 +1129,9 @@ static int svf_read_command_from_file(FILE *fd)
 				 *  - terminating NUL ('\0')
 				 */
 				if (cmd_pos + 3 > svf_command_buffer_size) {
-					svf_command_buffer = realloc(svf_command_buffer, cmd_pos + 3);
-					svf_command_buffer_size = cmd_pos + 3;
+					size_t new_size = MAX(cmd_pos + 3, 2 * svf_command_buffer_size);
+					svf_command_buffer = realloc(svf_command_buffer, new_size);
+					svf_command_buffer_size = new_size;
 					if (!svf_command_buffer) {
 						LOG_ERROR("not enough memory");
 						return ERROR_FAIL;
@@ -877,7 +1334,7 @@ static int svf_check_tdo(void)
 
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 {
-	if (svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE) {
+	if (svf_check_tdo_para_index >= svf_check_tdo_para_size) {
 		LOG_ERROR("toooooo many operation undone");
 		return ERROR_FAIL;
 	}
@@ -893,6 +1350,13 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 
 static int svf_execute_tap(void)
 {
+	/* nothing is queued while compiling */
+	if (svf_compile_fd) {
+		svf_buffer_index = 0;
+		svf_check_tdo_para_index = 0;
+		return ERROR_OK;
+	}
+
 	if ((!svf_nil) && (jtag_execute_queue() != ERROR_OK))
 		return ERROR_FAIL;
 	else if (svf_check_tdo() != ERROR_OK)
@@ -917,7 +1381,6 @@ static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
 	/* for XXR */
 	struct svf_xxr_para *xxr_para_tmp;
 	uint8_t **pbuffer_tmp;
-	struct scan_field field;
 	/* for STATE */
 	tap_state_t *path = NULL, state;
 	/* flag padding commands skipped due to -tap command */
@@ -976,9 +1439,8 @@ static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
 				svf_para.frequency = atof(argus[1]);
 				/* TODO: set jtag speed to */
 				if (svf_para.frequency > 0) {
-					command_run_linef(cmd_ctx,
-							"adapter speed %d",
-							(int)svf_para.frequency / 1000);
+					if (svf_op_frequency(cmd_ctx, (int)svf_para.frequency / 1000) != ERROR_OK)
+						return ERROR_FAIL;
 					LOG_DEBUG("\tfrequency = %f", svf_para.frequency);
 				}
 			}
@@ -1186,21 +1648,10 @@ xxr_common:
 							svf_para.tdr_para.len);
 					i += svf_para.tdr_para.len;
 
-					svf_add_check_para(1, svf_buffer_index, i);
-				} else
-					svf_add_check_para(0, svf_buffer_index, i);
-				field.num_bits = i;
-				field.out_value = &svf_tdi_buffer[svf_buffer_index];
-				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
-				if (!svf_nil) {
-					/* NOTE:  doesn't use SVF-specified state paths */
-					jtag_add_plain_dr_scan(field.num_bits,
-							field.out_value,
-							field.in_value,
-							svf_para.dr_end_state);
 				}
-
-				svf_buffer_index += (i + 7) >> 3;
+				if (svf_op_scan(false, i, svf_para.dr_end_state,
+						xxr_para_tmp->data_mask & XXR_TDO) != ERROR_OK)
+					return ERROR_FAIL;
 			} else if (command == SIR) {
 				/* check buffer size first, reallocate if necessary */
 				i = svf_para.hir_para.len + svf_para.sir_para.len +
@@ -1276,21 +1727,10 @@ xxr_common:
 							svf_para.tir_para.len);
 					i += svf_para.tir_para.len;
 
-					svf_add_check_para(1, svf_buffer_index, i);
-				} else
-					svf_add_check_para(0, svf_buffer_index, i);
-				field.num_bits = i;
-				field.out_value = &svf_tdi_buffer[svf_buffer_index];
-				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
-				if (!svf_nil) {
-					/* NOTE:  doesn't use SVF-specified state paths */
-					jtag_add_plain_ir_scan(field.num_bits,
-							field.out_value,
-							field.in_value,
-							svf_para.ir_end_state);
 				}
-
-				svf_buffer_index += (i + 7) >> 3;
+				if (svf_op_scan(true, i, svf_para.ir_end_state,
+						xxr_para_tmp->data_mask & XXR_TDO) != ERROR_OK)
+					return ERROR_FAIL;
 			}
 			break;
 		case PIO:
@@ -1376,23 +1816,25 @@ xxr_common:
 				uint32_t min_usec = 1000000 * min_time;
 
 				/* enter into run_state if necessary */
-				if (cmd_queue_cur_state != svf_para.runtest_run_state)
-					svf_add_statemove(svf_para.runtest_run_state);
+				if (svf_op_statemove(svf_para.runtest_run_state, true) != ERROR_OK)
+					return ERROR_FAIL;
 
 				/* add clocks and/or min wait */
 				if (run_count > 0) {
-					if (!svf_nil)
-						jtag_add_clocks(run_count);
+					if (svf_op_clocks(run_count) != ERROR_OK)
+						return ERROR_FAIL;
 				}
 
 				if (min_usec > 0) {
-					if (!svf_nil)
-						jtag_add_sleep(min_usec);
+					if (svf_op_sleep(min_usec) != ERROR_OK)
+						return ERROR_FAIL;
 				}
 
 				/* move to end_state if necessary */
-				if (svf_para.runtest_end_state != svf_para.runtest_run_state)
-					svf_add_statemove(svf_para.runtest_end_state);
+				if (svf_para.runtest_end_state != svf_para.runtest_run_state) {
+					if (svf_op_statemove(svf_para.runtest_end_state, false) != ERROR_OK)
+						return ERROR_FAIL;
+				}
 
 #else
 				if (svf_para.runtest_run_state != TAP_IDLE) {
@@ -1436,12 +1878,14 @@ xxr_common:
 					/* OpenOCD refuses paths containing TAP_RESET */
 					if (path[i] == TAP_RESET) {
 						/* FIXME last state MUST be stable! */
-						if (i > 0) {
-							if (!svf_nil)
-								jtag_add_pathmove(i, path);
+						if (i > 0 && svf_op_pathmove(i, path) != ERROR_OK) {
+							free(path);
+							return ERROR_FAIL;
+						}
+						if (svf_op_tlr() != ERROR_OK) {
+							free(path);
+							return ERROR_FAIL;
 						}
-						if (!svf_nil)
-							jtag_add_tlr();
 						num_of_argu -= i + 1;
 						i = -1;
 					}
@@ -1450,8 +1894,10 @@ xxr_common:
 					/* execute last path if necessary */
 					if (svf_tap_state_is_stable(path[num_of_argu - 1])) {
 						/* last state MUST be stable state */
-						if (!svf_nil)
-							jtag_add_pathmove(num_of_argu, path);
+						if (svf_op_pathmove(num_of_argu, path) != ERROR_OK) {
+							free(path);
+							return ERROR_FAIL;
+						}
 						LOG_DEBUG("\tmove to %s by path_move",
 								tap_state_name(path[num_of_argu - 1]));
 					} else {
@@ -1471,8 +1917,8 @@ xxr_common:
 				if (svf_tap_state_is_stable(state)) {
 					LOG_DEBUG("\tmove to %s by svf_add_statemove",
 							tap_state_name(state));
-					/* FIXME handle statemove failures */
-					svf_add_statemove(state);
+					if (svf_op_statemove(state, false) != ERROR_OK)
+						return ERROR_FAIL;
 				} else {
 					LOG_ERROR("%s: %s is not a stable state",
 							argus[0], tap_state_name(state));
@@ -1494,13 +1940,13 @@ xxr_common:
 						ARRAY_SIZE(svf_trst_mode_name));
 				switch (i_tmp) {
 				case TRST_ON:
-					if (!svf_nil)
-						jtag_add_reset(1, 0);
+					if (svf_op_trst(1) != ERROR_OK)
+						return ERROR_FAIL;
 					break;
 				case TRST_Z:
 				case TRST_OFF:
-					if (!svf_nil)
-						jtag_add_reset(0, 0);
+					if (svf_op_trst(0) != ERROR_OK)
+						return ERROR_FAIL;
 					break;
 				case TRST_ABSENT:
 					break;
@@ -1556,7 +2002,7 @@ static const struct command_registration svf_command_handlers[] = {
 		.handler = handle_svf_command,
 		.mode = COMMAND_EXEC,
 		.help = "Runs a SVF file.",
-		.usage = "[-tap device.tap] <file> [quiet] [nil] [progress] [ignore_error]",
+		.usage = "[-tap device.tap] <file> [quiet] [nil] [progress] [ignore_error] [-cache cachefile]",
 	},
 	COMMAND_REGISTRATION_DONE
 };
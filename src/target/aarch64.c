@@ -22,6 +22,7 @@
 #endif
 
 #include "breakpoints.h"
+#include "algorithm.h"
 #include "aarch64.h"
 #include "a64_disassembler.h"
 #include "register.h"
@@ -1198,6 +1199,177 @@ static int aarch64_step(struct target *target, int current, target_addr_t addres
 	return ERROR_OK;
 }
 
+/*
+ * Run a code fragment in AArch64 state on this PE only. The fragment must
+ * end with a HLT instruction; exit_point, when non-zero, is its address.
+ * Other PEs of an SMP group stay halted.
+ */
+static int aarch64_run_algorithm(struct target *target,
+	int num_mem_params, struct mem_param *mem_params,
+	int num_reg_params, struct reg_param *reg_params,
+	target_addr_t entry_point, target_addr_t exit_point,
+	int timeout_ms, void *arch_info)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+	struct arm *arm = &armv8->arm;
+	struct arm_algorithm *arm_algorithm_info = arch_info;
+	uint64_t context[ARMV8_xPSR + 1];
+	int retval;
+
+	LOG_DEBUG("Running algorithm");
+
+	if (!arm_algorithm_info || arm_algorithm_info->common_magic != ARM_COMMON_MAGIC) {
+		LOG_ERROR("current target isn't an ARMV8 target");
+		return ERROR_TARGET_INVALID;
+	}
+
+	if (target->state != TARGET_HALTED) {
+		LOG_WARNING("target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	if (arm->core_state != ARM_STATE_AARCH64 ||
+			arm_algorithm_info->core_state != ARM_STATE_AARCH64) {
+		LOG_ERROR("algorithms can only run in AArch64 state");
+		return ERROR_TARGET_INVALID;
+	}
+
+	/* save x0..x30, sp, pc and cpsr; they'll be restored later */
+	for (unsigned int i = 0; i <= ARMV8_xPSR; i++) {
+		struct reg *r = &arm->core_cache->reg_list[i];
+
+		if (!r->valid) {
+			retval = r->type->get(r);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		context[i] = buf_get_u64(r->value, 0, r->size);
+	}
+
+	for (int i = 0; i < num_mem_params; i++) {
+		if (mem_params[i].direction == PARAM_IN)
+			continue;
+		retval = target_write_buffer(target, mem_params[i].address,
+				mem_params[i].size, mem_params[i].value);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (int i = 0; i < num_reg_params; i++) {
+		if (reg_params[i].direction == PARAM_IN)
+			continue;
+
+		struct reg *reg = register_get_by_name(arm->core_cache, reg_params[i].reg_name, false);
+		if (!reg) {
+			LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		if (reg->size != reg_params[i].size) {
+			LOG_ERROR("BUG: register '%s' size doesn't match reg_params[i].size",
+				reg_params[i].reg_name);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		retval = reg->type->set(reg, reg_params[i].value);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/*
+	 * isolate the other PEs from the restart event, otherwise the CTI
+	 * would resume them together with the algorithm
+	 */
+	if (target->smp) {
+		struct target_list *head;
+
+		foreach_smp_target(head, target->smp_targets) {
+			struct target *curr = head->target;
+
+			if (curr == target || !target_was_examined(curr))
+				continue;
+			retval = arm_cti_gate_channel(target_to_armv8(curr)->cti, 1);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	/* no interrupts while the algorithm runs */
+	retval = aarch64_set_dscr_bits(target, 0x3 << 22, 0x3 << 22);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint64_t address = entry_point;
+	retval = aarch64_restore_one(target, 0, &address, 0, 1);
+	if (retval == ERROR_OK)
+		retval = aarch64_restart_one(target, RESTART_SYNC);
+	if (retval != ERROR_OK)
+		return retval;
+
+	target->debug_reason = DBG_REASON_NOTHALTED;
+	target->state = TARGET_DEBUG_RUNNING;
+	target_call_event_callbacks(target, TARGET_EVENT_DEBUG_RESUMED);
+	LOG_DEBUG("algorithm started at 0x%" PRIx64, address);
+
+	retval = target_wait_state(target, TARGET_HALTED, timeout_ms);
+	if (retval != ERROR_OK || target->state != TARGET_HALTED) {
+		LOG_ERROR("algorithm at 0x%" PRIx64 " did not finish in %d ms",
+			address, timeout_ms);
+		retval = aarch64_halt_one(target, HALT_SYNC);
+		if (retval == ERROR_OK)
+			retval = target_wait_state(target, TARGET_HALTED, 500);
+		if (retval == ERROR_OK)
+			retval = ERROR_TARGET_TIMEOUT;
+	} else if (exit_point && buf_get_u64(arm->pc->value, 0, 64) != exit_point) {
+		LOG_ERROR("algorithm halted at 0x%" PRIx64 " instead of 0x%" PRIx64,
+			buf_get_u64(arm->pc->value, 0, 64), (uint64_t)exit_point);
+		retval = ERROR_TARGET_TIMEOUT;
+	}
+
+	int retvaltemp = aarch64_set_dscr_bits(target, 0x3 << 22, 0);
+	if (retval == ERROR_OK)
+		retval = retvaltemp;
+
+	if (target->state != TARGET_HALTED)
+		return retval;
+
+	for (int i = 0; retval == ERROR_OK && i < num_mem_params; i++) {
+		if (mem_params[i].direction != PARAM_OUT)
+			retval = target_read_buffer(target, mem_params[i].address,
+					mem_params[i].size, mem_params[i].value);
+	}
+
+	for (int i = 0; retval == ERROR_OK && i < num_reg_params; i++) {
+		if (reg_params[i].direction == PARAM_OUT)
+			continue;
+
+		struct reg *reg = register_get_by_name(arm->core_cache, reg_params[i].reg_name, false);
+		if (!reg) {
+			LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+			retval = ERROR_COMMAND_SYNTAX_ERROR;
+			break;
+		}
+		if (!reg->valid)
+			retval = reg->type->get(reg);
+		buf_set_u64(reg_params[i].value, 0, reg_params[i].size,
+			buf_get_u64(reg->value, 0, reg->size));
+	}
+
+	/* restore everything we saved before */
+	for (unsigned int i = 0; i <= ARMV8_xPSR; i++) {
+		struct reg *r = &arm->core_cache->reg_list[i];
+
+		if (r->valid && buf_get_u64(r->value, 0, r->size) == context[i])
+			continue;
+		LOG_DEBUG("restoring register %s with value 0x%" PRIx64, r->name, context[i]);
+		buf_set_u64(r->value, 0, r->size, context[i]);
+		r->valid = true;
+		r->dirty = true;
+	}
+
+	return retval;
+}
+
 static int aarch64_restore_context(struct target *target, bool bpwp)
 {
 	struct armv8_common *armv8 = target_to_armv8(target);
@@ -2226,7 +2398,7 @@ static int aarch64_read_cpu_memory_slow(struct target *target,
 
 	/* change DCC to normal mode (if necessary) */
 	if (*dscr & DSCR_MA) {
-		*dscr &= DSCR_MA;
+		*dscr &= ~DSCR_MA;
 		retval =  mem_ap_write_atomic_u32(armv8->debug_ap,
 				armv8->debug_base + CPUV8_DBG_DSCR, *dscr);
 		if (retval != ERROR_OK)
@@ -2433,6 +2605,51 @@ static int aarch64_read_cpu_memory(struct target *target,
 	return ERROR_OK;
 }
 
+/* direct physical memory access through the system bus MEM-AP */
+static int aarch64_read_memory_ap(struct target *target,
+	target_addr_t address, uint32_t size,
+	uint32_t count, uint8_t *buffer)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+
+	/* disabling the data cache flushes it, the bus does not see dirty lines */
+	int retval = aarch64_mmu_modify(target, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mem_ap_read_buf(armv8->memory_ap, buffer, size, count, address);
+}
+
+static int aarch64_write_memory_ap(struct target *target,
+	target_addr_t address, uint32_t size,
+	uint32_t count, const uint8_t *buffer)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+
+	int retval = aarch64_mmu_modify(target, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = mem_ap_write_buf(armv8->memory_ap, buffer, size, count, address);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* the instruction cache doesn't see writes from the bus, drop stale code */
+	if (armv8->armv8_mmu.armv8_cache.i_cache_enabled)
+		retval = armv8_cache_i_inner_inval_virt(armv8, address, size * count);
+
+	return retval;
+}
+
+static bool aarch64_use_memory_ap(struct target *target)
+{
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	struct armv8_common *armv8 = &aarch64->armv8_common;
+
+	return armv8->memory_ap_available && aarch64->memory_ap_enabled &&
+		target->state == TARGET_HALTED;
+}
+
 static int aarch64_read_phys_memory(struct target *target,
 	target_addr_t address, uint32_t size,
 	uint32_t count, uint8_t *buffer)
@@ -2440,6 +2657,14 @@ static int aarch64_read_phys_memory(struct target *target,
 	int retval = ERROR_COMMAND_SYNTAX_ERROR;
 
 	if (count && buffer) {
+		if (aarch64_use_memory_ap(target)) {
+			/* read memory through the system bus MEM-AP */
+			retval = aarch64_read_memory_ap(target, address, size, count, buffer);
+			if (retval == ERROR_OK)
+				return retval;
+			LOG_DEBUG("memory AP read failed, falling back to CPU access");
+		}
+
 		/* read memory through APB-AP */
 		retval = aarch64_mmu_modify(target, 0);
 		if (retval != ERROR_OK)
@@ -2476,6 +2701,14 @@ static int aarch64_write_phys_memory(struct target *target,
 	int retval = ERROR_COMMAND_SYNTAX_ERROR;
 
 	if (count && buffer) {
+		if (aarch64_use_memory_ap(target)) {
+			/* write memory through the system bus MEM-AP */
+			retval = aarch64_write_memory_ap(target, address, size, count, buffer);
+			if (retval == ERROR_OK)
+				return retval;
+			LOG_DEBUG("memory AP write failed, falling back to CPU access");
+		}
+
 		/* write memory through APB-AP */
 		retval = aarch64_mmu_modify(target, 0);
 		if (retval != ERROR_OK)
@@ -2506,6 +2739,157 @@ static int aarch64_write_memory(struct target *target, target_addr_t address,
 	return aarch64_write_cpu_memory(target, address, size, count, buffer);
 }
 
+/*
+ * Fast mode DCC transfers (EDSCR.MA) only handle aligned words, while the
+ * generic buffer code splits unaligned heads and tails into byte and halfword
+ * accesses, each of them going through the slow, several instructions per
+ * access path. Instead, widen the transfer to the enclosing aligned words and
+ * move the whole buffer in a single fast mode transfer. Small buffers keep
+ * their natural access size, as they may well target peripheral registers.
+ */
+#define AARCH64_BUFFER_WIDEN_MIN	8
+
+static int aarch64_access_buffer_split(struct target *target, target_addr_t address,
+	uint32_t count, uint8_t *rbuffer, const uint8_t *wbuffer)
+{
+	uint32_t size;
+	int retval;
+
+	/* Align up to maximum 4 bytes. The loop condition makes sure the next pass
+	 * will have something to do with the size we leave to it. */
+	for (size = 1; size < 4 && count >= size * 2 + (address & size); size *= 2) {
+		if (address & size) {
+			if (rbuffer)
+				retval = target_read_memory(target, address, size, 1, rbuffer);
+			else
+				retval = target_write_memory(target, address, size, 1, wbuffer);
+			if (retval != ERROR_OK)
+				return retval;
+			address += size;
+			count -= size;
+			if (rbuffer)
+				rbuffer += size;
+			else
+				wbuffer += size;
+		}
+	}
+
+	/* Access the data with as large access size as possible. */
+	for (; size > 0; size /= 2) {
+		uint32_t aligned = count - count % size;
+		if (aligned > 0) {
+			if (rbuffer)
+				retval = target_read_memory(target, address, size, aligned / size, rbuffer);
+			else
+				retval = target_write_memory(target, address, size, aligned / size, wbuffer);
+			if (retval != ERROR_OK)
+				return retval;
+			address += aligned;
+			count -= aligned;
+			if (rbuffer)
+				rbuffer += aligned;
+			else
+				wbuffer += aligned;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+static int aarch64_read_buffer(struct target *target, target_addr_t address,
+	uint32_t count, uint8_t *buffer)
+{
+	target_addr_t start = address & ~(target_addr_t)3;
+	/* counted from start, rounding up the end could wrap at the top of memory */
+	uint64_t len = (address - start) + (uint64_t)count;
+	uint32_t words = (len + 3) / 4;
+	uint8_t *tmp;
+	int retval;
+
+	if (len % 4 == 0 && start == address)
+		return target_read_memory(target, address, 4, words, buffer);
+
+	if (count < AARCH64_BUFFER_WIDEN_MIN)
+		return aarch64_access_buffer_split(target, address, count, buffer, NULL);
+
+	tmp = malloc((size_t)words * 4);
+	if (!tmp) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = target_read_memory(target, start, 4, words, tmp);
+	if (retval == ERROR_OK)
+		memcpy(buffer, tmp + (address - start), count);
+
+	free(tmp);
+	return retval;
+}
+
+static int aarch64_write_buffer(struct target *target, target_addr_t address,
+	uint32_t count, const uint8_t *buffer)
+{
+	target_addr_t start = address & ~(target_addr_t)3;
+	/* counted from start, rounding up the end could wrap at the top of memory */
+	uint64_t len = (address - start) + (uint64_t)count;
+	uint32_t words = (len + 3) / 4;
+	uint8_t *tmp;
+	int retval = ERROR_OK;
+
+	if (len % 4 == 0 && start == address)
+		return target_write_memory(target, address, 4, words, buffer);
+
+	if (count < AARCH64_BUFFER_WIDEN_MIN)
+		return aarch64_access_buffer_split(target, address, count, NULL, buffer);
+
+	tmp = malloc((size_t)words * 4);
+	if (!tmp) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* fetch the bytes of the first and last words not covered by the buffer */
+	if (start != address)
+		retval = target_read_memory(target, start, 4, 1, tmp);
+	if (retval == ERROR_OK && len % 4 != 0)
+		retval = target_read_memory(target, start + (target_addr_t)(words - 1) * 4,
+				4, 1, tmp + (size_t)(words - 1) * 4);
+
+	if (retval == ERROR_OK) {
+		memcpy(tmp + (address - start), buffer, count);
+		retval = target_write_memory(target, start, 4, words, tmp);
+	}
+
+	free(tmp);
+	return retval;
+}
+
+/* the memory AP sees physical addresses, only usable while virtual ones match */
+static bool aarch64_memory_ap_path_available(struct target *target)
+{
+	int mmu_enabled = 0;
+
+	if (!aarch64_use_memory_ap(target))
+		return false;
+
+	return aarch64_mmu(target, &mmu_enabled) == ERROR_OK && !mmu_enabled;
+}
+
+static const struct target_memory_path aarch64_memory_paths[] = {
+	{
+		.name = "cpu",
+		.read_memory = aarch64_read_memory,
+		.write_memory = aarch64_write_memory,
+	},
+	{
+		.name = "memory_ap",
+		.available = aarch64_memory_ap_path_available,
+		.read_memory = aarch64_read_memory_ap,
+		.write_memory = aarch64_write_memory_ap,
+	},
+	{ .name = NULL }
+};
+
 static int aarch64_handle_target_request(void *priv)
 {
 	struct target *target = priv;
@@ -2538,6 +2922,36 @@ static int aarch64_handle_target_request(void *priv)
 	return ERROR_OK;
 }
 
+/*
+ * Look for a system bus MEM-AP (AXI-AP) that physical memory accesses can be
+ * routed through, bypassing the much slower DCC transfers through the core.
+ * Without one, simply go without memory AP.
+ */
+static int aarch64_find_memory_ap(struct target *target)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+	int retval;
+
+	armv8->memory_ap_available = false;
+
+	if (dap_find_ap(armv8->arm.dap, AP_TYPE_AXI_AP, &armv8->memory_ap) != ERROR_OK &&
+			dap_find_ap(armv8->arm.dap, AP_TYPE_AXI5_AP, &armv8->memory_ap) != ERROR_OK)
+		return ERROR_OK;
+
+	retval = mem_ap_init(armv8->memory_ap);
+	if (retval != ERROR_OK) {
+		LOG_WARNING("Could not initialize the AXI-AP at AP index %d",
+			armv8->memory_ap->ap_num);
+		return ERROR_OK;
+	}
+
+	LOG_DEBUG("Using AXI-AP at AP index %d for physical memory accesses",
+		armv8->memory_ap->ap_num);
+	armv8->memory_ap_available = true;
+
+	return ERROR_OK;
+}
+
 static int aarch64_examine_first(struct target *target)
 {
 	struct aarch64_common *aarch64 = target_to_aarch64(target);
@@ -2573,6 +2987,12 @@ static int aarch64_examine_first(struct target *target)
 
 	armv8->debug_ap->memaccess_tck = 10;
 
+	if (aarch64->memory_ap_enabled) {
+		retval = aarch64_find_memory_ap(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	if (!target->dbgbase_set) {
 		target_addr_t dbgbase;
 		/* Get ROM Table base */
@@ -2727,6 +3147,7 @@ static int aarch64_init_arch_info(struct target *target,
 	armv8->post_debug_entry = aarch64_post_debug_entry;
 	armv8->pre_restore_context = NULL;
 	armv8->armv8_mmu.read_physical_memory = aarch64_read_phys_memory;
+	aarch64->memory_ap_enabled = true;
 
 	armv8_init_arch_info(target, armv8);
 	target_register_timer_callback(aarch64_handle_target_request, 1,
@@ -2958,6 +3379,34 @@ COMMAND_HANDLER(aarch64_mask_interrupts_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(aarch64_handle_memory_ap_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	struct armv8_common *armv8 = &aarch64->armv8_common;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], aarch64->memory_ap_enabled);
+
+		/* look for the AP now if the target was examined without it */
+		if (aarch64->memory_ap_enabled && !armv8->memory_ap_available &&
+				target_was_examined(target)) {
+			int retval = aarch64_find_memory_ap(target);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	command_print(CMD, "aarch64 memory AP %s%s",
+			aarch64->memory_ap_enabled ? "on" : "off",
+			aarch64->memory_ap_enabled && !armv8->memory_ap_available ? " (no memory AP found)" : "");
+
+	return ERROR_OK;
+}
+
 static int jim_mcrmrc(Jim_Interp *interp, int argc, Jim_Obj * const *argv)
 {
 	struct command *c = jim_to_command(interp);
@@ -3125,6 +3574,13 @@ static const struct command_registration aarch64_exec_command_handlers[] = {
 		.help = "mask aarch64 interrupts during single-step",
 		.usage = "['on'|'off']",
 	},
+	{
+		.name = "memory_ap",
+		.handler = aarch64_handle_memory_ap_command,
+		.mode = COMMAND_ANY,
+		.help = "use the system bus MEM-AP for physical memory accesses",
+		.usage = "['on'|'off']",
+	},
 	{
 		.name = "mcr",
 		.mode = COMMAND_EXEC,
@@ -3189,6 +3645,8 @@ struct target_type aarch64_target = {
 
 	.read_memory = aarch64_read_memory,
 	.write_memory = aarch64_write_memory,
+	.read_buffer = aarch64_read_buffer,
+	.write_buffer = aarch64_write_buffer,
 
 	.add_breakpoint = aarch64_add_breakpoint,
 	.add_context_breakpoint = aarch64_add_context_breakpoint,
@@ -3198,6 +3656,10 @@ struct target_type aarch64_target = {
 	.remove_watchpoint = aarch64_remove_watchpoint,
 	.hit_watchpoint = aarch64_hit_watchpoint,
 
+	.run_algorithm = aarch64_run_algorithm,
+	.checksum_memory = armv8_checksum_memory,
+	.blank_check_memory = armv8_blank_check_memory,
+
 	.commands = aarch64_command_handlers,
 	.target_create = aarch64_target_create,
 	.target_jim_configure = aarch64_jim_configure,
@@ -3209,4 +3671,6 @@ struct target_type aarch64_target = {
 	.write_phys_memory = aarch64_write_phys_memory,
 	.mmu = aarch64_mmu,
 	.virt2phys = aarch64_virt2phys,
+
+	.memory_paths = aarch64_memory_paths,
 };
@@ -70,6 +70,9 @@ struct aarch64_common {
 	struct armv8_common armv8_common;
 
 	enum aarch64_isrmasking_mode isrmasking_mode;
+
+	/* use the system bus MEM-AP for physical memory accesses when available */
+	bool memory_ap_enabled;
 };
 
 static inline struct aarch64_common *
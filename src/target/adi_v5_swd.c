@@ -56,6 +56,13 @@
 /* for debug, set do_sync to true to force synchronous transfers */
 static bool do_sync;
 
+/* Largest number of idle cycles after an AP access, as for memaccess_tck */
+#define SWD_TUNE_MAX_TCK				255
+/* AP transactions without WAIT needed to consider a number of idle cycles clean */
+#define SWD_TUNE_CLEAN_TRANSACTIONS		256
+/* AP transactions after which a converged number of idle cycles is probed again */
+#define SWD_TUNE_RECHECK_TRANSACTIONS	65536
+
 static struct adiv5_dap *swd_multidrop_selected_dap;
 
 
@@ -89,12 +96,99 @@ static void swd_clear_sticky_errors(struct adiv5_dap *dap)
 		STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR, 0);
 }
 
+/* Idle cycles to insert after an access to ap */
+static uint32_t swd_memaccess_tck(struct adiv5_ap *ap)
+{
+	struct adiv5_dap *dap = ap->dap;
+	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
+	struct adiv5_memaccess_tuning *tuning = &ap->memaccess_tuning;
+
+	if (!dap->memaccess_tune || !swd->run_stats)
+		return ap->memaccess_tck;
+
+	if (!tuning->valid || tuning->base != ap->memaccess_tck) {
+		tuning->valid = true;
+		tuning->base = ap->memaccess_tck;
+		tuning->tck = ap->memaccess_tck;
+		tuning->stalled = -1;
+		tuning->clean = -1;
+		tuning->transactions = 0;
+	}
+
+	/* Statistics of a run are only attributed to an AP which had it alone */
+	if (!dap->memaccess_tune_ap)
+		dap->memaccess_tune_ap = ap;
+	else if (dap->memaccess_tune_ap != ap)
+		dap->memaccess_tune_mixed = true;
+
+	return tuning->tck;
+}
+
+/* Tune the idle cycles of the AP used in the last run from its WAIT count.
+ *
+ * This is a binary search between the largest value seen to cause WAITs and
+ * the smallest value which ran SWD_TUNE_CLEAN_TRANSACTIONS AP transactions
+ * without any. A WAIT at a value thought to be clean restarts the search
+ * upwards, and a converged value is probed again from time to time in case
+ * the target got faster, e.g. after raising its clock. */
+static void swd_tune_memaccess(struct adiv5_dap *dap)
+{
+	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
+	struct adiv5_ap *ap = dap->memaccess_tune_ap;
+	bool mixed = dap->memaccess_tune_mixed;
+	struct swd_run_stats stats;
+
+	if (!swd->run_stats)
+		return;
+
+	swd->run_stats(&stats);
+	dap->memaccess_tune_ap = NULL;
+	dap->memaccess_tune_mixed = false;
+	if (!ap || mixed || !dap->memaccess_tune)
+		return;
+
+	struct adiv5_memaccess_tuning *tuning = &ap->memaccess_tuning;
+	int32_t tck = tuning->tck;
+
+	if (stats.waits) {
+		tuning->waits += stats.waits;
+		tuning->stalled = tck;
+		if (tuning->clean > tck) {
+			tck = (tuning->stalled + tuning->clean + 1) / 2;
+		} else {
+			tuning->clean = -1;
+			tck = MIN(tck * 2 + 1, SWD_TUNE_MAX_TCK);
+		}
+	} else {
+		bool converged = tuning->clean == tck && tuning->stalled + 1 == tck;
+
+		tuning->transactions += stats.ap_transactions;
+		if (tuning->transactions < (converged ? SWD_TUNE_RECHECK_TRANSACTIONS
+					: SWD_TUNE_CLEAN_TRANSACTIONS))
+			return;
+
+		tuning->clean = tck;
+		if (converged)
+			tuning->stalled = -1;
+		if (tuning->clean - tuning->stalled > 1)
+			tck = (tuning->stalled + tuning->clean) / 2;
+	}
+
+	tuning->transactions = 0;
+	if ((uint32_t)tck != tuning->tck) {
+		LOG_DEBUG("AP %" PRIu8 ": %" PRIu32 " idle cycles after access (was %" PRIu32 ")",
+				ap->ap_num, (uint32_t)tck, tuning->tck);
+		tuning->tck = tck;
+	}
+}
+
 static int swd_run_inner(struct adiv5_dap *dap)
 {
 	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
 	int retval;
 
 	retval = swd->run();
+	swd_tune_memaccess(dap);
 
 	if (retval != ERROR_OK) {
 		/* fault response */
@@ -509,7 +603,7 @@ static int swd_queue_ap_read(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
-	swd->read_reg(swd_cmd(true, true, reg), dap->last_read, ap->memaccess_tck);
+	swd->read_reg(swd_cmd(true, true, reg), dap->last_read, swd_memaccess_tck(ap));
 	dap->last_read = data;
 
 	return check_sync(dap);
@@ -536,7 +630,7 @@ static int swd_queue_ap_write(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
-	swd->write_reg(swd_cmd(false, true, reg), data, ap->memaccess_tck);
+	swd->write_reg(swd_cmd(false, true, reg), data, swd_memaccess_tck(ap));
 
 	return check_sync(dap);
 }
@@ -1817,6 +1817,9 @@ COMMAND_HANDLER(dap_memaccess_command)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
 	dap->ap[dap->apsel].memaccess_tck = memaccess_tck;
+	/* start tuning again from the new value */
+	if (CMD_ARGC == 1)
+		dap->ap[dap->apsel].memaccess_tuning.valid = false;
 
 	command_print(CMD, "memory bus access delay set to %" PRIu32 " tck",
 			dap->ap[dap->apsel].memaccess_tck);
@@ -1824,6 +1827,41 @@ COMMAND_HANDLER(dap_memaccess_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(dap_memaccess_tune_command)
+{
+	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
+
+	switch (CMD_ARGC) {
+	case 0:
+		break;
+	case 1:
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], dap->memaccess_tune);
+		break;
+	default:
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	command_print(CMD, "memory bus access delay tuning %s",
+			dap->memaccess_tune ? "enabled" : "disabled");
+
+	for (unsigned int i = 0; i <= DP_APSEL_MAX; i++) {
+		const struct adiv5_ap *ap = &dap->ap[i];
+		const struct adiv5_memaccess_tuning *tuning = &ap->memaccess_tuning;
+
+		if (!tuning->valid)
+			continue;
+
+		command_print(CMD, "AP %u: %" PRIu32 " tck (memaccess %" PRIu32 "), "
+				"%s, %" PRIu64 " WAITs",
+				i, tuning->tck, tuning->base,
+				tuning->clean == (int32_t)tuning->tck
+					&& tuning->stalled + 1 == (int32_t)tuning->tck ? "converged" : "tuning",
+				tuning->waits);
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(dap_apsel_command)
 {
 	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
@@ -2104,6 +2142,15 @@ const struct command_registration dap_instance_commands[] = {
 			"bus access [0-255]",
 		.usage = "[cycles]",
 	},
+	{
+		.name = "memaccess_tune",
+		.handler = dap_memaccess_tune_command,
+		.mode = COMMAND_ANY,
+		.help = "enable/disable tuning of the extra tck for MEM-AP "
+			"memory bus access from SWD WAIT responses, and show "
+			"the tuned values",
+		.usage = "['on'|'off']",
+	},
 	{
 		.name = "ti_be_32_quirks",
 		.handler = dap_ti_be_32_quirks_command,
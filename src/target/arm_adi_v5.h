@@ -205,6 +205,26 @@ enum swd_special_seq {
 	DORMANT_TO_JTAG,
 };
 
+/**
+ * State of the tuning of the idle cycles after AP accesses on SWD, driven
+ * by the WAIT responses seen by the SWD driver.
+ */
+struct adiv5_memaccess_tuning {
+	/* tuning started from memaccess_tck == base */
+	bool valid;
+	uint32_t base;
+	/* idle cycles in use */
+	uint32_t tck;
+	/* largest value seen to cause WAITs, or -1 */
+	int32_t stalled;
+	/* smallest value seen to run without WAITs, or -1 */
+	int32_t clean;
+	/* AP transactions without WAIT at tck */
+	uint32_t transactions;
+	/* WAIT responses seen in total */
+	uint64_t waits;
+};
+
 /**
  * This represents an ARM Debug Interface (v5) Access Port (AP).
  * Most common is a MEM-AP, for memory access.
@@ -245,6 +265,12 @@ struct adiv5_ap {
 	 */
 	uint32_t memaccess_tck;
 
+	/**
+	 * Tuned replacement for memaccess_tck on SWD, see
+	 * adiv5_dap::memaccess_tune.
+	 */
+	struct adiv5_memaccess_tuning memaccess_tuning;
+
 	/* Size of TAR autoincrement block, ARM ADI Specification requires at least 10 bits */
 	uint32_t tar_autoincr_block;
 
@@ -347,6 +373,16 @@ struct adiv5_dap {
 	 * Record if enter in SWD required passing through DORMANT
 	 */
 	bool switch_through_dormant;
+
+	/**
+	 * Tune the idle cycles after AP accesses from the WAIT responses
+	 * reported by the SWD driver, instead of using memaccess_tck as is.
+	 */
+	bool memaccess_tune;
+	/** The only AP accessed since the last run, NULL if none */
+	struct adiv5_ap *memaccess_tune_ap;
+	/** More than one AP was accessed since the last run */
+	bool memaccess_tune_mixed;
 };
 
 /**
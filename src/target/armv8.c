@@ -24,8 +24,10 @@
 #endif
 
 #include <helper/replacements.h>
+#include <helper/align.h>
 
 #include "armv8.h"
+#include "armv8_cache.h"
 #include "arm_disassembler.h"
 
 #include "register.h"
@@ -39,6 +41,7 @@
 #include "armv8_opcodes.h"
 #include "target.h"
 #include "target_type.h"
+#include "algorithm.h"
 #include "semihosting_common.h"
 
 static const char * const armv8_state_strings[] = {
@@ -1108,6 +1111,246 @@ int armv8_handle_cache_info_command(struct command_invocation *cmd,
 	return ERROR_OK;
 }
 
+static int armv8_write_algorithm(struct target *target,
+	struct working_area *area, const uint8_t *code, uint32_t code_size)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+	int retval;
+
+	/* the code may go through a different path than the core's
+	 * instruction fetch, so keep caches out of the way; cache
+	 * maintenance fails harmlessly with caches disabled */
+	armv8_cache_d_inner_flush_virt(armv8, area->address, code_size);
+
+	retval = target_write_buffer(target, area->address, code_size, code);
+	if (retval != ERROR_OK)
+		return retval;
+
+	armv8_cache_d_inner_flush_virt(armv8, area->address, code_size);
+	armv8_cache_i_inner_inval_virt(armv8, area->address, code_size);
+
+	return ERROR_OK;
+}
+
+/**
+ * Runs A64 code in the target to calculate a CRC32 checksum.
+ *
+ */
+int armv8_checksum_memory(struct target *target,
+	target_addr_t address, uint32_t count, uint32_t *checksum)
+{
+	struct arm *arm = target_to_arm(target);
+	struct working_area *crc_algorithm;
+	struct arm_algorithm arm_algo;
+	struct reg_param reg_params[3];
+	int retval;
+
+	static const uint8_t armv8_crc_code[] = {
+#include "../../contrib/loaders/checksum/armv8_crc.inc"
+	};
+
+	/* code, then the 256 entry table built by the code */
+	const uint32_t table_offset = ALIGN_UP(sizeof(armv8_crc_code), 8);
+
+	if (arm->core_state != ARM_STATE_AARCH64) {
+		LOG_DEBUG("not in AArch64 state, no on-target checksum");
+		return ERROR_FAIL;
+	}
+
+	/* the crc of small buffers is computed faster on the host;
+	 * target_checksum_memory() takes care of that if we fail */
+	if (count < sizeof(armv8_crc_code) * 4)
+		return ERROR_FAIL;
+
+	retval = target_alloc_working_area(target, table_offset + 256 * 4,
+			&crc_algorithm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (crc_algorithm->address + crc_algorithm->size > address &&
+			crc_algorithm->address < address + count) {
+		target_free_working_area(target, crc_algorithm);
+		return ERROR_FAIL;
+	}
+
+	retval = armv8_write_algorithm(target, crc_algorithm,
+			armv8_crc_code, sizeof(armv8_crc_code));
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	arm_algo.common_magic = ARM_COMMON_MAGIC;
+	arm_algo.core_mode = ARM_MODE_ANY;
+	arm_algo.core_state = ARM_STATE_AARCH64;
+
+	init_reg_param(&reg_params[0], "x0", 64, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "x1", 64, PARAM_OUT);
+	init_reg_param(&reg_params[2], "x2", 64, PARAM_OUT);
+
+	buf_set_u64(reg_params[0].value, 0, 64, address);
+	buf_set_u64(reg_params[1].value, 0, 64, count);
+	buf_set_u64(reg_params[2].value, 0, 64, crc_algorithm->address + table_offset);
+
+	/* 20 second timeout/megabyte */
+	int timeout = 20000 * (1 + (count / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+			crc_algorithm->address,
+			crc_algorithm->address + sizeof(armv8_crc_code) - 4,
+			timeout, &arm_algo);
+
+	if (retval == ERROR_OK)
+		*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	else
+		LOG_ERROR("error executing A64 crc algorithm");
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+
+cleanup:
+	target_free_working_area(target, crc_algorithm);
+
+	return retval;
+}
+
+/**
+ * Runs A64 code in the target to check whether memory blocks hold the
+ * erased value. As many blocks as the working area allows are checked
+ * by a single run.
+ *
+ */
+int armv8_blank_check_memory(struct target *target,
+	struct target_memory_check_block *blocks, int num_blocks, uint8_t erased_value)
+{
+	struct arm *arm = target_to_arm(target);
+	struct working_area *erase_check_algorithm;
+	struct working_area *erase_check_params;
+	struct arm_algorithm arm_algo;
+	struct reg_param reg_params[2];
+	int retval;
+
+	static bool timed_out;
+
+	static const uint8_t erase_check_code[] = {
+#include "../../contrib/loaders/erase_check/armv8_erase_check.inc"
+	};
+
+	/* struct { uint64_t size_in_result_out, uint64_t addr } */
+	const uint32_t block_size = 16;
+
+	if (arm->core_state != ARM_STATE_AARCH64) {
+		LOG_DEBUG("not in AArch64 state, no on-target blank check");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	if (target_alloc_working_area(target, sizeof(erase_check_code),
+			&erase_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = armv8_write_algorithm(target, erase_check_algorithm,
+			erase_check_code, sizeof(erase_check_code));
+	if (retval != ERROR_OK)
+		goto cleanup1;
+
+	uint32_t avail = target_get_working_area_avail(target);
+	int blocks_to_check = avail / block_size - 1;
+	if (num_blocks < blocks_to_check)
+		blocks_to_check = num_blocks;
+	if (blocks_to_check < 1) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup1;
+	}
+
+	uint32_t param_size = (blocks_to_check + 1) * block_size;
+	uint8_t *params = malloc(param_size);
+	if (!params) {
+		retval = ERROR_FAIL;
+		goto cleanup1;
+	}
+
+	int i;
+	uint64_t total_size = 0;
+	for (i = 0; i < blocks_to_check; i++) {
+		total_size += blocks[i].size;
+		target_buffer_set_u64(target, params + i * block_size, blocks[i].size);
+		target_buffer_set_u64(target, params + i * block_size + 8, blocks[i].address);
+	}
+	target_buffer_set_u64(target, params + blocks_to_check * block_size, 0);
+
+	if (target_alloc_working_area(target, param_size,
+			&erase_check_params) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = armv8_write_algorithm(target, erase_check_params, params, param_size);
+	if (retval != ERROR_OK)
+		goto cleanup3;
+
+	uint64_t erased_dword = erased_value * 0x0101010101010101ull;
+
+	LOG_DEBUG("Starting erase check of %d blocks, parameters@"
+		 TARGET_ADDR_FMT, blocks_to_check, erase_check_params->address);
+
+	arm_algo.common_magic = ARM_COMMON_MAGIC;
+	arm_algo.core_mode = ARM_MODE_ANY;
+	arm_algo.core_state = ARM_STATE_AARCH64;
+
+	init_reg_param(&reg_params[0], "x0", 64, PARAM_OUT);
+	buf_set_u64(reg_params[0].value, 0, 64, erase_check_params->address);
+
+	init_reg_param(&reg_params[1], "x1", 64, PARAM_OUT);
+	buf_set_u64(reg_params[1].value, 0, 64, erased_dword);
+
+	/* assume CPU clk at least 1 MHz */
+	int timeout = (timed_out ? 30000 : 2000) + total_size * 3 / 1000;
+
+	retval = target_run_algorithm(target,
+				0, NULL,
+				ARRAY_SIZE(reg_params), reg_params,
+				erase_check_algorithm->address,
+				erase_check_algorithm->address + sizeof(erase_check_code) - 4,
+				timeout,
+				&arm_algo);
+
+	timed_out = retval == ERROR_TARGET_TIMEOUT;
+	if (retval != ERROR_OK && !timed_out)
+		goto cleanup4;
+
+	armv8_cache_d_inner_flush_virt(target_to_armv8(target),
+			erase_check_params->address, param_size);
+
+	retval = target_read_buffer(target, erase_check_params->address,
+				param_size, params);
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	for (i = 0; i < blocks_to_check; i++) {
+		uint64_t result = target_buffer_get_u64(target, params + i * block_size);
+		if (result != 0 && result != 1)
+			break;
+
+		blocks[i].result = result;
+	}
+	if (i && timed_out)
+		LOG_INFO("Slow CPU clock: %d blocks checked, %d remain. Continuing...", i, num_blocks - i);
+
+	retval = i;		/* return number of blocks really checked */
+
+cleanup4:
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+cleanup3:
+	target_free_working_area(target, erase_check_params);
+cleanup2:
+	free(params);
+cleanup1:
+	target_free_working_area(target, erase_check_algorithm);
+
+	return retval;
+}
+
 static int armv8_setup_semihosting(struct target *target, int enable)
 {
 	return ERROR_OK;
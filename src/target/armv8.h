@@ -199,6 +199,10 @@ struct armv8_common {
 	target_addr_t debug_base;
 	struct adiv5_ap *debug_ap;
 
+	/* System bus MEM-AP (AXI-AP), if any, used for physical memory accesses */
+	struct adiv5_ap *memory_ap;
+	bool memory_ap_available;
+
 	const uint32_t *opcodes;
 
 	/* mdir */
@@ -306,6 +310,11 @@ int armv8_handle_cache_info_command(struct command_invocation *cmd,
 
 void armv8_set_cpsr(struct arm *arm, uint32_t cpsr);
 
+int armv8_checksum_memory(struct target *target,
+		target_addr_t address, uint32_t count, uint32_t *checksum);
+int armv8_blank_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks, uint8_t erased_value);
+
 static inline unsigned int armv8_curel_from_core_mode(enum arm_mode core_mode)
 {
 	switch (core_mode) {
@@ -19,6 +19,7 @@
 #endif
 
 #include "mips64.h"
+#include "algorithm.h"
 
 static const struct {
 	unsigned id;
@@ -456,12 +457,148 @@ int mips64_init_arch_info(struct target *target, struct mips64_common *mips64,
 	return ERROR_OK;
 }
 
+static int mips64_run_and_wait(struct target *target, target_addr_t entry_point,
+			       int timeout_ms, target_addr_t exit_point,
+			       struct mips64_common *mips64)
+{
+	uint64_t pc;
+	int retval;
+
+	/* This code relies on the target specific resume() and
+	 * poll()->debug_entry() sequence to write register values to the
+	 * processor and the read them back */
+	retval = target_resume(target, 0, entry_point, 0, 1);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_wait_state(target, TARGET_HALTED, timeout_ms);
+	/* If the target fails to halt due to the breakpoint, force a halt */
+	if (retval != ERROR_OK || target->state != TARGET_HALTED) {
+		retval = target_halt(target);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = target_wait_state(target, TARGET_HALTED, 500);
+		if (retval != ERROR_OK)
+			return retval;
+		return ERROR_TARGET_TIMEOUT;
+	}
+
+	/* in 32 bit mode the pc holds sign extended addresses */
+	if (mips64->mips64mode32 && !(exit_point >> 32))
+		exit_point = (uint64_t)(int64_t)(int32_t)exit_point;
+
+	pc = buf_get_u64(mips64->core_cache->reg_list[MIPS64_PC].value, 0, 64);
+	if (exit_point && pc != exit_point) {
+		LOG_DEBUG("failed algorithm halted at 0x%" PRIx64, pc);
+		return ERROR_TARGET_TIMEOUT;
+	}
+
+	return ERROR_OK;
+}
+
 int mips64_run_algorithm(struct target *target, int num_mem_params,
 			 struct mem_param *mem_params, int num_reg_params,
 			 struct reg_param *reg_params, target_addr_t entry_point,
 			 target_addr_t exit_point, int timeout_ms, void *arch_info)
 {
-	/* TODO */
+	struct mips64_common *mips64 = target->arch_info;
+	uint64_t context[MIPS64_PC + 1];
+	int retval;
+
+	LOG_DEBUG("Running algorithm");
+
+	/* NOTE: mips64_run_algorithm requires that each algorithm uses a
+	 * software breakpoint at the exit point */
+
+	if (mips64->common_magic != MIPS64_COMMON_MAGIC) {
+		LOG_ERROR("current target isn't a MIPS64 target");
+		return ERROR_TARGET_INVALID;
+	}
+
+	if (target->state != TARGET_HALTED) {
+		LOG_WARNING("target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	/* save r0..r31, lo, hi and pc; they'll be restored later */
+	for (unsigned int i = 0; i <= MIPS64_PC; i++) {
+		if (!mips64->core_cache->reg_list[i].valid)
+			mips64->read_core_reg(target, i);
+		context[i] = buf_get_u64(mips64->core_cache->reg_list[i].value, 0, 64);
+	}
+
+	for (int i = 0; i < num_mem_params; i++) {
+		if (mem_params[i].direction == PARAM_IN)
+			continue;
+		retval = target_write_buffer(target, mem_params[i].address,
+				mem_params[i].size, mem_params[i].value);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (int i = 0; i < num_reg_params; i++) {
+		if (reg_params[i].direction == PARAM_IN)
+			continue;
+
+		struct reg *reg = register_get_by_name(mips64->core_cache, reg_params[i].reg_name, false);
+		if (!reg) {
+			LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		if (reg->size != reg_params[i].size) {
+			LOG_ERROR("BUG: register '%s' size doesn't match reg_params[i].size",
+				  reg_params[i].reg_name);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		mips64_set_core_reg(reg, reg_params[i].value);
+	}
+
+	retval = mips64_run_and_wait(target, entry_point, timeout_ms, exit_point, mips64);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (int i = 0; i < num_mem_params; i++) {
+		if (mem_params[i].direction != PARAM_OUT) {
+			retval = target_read_buffer(target, mem_params[i].address,
+					mem_params[i].size, mem_params[i].value);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	for (int i = 0; i < num_reg_params; i++) {
+		if (reg_params[i].direction != PARAM_OUT) {
+			struct reg *reg = register_get_by_name(mips64->core_cache, reg_params[i].reg_name, false);
+			if (!reg) {
+				LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			}
+
+			if (reg->size != reg_params[i].size) {
+				LOG_ERROR("BUG: register '%s' size doesn't match reg_params[i].size",
+					  reg_params[i].reg_name);
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			}
+
+			buf_set_u64(reg_params[i].value, 0, reg->size, buf_get_u64(reg->value, 0, reg->size));
+		}
+	}
+
+	/* restore everything we saved before */
+	for (unsigned int i = 0; i <= MIPS64_PC; i++) {
+		struct reg *reg = &mips64->core_cache->reg_list[i];
+
+		if (buf_get_u64(reg->value, 0, 64) != context[i]) {
+			LOG_DEBUG("restoring register %s with value 0x%16.16" PRIx64,
+				  reg->name, context[i]);
+			buf_set_u64(reg->value, 0, 64, context[i]);
+			reg->valid = 1;
+			reg->dirty = 1;
+		}
+	}
+
 	return ERROR_OK;
 }
 
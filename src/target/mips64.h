@@ -113,15 +113,22 @@ struct mips64_core_reg {
 	struct reg_data_type reg_data_type;
 };
 
+#define MIPS64_OP_SLL	0x00
 #define MIPS64_OP_SRL	0x02
+#define MIPS64_OP_MOVN	0x0B
 #define MIPS64_OP_BEQ	0x04
 #define MIPS64_OP_BNE	0x05
 #define MIPS64_OP_ADDI	0x08
+#define MIPS64_OP_ADDIU	0x09
+#define MIPS64_OP_SLTI	0x0A
 #define MIPS64_OP_ANDI	0x0c
 #define MIPS64_OP_DADDI	0x18
 #define MIPS64_OP_DADDIU	0x19
+#define MIPS64_OP_ADDU	0x21
 #define MIPS64_OP_AND	0x24
+#define MIPS64_OP_XOR	0x26
 #define MIPS64_OP_LUI	0x0F
+#define MIPS64_OP_LB	0x20
 #define MIPS64_OP_LW	0x23
 #define MIPS64_OP_LD	0x37
 #define MIPS64_OP_LBU	0x24
@@ -155,11 +162,17 @@ struct mips64_core_reg {
 
 #define MIPS64_NOP			0
 #define MIPS64_ADDI(tar, src, val)	MIPS64_I_INST(MIPS64_OP_ADDI, src, tar, val)
+#define MIPS64_ADDIU(tar, src, val)	MIPS64_I_INST(MIPS64_OP_ADDIU, src, tar, val)
+#define MIPS64_ADDU(dst, src, tar)	MIPS64_R_INST(0, src, tar, dst, 0, MIPS64_OP_ADDU)
 #define MIPS64_DADDI(tar, src, val)	MIPS64_I_INST(MIPS64_OP_DADDI, src, tar, val)
 #define MIPS64_DADDIU(tar, src, val)	MIPS64_I_INST(MIPS64_OP_DADDIU, src, tar, val)
 #define MIPS64_AND(reg, off, val)	MIPS64_R_INST(0, off, val, reg, 0, MIPS64_OP_AND)
 #define MIPS64_ANDI(d, s, im)		MIPS64_I_INST(MIPS64_OP_ANDI, s, d, im)
+#define MIPS64_SLL(d, w, sh)		MIPS64_R_INST(0, 0, w, d, sh, MIPS64_OP_SLL)
 #define MIPS64_SRL(d, w, sh)		MIPS64_R_INST(0, 0, w, d, sh, MIPS64_OP_SRL)
+#define MIPS64_SLTI(tar, src, val)	MIPS64_I_INST(MIPS64_OP_SLTI, src, tar, val)
+#define MIPS64_XOR(dst, src, tar)	MIPS64_R_INST(0, src, tar, dst, 0, MIPS64_OP_XOR)
+#define MIPS64_MOVN(dst, src, tar)	MIPS64_R_INST(0, src, tar, dst, 0, MIPS64_OP_MOVN)
 #define MIPS64_B(off)			MIPS64_BEQ(0, 0, off)
 #define MIPS64_BEQ(src, tar, off)	MIPS64_I_INST(MIPS64_OP_BEQ, src, tar, off)
 #define MIPS64_BNE(src, tar, off)	MIPS64_I_INST(MIPS64_OP_BNE, src, tar, off)
@@ -177,6 +190,7 @@ struct mips64_core_reg {
 #define MIPS64_CTC1(gpr, cpr, sel)	MIPS64_R_INST(MIPS64_OP_COP1, MIPS64_COP_CT, gpr, cpr, 0, 0)
 #define MIPS64_CFC2(gpr, cpr, sel)	MIPS64_R_INST(MIPS64_OP_COP2, MIPS64_COP_CF, gpr, cpr, 0, sel)
 #define MIPS64_CTC2(gpr, cpr, sel)	MIPS64_R_INST(MIPS64_OP_COP2, MIPS64_COP_CT, gpr, cpr, 0, sel)
+#define MIPS64_LB(reg, off, base)	MIPS64_I_INST(MIPS64_OP_LB, base, reg, off)
 #define MIPS64_LBU(reg, off, base)	MIPS64_I_INST(MIPS64_OP_LBU, base, reg, off)
 #define MIPS64_LHU(reg, off, base)	MIPS64_I_INST(MIPS64_OP_LHU, base, reg, off)
 #define MIPS64_LUI(reg, val)		MIPS64_I_INST(MIPS64_OP_LUI, 0, reg, val)
@@ -17,6 +17,7 @@
 #endif
 
 #include "breakpoints.h"
+#include "algorithm.h"
 #include "mips32.h"
 #include "mips64.h"
 #include "mips_mips64.h"
@@ -1124,7 +1125,153 @@ static int mips_mips64_examine(struct target *target)
 static int mips_mips64_checksum_memory(struct target *target, uint64_t address,
 				       uint32_t size, uint32_t *checksum)
 {
-	return ERROR_FAIL; /* use bulk read method */
+	struct working_area *crc_algorithm;
+	struct reg_param reg_params[2];
+	int retval;
+
+	/* see contrib/loaders/checksum/mips64.s for src */
+	static const uint32_t mips_crc_code[] = {
+		MIPS64_DADDIU(12, 4, 0),		/* daddiu	$12, $4, 0 */
+		MIPS64_DADDIU(10, 5, 0),		/* daddiu	$10, $5, 0 */
+		MIPS64_ADDIU(4, 0, 0xFFFF),		/* addiu	$4, $0, -1 */
+		MIPS64_BEQ(0, 0, 0x10),			/* beq		$0, $0, ncomp */
+		MIPS64_DADDIU(11, 0, 0),		/* daddiu	$11, $0, 0 */
+					/* nbyte: */
+		MIPS64_LB(5, 0, 12),			/* lb		$5, ($12) */
+		MIPS64_DADDIU(12, 12, 1),		/* daddiu	$12, $12, 1 */
+		MIPS64_SLL(5, 5, 24),			/* sll		$5, $5, 24 */
+		MIPS64_LUI(2, 0x04c1),			/* lui		$2, 0x04c1 */
+		MIPS64_XOR(4, 4, 5),			/* xor		$4, $4, $5 */
+		MIPS64_ORI(2, 7, 0x1db7),		/* ori		$7, $2, 0x1db7 */
+		MIPS64_ADDU(6, 0, 0),			/* addu		$6, $0, $0 */
+					/* loop: */
+		MIPS64_SLL(8, 4, 1),			/* sll		$8, $4, 1 */
+		MIPS64_ADDIU(6, 6, 1),			/* addiu	$6, $6, 1 */
+		MIPS64_SLTI(4, 4, 0),			/* slti		$4, $4, 0 */
+		MIPS64_XOR(9, 8, 7),			/* xor		$9, $8, $7 */
+		MIPS64_MOVN(8, 9, 4),			/* movn		$8, $9, $4 */
+		MIPS64_SLTI(3, 6, 8),			/* slti		$3, $6, 8 */
+		MIPS64_BNE(3, 0, NEG16(7)),		/* bne		$3, $0, loop */
+		MIPS64_ADDU(4, 8, 0),			/* addu		$4, $8, $0 */
+					/* ncomp: */
+		MIPS64_BNE(10, 11, NEG16(16)),		/* bne		$10, $11, nbyte */
+		MIPS64_DADDIU(11, 11, 1),		/* daddiu	$11, $11, 1 */
+		MIPS64_SDBBP,				/* sdbbp */
+	};
+
+	/* make sure we have a working area */
+	if (target_alloc_working_area(target, sizeof(mips_crc_code), &crc_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* convert mips crc code into a buffer in target endianness */
+	uint8_t mips_crc_code_8[sizeof(mips_crc_code)];
+	target_buffer_set_u32_array(target, mips_crc_code_8,
+				    ARRAY_SIZE(mips_crc_code), mips_crc_code);
+
+	retval = target_write_buffer(target, crc_algorithm->address,
+				     sizeof(mips_crc_code), mips_crc_code_8);
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	init_reg_param(&reg_params[0], "r4", 64, PARAM_IN_OUT);
+	buf_set_u64(reg_params[0].value, 0, 64, address);
+
+	init_reg_param(&reg_params[1], "r5", 64, PARAM_OUT);
+	buf_set_u64(reg_params[1].value, 0, 64, size);
+
+	int timeout = 20000 * (1 + (size / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, 2, reg_params, crc_algorithm->address,
+				      crc_algorithm->address + (sizeof(mips_crc_code) - 4),
+				      timeout, NULL);
+
+	if (retval == ERROR_OK)
+		*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+cleanup:
+	target_free_working_area(target, crc_algorithm);
+
+	/* an error makes target_checksum_memory() use the bulk read method */
+	return retval;
+}
+
+/** Checks whether a memory region is erased. */
+static int mips_mips64_blank_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint8_t erased_value)
+{
+	struct working_area *erase_check_algorithm;
+	struct reg_param reg_params[3];
+	int retval;
+
+	static const uint32_t erase_check_code[] = {
+					/* nbyte: */
+		MIPS64_LB(8, 0, 4),			/* lb		$8, ($4) */
+		MIPS64_AND(6, 6, 8),			/* and		$6, $6, $8 */
+		MIPS64_DADDIU(5, 5, NEG16(1)),		/* daddiu	$5, $5, -1 */
+		MIPS64_BNE(5, 0, NEG16(4)),		/* bne		$5, $0, nbyte */
+		MIPS64_DADDIU(4, 4, 1),			/* daddiu	$4, $4, 1 */
+		MIPS64_SDBBP,				/* sdbbp */
+	};
+
+	/* the code ands all bytes, so it can only check for all ones */
+	if (erased_value != 0xff) {
+		LOG_ERROR("Erase value 0x%02" PRIx8 " not yet supported for MIPS64",
+			  erased_value);
+		return ERROR_FAIL;
+	}
+
+	if (!blocks[0].size)
+		return ERROR_FAIL;
+
+	/* make sure we have a working area */
+	if (target_alloc_working_area(target, sizeof(erase_check_code), &erase_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* convert erase check code into a buffer in target endianness */
+	uint8_t erase_check_code_8[sizeof(erase_check_code)];
+	target_buffer_set_u32_array(target, erase_check_code_8,
+				    ARRAY_SIZE(erase_check_code), erase_check_code);
+
+	retval = target_write_buffer(target, erase_check_algorithm->address,
+				     sizeof(erase_check_code), erase_check_code_8);
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	init_reg_param(&reg_params[0], "r4", 64, PARAM_OUT);
+	buf_set_u64(reg_params[0].value, 0, 64, blocks[0].address);
+
+	init_reg_param(&reg_params[1], "r5", 64, PARAM_OUT);
+	buf_set_u64(reg_params[1].value, 0, 64, blocks[0].size);
+
+	/* the and of all bytes, sign extended like the lb results */
+	init_reg_param(&reg_params[2], "r6", 64, PARAM_IN_OUT);
+	buf_set_u64(reg_params[2].value, 0, 64, UINT64_MAX);
+
+	/* assume CPU clk at least 1 MHz */
+	int timeout = 2000 + blocks[0].size * 5 / 1000;
+
+	retval = target_run_algorithm(target, 0, NULL, 3, reg_params, erase_check_algorithm->address,
+				      erase_check_algorithm->address + (sizeof(erase_check_code) - 4),
+				      timeout, NULL);
+
+	if (retval == ERROR_OK)
+		blocks[0].result = buf_get_u32(reg_params[2].value, 0, 8) == erased_value;
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+
+cleanup:
+	target_free_working_area(target, erase_check_algorithm);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	return 1;       /* only one block has been checked */
 }
 
 COMMAND_HANDLER(handle_mips64mode32)
@@ -1176,7 +1323,7 @@ struct target_type mips_mips64_target = {
 	.read_memory = mips_mips64_read_memory,
 	.write_memory = mips_mips64_write_memory,
 	.checksum_memory = mips_mips64_checksum_memory,
-	.blank_check_memory = NULL,
+	.blank_check_memory = mips_mips64_blank_check_memory,
 
 	.run_algorithm = mips64_run_algorithm,
 
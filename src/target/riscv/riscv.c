@@ -1740,6 +1740,101 @@ static int riscv_write_memory(struct target *target, target_addr_t address,
 	return tt->write_memory(target, address, size, count, buffer);
 }
 
+/* Access memory with a single method instead of the configured fallback list,
+ * for the memory_path commands to compare and select methods per range. */
+static int riscv_access_memory_method(struct target *target,
+		enum riscv_mem_access_method method, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *rbuffer, const uint8_t *wbuffer)
+{
+	RISCV_INFO(r);
+	int saved_methods[RISCV_NUM_MEM_ACCESS_METHODS];
+	int retval;
+
+	memcpy(saved_methods, r->mem_access_methods, sizeof(saved_methods));
+	r->mem_access_methods[0] = method;
+	for (unsigned int i = 1; i < RISCV_NUM_MEM_ACCESS_METHODS; i++)
+		r->mem_access_methods[i] = RISCV_MEM_ACCESS_UNSPECIFIED;
+
+	if (rbuffer)
+		retval = riscv_read_memory(target, address, size, count, rbuffer);
+	else
+		retval = riscv_write_memory(target, address, size, count, wbuffer);
+
+	memcpy(r->mem_access_methods, saved_methods, sizeof(saved_methods));
+	return retval;
+}
+
+static int riscv_read_memory_progbuf(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	return riscv_access_memory_method(target, RISCV_MEM_ACCESS_PROGBUF,
+			address, size, count, buffer, NULL);
+}
+
+static int riscv_write_memory_progbuf(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, const uint8_t *buffer)
+{
+	return riscv_access_memory_method(target, RISCV_MEM_ACCESS_PROGBUF,
+			address, size, count, NULL, buffer);
+}
+
+static int riscv_read_memory_sysbus(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	return riscv_access_memory_method(target, RISCV_MEM_ACCESS_SYSBUS,
+			address, size, count, buffer, NULL);
+}
+
+static int riscv_write_memory_sysbus(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, const uint8_t *buffer)
+{
+	return riscv_access_memory_method(target, RISCV_MEM_ACCESS_SYSBUS,
+			address, size, count, NULL, buffer);
+}
+
+static int riscv_read_memory_abstract(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	return riscv_access_memory_method(target, RISCV_MEM_ACCESS_ABSTRACT,
+			address, size, count, buffer, NULL);
+}
+
+static int riscv_write_memory_abstract(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, const uint8_t *buffer)
+{
+	return riscv_access_memory_method(target, RISCV_MEM_ACCESS_ABSTRACT,
+			address, size, count, NULL, buffer);
+}
+
+/* only 0.13 targets implement the individual access methods */
+static bool riscv_memory_path_available(struct target *target)
+{
+	RISCV_INFO(r);
+	return r->dtm_version == 1;
+}
+
+static const struct target_memory_path riscv_memory_paths[] = {
+	{
+		.name = "progbuf",
+		.available = riscv_memory_path_available,
+		.read_memory = riscv_read_memory_progbuf,
+		.write_memory = riscv_write_memory_progbuf,
+	},
+	{
+		.name = "sysbus",
+		.available = riscv_memory_path_available,
+		.read_memory = riscv_read_memory_sysbus,
+		.write_memory = riscv_write_memory_sysbus,
+	},
+	{
+		.name = "abstract",
+		.available = riscv_memory_path_available,
+		.read_memory = riscv_read_memory_abstract,
+		.write_memory = riscv_write_memory_abstract,
+	},
+	{ .name = NULL }
+};
+
 const char *riscv_get_gdb_arch(struct target *target)
 {
 	switch (riscv_xlen(target)) {
@@ -2070,6 +2165,137 @@ static int riscv_checksum_memory(struct target *target,
 	return retval;
 }
 
+/* Checks as many blocks as the working area allows with a single run. */
+static int riscv_blank_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint8_t erased_value)
+{
+	struct working_area *erase_check_algorithm;
+	struct working_area *erase_check_params;
+	struct reg_param reg_params[6];
+	int retval;
+
+	static const uint8_t riscv32_erase_check_code[] = {
+#include "../../../contrib/loaders/erase_check/riscv32_erase_check.inc"
+	};
+	static const uint8_t riscv64_erase_check_code[] = {
+#include "../../../contrib/loaders/erase_check/riscv64_erase_check.inc"
+	};
+
+	const uint8_t *code;
+	unsigned code_size;
+	unsigned xlen = riscv_xlen(target);
+	if (xlen == 32) {
+		code = riscv32_erase_check_code;
+		code_size = sizeof(riscv32_erase_check_code);
+	} else {
+		code = riscv64_erase_check_code;
+		code_size = sizeof(riscv64_erase_check_code);
+	}
+
+	/* struct { xlen size_in_result_out, xlen addr } */
+	const unsigned block_size = 2 * xlen / 8;
+
+	retval = target_alloc_working_area(target, code_size, &erase_check_algorithm);
+	if (retval != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = target_write_buffer(target, erase_check_algorithm->address,
+			code_size, code);
+	if (retval != ERROR_OK)
+		goto cleanup1;
+
+	uint32_t avail = target_get_working_area_avail(target);
+	int blocks_to_check = avail / block_size - 1;
+	if (num_blocks < blocks_to_check)
+		blocks_to_check = num_blocks;
+	if (blocks_to_check < 1) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup1;
+	}
+
+	uint32_t param_size = (blocks_to_check + 1) * block_size;
+	uint8_t *params = calloc(1, param_size);
+	if (!params) {
+		retval = ERROR_FAIL;
+		goto cleanup1;
+	}
+
+	int i;
+	uint64_t total_size = 0;
+	for (i = 0; i < blocks_to_check; i++) {
+		total_size += blocks[i].size;
+		buf_set_u64(params + i * block_size, 0, xlen, blocks[i].size);
+		buf_set_u64(params + i * block_size + xlen / 8, 0, xlen, blocks[i].address);
+	}
+
+	retval = target_alloc_working_area(target, param_size, &erase_check_params);
+	if (retval != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = target_write_buffer(target, erase_check_params->address,
+			param_size, params);
+	if (retval != ERROR_OK)
+		goto cleanup3;
+
+	LOG_DEBUG("Starting erase check of %d blocks, parameters@"
+			TARGET_ADDR_FMT, blocks_to_check, erase_check_params->address);
+
+	/* riscv_run_algorithm() only restores the registers passed in,
+	 * so list the scratch registers too */
+	init_reg_param(&reg_params[0], "a0", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[1], "a1", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[2], "a2", xlen, PARAM_IN);
+	init_reg_param(&reg_params[3], "a3", xlen, PARAM_IN);
+	init_reg_param(&reg_params[4], "a4", xlen, PARAM_IN);
+	init_reg_param(&reg_params[5], "a5", xlen, PARAM_IN);
+	buf_set_u64(reg_params[0].value, 0, xlen, erase_check_params->address);
+	buf_set_u64(reg_params[1].value, 0, xlen, erased_value * 0x0101010101010101ull);
+
+	/* assume CPU clk at least 1 MHz */
+	int timeout = 2000 + total_size * 3 / 1000;
+
+	retval = target_run_algorithm(target, 0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			erase_check_algorithm->address,
+			erase_check_algorithm->address + code_size - 4,
+			timeout, NULL);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("error executing RISC-V erase check algorithm");
+		goto cleanup4;
+	}
+
+	retval = target_read_buffer(target, erase_check_params->address,
+			param_size, params);
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	for (i = 0; i < blocks_to_check; i++) {
+		uint64_t result = buf_get_u64(params + i * block_size, 0, xlen);
+		if (result != 0 && result != 1)
+			break;
+
+		blocks[i].result = result;
+	}
+
+	retval = i;		/* return number of blocks really checked */
+
+cleanup4:
+	for (unsigned j = 0; j < ARRAY_SIZE(reg_params); j++)
+		destroy_reg_param(&reg_params[j]);
+
+cleanup3:
+	target_free_working_area(target, erase_check_params);
+cleanup2:
+	free(params);
+cleanup1:
+	target_free_working_area(target, erase_check_algorithm);
+
+	return retval;
+}
+
 /*** OpenOCD Helper Functions ***/
 
 enum riscv_poll_hart {
@@ -3171,6 +3397,7 @@ struct target_type riscv_target = {
 	.write_phys_memory = riscv_write_phys_memory,
 
 	.checksum_memory = riscv_checksum_memory,
+	.blank_check_memory = riscv_blank_check_memory,
 
 	.mmu = riscv_mmu,
 	.virt2phys = riscv_virt2phys,
@@ -3193,7 +3420,9 @@ struct target_type riscv_target = {
 	.commands = riscv_command_handlers,
 
 	.address_bits = riscv_xlen_nonconst,
-	.data_bits = riscv_data_bits
+	.data_bits = riscv_data_bits,
+
+	.memory_paths = riscv_memory_paths,
 };
 
 /*** RISC-V Interface ***/
@@ -42,6 +42,7 @@
 #endif
 
 #include <helper/align.h>
+#include <helper/bits.h>
 #include <helper/time_support.h>
 #include <jtag/jtag.h>
 #include <flash/nor/core.h>
@@ -65,6 +66,22 @@ static int target_read_buffer_default(struct target *target, target_addr_t addre
 		uint32_t count, uint8_t *buffer);
 static int target_write_buffer_default(struct target *target, target_addr_t address,
 		uint32_t count, const uint8_t *buffer);
+static int target_read_buffer_split(struct target *target, target_addr_t address,
+		uint32_t count, uint8_t *buffer,
+		int (*read_memory)(struct target *target, target_addr_t address,
+			uint32_t size, uint32_t count, uint8_t *buffer));
+static int target_write_buffer_split(struct target *target, target_addr_t address,
+		uint32_t count, const uint8_t *buffer,
+		int (*write_memory)(struct target *target, target_addr_t address,
+			uint32_t size, uint32_t count, const uint8_t *buffer));
+static void target_free_memory_path_ranges(struct target *target);
+static int target_restore_working_areas(struct target *target);
+static void target_working_area_access(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer, bool write);
+static void target_working_area_phys_access(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer, bool write);
+static bool target_working_area_saved_in(struct target *target, target_addr_t address,
+		uint32_t size);
 static int target_array2mem(Jim_Interp *interp, struct target *target,
 		int argc, Jim_Obj * const *argv);
 static int target_mem2array(Jim_Interp *interp, struct target *target,
@@ -658,6 +675,10 @@ int target_resume(struct target *target, int current, target_addr_t address,
 	 * Disable polling during resume() to guarantee the execution of handlers
 	 * in the correct order.
 	 */
+	/* Code about to run must see the original working area content */
+	if (!debug_execution)
+		target_restore_working_areas(target);
+
 	bool save_poll = jtag_poll_get_enabled();
 	jtag_poll_set_enabled(false);
 	retval = target->type->resume(target, current, address, handle_breakpoints, debug_execution);
@@ -961,6 +982,184 @@ done:
 	return retval;
 }
 
+/* Give up when an asynchronous algorithm makes no progress for this long */
+#define ASYNC_ALGORITHM_TIMEOUT_MS	5000
+/* Longest single wait for an asynchronous algorithm */
+#define ASYNC_ALGORITHM_MAX_WAIT_MS	100
+
+/* Host side pacing of an asynchronous algorithm.
+ *
+ * The throughput of the algorithm is measured while it has work in the fifo,
+ * and the duration of a pointer poll gives the adapter latency. From both,
+ * the host derives how large each transfer can be without letting the
+ * algorithm run dry, so that slow algorithms are fed with few large transfers
+ * instead of many small ones, and sleeps about as long as the algorithm needs
+ * to make that much room instead of polling at a fixed rate. */
+struct async_algorithm_pacer {
+	struct async_algorithm_stats *stats;
+	uint32_t fifo_size;
+	uint32_t block_size;
+	int64_t start_us;
+	int64_t busy_us;		/* since when the algorithm has been busy, or -1 */
+	uint64_t busy_done;		/* bytes handled by the algorithm at that time */
+	uint64_t done;			/* bytes handled by the algorithm at the last poll */
+	bool moved;				/* the algorithm made progress since the previous poll */
+	int64_t progress_ms;	/* time of the last progress of the algorithm */
+	uint64_t transfer_rate;	/* measured host transfer rate in bytes/s, 0 if unknown */
+};
+
+static int64_t async_algorithm_time_us(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void async_algorithm_pacer_init(struct async_algorithm_pacer *pacer,
+		struct target *target, bool write, uint32_t fifo_size, uint32_t block_size)
+{
+	pacer->stats = &target->async_algorithm_stats;
+	memset(pacer->stats, 0, sizeof(*pacer->stats));
+	pacer->stats->write = write;
+	pacer->stats->min_transfer = block_size;
+	pacer->fifo_size = fifo_size;
+	pacer->block_size = block_size;
+	pacer->start_us = async_algorithm_time_us();
+	pacer->busy_us = -1;
+	pacer->busy_done = 0;
+	pacer->done = 0;
+	pacer->moved = false;
+	pacer->progress_ms = timeval_ms();
+	pacer->transfer_rate = 0;
+}
+
+/* Account for a poll of the fifo pointer which started at poll_us and found
+ * that the algorithm has handled done bytes so far. busy tells whether the
+ * algorithm has work (write) or room (read) left in the fifo, stalled whether
+ * it is waiting for the host. */
+static void async_algorithm_pacer_poll(struct async_algorithm_pacer *pacer,
+		int64_t poll_us, uint64_t done, bool busy, bool stalled)
+{
+	struct async_algorithm_stats *stats = pacer->stats;
+	int64_t now = async_algorithm_time_us();
+	uint32_t latency = now - poll_us;
+
+	stats->polls++;
+	stats->poll_latency_us = stats->polls == 1 ? latency
+		: (stats->poll_latency_us * 3 + latency) / 4;
+	if (stalled)
+		stats->target_stalls++;
+
+	pacer->moved = done != pacer->done;
+	if (pacer->moved) {
+		pacer->done = done;
+		pacer->progress_ms = timeval_ms();
+	}
+
+	if (!busy) {
+		pacer->busy_us = -1;
+		return;
+	}
+
+	if (pacer->busy_us < 0) {
+		pacer->busy_us = now;
+		pacer->busy_done = done;
+	} else if (now - pacer->busy_us >= 1000 && done > pacer->busy_done) {
+		stats->algorithm_rate = (done - pacer->busy_done) * 1000000 / (now - pacer->busy_us);
+	}
+}
+
+/* Account for a transfer of bytes through the fifo which started at start_us,
+ * including the update of the fifo pointer */
+static void async_algorithm_pacer_transfer(struct async_algorithm_pacer *pacer,
+		int64_t start_us, uint32_t bytes)
+{
+	int64_t duration = async_algorithm_time_us() - start_us;
+	uint64_t rate = bytes * 1000000ULL / MAX(duration, 1);
+
+	pacer->stats->transfers++;
+	pacer->transfer_rate = pacer->transfer_rate ? (pacer->transfer_rate * 3 + rate) / 4 : rate;
+}
+
+/* Smallest transfer worth doing when remaining bytes are left to transfer.
+ *
+ * The fifo only has to keep enough work for the algorithm to cover a few
+ * adapter round trips plus the transfer itself, so the host waits until
+ * everything else can be moved in one transfer. An unknown rate means the
+ * algorithm is faster than the host can measure, and any amount is
+ * transferred at once.
+ *
+ * Nothing is held back while the algorithm hasn't moved since the previous
+ * poll: it may be waiting for more data than the fifo has for it, e.g. a
+ * whole flash write buffer, and would never move again. */
+static uint32_t async_algorithm_pacer_min_transfer(struct async_algorithm_pacer *pacer,
+		uint32_t remaining)
+{
+	struct async_algorithm_stats *stats = pacer->stats;
+	uint64_t usable = pacer->fifo_size - pacer->block_size;
+	uint64_t reserve = stats->algorithm_rate * stats->poll_latency_us * 4 / 1000000;
+	uint64_t bytes = 0;
+
+	if (!pacer->moved)
+		return MIN(pacer->block_size, remaining);
+
+	if (stats->algorithm_rate && reserve < usable) {
+		bytes = usable - reserve;
+		/* The algorithm keeps going while a transfer of bytes is under way,
+		 * which takes bytes / transfer_rate */
+		if (pacer->transfer_rate)
+			bytes = bytes * pacer->transfer_rate / (pacer->transfer_rate + stats->algorithm_rate);
+		bytes &= ~(uint64_t)(pacer->block_size - 1);
+	}
+	bytes = MAX(bytes, pacer->block_size);
+	stats->min_transfer = bytes;
+
+	return MIN(bytes, remaining);
+}
+
+/* Wait for the algorithm to make room for (write) or produce (read) the
+ * missing bytes of a transfer */
+static int async_algorithm_pacer_wait(struct async_algorithm_pacer *pacer, uint32_t missing)
+{
+	struct async_algorithm_stats *stats = pacer->stats;
+
+	if (timeval_ms() - pacer->progress_ms > ASYNC_ALGORITHM_TIMEOUT_MS) {
+		LOG_ERROR("timeout waiting for algorithm, a target reset is recommended");
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	stats->host_stalls++;
+
+	/* Without a measured rate, throttle polling a bit. The exact delay
+	 * shouldn't matter as long as it's less than buffer size / flash speed. */
+	uint64_t wait_ms = 1;
+	if (stats->algorithm_rate)
+		wait_ms = MIN(missing * 1000ULL / stats->algorithm_rate, ASYNC_ALGORITHM_MAX_WAIT_MS);
+
+	int64_t start = async_algorithm_time_us();
+	if (wait_ms)
+		alive_sleep(wait_ms);
+	else
+		keep_alive();
+	stats->host_stall_us += async_algorithm_time_us() - start;
+
+	return ERROR_OK;
+}
+
+static void async_algorithm_pacer_done(struct async_algorithm_pacer *pacer, uint64_t bytes)
+{
+	struct async_algorithm_stats *stats = pacer->stats;
+
+	stats->bytes = bytes;
+	stats->duration_us = async_algorithm_time_us() - pacer->start_us;
+
+	LOG_DEBUG("%s %" PRIu64 " bytes in %" PRId64 " us, %" PRIu32 " transfers, "
+			"%" PRIu32 " polls, %" PRIu32 " target stalls, %" PRIu32 " host stalls",
+			stats->write ? "wrote" : "read", stats->bytes, stats->duration_us,
+			stats->transfers, stats->polls, stats->target_stalls, stats->host_stalls);
+}
+
 /**
  * Streams data to a circular buffer on target intended for consumption by code
  * running asynchronously on target.
@@ -988,6 +1187,9 @@ done:
  *
  * See contrib/loaders/flash/stm32f1x.S for an example.
  *
+ * The transfers are paced by struct async_algorithm_pacer, and the
+ * statistics of the run are kept in target::async_algorithm_stats.
+ *
  * @param target used to run the algorithm
  * @param buffer address on the host where data to be sent is located
  * @param count number of blocks to send
@@ -1012,7 +1214,7 @@ int target_run_flash_async_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point, void *arch_info)
 {
 	int retval;
-	int timeout = 0;
+	struct async_algorithm_pacer pacer;
 
 	const uint8_t *buffer_orig = buffer;
 
@@ -1022,6 +1224,7 @@ int target_run_flash_async_algorithm(struct target *target,
 	uint32_t rp_addr = buffer_start + 4;
 	uint32_t fifo_start_addr = buffer_start + 8;
 	uint32_t fifo_end_addr = buffer_start + buffer_size;
+	uint32_t fifo_size = fifo_end_addr - fifo_start_addr;
 
 	uint32_t wp = fifo_start_addr;
 	uint32_t rp = fifo_start_addr;
@@ -1048,7 +1251,10 @@ int target_run_flash_async_algorithm(struct target *target,
 		return retval;
 	}
 
+	async_algorithm_pacer_init(&pacer, target, true, fifo_size, block_size);
+
 	while (count > 0) {
+		int64_t poll_us = async_algorithm_time_us();
 
 		retval = target_read_u32(target, rp_addr, &rp);
 		if (retval != ERROR_OK) {
@@ -1070,46 +1276,45 @@ int target_run_flash_async_algorithm(struct target *target,
 			break;
 		}
 
-		/* Count the number of bytes available in the fifo without
-		 * crossing the wrap around. Make sure to not fill it completely,
-		 * because that would make wp == rp and that's the empty condition. */
-		uint32_t thisrun_bytes;
-		if (rp > wp)
-			thisrun_bytes = rp - wp - block_size;
-		else if (rp > fifo_start_addr)
-			thisrun_bytes = fifo_end_addr - wp;
-		else
-			thisrun_bytes = fifo_end_addr - wp - block_size;
-
-		if (thisrun_bytes == 0) {
-			/* Throttle polling a bit if transfer is (much) faster than flash
-			 * programming. The exact delay shouldn't matter as long as it's
-			 * less than buffer size / flash speed. This is very unlikely to
-			 * run when using high latency connections such as USB. */
-			alive_sleep(2);
-
-			/* to stop an infinite loop on some targets check and increment a timeout
-			 * this issue was observed on a stellaris using the new ICDI interface */
-			if (timeout++ >= 2500) {
-				LOG_ERROR("timeout waiting for algorithm, a target reset is recommended");
-				return ERROR_FLASH_OPERATION_FAILED;
-			}
-			continue;
-		}
+		/* Bytes the algorithm has yet to consume */
+		uint32_t pending = wp >= rp ? wp - rp : fifo_size - (rp - wp);
+		bool started = buffer != buffer_orig;
+		async_algorithm_pacer_poll(&pacer, poll_us, (buffer - buffer_orig) - pending,
+				pending > 0, started && pending == 0);
 
-		/* reset our timeout */
-		timeout = 0;
+		/* Count the number of bytes available in the fifo, across the wrap
+		 * around. Make sure to not fill it completely, because that would
+		 * make wp == rp and that's the empty condition. */
+		uint32_t thisrun_bytes = fifo_size - pending - block_size;
 
 		/* Limit to the amount of data we actually want to write */
 		if (thisrun_bytes > count * block_size)
 			thisrun_bytes = count * block_size;
 
 		/* Force end of large blocks to be word aligned */
-		if (thisrun_bytes >= 16)
-			thisrun_bytes -= (rp + thisrun_bytes) & 0x03;
+		if (thisrun_bytes >= 16) {
+			uint32_t end = wp + thisrun_bytes;
+			if (end >= fifo_end_addr)
+				end -= fifo_size;
+			thisrun_bytes -= end & 0x03;
+		}
+
+		/* Wait until a transfer is worth its overhead */
+		uint32_t min_bytes = async_algorithm_pacer_min_transfer(&pacer, count * block_size);
+		if (thisrun_bytes < min_bytes) {
+			retval = async_algorithm_pacer_wait(&pacer, min_bytes - thisrun_bytes);
+			if (retval != ERROR_OK)
+				return retval;
+			continue;
+		}
 
-		/* Write data to fifo */
-		retval = target_write_buffer(target, wp, thisrun_bytes, buffer);
+		/* Write data to fifo, in two parts if it wraps around */
+		int64_t transfer_us = async_algorithm_time_us();
+		uint32_t first_bytes = MIN(thisrun_bytes, fifo_end_addr - wp);
+		retval = target_write_buffer(target, wp, first_bytes, buffer);
+		if (retval == ERROR_OK && thisrun_bytes > first_bytes)
+			retval = target_write_buffer(target, fifo_start_addr,
+					thisrun_bytes - first_bytes, buffer + first_bytes);
 		if (retval != ERROR_OK)
 			break;
 
@@ -1118,17 +1323,20 @@ int target_run_flash_async_algorithm(struct target *target,
 		count -= thisrun_bytes / block_size;
 		wp += thisrun_bytes;
 		if (wp >= fifo_end_addr)
-			wp = fifo_start_addr;
+			wp -= fifo_size;
 
 		/* Store updated write pointer to target */
 		retval = target_write_u32(target, wp_addr, wp);
 		if (retval != ERROR_OK)
 			break;
+		async_algorithm_pacer_transfer(&pacer, transfer_us, thisrun_bytes);
 
 		/* Avoid GDB timeouts */
 		keep_alive();
 	}
 
+	async_algorithm_pacer_done(&pacer, buffer - buffer_orig);
+
 	if (retval != ERROR_OK) {
 		/* abort flash write algorithm on target */
 		target_write_u32(target, wp_addr, 0);
@@ -1165,7 +1373,7 @@ int target_run_read_async_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point, void *arch_info)
 {
 	int retval;
-	int timeout = 0;
+	struct async_algorithm_pacer pacer;
 
 	const uint8_t *buffer_orig = buffer;
 
@@ -1175,6 +1383,7 @@ int target_run_read_async_algorithm(struct target *target,
 	uint32_t rp_addr = buffer_start + 4;
 	uint32_t fifo_start_addr = buffer_start + 8;
 	uint32_t fifo_end_addr = buffer_start + buffer_size;
+	uint32_t fifo_size = fifo_end_addr - fifo_start_addr;
 
 	uint32_t wp = fifo_start_addr;
 	uint32_t rp = fifo_start_addr;
@@ -1201,7 +1410,11 @@ int target_run_read_async_algorithm(struct target *target,
 		return retval;
 	}
 
+	async_algorithm_pacer_init(&pacer, target, false, fifo_size, block_size);
+
 	while (count > 0) {
+		int64_t poll_us = async_algorithm_time_us();
+
 		retval = target_read_u32(target, wp_addr, &wp);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("failed to get write pointer");
@@ -1222,63 +1435,64 @@ int target_run_read_async_algorithm(struct target *target,
 			break;
 		}
 
-		/* Count the number of bytes available in the fifo without
-		 * crossing the wrap around. */
-		uint32_t thisrun_bytes;
-		if (wp >= rp)
-			thisrun_bytes = wp - rp;
-		else
-			thisrun_bytes = fifo_end_addr - rp;
-
-		if (thisrun_bytes == 0) {
-			/* Throttle polling a bit if transfer is (much) faster than flash
-			 * reading. The exact delay shouldn't matter as long as it's
-			 * less than buffer size / flash speed. This is very unlikely to
-			 * run when using high latency connections such as USB. */
-			alive_sleep(2);
-
-			/* to stop an infinite loop on some targets check and increment a timeout
-			 * this issue was observed on a stellaris using the new ICDI interface */
-			if (timeout++ >= 2500) {
-				LOG_ERROR("timeout waiting for algorithm, a target reset is recommended");
-				return ERROR_FLASH_OPERATION_FAILED;
-			}
-			continue;
-		}
-
-		/* Reset our timeout */
-		timeout = 0;
+		/* Count the number of bytes available in the fifo, across the
+		 * wrap around. The algorithm stalls when the fifo is full. */
+		uint32_t thisrun_bytes = wp >= rp ? wp - rp : fifo_size - (rp - wp);
+		bool full = thisrun_bytes >= fifo_size - block_size;
+		async_algorithm_pacer_poll(&pacer, poll_us, (buffer - buffer_orig) + thisrun_bytes,
+				!full, full);
 
 		/* Limit to the amount of data we actually want to read */
 		if (thisrun_bytes > count * block_size)
 			thisrun_bytes = count * block_size;
 
 		/* Force end of large blocks to be word aligned */
-		if (thisrun_bytes >= 16)
-			thisrun_bytes -= (rp + thisrun_bytes) & 0x03;
+		if (thisrun_bytes >= 16) {
+			uint32_t end = rp + thisrun_bytes;
+			if (end >= fifo_end_addr)
+				end -= fifo_size;
+			thisrun_bytes -= end & 0x03;
+		}
+
+		/* Wait until a transfer is worth its overhead */
+		uint32_t min_bytes = async_algorithm_pacer_min_transfer(&pacer, count * block_size);
+		if (thisrun_bytes < min_bytes) {
+			retval = async_algorithm_pacer_wait(&pacer, min_bytes - thisrun_bytes);
+			if (retval != ERROR_OK)
+				return retval;
+			continue;
+		}
 
-		/* Read data from fifo */
-		retval = target_read_buffer(target, rp, thisrun_bytes, buffer);
+		/* Read data from fifo, in two parts if it wraps around */
+		int64_t transfer_us = async_algorithm_time_us();
+		uint32_t first_bytes = MIN(thisrun_bytes, fifo_end_addr - rp);
+		retval = target_read_buffer(target, rp, first_bytes, buffer);
+		if (retval == ERROR_OK && thisrun_bytes > first_bytes)
+			retval = target_read_buffer(target, fifo_start_addr,
+					thisrun_bytes - first_bytes, buffer + first_bytes);
 		if (retval != ERROR_OK)
 			break;
 
-		/* Update counters and wrap write pointer */
+		/* Update counters and wrap read pointer */
 		buffer += thisrun_bytes;
 		count -= thisrun_bytes / block_size;
 		rp += thisrun_bytes;
 		if (rp >= fifo_end_addr)
-			rp = fifo_start_addr;
+			rp -= fifo_size;
 
-		/* Store updated write pointer to target */
+		/* Store updated read pointer to target */
 		retval = target_write_u32(target, rp_addr, rp);
 		if (retval != ERROR_OK)
 			break;
+		async_algorithm_pacer_transfer(&pacer, transfer_us, thisrun_bytes);
 
 		/* Avoid GDB timeouts */
 		keep_alive();
 
 	}
 
+	async_algorithm_pacer_done(&pacer, buffer - buffer_orig);
+
 	if (retval != ERROR_OK) {
 		/* abort flash write algorithm on target */
 		target_write_u32(target, rp_addr, 0);
@@ -1318,7 +1532,10 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->read_memory(target, address, size, count, buffer);
+	int retval = target->type->read_memory(target, address, size, count, buffer);
+	if (retval == ERROR_OK)
+		target_working_area_access(target, address, size * count, buffer, false);
+	return retval;
 }
 
 int target_read_phys_memory(struct target *target,
@@ -1332,7 +1549,10 @@ int target_read_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->read_phys_memory(target, address, size, count, buffer);
+	int retval = target->type->read_phys_memory(target, address, size, count, buffer);
+	if (retval == ERROR_OK)
+		target_working_area_phys_access(target, address, size * count, buffer, false);
+	return retval;
 }
 
 int target_write_memory(struct target *target,
@@ -1346,7 +1566,10 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->write_memory(target, address, size, count, buffer);
+	int retval = target->type->write_memory(target, address, size, count, buffer);
+	if (retval == ERROR_OK)
+		target_working_area_access(target, address, size * count, (uint8_t *)buffer, true);
+	return retval;
 }
 
 int target_write_phys_memory(struct target *target,
@@ -1360,7 +1583,10 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->write_phys_memory(target, address, size, count, buffer);
+	int retval = target->type->write_phys_memory(target, address, size, count, buffer);
+	if (retval == ERROR_OK)
+		target_working_area_phys_access(target, address, size * count, (uint8_t *)buffer, true);
+	return retval;
 }
 
 int target_add_breakpoint(struct target *target,
@@ -1487,6 +1713,8 @@ int target_step(struct target *target,
 
 	target_call_event_callbacks(target, TARGET_EVENT_STEP_START);
 
+	target_restore_working_areas(target);
+
 	retval = target->type->step(target, current, address, handle_breakpoints);
 	if (retval != ERROR_OK)
 		return retval;
@@ -1970,13 +2198,20 @@ static void print_wa_layout(struct target *target)
 	struct working_area *c = target->working_areas;
 
 	while (c) {
-		LOG_DEBUG("%c%c " TARGET_ADDR_FMT "-" TARGET_ADDR_FMT " (%" PRIu32 " bytes)",
-			c->backup ? 'b' : ' ', c->free ? ' ' : '*',
+		LOG_DEBUG("%c " TARGET_ADDR_FMT "-" TARGET_ADDR_FMT " (%" PRIu32 " bytes)",
+			c->free ? ' ' : '*',
 			c->address, c->address + c->size - 1, c->size);
 		c = c->next;
 	}
 }
 
+/* Index of the working area word at address, relative to the start of the
+ * working area. Areas are always a multiple of 4 bytes from the start. */
+static unsigned int target_working_area_word(struct target *target, target_addr_t address)
+{
+	return (address - target->working_area) / 4;
+}
+
 /* Reduce area to size bytes, create a new free area from the remaining bytes, if any. */
 static void target_split_working_area(struct working_area *area, uint32_t size)
 {
@@ -1993,17 +2228,11 @@ static void target_split_working_area(struct working_area *area, uint32_t size)
 		new_wa->next = area->next;
 		new_wa->size = area->size - size;
 		new_wa->address = area->address + size;
-		new_wa->backup = NULL;
 		new_wa->user = NULL;
 		new_wa->free = true;
 
 		area->next = new_wa;
 		area->size = size;
-
-		/* If backup memory was allocated to this area, it has the wrong size
-		 * now so free it and it will be reallocated if/when needed */
-		free(area->backup);
-		area->backup = NULL;
 	}
 }
 
@@ -2023,19 +2252,199 @@ static void target_merge_working_areas(struct target *target)
 			/* Remove the last */
 			struct working_area *to_be_freed = c->next;
 			c->next = c->next->next;
-			free(to_be_freed->backup);
 			free(to_be_freed);
-
-			/* If backup memory was allocated to the remaining area, it's has
-			 * the wrong size now */
-			free(c->backup);
-			c->backup = NULL;
 		} else {
 			c = c->next;
 		}
 	}
 }
 
+/* Save the original content of an area before it is handed out.
+ *
+ * The whole working area shares one backup buffer, and a word is read from
+ * the target only the first time it is allocated. Consecutive words that
+ * still need saving are read with a single access. */
+static int target_backup_working_area(struct target *target, struct working_area *area)
+{
+	struct working_area_stats *stats = &target->working_area_stats;
+
+	if (!target->backup_working_area)
+		return ERROR_OK;
+
+	if (!target->working_area_backup) {
+		unsigned int words = target->working_area_size / 4;
+
+		target->working_area_backup = malloc(words * 4);
+		target->working_area_saved = calloc(BITS_TO_LONGS(words), sizeof(unsigned long));
+		if (!target->working_area_backup || !target->working_area_saved) {
+			free(target->working_area_backup);
+			free(target->working_area_saved);
+			target->working_area_backup = NULL;
+			target->working_area_saved = NULL;
+			return ERROR_FAIL;
+		}
+	}
+
+	unsigned int i = target_working_area_word(target, area->address);
+	unsigned int end = i + area->size / 4;
+
+	while (i < end) {
+		if (test_bit(i, target->working_area_saved)) {
+			stats->backup_reused += 4;
+			i++;
+			continue;
+		}
+
+		unsigned int first = i;
+		while (i < end && !test_bit(i, target->working_area_saved))
+			i++;
+
+		int retval = target_read_memory(target, target->working_area + first * 4,
+				4, i - first, target->working_area_backup + first * 4);
+		if (retval != ERROR_OK)
+			return retval;
+
+		stats->backup_reads++;
+		stats->backup_bytes += (i - first) * 4;
+		while (first < i)
+			set_bit(first++, target->working_area_saved);
+	}
+
+	return ERROR_OK;
+}
+
+/* Write the saved content of all free areas back to the target, one access
+ * per run of saved words. Allocated areas keep their saved content until
+ * they are free again. */
+static int target_restore_working_areas(struct target *target)
+{
+	struct working_area_stats *stats = &target->working_area_stats;
+	int retval = ERROR_OK;
+
+	if (!target->working_area_saved)
+		return ERROR_OK;
+
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (!c->free)
+			continue;
+
+		unsigned int i = target_working_area_word(target, c->address);
+		unsigned int end = i + c->size / 4;
+
+		while (i < end) {
+			if (!test_bit(i, target->working_area_saved)) {
+				i++;
+				continue;
+			}
+
+			unsigned int first = i;
+			while (i < end && test_bit(i, target->working_area_saved))
+				i++;
+
+			int retval2 = target_write_memory(target, target->working_area + first * 4,
+					4, i - first, target->working_area_backup + first * 4);
+			if (retval2 != ERROR_OK) {
+				LOG_ERROR("failed to restore %u bytes of working area at address " TARGET_ADDR_FMT,
+						(i - first) * 4, target->working_area + first * 4);
+				if (retval == ERROR_OK)
+					retval = retval2;
+				continue;
+			}
+
+			stats->restore_writes++;
+			stats->restore_bytes += (i - first) * 4;
+			while (first < i)
+				clear_bit(first++, target->working_area_saved);
+		}
+	}
+
+	return retval;
+}
+
+/* Forget the saved content of the working area, e.g. after a reset */
+static void target_drop_working_area_backup(struct target *target)
+{
+	free(target->working_area_backup);
+	free(target->working_area_saved);
+	target->working_area_backup = NULL;
+	target->working_area_saved = NULL;
+}
+
+/* Keep the host view of free working area memory consistent while its
+ * original content is only saved on the host: reads of saved words return
+ * the saved content, writes to them update it. Allocated areas belong to
+ * their user and are accessed directly. */
+static void target_working_area_access(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer, bool write)
+{
+	if (!target->working_area_saved || size == 0)
+		return;
+
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (!c->free)
+			continue;
+
+		target_addr_t start = MAX(address, c->address);
+		target_addr_t end = MIN(address + size, c->address + c->size);
+
+		for (target_addr_t a = start; a < end; a++) {
+			unsigned int offset = a - target->working_area;
+
+			if (!test_bit(offset / 4, target->working_area_saved))
+				continue;
+
+			if (write)
+				target->working_area_backup[offset] = buffer[a - address];
+			else
+				buffer[a - address] = target->working_area_backup[offset];
+		}
+	}
+}
+
+/* Physical accesses see the working area at its physical address, which is
+ * only known if it was specified. */
+static void target_working_area_phys_access(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer, bool write)
+{
+	if (!target->working_area_saved || !target->working_area_phys_spec)
+		return;
+
+	if (address + size <= target->working_area_phys ||
+			address >= target->working_area_phys + target->working_area_size)
+		return;
+
+	target_working_area_access(target,
+			address - target->working_area_phys + target->working_area,
+			size, buffer, write);
+}
+
+/* Whether the target still holds algorithm data instead of the saved
+ * content somewhere in the range */
+static bool target_working_area_saved_in(struct target *target, target_addr_t address,
+		uint32_t size)
+{
+	if (!target->working_area_saved || size == 0)
+		return false;
+
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (!c->free)
+			continue;
+
+		target_addr_t start = MAX(address, c->address);
+		target_addr_t end = MIN(address + size, c->address + c->size);
+
+		if (start >= end)
+			continue;
+
+		unsigned int last = target_working_area_word(target, end - 1);
+		for (unsigned int i = target_working_area_word(target, start); i <= last; i++)
+			if (test_bit(i, target->working_area_saved))
+				return true;
+	}
+
+	return false;
+}
+
 int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
 {
 	/* Reevaluate working area address based on MMU state*/
@@ -2077,7 +2486,6 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 			new_wa->next = NULL;
 			new_wa->size = target->working_area_size & ~3UL; /* 4-byte align */
 			new_wa->address = target->working_area;
-			new_wa->backup = NULL;
 			new_wa->user = NULL;
 			new_wa->free = true;
 		}
@@ -2089,17 +2497,21 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	if (size % 4)
 		size = (size + 3) & (~3UL);
 
-	struct working_area *c = target->working_areas;
-
-	/* Find the first large enough working area */
-	while (c) {
-		if (c->free && c->size >= size)
-			break;
-		c = c->next;
+	/* Find the smallest free area that is large enough, so that large
+	 * free areas stay available for large requests */
+	struct working_area *c = NULL;
+	uint32_t used = 0;
+	for (struct working_area *i = target->working_areas; i; i = i->next) {
+		if (!i->free)
+			used += i->size;
+		else if (i->size >= size && (!c || i->size < c->size))
+			c = i;
 	}
 
-	if (!c)
+	if (!c) {
+		target->working_area_stats.alloc_failures++;
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
 
 	/* Split the working area into the requested size */
 	target_split_working_area(c, size);
@@ -2107,16 +2519,10 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	LOG_DEBUG("allocated new working area of %" PRIu32 " bytes at address " TARGET_ADDR_FMT,
 			  size, c->address);
 
-	if (target->backup_working_area) {
-		if (!c->backup) {
-			c->backup = malloc(c->size);
-			if (!c->backup)
-				return ERROR_FAIL;
-		}
-
-		int retval = target_read_memory(target, c->address, 4, c->size / 4, c->backup);
-		if (retval != ERROR_OK)
-			return retval;
+	int retval = target_backup_working_area(target, c);
+	if (retval != ERROR_OK) {
+		target_merge_working_areas(target);
+		return retval;
 	}
 
 	/* mark as used, and return the new (reused) area */
@@ -2126,6 +2532,11 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	/* user pointer */
 	c->user = area;
 
+	target->working_area_stats.allocs++;
+	used += c->size;
+	if (target->working_area_stats.peak_used < used)
+		target->working_area_stats.peak_used = used;
+
 	print_wa_layout(target);
 
 	return ERROR_OK;
@@ -2142,34 +2553,13 @@ int target_alloc_working_area(struct target *target, uint32_t size, struct worki
 
 }
 
-static int target_restore_working_area(struct target *target, struct working_area *area)
-{
-	int retval = ERROR_OK;
-
-	if (target->backup_working_area && area->backup) {
-		retval = target_write_memory(target, area->address, 4, area->size / 4, area->backup);
-		if (retval != ERROR_OK)
-			LOG_ERROR("failed to restore %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
-					area->size, area->address);
-	}
-
-	return retval;
-}
-
-/* Restore the area's backup memory, if any, and return the area to the allocation pool */
-static int target_free_working_area_restore(struct target *target, struct working_area *area, int restore)
+/* Return the area to the allocation pool. Its original content stays saved
+ * and is restored together with the rest of the working area. */
+int target_free_working_area(struct target *target, struct working_area *area)
 {
 	if (!area || area->free)
 		return ERROR_OK;
 
-	int retval = ERROR_OK;
-	if (restore) {
-		retval = target_restore_working_area(target, area);
-		/* REVISIT: Perhaps the area should be freed even if restoring fails. */
-		if (retval != ERROR_OK)
-			return retval;
-	}
-
 	area->free = true;
 
 	LOG_DEBUG("freed %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
@@ -2186,12 +2576,7 @@ static int target_free_working_area_restore(struct target *target, struct workin
 
 	print_wa_layout(target);
 
-	return retval;
-}
-
-int target_free_working_area(struct target *target, struct working_area *area)
-{
-	return target_free_working_area_restore(target, area, 1);
+	return ERROR_OK;
 }
 
 /* free resources and restore memory, if restoring memory fails,
@@ -2203,11 +2588,9 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 
 	LOG_DEBUG("freeing all working areas");
 
-	/* Loop through all areas, restoring the allocated ones and marking them as free */
+	/* Loop through all areas, marking the allocated ones as free */
 	while (c) {
 		if (!c->free) {
-			if (restore)
-				target_restore_working_area(target, c);
 			c->free = true;
 			*c->user = NULL; /* Same as above */
 			c->user = NULL;
@@ -2218,6 +2601,11 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 	/* Run a merge pass to combine all areas into one */
 	target_merge_working_areas(target);
 
+	/* Restore the whole working area with as few accesses as possible */
+	if (restore)
+		target_restore_working_areas(target);
+	target_drop_working_area_backup(target);
+
 	print_wa_layout(target);
 }
 
@@ -2228,7 +2616,6 @@ void target_free_all_working_areas(struct target *target)
 	/* Now we have none or only one working area marked as free */
 	if (target->working_areas) {
 		/* Free the last one to allow on-the-fly moving and resizing */
-		free(target->working_areas->backup);
 		free(target->working_areas);
 		target->working_areas = NULL;
 	}
@@ -2271,6 +2658,7 @@ static void target_destroy(struct target *target)
 	}
 
 	target_free_all_working_areas(target);
+	target_free_memory_path_ranges(target);
 
 	/* release the targets SMP list */
 	if (target->smp) {
@@ -2404,6 +2792,89 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 	return retval;
 }
 
+static const struct target_memory_path *target_memory_path_by_name(struct target *target,
+		const char *name)
+{
+	const struct target_memory_path *path = target->type->memory_paths;
+
+	for (; path && path->name; path++) {
+		if (strcmp(path->name, name) == 0)
+			return path;
+	}
+	return NULL;
+}
+
+static bool target_memory_path_usable(struct target *target,
+		const struct target_memory_path *path)
+{
+	return path && (!path->available || path->available(target));
+}
+
+/**
+ * Return the memory path selected for the range covering the whole
+ * [address, address + size) area, or NULL to use the target's default
+ * buffer access functions.
+ */
+static const struct target_memory_path *target_memory_path_lookup(struct target *target,
+		target_addr_t address, uint32_t size, bool read)
+{
+	for (struct target_memory_path_range *range = target->memory_path_ranges;
+			range; range = range->next) {
+		/* written so that a range ending at the top of the address
+		 * space does not overflow */
+		if (address < range->address ||
+				address - range->address >= range->size ||
+				size > range->size - (address - range->address))
+			continue;
+
+		const struct target_memory_path *path = read ? range->read_path : range->write_path;
+		if (!target_memory_path_usable(target, path))
+			return NULL;
+
+		LOG_DEBUG("using memory path '%s' for %s of " TARGET_ADDR_FMT,
+				path->name, read ? "read" : "write", address);
+		return path;
+	}
+
+	return NULL;
+}
+
+static struct target_memory_path_range *target_memory_path_range_get(struct target *target,
+		target_addr_t address, uint32_t size)
+{
+	struct target_memory_path_range *range;
+
+	for (range = target->memory_path_ranges; range; range = range->next) {
+		if (range->address == address && range->size == size)
+			return range;
+	}
+
+	range = calloc(1, sizeof(*range));
+	if (!range) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+
+	/* most recent ranges take precedence over older overlapping ones */
+	range->address = address;
+	range->size = size;
+	range->next = target->memory_path_ranges;
+	target->memory_path_ranges = range;
+	return range;
+}
+
+static void target_free_memory_path_ranges(struct target *target)
+{
+	struct target_memory_path_range *range = target->memory_path_ranges;
+
+	while (range) {
+		struct target_memory_path_range *next = range->next;
+		free(range);
+		range = next;
+	}
+	target->memory_path_ranges = NULL;
+}
+
 /* Single aligned words are guaranteed to use 16 or 32 bit access
  * mode respectively, otherwise data is handled as quickly as
  * possible
@@ -2429,11 +2900,22 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
-	return target->type->write_buffer(target, address, size, buffer);
+	const struct target_memory_path *path =
+		target_memory_path_lookup(target, address, size, false);
+	int retval;
+	if (path)
+		retval = target_write_buffer_split(target, address, size, buffer, path->write_memory);
+	else
+		retval = target->type->write_buffer(target, address, size, buffer);
+	if (retval == ERROR_OK)
+		target_working_area_access(target, address, size, (uint8_t *)buffer, true);
+	return retval;
 }
 
-static int target_write_buffer_default(struct target *target,
-	target_addr_t address, uint32_t count, const uint8_t *buffer)
+static int target_write_buffer_split(struct target *target,
+	target_addr_t address, uint32_t count, const uint8_t *buffer,
+	int (*write_memory)(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, const uint8_t *buffer))
 {
 	uint32_t size;
 	unsigned int data_bytes = target_data_bits(target) / 8;
@@ -2444,7 +2926,7 @@ static int target_write_buffer_default(struct target *target,
 			size < data_bytes && count >= size * 2 + (address & size);
 			size *= 2) {
 		if (address & size) {
-			int retval = target_write_memory(target, address, size, 1, buffer);
+			int retval = write_memory(target, address, size, 1, buffer);
 			if (retval != ERROR_OK)
 				return retval;
 			address += size;
@@ -2457,7 +2939,7 @@ static int target_write_buffer_default(struct target *target,
 	for (; size > 0; size /= 2) {
 		uint32_t aligned = count - count % size;
 		if (aligned > 0) {
-			int retval = target_write_memory(target, address, size, aligned / size, buffer);
+			int retval = write_memory(target, address, size, aligned / size, buffer);
 			if (retval != ERROR_OK)
 				return retval;
 			address += aligned;
@@ -2469,6 +2951,12 @@ static int target_write_buffer_default(struct target *target,
 	return ERROR_OK;
 }
 
+static int target_write_buffer_default(struct target *target,
+	target_addr_t address, uint32_t count, const uint8_t *buffer)
+{
+	return target_write_buffer_split(target, address, count, buffer, target_write_memory);
+}
+
 /* Single aligned words are guaranteed to use 16 or 32 bit access
  * mode respectively, otherwise data is handled as quickly as
  * possible
@@ -2494,10 +2982,22 @@ int target_read_buffer(struct target *target, target_addr_t address, uint32_t si
 		return ERROR_FAIL;
 	}
 
-	return target->type->read_buffer(target, address, size, buffer);
+	const struct target_memory_path *path =
+		target_memory_path_lookup(target, address, size, true);
+	int retval;
+	if (path)
+		retval = target_read_buffer_split(target, address, size, buffer, path->read_memory);
+	else
+		retval = target->type->read_buffer(target, address, size, buffer);
+	if (retval == ERROR_OK)
+		target_working_area_access(target, address, size, buffer, false);
+	return retval;
 }
 
-static int target_read_buffer_default(struct target *target, target_addr_t address, uint32_t count, uint8_t *buffer)
+static int target_read_buffer_split(struct target *target, target_addr_t address,
+	uint32_t count, uint8_t *buffer,
+	int (*read_memory)(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer))
 {
 	uint32_t size;
 	unsigned int data_bytes = target_data_bits(target) / 8;
@@ -2508,7 +3008,7 @@ static int target_read_buffer_default(struct target *target, target_addr_t addre
 			size < data_bytes && count >= size * 2 + (address & size);
 			size *= 2) {
 		if (address & size) {
-			int retval = target_read_memory(target, address, size, 1, buffer);
+			int retval = read_memory(target, address, size, 1, buffer);
 			if (retval != ERROR_OK)
 				return retval;
 			address += size;
@@ -2521,7 +3021,7 @@ static int target_read_buffer_default(struct target *target, target_addr_t addre
 	for (; size > 0; size /= 2) {
 		uint32_t aligned = count - count % size;
 		if (aligned > 0) {
-			int retval = target_read_memory(target, address, size, aligned / size, buffer);
+			int retval = read_memory(target, address, size, aligned / size, buffer);
 			if (retval != ERROR_OK)
 				return retval;
 			address += aligned;
@@ -2533,6 +3033,12 @@ static int target_read_buffer_default(struct target *target, target_addr_t addre
 	return ERROR_OK;
 }
 
+static int target_read_buffer_default(struct target *target, target_addr_t address,
+	uint32_t count, uint8_t *buffer)
+{
+	return target_read_buffer_split(target, address, count, buffer, target_read_memory);
+}
+
 int target_checksum_memory(struct target *target, target_addr_t address, uint32_t size, uint32_t *crc)
 {
 	uint8_t *buffer;
@@ -2548,6 +3054,14 @@ int target_checksum_memory(struct target *target, target_addr_t address, uint32_
 		return ERROR_FAIL;
 	}
 
+	/* the checksum is computed on the target, so put back what algorithms
+	 * left in free working areas first */
+	if (target_working_area_saved_in(target, address, size)) {
+		retval = target_restore_working_areas(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	retval = target->type->checksum_memory(target, address, size, &checksum);
 	if (retval != ERROR_OK) {
 		buffer = malloc(size);
@@ -6932,6 +7446,364 @@ nextw:
 	return retval;
 }
 
+static void target_memory_path_print_range(struct command_invocation *cmd,
+		struct target_memory_path_range *range)
+{
+	command_print(cmd, "memory_path set " TARGET_ADDR_FMT " 0x%" PRIx32 " %s %s",
+			range->address, range->size,
+			range->read_path ? range->read_path->name : "default",
+			range->write_path ? range->write_path->name : "default");
+}
+
+COMMAND_HANDLER(handle_memory_path_list_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	const struct target_memory_path *path = target->type->memory_paths;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	command_print(CMD, "memory paths of target %s:", target_name(target));
+	command_print(CMD, "  default");
+	for (; path && path->name; path++)
+		command_print(CMD, "  %s%s", path->name,
+				target_memory_path_usable(target, path) ? "" : " (unavailable)");
+
+	for (struct target_memory_path_range *range = target->memory_path_ranges;
+			range; range = range->next)
+		target_memory_path_print_range(CMD, range);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memory_path_set_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	const struct target_memory_path *paths[2] = { NULL, NULL };
+	target_addr_t address;
+	uint32_t size;
+
+	if (CMD_ARGC < 3 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+	if (size == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	for (unsigned int i = 0; i < 2; i++) {
+		/* the write path defaults to the read path */
+		const char *name = CMD_ARGV[CMD_ARGC > 3 + i ? 2 + i : 2];
+		if (strcmp(name, "default") == 0)
+			continue;
+		paths[i] = target_memory_path_by_name(target, name);
+		if (!paths[i]) {
+			command_print(CMD, "target %s has no memory path '%s'",
+					target_name(target), name);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	struct target_memory_path_range *range =
+		target_memory_path_range_get(target, address, size);
+	if (!range)
+		return ERROR_FAIL;
+	range->read_path = paths[0];
+	range->write_path = paths[1];
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memory_path_clear_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_free_memory_path_ranges(target);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memory_path_benchmark_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	const struct target_memory_path *path = target->type->memory_paths;
+	const struct target_memory_path *best_read = NULL, *best_write = NULL;
+	float best_read_kbps = 0, best_write_kbps = 0;
+	bool have_reference = false;
+	bool readwrite = false;
+	unsigned int access_size = 4;
+	target_addr_t address;
+	uint32_t size;
+	int retval = ERROR_OK;
+
+	if (CMD_ARGC < 2 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+	if (CMD_ARGC > 2)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], access_size);
+	if (CMD_ARGC > 3) {
+		if (strcmp(CMD_ARGV[3], "readwrite") == 0)
+			readwrite = true;
+		else if (strcmp(CMD_ARGV[3], "read") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (access_size != 1 && access_size != 2 && access_size != 4 && access_size != 8)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	if (size == 0 || size % access_size || address % access_size) {
+		command_print(CMD, "address and size must be multiples of the access size");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (!path || !path->name) {
+		command_print(CMD, "target %s has a single memory path", target_name(target));
+		return ERROR_OK;
+	}
+
+	uint8_t *reference = malloc(size);
+	uint8_t *data = malloc(size);
+	if (!reference || !data) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	for (; path->name; path++) {
+		struct duration bench;
+		float read_kbps, write_kbps = 0;
+
+		if (!target_memory_path_usable(target, path)) {
+			command_print(CMD, "%-12s unavailable", path->name);
+			continue;
+		}
+
+		duration_start(&bench);
+		retval = path->read_memory(target, address, access_size, size / access_size, data);
+		if (retval != ERROR_OK || duration_measure(&bench) != ERROR_OK) {
+			command_print(CMD, "%-12s read failed", path->name);
+			continue;
+		}
+		read_kbps = duration_kbps(&bench, size);
+
+		/* all paths must agree on the content of the range */
+		if (!have_reference) {
+			memcpy(reference, data, size);
+			have_reference = true;
+		} else if (memcmp(reference, data, size) != 0) {
+			command_print(CMD, "%-12s read data mismatch", path->name);
+			continue;
+		}
+
+		if (readwrite) {
+			/* write back the same content, then check it */
+			duration_start(&bench);
+			retval = path->write_memory(target, address, access_size, size / access_size,
+					reference);
+			if (retval != ERROR_OK || duration_measure(&bench) != ERROR_OK) {
+				command_print(CMD, "%-12s read %10.3f KiB/s, write failed",
+						path->name, read_kbps);
+				continue;
+			}
+			write_kbps = duration_kbps(&bench, size);
+
+			retval = path->read_memory(target, address, access_size, size / access_size, data);
+			if (retval != ERROR_OK || memcmp(reference, data, size) != 0) {
+				command_print(CMD, "%-12s read %10.3f KiB/s, write verify failed",
+						path->name, read_kbps);
+				continue;
+			}
+
+			command_print(CMD, "%-12s read %10.3f KiB/s, write %10.3f KiB/s",
+					path->name, read_kbps, write_kbps);
+			if (write_kbps > best_write_kbps) {
+				best_write = path;
+				best_write_kbps = write_kbps;
+			}
+		} else {
+			command_print(CMD, "%-12s read %10.3f KiB/s", path->name, read_kbps);
+		}
+
+		if (read_kbps > best_read_kbps) {
+			best_read = path;
+			best_read_kbps = read_kbps;
+		}
+	}
+	retval = ERROR_OK;
+
+	if (!best_read) {
+		command_print(CMD, "no memory path could access the range");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	struct target_memory_path_range *range =
+		target_memory_path_range_get(target, address, size);
+	if (!range) {
+		retval = ERROR_FAIL;
+		goto out;
+	}
+	range->read_path = best_read;
+	if (readwrite)
+		range->write_path = best_write;
+
+	/* a line that can be added to the configuration to keep the choice */
+	target_memory_path_print_range(CMD, range);
+
+out:
+	free(reference);
+	free(data);
+	return retval;
+}
+
+static const struct command_registration memory_path_command_handlers[] = {
+	{
+		.name = "list",
+		.handler = handle_memory_path_list_command,
+		.mode = COMMAND_EXEC,
+		.help = "list the memory access paths of the current target "
+			"and the ranges they are used for",
+		.usage = "",
+	},
+	{
+		.name = "set",
+		.handler = handle_memory_path_set_command,
+		.mode = COMMAND_EXEC,
+		.help = "use the given memory paths for buffer reads and "
+			"writes within a range",
+		.usage = "address size ('default'|read_path) [('default'|write_path)]",
+	},
+	{
+		.name = "clear",
+		.handler = handle_memory_path_clear_command,
+		.mode = COMMAND_EXEC,
+		.help = "forget all memory path ranges of the current target",
+		.usage = "",
+	},
+	{
+		.name = "benchmark",
+		.handler = handle_memory_path_benchmark_command,
+		.mode = COMMAND_EXEC,
+		.help = "measure each memory path of the current target over a "
+			"range and use the fastest one for this range",
+		.usage = "address size [access_size ['read'|'readwrite']]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+COMMAND_HANDLER(handle_working_area_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	const struct working_area_stats *stats = &target->working_area_stats;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!target->working_areas) {
+		command_print(CMD, "working area of target %s: %" PRIu32 " bytes, not in use",
+				target_name(target), target->working_area_size);
+	} else {
+		unsigned int used_areas = 0, free_areas = 0;
+		uint32_t used = 0, available = 0, largest = 0;
+
+		for (struct working_area *c = target->working_areas; c; c = c->next) {
+			if (c->free) {
+				free_areas++;
+				available += c->size;
+				largest = MAX(largest, c->size);
+			} else {
+				used_areas++;
+				used += c->size;
+			}
+		}
+
+		command_print(CMD, "working area of target %s: " TARGET_ADDR_FMT "-" TARGET_ADDR_FMT,
+				target_name(target), target->working_area,
+				target->working_area + used + available - 1);
+		command_print(CMD, "  allocated: %u areas, %" PRIu32 " bytes", used_areas, used);
+		command_print(CMD, "  free:      %u areas, %" PRIu32 " bytes, largest %" PRIu32 " bytes",
+				free_areas, available, largest);
+		command_print(CMD, "  fragmentation: %" PRIu32 "%%",
+				available ? 100 - (uint32_t)((uint64_t)largest * 100 / available) : 0);
+	}
+
+	command_print(CMD, "  allocations: %" PRIu32 ", failed %" PRIu32 ", peak use %" PRIu32 " bytes",
+			stats->allocs, stats->alloc_failures, stats->peak_used);
+
+	if (!target->backup_working_area) {
+		command_print(CMD, "  backup: disabled");
+		return ERROR_OK;
+	}
+
+	unsigned int saved = 0;
+	if (target->working_area_saved) {
+		for (unsigned int i = 0; i < target->working_area_size / 4; i++)
+			if (test_bit(i, target->working_area_saved))
+				saved++;
+	}
+
+	command_print(CMD, "  backup: %" PRIu64 " bytes saved in %" PRIu32 " reads, "
+			"%" PRIu64 " bytes reused, %u bytes pending restore",
+			stats->backup_bytes, stats->backup_reads, stats->backup_reused, saved * 4);
+	command_print(CMD, "  restore: %" PRIu64 " bytes in %" PRIu32 " writes",
+			stats->restore_bytes, stats->restore_writes);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration working_area_command_handlers[] = {
+	{
+		.name = "stats",
+		.handler = handle_working_area_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show the working area layout, fragmentation and "
+			"backup traffic of the current target",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+COMMAND_HANDLER(handle_async_algorithm_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	const struct async_algorithm_stats *stats = &target->async_algorithm_stats;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* One "name value" pair per line, so that the result is a Tcl dict */
+	command_print(CMD, "direction %s", stats->write ? "write" : "read");
+	command_print(CMD, "bytes %" PRIu64, stats->bytes);
+	command_print(CMD, "duration_us %" PRId64, stats->duration_us);
+	command_print(CMD, "bytes_per_second %" PRIu64, stats->duration_us > 0
+			? stats->bytes * 1000000 / stats->duration_us : 0);
+	command_print(CMD, "algorithm_bytes_per_second %" PRIu64, stats->algorithm_rate);
+	command_print(CMD, "transfers %" PRIu32, stats->transfers);
+	command_print(CMD, "min_transfer %" PRIu32, stats->min_transfer);
+	command_print(CMD, "polls %" PRIu32, stats->polls);
+	command_print(CMD, "poll_latency_us %" PRIu32, stats->poll_latency_us);
+	command_print(CMD, "target_stalls %" PRIu32, stats->target_stalls);
+	command_print(CMD, "host_stalls %" PRIu32, stats->host_stalls);
+	command_print(CMD, "host_stall_us %" PRId64, stats->host_stall_us);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration async_algorithm_command_handlers[] = {
+	{
+		.name = "stats",
+		.handler = handle_async_algorithm_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show the statistics of the last asynchronous flash "
+			"algorithm run on the current target",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration target_exec_command_handlers[] = {
 	{
 		.name = "fast_load_image",
@@ -7190,6 +8062,27 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "Test the target's memory access functions",
 		.usage = "size",
 	},
+	{
+		.name = "memory_path",
+		.mode = COMMAND_EXEC,
+		.help = "select memory access paths per address range",
+		.usage = "",
+		.chain = memory_path_command_handlers,
+	},
+	{
+		.name = "working_area",
+		.mode = COMMAND_EXEC,
+		.help = "working area commands",
+		.usage = "",
+		.chain = working_area_command_handlers,
+	},
+	{
+		.name = "async_algorithm",
+		.mode = COMMAND_EXEC,
+		.help = "asynchronous flash algorithm commands",
+		.usage = "",
+		.chain = async_algorithm_command_handlers,
+	},
 
 	COMMAND_REGISTRATION_DONE
 };
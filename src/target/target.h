@@ -37,6 +37,7 @@
 #include <jim.h>
 
 struct reg;
+struct target;
 struct trace;
 struct command_context;
 struct command_invocation;
@@ -101,11 +102,64 @@ struct working_area {
 	target_addr_t address;
 	uint32_t size;
 	bool free;
-	uint8_t *backup;
 	struct working_area **user;
 	struct working_area *next;
 };
 
+/* Counters reported by "working_area stats" */
+struct working_area_stats {
+	uint32_t allocs;			/* successful allocations */
+	uint32_t alloc_failures;	/* allocations that did not fit */
+	uint32_t peak_used;			/* most bytes allocated at the same time */
+	uint32_t backup_reads;		/* target reads done to save original content */
+	uint64_t backup_bytes;		/* bytes saved by these reads */
+	uint64_t backup_reused;		/* allocated bytes that were already saved */
+	uint32_t restore_writes;	/* target writes done to restore original content */
+	uint64_t restore_bytes;		/* bytes restored by these writes */
+};
+
+/* Host side view of the last run of target_run_flash_async_algorithm() or
+ * target_run_read_async_algorithm(), reported by "async_algorithm stats" */
+struct async_algorithm_stats {
+	bool write;					/* data was streamed to the target */
+	uint64_t bytes;				/* bytes transferred through the fifo */
+	int64_t duration_us;		/* from algorithm start to the last transfer */
+	uint32_t transfers;			/* fifo data transfers */
+	uint32_t polls;				/* reads of the algorithm's fifo pointer */
+	uint32_t target_stalls;		/* polls that found the algorithm waiting for the host */
+	uint32_t host_stalls;		/* polls after which the host waited for the algorithm */
+	int64_t host_stall_us;		/* time the host spent waiting */
+	uint64_t algorithm_rate;	/* measured algorithm throughput in bytes/s, 0 if unknown */
+	uint32_t poll_latency_us;	/* measured duration of a pointer poll */
+	uint32_t min_transfer;		/* final minimum transfer size in bytes */
+};
+
+/**
+ * One of several ways a target can access memory, e.g. through the CPU, a
+ * system bus MEM-AP or the RISC-V system bus access. Targets offering more
+ * than one list them in target_type::memory_paths, so that the fastest one
+ * can be picked per address range by the memory_path commands.
+ */
+struct target_memory_path {
+	const char *name;
+	/** Optional; tells whether the path is usable in the current target state. */
+	bool (*available)(struct target *target);
+	int (*read_memory)(struct target *target, target_addr_t address,
+			uint32_t size, uint32_t count, uint8_t *buffer);
+	int (*write_memory)(struct target *target, target_addr_t address,
+			uint32_t size, uint32_t count, const uint8_t *buffer);
+};
+
+/* memory paths used by target_read_buffer()/target_write_buffer() in a range,
+ * NULL meaning the target's default buffer access */
+struct target_memory_path_range {
+	target_addr_t address;
+	uint32_t size;
+	const struct target_memory_path *read_path;
+	const struct target_memory_path *write_path;
+	struct target_memory_path_range *next;
+};
+
 struct gdb_service {
 	struct target *target;
 	/*  field for smp display  */
@@ -167,6 +221,11 @@ struct target {
 	uint32_t working_area_size;			/* size in bytes */
 	uint32_t backup_working_area;		/* whether the content of the working area has to be preserved */
 	struct working_area *working_areas;/* list of allocated working areas */
+	uint8_t *working_area_backup;		/* original content of the working area, see working_area_saved */
+	unsigned long *working_area_saved;	/* bitmap of the words of working_area_backup which hold saved content */
+	struct working_area_stats working_area_stats;
+	struct async_algorithm_stats async_algorithm_stats;
+	struct target_memory_path_range *memory_path_ranges; /* memory path selection per range */
 	enum target_debug_reason debug_reason;/* reason why the target entered debug state */
 	enum target_endianness endianness;	/* target endianness */
 	/* also see: target_state_name() */
@@ -739,10 +798,12 @@ int target_alloc_working_area_try(struct target *target,
 		uint32_t size, struct working_area **area);
 /**
  * Free a working area.
- * Restore target data if area backup is configured.
+ * If area backup is configured, the original target data stays saved on the
+ * host and is restored by target_free_all_working_areas() or when the target
+ * is resumed, so the area can be reused without another backup.
  * @param target
  * @param area Pointer to the area to be freed or NULL
- * @returns ERROR_OK if successful; error code if restore failed
+ * @returns ERROR_OK
  */
 int target_free_working_area(struct target *target, struct working_area *area);
 void target_free_all_working_areas(struct target *target);
@@ -300,6 +300,10 @@ struct target_type {
 	 * will typically be 32 for 32-bit targets, and 64 for 64-bit targets. If
 	 * not implemented, it's assumed to be 32. */
 	unsigned int (*data_bits)(struct target *target);
+
+	/* Alternative memory access paths, terminated by an entry with a NULL
+	 * name. Optional, see struct target_memory_path. */
+	const struct target_memory_path *memory_paths;
 };
 
 #endif /* OPENOCD_TARGET_TARGET_TYPE_H */